@@ -0,0 +1,121 @@
+#pragma once
+
+#include "AudioBlock.h"
+#include "LevelMeter.h"
+#include "SampleFormat.h"
+#include <ctime>
+#include <vector>
+#include <functional>
+
+// Level-activated recording: audio is kept only while the session is active
+struct ActivationOptions {
+    bool enabled = false;
+    float thresholdDb = -45.0f;        // Block RMS level (dBFS) that counts as activity
+    uint32_t attackMs = 30;            // Activity must last this long to start an activation
+    uint32_t holdMs = 800;             // Keep recording this long after the activity stops
+    uint32_t releaseMs = 200;          // Then fade out over this long before stopping
+    uint32_t prerollMs = 500;          // Audio kept from before the activity started
+    bool segmentPerActivation = true;  // New file per activation; otherwise one file with a label track
+};
+
+// Voice/level activation gate for one session. Each captured block is measured with a
+// vectorized energy estimate; while the gate is closed, blocks only pass through a small
+// pre-roll ring, so an idle session costs one energy pass and one copy per block. When
+// activity has lasted the attack time, the ring (audio from before the onset) and then the
+// live blocks are handed on, until the level has stayed below the threshold for the hold
+// time and the release fade has run.
+class ActivationGate {
+public:
+    // Audio to record, in the capture format; silent blocks stay flagged as silent
+    using DataCallback = std::function<void(const AudioBlock& block)>;
+
+    // An activation started (active = true, number counts from 1) or ended
+    using ActivationCallback = std::function<void(bool active, uint32_t number)>;
+
+    // One line of text per finished activation
+    using LabelCallback = std::function<void(const char* line, size_t length)>;
+
+    ActivationGate();
+    ~ActivationGate();
+
+    bool Initialize(const SampleFormat& format, const ActivationOptions& options);
+
+    void SetDataCallback(DataCallback callback) { m_dataCallback = std::move(callback); }
+    void SetActivationCallback(ActivationCallback callback) { m_activationCallback = std::move(callback); }
+
+    // Receive one line per activation (start, end and wall-clock time, in Audacity label
+    // format); positions are in the recorded (gated) timeline. The caller writes them out.
+    void SetLabelCallback(LabelCallback callback) { m_labelCallback = std::move(callback); }
+
+    // Run a captured block through the gate. Silent blocks are never activity and
+    // aren't measured.
+    void Process(const AudioBlock& block);
+
+    // End an activation in progress, which reports its label
+    void Close();
+
+    bool IsActive() const { return m_state != State::Closed; }
+
+    // Level of the most recent block in dBFS
+    float GetLevelDb() const { return m_levelDb; }
+
+private:
+    enum class State {
+        Closed,
+        Open,
+        Hold,
+        Release
+    };
+
+    enum class SampleType {
+        Int16,
+        Int24,
+        Int32,
+        Float32,
+        Other
+    };
+
+    void PushPreroll(const AudioBlock& block);
+    void FlushPreroll();
+    void Emit(const AudioBlock& block);
+    void EmitFaded(const AudioBlock& block);
+    void BeginActivation();
+    void EndActivation();
+
+    LevelMeter m_meter;
+    SampleType m_sampleType;         // For the release fade
+    uint32_t m_sampleRate;
+    uint32_t m_blockAlign;
+    uint32_t m_channels;
+    ActivationOptions m_options;
+
+    // Durations in frames
+    uint64_t m_attackFrames;
+    uint64_t m_holdFrames;
+    uint64_t m_releaseFrames;
+
+    State m_state;
+    uint64_t m_activeFrames;         // Closed: consecutive frames above the threshold
+    uint64_t m_quietFrames;          // Hold: consecutive frames below it
+    uint64_t m_releasePosition;      // Release: frames of the fade already written
+    float m_thresholdPower;          // Threshold as mean square
+    float m_levelDb;
+
+    // Pre-roll ring of raw capture data: the pre-roll plus the attack time, since an
+    // activation is only recognized once the attack has passed
+    std::vector<uint8_t> m_ring;
+    size_t m_ringStart;
+    size_t m_ringFill;
+
+    std::vector<uint8_t> m_fadeBuffer;
+
+    DataCallback m_dataCallback;
+    ActivationCallback m_activationCallback;
+    LabelCallback m_labelCallback;
+    uint32_t m_activationCount;
+
+    // Label track
+    uint64_t m_recordedFrames;
+    uint64_t m_activationStartFrame;
+    std::tm m_activationTime;        // Local wall-clock time the activation started
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+// One captured block of whole frames in the capture format. A silent block (WASAPI's
+// AUDCLNT_BUFFERFLAGS_SILENT) carries only its length: data is null and every frame is
+// digital silence, so later stages can skip it or take a cheap path instead of
+// scanning, converting and encoding zeros. Free of Windows types so it can be built
+// and driven anywhere (see SyntheticSource).
+struct AudioBlock {
+    const uint8_t* data = nullptr;  // Null for a silent block
+    uint32_t size = 0;              // Bytes covered: frames * block align
+    uint32_t frames = 0;
+    bool silent = false;
+
+    static AudioBlock Samples(const uint8_t* data, uint32_t size, uint32_t blockAlign) {
+        AudioBlock block;
+        block.frames = blockAlign != 0 ? size / blockAlign : 0;
+        block.size = block.frames * blockAlign;
+        block.data = data;
+        return block;
+    }
+
+    static AudioBlock Silence(uint32_t frames, uint32_t blockAlign) {
+        AudioBlock block;
+        block.frames = frames;
+        block.size = frames * blockAlign;
+        block.silent = true;
+        return block;
+    }
+};
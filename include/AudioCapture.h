@@ -1,5 +1,8 @@
 #pragma once
 
+#include "AudioBlock.h"
+#include "GainStage.h"
+#include "SampleFormat.h"
 #include <windows.h>
 #include <mmdeviceapi.h>
 #include <audioclient.h>
@@ -18,6 +21,12 @@ class AudioClientActivationHandler;
 
 class AudioCapture {
 public:
+    static constexpr DWORD DEFAULT_POLL_MS = 10;
+    static constexpr DWORD MAX_POLL_MS = 500;
+
+    // Called on the capture thread for every packet; silent packets arrive as silent blocks
+    using DataCallback = std::function<void(const AudioBlock& block)>;
+
     AudioCapture();
     ~AudioCapture();
 
@@ -48,13 +57,24 @@ public:
     // Get audio format information
     WAVEFORMATEX* GetFormat() const { return m_waveFormat; }
 
+    // The same format for the stages free of Windows types (empty before Initialize)
+    SampleFormat GetSampleFormat() const;
+
     // Set callback for audio data (called when new audio data is available)
-    void SetDataCallback(std::function<void(const BYTE*, UINT32)> callback) {
+    void SetDataCallback(DataCallback callback) {
         m_dataCallback = callback;
     }
 
-    // Set volume multiplier (0.0 to 1.0)
-    void SetVolume(float volume) { m_volumeMultiplier = volume; }
+    // Set volume multiplier (0.0 to GainStage::MAX_GAIN); safe while capturing, as changes are ramped
+    void SetVolume(float volume) { m_gain.SetGain(volume); }
+
+    // Soft clip peaks pushed past full scale by a volume above 1.0 (on by default)
+    void SetSoftClip(bool enabled) { m_gain.SetSoftClip(enabled); }
+
+    // How often the capture thread drains the device (default 10 ms). Longer intervals
+    // suit idle sessions; capped at half the 1 s device buffer, and ignored while
+    // passthrough needs the render buffer kept full.
+    void SetPollInterval(DWORD ms) { m_pollIntervalMs = ms; }
 
     // Enable/disable audio passthrough to a render device
     bool EnablePassthrough(const std::wstring& deviceId);
@@ -65,7 +85,6 @@ private:
     void CaptureThread();
     bool InitializeProcessSpecificCapture(DWORD processId);
     bool InitializeSystemWideCapture();
-    void ApplyVolumeToBuffer(BYTE* data, UINT32 size);
 
     IMMDeviceEnumerator* m_deviceEnumerator;
     IMMDevice* m_device;
@@ -75,11 +94,13 @@ private:
 
     std::atomic<bool> m_isCapturing;
     std::atomic<bool> m_isPaused;
+    std::atomic<DWORD> m_pollIntervalMs;
     std::thread m_captureThread;
-    std::function<void(const BYTE*, UINT32)> m_dataCallback;
+    DataCallback m_dataCallback;
+    GainStage m_gain;
+    std::vector<BYTE> m_gainBuffer;  // Packets scaled out of the device buffer (capture thread)
 
     DWORD m_targetProcessId;
-    float m_volumeMultiplier;
     bool m_isProcessSpecific;
     bool m_isInputDevice;  // True if capturing from input device (mic), false if loopback
 
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized sample-format kernels shared by the encoders.
+// SSE2 is used when the target guarantees it (always the case on x64);
+// otherwise the scalar fallbacks produce identical results.
+namespace AudioKernels {
+
+// 16-bit PCM to float in [-1.0, 1.0)
+void Int16ToFloat(const int16_t* input, float* output, size_t count);
+
+// 32-bit integer PCM to float in [-1.0, 1.0)
+void Int32ToFloat(const int32_t* input, float* output, size_t count);
+
+// Packed little-endian 24-bit PCM to float in [-1.0, 1.0)
+void Int24ToFloat(const uint8_t* input, float* output, size_t count);
+
+// Float to 16-bit PCM, rounded to nearest and clipped at full scale
+void FloatToInt16(const float* input, int16_t* output, size_t count);
+
+// Float to packed little-endian 24-bit PCM, rounded to nearest and clipped at full scale
+void FloatToInt24(const float* input, uint8_t* output, size_t count);
+
+// Sum of squared samples, for block energy. Both paths add into four interleaved partial
+// sums, so the float result is the same with and without SSE2.
+float SumSquares(const float* input, size_t count);
+
+// Sum of squared 16-bit samples (exact)
+uint64_t SumSquaresInt16(const int16_t* input, size_t count);
+
+// Largest absolute sample value (NaN samples are ignored)
+float PeakAbs(const float* input, size_t count);
+
+// Largest absolute 16-bit sample value, saturated to 32767
+int PeakAbsInt16(const int16_t* input, size_t count);
+
+// True if every byte is zero (digital silence in any integer format). Returns at the
+// first non-zero 64-byte stretch, so real audio costs almost nothing.
+bool IsAllZero(const uint8_t* data, size_t size);
+
+// True if every float sample is +0.0 or -0.0 (scaling audio by zero gives -0.0 for
+// negative samples). Returns early like IsAllZero.
+bool IsAllZeroFloat(const float* input, size_t count);
+
+// Gain, from input to output (which may be the same buffer). Sample i is scaled by
+// gain + step * i, so a ramp costs the same as a constant gain. With softClip, samples
+// past 0.8 of full scale bend smoothly towards full scale instead of being cut off;
+// integer formats are always saturated at full scale, float is otherwise left unclipped.
+void ApplyGain(const float* input, float* output, size_t count, float gain, float step, bool softClip);
+void ApplyGainInt16(const int16_t* input, int16_t* output, size_t count, float gain, float step, bool softClip);
+void ApplyGainInt32(const int32_t* input, int32_t* output, size_t count, float gain, float step, bool softClip);
+
+// Packed little-endian 24-bit PCM; count is in samples
+void ApplyGainInt24(const uint8_t* input, uint8_t* output, size_t count, float gain, float step, bool softClip);
+
+} // namespace AudioKernels
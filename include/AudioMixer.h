@@ -1,46 +1,61 @@
 #pragma once
 
-#include <windows.h>
-#include <mmreg.h>
+#include "AudioBlock.h"
+#include "SampleFormat.h"
 #include <vector>
+#include <deque>
 #include <mutex>
 #include <map>
 
-// Simple audio mixer that combines multiple audio streams by summing samples
+// Simple audio mixer that combines multiple audio streams by summing samples. Each
+// source's queued audio is marked active or silent per block (flagged silent, or all
+// zeros as found at ingest, e.g. a muted session), and only active sources are summed:
+// a stretch with one active source is a copy, one with none is a fill with zeros.
 class AudioMixer {
 public:
     AudioMixer();
     ~AudioMixer();
 
     // Initialize with the target audio format (mixer output format)
-    bool Initialize(const WAVEFORMATEX* format);
+    bool Initialize(const SampleFormat& format);
 
     // Add audio data from a specific source (identified by sourceId)
     // The sourceFormat parameter specifies the format of the incoming data
-    // Audio will be resampled to match the mixer's target format if needed
-    void AddAudioData(DWORD sourceId, const BYTE* data, UINT32 size, const WAVEFORMATEX* sourceFormat);
+    // Audio will be resampled to match the mixer's target format if needed.
+    // Silent blocks are queued as zeros and left out of the mix.
+    void AddAudioData(uint32_t sourceId, const AudioBlock& block, const SampleFormat& sourceFormat);
 
     // Get the mixed audio buffer (call this periodically to get mixed output)
     // Returns true if there's data available, false otherwise
-    bool GetMixedAudio(std::vector<BYTE>& outBuffer);
+    bool GetMixedAudio(std::vector<uint8_t>& outBuffer);
 
     // Clear all pending audio data
     void Clear();
 
 private:
+    // A run of queued bytes that is all active or all silent
+    struct Span {
+        size_t end;              // Offset in data just past the run
+        bool active;
+    };
+
     struct AudioBuffer {
-        std::vector<BYTE> data;
-        UINT32 readPosition;
+        std::vector<uint8_t> data;
+        uint32_t readPosition = 0;
+        std::deque<Span> spans;  // Cover data in order; adjacent runs never share a state
     };
 
-    WAVEFORMATEX m_format;  // Target output format
+    SampleFormat m_format;  // Target output format
     bool m_initialized;
     std::mutex m_mutex;
-    std::map<DWORD, AudioBuffer> m_buffers;  // Per-source audio buffers
+    std::map<uint32_t, AudioBuffer> m_buffers;  // Per-source audio buffers
+
+    // Queue size bytes (data, or zeros if null) and record whether they are active
+    void Append(AudioBuffer& buffer, const uint8_t* data, size_t size, bool active);
 
     // Mix audio samples based on format
-    void MixSamples(const std::vector<const BYTE*>& sources, BYTE* dest, UINT32 frameCount);
+    void MixSamples(const std::vector<const uint8_t*>& sources, uint8_t* dest, uint32_t frameCount);
 
     // Resample audio from source format to target format using linear interpolation
-    std::vector<BYTE> ResampleAudio(const BYTE* data, UINT32 size, const WAVEFORMATEX* sourceFormat);
+    std::vector<uint8_t> ResampleAudio(const uint8_t* data, uint32_t size, const SampleFormat& sourceFormat);
 };
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "FileSink.h"
+#include "IoService.h"
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Write-behind file output. Callers copy data into aligned blocks; full blocks are
+// submitted to the shared IoService as overlapped writes and return to the pool when they
+// complete. The audio path only ever does a memcpy unless every block is still in flight.
+// Each file has at most one write in flight, so writes land in submission order.
+//
+// Blocks hold about a second of data at the expected rate, and a partial block is handed
+// off once its oldest data has waited maxLatencyMs, so a low-bitrate stream never keeps
+// minutes of audio in memory. Blocks are allocated on first use.
+//
+// In direct mode the file is opened with FILE_FLAG_NO_BUFFERING so recordings bypass the
+// system file cache. Every write is then sector aligned: the unwritten sectors of a
+// partial block are copied into a spare block and written zero-padded from there, while
+// the caller keeps appending to the original (later writes of it skip the sectors already
+// on disk). The file is trimmed on Close, and header patches rewrite a retained copy of
+// the file's first page.
+//
+// Syncs requested by the durability policy are queued behind the data they cover and run
+// on the IoService's sync thread, so the caller never waits for the device.
+class BufferedFileWriter : public FileSink, private IoCompletionHandler {
+public:
+    static constexpr size_t MIN_BUFFER_SIZE = 64 * 1024;         // Smallest block
+    static constexpr size_t MAX_BUFFER_SIZE = 2 * 1024 * 1024;   // Largest block, and the size when the rate is unknown
+    static constexpr int BUFFER_COUNT = 3;                       // Triple buffered
+
+    explicit BufferedFileWriter(const FileSinkOptions& options = FileSinkOptions());
+    ~BufferedFileWriter() override;
+
+    // Create (or truncate) the file and register it with the IoService
+    bool Open(const std::wstring& filename) override;
+
+    // Append data at the current end of the file
+    bool Write(const void* data, size_t size) override;
+
+    // Overwrite a few bytes at an absolute offset (e.g. a header field).
+    // Queued behind all data handed off so far, so it lands after that data.
+    bool WriteAt(UINT64 offset, const void* data, UINT32 size) override;
+
+    // Hand off the partially filled buffer and wait until everything is on disk.
+    // In direct mode the partial block is written padded and kept for further appends.
+    bool Flush() override;
+
+    // Hand off the partially filled buffer without waiting. In direct mode the partial
+    // block is written padded and kept, as in Flush.
+    bool FlushAsync() override;
+
+    // Flush, sync if the policy asks for it, and close the file
+    void Close() override;
+
+    bool IsOpen() const override { return m_handle != INVALID_HANDLE_VALUE; }
+
+    // Logical file size: everything accepted by Write so far
+    UINT64 GetPosition() const override { return m_position; }
+
+    // Bytes already handed off for writing. A WriteAt issued now lands after all of
+    // them, so header fields describing this much data never point past the written data.
+    UINT64 GetSubmittedPosition() const override { return m_current ? m_currentOffset : m_position; }
+
+    FileSyncStats GetSyncStats() const override;
+
+    // A background write or sync failed; further writes are rejected
+    bool HasFailed() const { return m_failed; }
+
+private:
+    struct PendingWrite {
+        BYTE* buffer = nullptr;  // Pooled block to return once written (nullptr for patches)
+        bool sync = false;       // Sync everything written before it instead of writing
+        UINT32 start = 0;        // Direct mode: leading bytes of the block already on disk
+        UINT32 size = 0;
+        UINT64 offset = 0;
+        BYTE patch[MAX_PATCH_SIZE];
+    };
+
+    void Enqueue(const PendingWrite& op);
+    void StartNextWrite();
+    void OnIoComplete(IoRequest* request, bool success) override;
+    void SyncIfDue();
+    void QueueSync();
+    bool WaitForWrites();
+    bool SubmitCurrentBuffer();
+    void QueuePartialBlock();
+    bool AcquireBuffer();
+    BYTE* TakeFreeBuffer();
+    void FreeBuffers();
+
+    HANDLE m_handle;
+    bool m_directIo;
+    size_t m_bufferSize;      // Size of every block in the pool
+    UINT32 m_maxLatencyMs;
+    UINT32 m_sectorSize;      // Direct mode: alignment for offsets and lengths
+    BYTE* m_headBlock;        // Direct mode: copy of the file's first page as last written
+    FileSyncMode m_syncMode;
+    UINT32 m_syncIntervalMs;
+    ULONGLONG m_lastSyncTime;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_doneCondition;    // Signals buffer returns and drained queue
+    std::deque<PendingWrite> m_queue;           // Waiting behind the write in flight
+    PendingWrite m_inFlight;
+    IoRequest m_request;
+    bool m_writeInProgress;
+    bool m_syncPending;       // A sync is queued or running
+    FileSyncStats m_syncStats;
+
+    std::vector<BYTE*> m_allBuffers;
+    std::vector<BYTE*> m_freeBuffers;
+    BYTE* m_current;          // Block being filled by the caller
+    size_t m_currentFill;
+    size_t m_currentWritten;  // Direct mode: bytes of m_current already handed off by a partial write
+    ULONGLONG m_currentStartTime; // When the oldest data not yet handed off was written
+    UINT64 m_currentOffset;   // File offset of m_current[0]
+    UINT64 m_position;
+    std::atomic<bool> m_failed;
+};
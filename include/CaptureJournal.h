@@ -0,0 +1,121 @@
+#pragma once
+
+#include <windows.h>
+#include <mmreg.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "FileSink.h"
+#include "OpusEncoder.h"
+
+// Append-only raw capture journal (.acj): captured PCM stored as it arrives so encoding
+// can happen later, off the live path.
+//
+// Layout (little-endian):
+//   JournalFileHeader                 target encoding settings for the transcoder
+//   { JournalChunkHeader, WAVEFORMATEX (+ extension), PCM payload } ...
+//
+// Every chunk carries its own format, position and CRC, so a journal cut short by a crash
+// is readable up to the last complete chunk. Each chunk is handed to the disk as soon as it
+// is complete.
+
+#pragma pack(push, 1)
+struct JournalFileHeader {
+    char magic[4];              // "ACJ1"
+    UINT32 headerSize;          // sizeof(JournalFileHeader)
+    UINT32 targetFormat;        // AudioFormat to transcode to
+    UINT32 bitrate;             // MP3 bitrate or FLAC compression level (0 = default)
+    UINT32 opusBitrate;
+    UINT32 opusFrameTenthsMs;
+    INT32 opusApplication;
+    INT32 opusComplexity;
+    INT32 opusSignal;
+    INT32 opusMaxBandwidth;
+    BYTE opusVbr;
+    BYTE opusDtx;
+    BYTE opusDownmixToMono;
+    BYTE reserved;
+};
+
+struct JournalChunkHeader {
+    char magic[4];              // "ACJC"
+    UINT32 formatSize;          // Bytes of format data following this header
+    UINT32 payloadSize;         // Bytes of PCM following the format
+    UINT32 crc;                 // CRC-32 of this header (crc = 0), format and payload
+    UINT64 samplePosition;      // Frame index of the first frame in the journal's stream
+    UINT64 timestamp;           // FILETIME (UTC) when the first frame was captured
+};
+#pragma pack(pop)
+
+// Outcome of reading one journal chunk
+enum class JournalChunkStatus {
+    Chunk,      // An intact chunk was read
+    End,        // Clean end of the journal
+    Torn,       // The final chunk is incomplete or damaged, as a crash leaves it
+    Corrupt     // A damaged chunk with more data after it: the rest can't be trusted
+};
+
+class CaptureJournalWriter {
+public:
+    static constexpr UINT32 CHUNK_MILLISECONDS = 1000;   // Audio per chunk: the crash-loss bound
+
+    CaptureJournalWriter();
+    ~CaptureJournalWriter();
+
+    // Create the journal and record the settings the transcoder should use
+    bool Open(const std::wstring& filename, const WAVEFORMATEX* format,
+              UINT32 targetFormat, UINT32 bitrate, const OpusEncoderConfig& opusConfig);
+
+    // Append audio data; complete chunks are handed to the file sink
+    bool WriteData(const BYTE* data, UINT32 size);
+
+    // Write the partial chunk and close the file
+    void Close();
+
+    bool IsOpen() const { return m_file && m_file->IsOpen(); }
+
+    // Choose the output mode and durability policy. Takes effect at the next Open.
+    void SetSinkOptions(const FileSinkOptions& options) { m_sinkOptions = options; }
+
+    FileSyncStats GetSyncStats() const { return m_file ? m_file->GetSyncStats() : FileSyncStats(); }
+
+private:
+    bool WriteChunk();
+
+    std::unique_ptr<FileSink> m_file;
+    FileSinkOptions m_sinkOptions;
+    std::vector<BYTE> m_chunk;        // [chunk header][format][payload being filled]
+    size_t m_payloadOffset;
+    size_t m_payloadFill;
+    size_t m_payloadCapacity;
+    UINT32 m_blockAlign;
+    UINT64 m_samplePosition;          // Frames written before the current chunk
+};
+
+class CaptureJournalReader {
+public:
+    CaptureJournalReader();
+    ~CaptureJournalReader();
+
+    bool Open(const std::wstring& filename);
+    void Close();
+
+    const JournalFileHeader& GetHeader() const { return m_header; }
+
+    // Read the next chunk. Anything other than Chunk ends the journal; damage that only
+    // affects the tail a crash could have torn is reported as Torn, any other as Corrupt.
+    JournalChunkStatus ReadChunk(JournalChunkHeader& chunk, std::vector<BYTE>& format, std::vector<BYTE>& payload);
+
+private:
+    bool Read(void* data, UINT32 size);
+
+    // Classify damage found in the chunk starting at chunkOffset
+    JournalChunkStatus Damaged(UINT64 chunkOffset, UINT64 declaredSize);
+    bool IsZeroFrom(UINT64 offset);
+
+    HANDLE m_handle;
+    UINT64 m_offset;
+    UINT64 m_fileSize;
+    UINT64 m_largestChunk;          // Largest intact chunk so far, in bytes
+    JournalFileHeader m_header;
+};
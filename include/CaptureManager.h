@@ -2,33 +2,61 @@
 
 #include "AudioCapture.h"
 #include "AudioMixer.h"
-#include "WavWriter.h"
-#include "Mp3Encoder.h"
-#include "OpusEncoder.h"
-#include "FlacEncoder.h"
+#include "RecordingOutput.h"
+#include "RecordingFanout.h"
+#include "PrerollBuffer.h"
+#include "ActivationGate.h"
+#include "LevelMeter.h"
+#include "IdleDetector.h"
 #include <memory>
+#include <vector>
+#include <deque>
 #include <map>
 #include <mutex>
 #include <thread>
 #include <atomic>
 
-enum class AudioFormat {
-    WAV,
-    MP3,
-    OPUS,
-    FLAC
+// Encoder tuning per session. Music suits anything; Voice (opt-in) trades fidelity for
+// size and CPU on speech-only sources such as meeting microphones.
+enum class EncodingProfile {
+    Music,
+    Voice
+};
+
+// One file a session records to
+struct RecordingTarget {
+    std::wstring outputPath;
+    AudioFormat format = AudioFormat::WAV;
+    UINT32 bitrate = 0;
+};
+
+// A captured block held back while a session's outputs are still being opened
+struct HeldBlock {
+    std::vector<BYTE> data;          // Empty for a silent block
+    UINT32 frames;
+    bool silent;
 };
 
 struct CaptureSession {
     DWORD processId;
     std::wstring processName;
-    std::wstring outputFile;
+    std::wstring outputFile;         // First target's file and format
     AudioFormat format;
+    EncodingProfile profile;
     std::unique_ptr<AudioCapture> capture;
-    std::unique_ptr<WavWriter> wavWriter;
-    std::unique_ptr<Mp3Encoder> mp3Encoder;
-    std::unique_ptr<OpusOggEncoder> opusEncoder;
-    std::unique_ptr<FlacEncoder> flacEncoder;
+    std::unique_ptr<RecordingFanout> outputs;
+    std::unique_ptr<PrerollBuffer> preroll;  // Most recent audio, kept for retroactive saves
+    std::unique_ptr<ActivationGate> gate;    // Level activation in front of the outputs, if enabled
+    std::unique_ptr<FileSink> labels;        // The gate's label track, without segmentPerActivation
+    std::unique_ptr<SilenceDetector> silence; // Set when skipSilence is on
+    std::unique_ptr<IdleDetector> idle;      // Suspends the session while it is silent, if enabled
+    std::vector<RecordingTarget> deferredTargets; // Opened at the first audio (IdleOptions::deferOpen)
+    std::thread openThread;                  // Opens the deferred targets off the capture thread
+    std::unique_ptr<RecordingFanout> openedOutputs; // Its result, null if the open failed
+    std::atomic<bool> openFinished{ false };
+    std::deque<HeldBlock> heldBlocks;        // Audio captured while the open runs
+    UINT64 heldFrames = 0;
+    UINT64 droppedFrames = 0;                // Captured past the hold limit, padded with silence
     bool isActive;
     UINT64 bytesWritten;
     bool skipSilence;
@@ -45,14 +73,33 @@ public:
                      const std::wstring& outputPath, AudioFormat format,
                      UINT32 bitrate = 0, bool skipSilence = false,
                      const std::wstring& passthroughDeviceId = L"",
-                     bool monitorOnly = false);
+                     bool monitorOnly = false,
+                     EncodingProfile profile = EncodingProfile::Music);
+
+    // Start capturing from a process into several files at once (e.g. a FLAC archive and an
+    // Opus review copy); the audio is captured and converted only once
+    bool StartCapture(DWORD processId, const std::wstring& processName,
+                     const std::vector<RecordingTarget>& targets,
+                     bool skipSilence = false,
+                     const std::wstring& passthroughDeviceId = L"",
+                     bool monitorOnly = false,
+                     EncodingProfile profile = EncodingProfile::Music);
 
     // Start capturing from an audio device (microphone/line-in)
     bool StartCaptureFromDevice(DWORD sessionId, const std::wstring& deviceName,
                                 const std::wstring& deviceId, bool isInputDevice,
                                 const std::wstring& outputPath, AudioFormat format,
                                 UINT32 bitrate = 0, bool skipSilence = false,
-                                bool monitorOnly = false);
+                                bool monitorOnly = false,
+                                EncodingProfile profile = EncodingProfile::Music);
+
+    // Start capturing from an audio device into several files at once
+    bool StartCaptureFromDevice(DWORD sessionId, const std::wstring& deviceName,
+                                const std::wstring& deviceId, bool isInputDevice,
+                                const std::vector<RecordingTarget>& targets,
+                                bool skipSilence = false,
+                                bool monitorOnly = false,
+                                EncodingProfile profile = EncodingProfile::Music);
 
     // Enable mixed recording (all processes will be mixed into one file)
     bool EnableMixedRecording(const std::wstring& outputPath, AudioFormat format, UINT32 bitrate = 0);
@@ -81,21 +128,128 @@ public:
     // Check if a process is being captured
     bool IsCapturing(DWORD processId) const;
 
+    // Output mode and durability policy for sessions and mixed recordings started afterwards
+    void SetSinkOptions(const FileSinkOptions& options);
+
+    // Segment rotation for sessions and mixed recordings started afterwards
+    void SetSegmentOptions(const SegmentOptions& options);
+
+    // Record MP3, Opus and FLAC as raw journals and encode them in the background afterwards
+    void SetDeferredEncoding(bool enabled);
+
+    // Convert WAV recordings (and their _partN files) to FLAC or Opus in the background
+    // as each file is finished
+    void SetWavTranscodeOptions(const WavTranscodeOptions& options);
+
+    // Extra bitrates for Opus recordings, each written to its own <name>_<N>k.opus file
+    // from the same input (empty = one file per recording)
+    void SetOpusLadder(const std::vector<UINT32>& bitrates);
+
+    // Average all channels into one in Opus recordings (and pre-rolls) of sessions started
+    // afterwards, whatever their profile
+    void SetDownmixToMono(bool enabled);
+
+    // Thresholds for skipSilence in sessions started afterwards
+    void SetSilenceOptions(const SilenceOptions& options);
+
+    // Record sessions started afterwards only while they are active (voice or level
+    // activation), instead of dropping silent packets
+    void SetActivationOptions(const ActivationOptions& options);
+
+    // Suspend sessions started afterwards while their audio is digital silence, and
+    // optionally open their files only once there is something to record
+    void SetIdleOptions(const IdleOptions& options);
+
+    // Keep the last N seconds of every session started afterwards in memory, including
+    // monitor-only sessions, so it can be saved after the fact
+    void SetPrerollOptions(const PrerollOptions& options);
+
+    // Write a session's buffered audio to an .opus file. Returns once the buffer is copied;
+    // the file is written in the background.
+    bool SavePreroll(DWORD processId, const std::wstring& outputPath);
+
+    // Queue journals left in a directory by an earlier run (e.g. after a crash)
+    void ResumeDeferredEncoding(const std::wstring& directory);
+
+    // Repair the headers of WAV files a crash left unfinalized in a directory, on a
+    // background thread. Uses the current sink options to recognize mapped output.
+    void RecoverInterruptedRecordings(const std::wstring& directory);
+
+    // Sync latency metrics for one of a session's current output files
+    FileSyncStats GetSyncStats(DWORD processId, size_t outputIndex = 0) const;
+
 private:
-    void OnAudioData(DWORD processId, const BYTE* data, UINT32 size);
+    void OnAudioData(DWORD processId, const AudioBlock& block);
+
+    // Opus settings for a profile; a bitrate of 0 picks the profile's default
+    OpusEncoderConfig MakeOpusConfig(EncodingProfile profile, UINT32 bitrate) const;
+
+    // Output settings for a new recording from the current sink, segment and background encoding options
+    RecordingOptions MakeRecordingOptions(AudioFormat format, UINT32 bitrate, EncodingProfile profile) const;
     void MixerThread();
 
+    // Open every target of a new session
+    bool OpenOutputs(CaptureSession* session, const std::vector<RecordingTarget>& targets);
+
+    // Open a set of targets with their settings; null if any of them fails
+    static std::unique_ptr<RecordingFanout> CreateOutputs(const WAVEFORMATEX* format,
+                                                          const std::vector<RecordingTarget>& targets,
+                                                          const std::vector<RecordingOptions>& options);
+
+    // Start opening a resumed session's deferred targets on its open thread
+    void StartDeferredOpen(CaptureSession* session);
+
+    // Once the open thread is done, take over its outputs and record the blocks held
+    // meanwhile. Returns false while the open is still running.
+    bool FinishDeferredOpen(CaptureSession* session, bool wait);
+
+    // Hold a block until the deferred outputs are open
+    void HoldBlock(CaptureSession* session, const AudioBlock& block);
+
+    // Run a block through skip-silence or the activation gate into the outputs
+    void RecordBlock(CaptureSession* session, const AudioBlock& block);
+
+    // Start the session's pre-roll buffer if one is configured
+    void StartPreroll(CaptureSession* session);
+
+    // Put an activation gate in front of the session's outputs if activation is enabled
+    void StartActivation(CaptureSession* session);
+
+    // Create the session's silence detector if it skips silence
+    void StartSilenceDetection(CaptureSession* session);
+
+    // Create the session's idle detector if idle suspension is enabled; with deferOpen
+    // the targets are kept to be opened at the first audio
+    void StartIdleDetection(CaptureSession* session, const std::vector<RecordingTarget>& targets);
+
+    // Run a block through the idle detector; false if the session is suspended and the
+    // block should go no further
+    bool UpdateIdleState(CaptureSession* session, const AudioBlock& block);
+
+    // With padGaps, record a suspended session's skipped block as silence
+    void PadIdleGap(CaptureSession* session, UINT32 frames);
+
+    // Without padGaps, log the gap a resumed session skipped
+    void MarkIdleGap(CaptureSession* session);
+
     std::map<DWORD, std::unique_ptr<CaptureSession>> m_sessions;
     std::mutex m_mutex;
+    FileSinkOptions m_sinkOptions;
+    SegmentOptions m_segmentOptions;
+    bool m_deferEncoding;
+    bool m_downmixToMono;
+    WavTranscodeOptions m_wavTranscode;
+    std::vector<UINT32> m_opusLadder;
+    PrerollOptions m_prerollOptions;
+    ActivationOptions m_activationOptions;
+    IdleOptions m_idleOptions;
+    SilenceOptions m_silenceOptions;
+    std::thread m_recoveryThread;
 
     // Mixed recording members
     bool m_mixedRecordingEnabled;
     std::unique_ptr<AudioMixer> m_mixer;
-    std::unique_ptr<WavWriter> m_mixedWavWriter;
-    std::unique_ptr<Mp3Encoder> m_mixedMp3Encoder;
-    std::unique_ptr<OpusOggEncoder> m_mixedOpusEncoder;
-    std::unique_ptr<FlacEncoder> m_mixedFlacEncoder;
-    AudioFormat m_mixedFormat;
+    std::unique_ptr<RecordingOutput> m_mixedOutput;
     std::unique_ptr<std::thread> m_mixerThread;
     std::atomic<bool> m_mixerThreadRunning;
     std::mutex m_mixerMutex;
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <memory>
+
+// How a file sink moves data to disk
+enum class FileSinkMode {
+    Buffered,   // Write-behind through large aligned blocks (BufferedFileWriter)
+    Direct,     // As Buffered, but unbuffered I/O that bypasses the system file cache
+    Mapped      // Preallocated extents written through a sliding mapped view (MappedFileWriter)
+};
+
+// When a sink forces its data through the device cache to stable storage
+enum class FileSyncMode {
+    None,       // Leave write-back to the system; a power failure can lose unflushed data
+    Periodic,   // Sync in the background every syncIntervalMs, and when the file is closed
+    OnSegment   // Sync once, when each file (segment) is closed
+};
+
+struct FileSinkOptions {
+    FileSinkMode mode = FileSinkMode::Buffered;
+    UINT64 extentBytes = 256ULL * 1024 * 1024;   // Mapped: file space reserved per growth step
+    UINT64 windowBytes = 16ULL * 1024 * 1024;    // Mapped: size of the mapped view
+    FileSyncMode syncMode = FileSyncMode::None;
+    UINT32 syncIntervalMs = 2000;                // Periodic: time between syncs
+    UINT32 bytesPerSecond = 0;                   // Buffered/Direct: expected data rate, sizes the blocks (0 = unknown)
+    UINT32 maxLatencyMs = 1000;                  // Buffered/Direct: hand off data once it has waited this long (0 = when a block fills)
+};
+
+// Sync latency metrics for one file
+struct FileSyncStats {
+    UINT64 syncCount = 0;
+    UINT64 failedSyncs = 0;
+    UINT64 lastSyncMicros = 0;
+    UINT64 maxSyncMicros = 0;
+    UINT64 totalSyncMicros = 0;
+
+    void Record(UINT64 micros, bool success) {
+        syncCount++;
+        if (!success) {
+            failedSyncs++;
+        }
+        lastSyncMicros = micros;
+        maxSyncMicros = (micros > maxSyncMicros) ? micros : maxSyncMicros;
+        totalSyncMicros += micros;
+    }
+};
+
+// Sequential file output with small positional patches (for headers).
+// Implementations may defer the actual disk writes to a background thread.
+class FileSink {
+public:
+    static constexpr UINT32 MAX_PATCH_SIZE = 64;  // Largest WriteAt payload
+
+    virtual ~FileSink() = default;
+
+    // Create (or truncate) the file
+    virtual bool Open(const std::wstring& filename) = 0;
+
+    // Append data at the current end of the file
+    virtual bool Write(const void* data, size_t size) = 0;
+
+    // Overwrite a few bytes at an absolute offset, ordered after all data handed off so far
+    virtual bool WriteAt(UINT64 offset, const void* data, UINT32 size) = 0;
+
+    // Push everything written so far out of the sink's own buffers
+    virtual bool Flush() = 0;
+
+    // Start pushing buffered data out without waiting for it to reach the file
+    virtual bool FlushAsync() = 0;
+
+    // Flush, trim any preallocated space and close the file
+    virtual void Close() = 0;
+
+    virtual bool IsOpen() const = 0;
+
+    // Logical file size: everything accepted by Write so far
+    virtual UINT64 GetPosition() const = 0;
+
+    // Bytes that a WriteAt issued now is guaranteed to land after
+    virtual UINT64 GetSubmittedPosition() const = 0;
+
+    // Syncs performed for the current (or last closed) file
+    virtual FileSyncStats GetSyncStats() const = 0;
+
+    // Build the sink selected by options
+    static std::unique_ptr<FileSink> Create(const FileSinkOptions& options);
+};
+
+// Synchronous positional I/O on a plain handle, for checking and repairing closed files.
+// Each succeeds only if every byte was transferred.
+bool ReadFileAt(HANDLE file, UINT64 offset, void* data, DWORD size);
+bool WriteFileAt(HANDLE file, UINT64 offset, const void* data, DWORD size);
@@ -3,9 +3,10 @@
 #include <windows.h>
 #include <mmreg.h>
 #include <string>
-#include <fstream>
+#include <memory>
 #include <vector>
 #include <FLAC/stream_encoder.h>
+#include "FileSink.h"
 
 class FlacEncoder {
 public:
@@ -18,12 +19,25 @@ public:
     // Write audio data (PCM format)
     bool WriteData(const BYTE* data, UINT32 size);
 
+    // Write frames of digital silence. Whole blocks skip conversion and are stored by
+    // libFLAC as constant subframes.
+    bool WriteSilence(UINT32 frames);
+
     // Close file and finalize
     void Close();
 
     // Check if file is open
     bool IsOpen() const { return m_encoder != nullptr; }
 
+    // Choose how encoded frames reach the disk. Takes effect at the next Open.
+    void SetSinkOptions(const FileSinkOptions& options) { m_sinkOptions = options; }
+
+    // Sync latency metrics for the current file
+    FileSyncStats GetSyncStats() const { return m_file ? m_file->GetSyncStats() : FileSyncStats(); }
+
+    // Check that a finished file's STREAMINFO records exactly this many frames
+    static bool VerifyFrameCount(const std::wstring& filename, UINT64 frames);
+
 private:
     static FLAC__StreamEncoderWriteStatus WriteCallback(
         const FLAC__StreamEncoder* encoder,
@@ -44,14 +58,19 @@ private:
         void* client_data);
 
     bool ProcessBuffer();
+    FLAC__int32 ReadSample(const BYTE* sample) const;
 
-    std::ofstream m_file;
+    std::unique_ptr<FileSink> m_file;
+    FileSinkOptions m_sinkOptions;
+    UINT64 m_writeOffset;   // Where libFLAC's next write goes (it seeks back to patch STREAMINFO)
     std::wstring m_filename;
     WAVEFORMATEX m_format;
 
     FLAC__StreamEncoder* m_encoder;
     std::vector<BYTE> m_buffer;
+    std::vector<FLAC__int32> m_zeroChannel;  // One block of silence, shared by every channel
     UINT32 m_samplesPerFrame;
     UINT32 m_compressionLevel;
     UINT64 m_totalSamples;
+    bool m_isFloat;          // 32-bit samples are IEEE float rather than integer PCM
 };
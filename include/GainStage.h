@@ -0,0 +1,77 @@
+#pragma once
+
+#include <windows.h>
+#include <mmreg.h>
+#include <atomic>
+
+// Shape of the move from one gain to the next
+enum class GainRamp {
+    Linear,         // Straight line in amplitude
+    Exponential     // Equal steps in dB, which sounds even; silence is approached from -60 dB
+};
+
+// Volume for one capture session. The target gain can be set from any thread; the capture
+// thread glides to it over a short ramp, so moving a slider mid-recording never clicks or
+// zippers. Gains above 1 boost, optionally through a soft clipper. The sample kernel is
+// picked once for the capture format, and at unity gain the stage is skipped entirely.
+class GainStage {
+public:
+    static constexpr float MAX_GAIN = 4.0f;             // +12 dB
+    static constexpr UINT32 DEFAULT_RAMP_MS = 20;
+
+    GainStage();
+
+    // Set the ramp before Initialize
+    void SetRamp(GainRamp shape, UINT32 rampMs);
+
+    // Picks the kernel for the format; false (and samples pass unchanged) for layouts it
+    // can't scale. The gain starts at the target rather than ramping to it.
+    bool Initialize(const WAVEFORMATEX* format);
+
+    // Any thread. Clamped to 0..MAX_GAIN.
+    void SetGain(float gain);
+    float GetGain() const { return m_targetGain.load(std::memory_order_relaxed); }
+
+    // Any thread. Bend boosted peaks smoothly below full scale (on by default); otherwise
+    // integer samples are hard clipped and float samples left for the encoders to clip.
+    void SetSoftClip(bool enabled) { m_softClip.store(enabled, std::memory_order_relaxed); }
+
+    // Capture thread: true while the output would equal the input
+    bool IsUnity() const;
+
+    // Capture thread: scale frames from input to output, which may be the same buffer.
+    // A null input (a silent packet) only advances the ramp.
+    void Process(const BYTE* input, BYTE* output, UINT32 frames);
+
+private:
+    // Longest stretch scaled with one linear step, so exponential ramps stay smooth
+    static constexpr UINT32 RAMP_SEGMENT_FRAMES = 64;
+    static constexpr float MIN_RAMP_GAIN = 0.001f;      // -60 dB
+
+    enum class SampleType {
+        Int16,
+        Int24,
+        Int32,
+        Float32,
+        Other
+    };
+
+    float RampGainAt(UINT32 position) const;
+    void Apply(const BYTE* input, BYTE* output, UINT32 frames, float gain, float step, bool softClip);
+
+    std::atomic<float> m_targetGain;
+    std::atomic<bool> m_softClip;
+
+    GainRamp m_rampShape;
+    UINT32 m_rampMs;
+
+    // Capture thread only
+    SampleType m_sampleType;
+    UINT32 m_channels;
+    UINT32 m_blockAlign;
+    float m_gain;                   // Gain reached so far
+    float m_rampStart;
+    float m_rampTarget;
+    UINT32 m_rampFrames;
+    UINT32 m_rampPosition;          // Frames into the current ramp
+};
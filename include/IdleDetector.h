@@ -0,0 +1,67 @@
+#pragma once
+
+#include "AudioBlock.h"
+#include "FileSink.h"
+#include <windows.h>
+#include <mmreg.h>
+#include <string>
+#include <memory>
+
+// Suspension of sessions whose process is open but silent
+struct IdleOptions {
+    bool enabled = false;
+    UINT32 suspendAfterMs = 10000;   // Digital silence this long suspends the session
+    bool padGaps = false;            // Write the gap as silence while it lasts, one skipped block at a time;
+                                     // otherwise log it to <name>.gaps.txt on resume
+    bool deferOpen = false;          // Open the output files only at the first non-silent block
+    UINT32 idlePollMs = 100;         // Capture polling interval while suspended
+};
+
+// Tracks one session's digital silence (blocks flagged silent or all zeros). Once it has
+// lasted the suspend time the session is suspended: blocks are only counted, so nothing is
+// converted, encoded or written until audio returns. The gap is then either padded into
+// the recording or logged to a marker file, in Audacity label format, at the point in the
+// recording where it was cut out.
+class IdleDetector {
+public:
+    enum class Action {
+        Write,      // Record the block
+        Suspend,    // The session just went idle; this block is the first one skipped
+        Skip,       // Suspended; drop the block
+        Resume      // Audio is back: deal with the gap, then record the block
+    };
+
+    IdleDetector();
+    ~IdleDetector();
+
+    // startSuspended: the session starts out suspended (outputs not open yet)
+    bool Initialize(const WAVEFORMATEX* format, const IdleOptions& options, bool startSuspended);
+
+    Action Process(const AudioBlock& block);
+
+    bool IsSuspended() const { return m_suspended; }
+
+    // Frames dropped while suspended; after Resume, the length of the gap just ended
+    UINT64 GetGapFrames() const { return m_gapFrames; }
+
+    // Log gaps to filename, which is created at the first gap
+    void SetMarkerFile(const std::wstring& filename, const FileSinkOptions& options);
+
+    // Log the gap just ended at positionFrames of the recorded timeline
+    void WriteMarker(UINT64 positionFrames);
+
+    void Close();
+
+private:
+    UINT32 m_sampleRate;
+    bool m_isFloat;                  // Zero test ignores the sign of float samples
+    UINT64 m_suspendFrames;
+    UINT64 m_silentFrames;           // Consecutive silent frames while recording
+    UINT64 m_gapFrames;
+    bool m_suspended;
+    SYSTEMTIME m_gapTime;            // Wall-clock time the current gap started
+
+    std::wstring m_markerFilename;
+    FileSinkOptions m_markerOptions;
+    std::unique_ptr<FileSink> m_markers;
+};
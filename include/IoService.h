@@ -0,0 +1,95 @@
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct IoRequest;
+
+// Receives completions for requests submitted to the IoService
+class IoCompletionHandler {
+public:
+    virtual ~IoCompletionHandler() = default;
+
+    // Called on a service thread once the whole request is written (or has failed)
+    virtual void OnIoComplete(IoRequest* request, bool success) = 0;
+};
+
+enum class IoRequestType {
+    Write,      // Positional write of data/size at offset
+    Sync        // FlushFileBuffers on file (after FlushViewOfFile on data/size, if set)
+};
+
+// A request handed to the IoService. The owner keeps it (and the data) alive until
+// OnIoComplete runs.
+struct IoRequest {
+    OVERLAPPED overlapped;          // First member so a completion maps back to its request
+    IoRequestType type;
+    HANDLE file;
+    const BYTE* data;
+    UINT32 size;
+    UINT64 offset;
+    UINT32 transferred;             // Progress across partial completions
+    IoCompletionHandler* handler;
+    UINT64 syncMicros;              // Sync: time spent in FlushFileBuffers
+};
+
+// Process-wide asynchronous file I/O on one I/O completion port.
+// Sinks in every session submit writes here, so callers never block in a file system call.
+// Writes are issued as overlapped I/O by one thread per volume: a write that extends a file
+// can complete synchronously inside WriteFile (NTFS does this), and that must only hold up
+// other files on the same disk. A single completion thread dispatches the results. Syncs
+// run on their own thread so a slow flush to stable storage never holds up writes.
+class IoService {
+public:
+    static IoService& Instance();
+
+    // Associate a handle opened with FILE_FLAG_OVERLAPPED with the completion port
+    // and with the issuing thread of its volume
+    bool Register(HANDLE file);
+
+    // Forget a registered handle before it is closed (handle values are reused)
+    void Unregister(HANDLE file);
+
+    // Queue a write or sync. Never blocks; callable from any thread.
+    void Submit(IoRequest* request);
+
+private:
+    IoService();
+    ~IoService();
+
+    IoService(const IoService&) = delete;
+    IoService& operator=(const IoService&) = delete;
+
+    // Writes waiting for one volume's issuing thread
+    struct Volume {
+        DWORD serialNumber = 0;
+        std::thread thread;
+        std::condition_variable condition;
+        std::deque<IoRequest*> queue;
+    };
+
+    void CompletionThread();
+    void IssueThread(Volume* volume);
+    void SyncThread();
+    void Issue(IoRequest* request);
+    void QueueWrite(IoRequest* request);
+    Volume* VolumeFor(HANDLE file);
+
+    HANDLE m_port;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    bool m_stop;
+
+    std::vector<std::unique_ptr<Volume>> m_volumes;     // Created on first use, kept until exit
+    std::unordered_map<HANDLE, Volume*> m_fileVolumes;  // Registered (or looked up) handles
+
+    std::thread m_syncThread;
+    std::condition_variable m_syncCondition;
+    std::deque<IoRequest*> m_syncQueue;
+};
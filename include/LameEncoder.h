@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <lame/lame.h>
+
+#include "SampleFormat.h"
+
+// The LAME side of MP3 encoding: sample conversion, batching, the surround downmix and
+// the Xing/LAME tag. Free of Windows types and of file I/O - encoded bytes go to an
+// Output - so it builds and is tested anywhere libmp3lame is available. Mp3Encoder
+// (LAME build) wraps it with a FileSink.
+class LameEncoder {
+public:
+    // Where the MP3 stream goes. Write appends; WriteAt overwrites bytes already
+    // written (the tag frame at offset 0, once the stream is finished).
+    class Output {
+    public:
+        virtual ~Output() = default;
+        virtual bool Write(const uint8_t* data, size_t size) = 0;
+        virtual bool WriteAt(uint64_t offset, const uint8_t* data, size_t size) = 0;
+    };
+
+    LameEncoder();
+    ~LameEncoder();
+
+    LameEncoder(const LameEncoder&) = delete;
+    LameEncoder& operator=(const LameEncoder&) = delete;
+
+    // Start a CBR stream. channelMask is the WAVE speaker mask (0 = standard order);
+    // it places the channels when more than two are folded into stereo.
+    bool Open(const SampleFormat& format, uint32_t channelMask, uint32_t bitrate, Output* output);
+
+    // Encode interleaved samples in the format given to Open
+    bool Encode(const uint8_t* data, uint32_t size);
+
+    // Flush the encoder, write the final tag frame and end the stream
+    bool Finish();
+
+    bool IsOpen() const { return m_lame != nullptr; }
+
+private:
+    enum class SampleType {
+        Int16,
+        Int24,
+        Int32,
+        Float32
+    };
+
+    bool EncodeFrames(const uint8_t* data, uint32_t frames);
+    bool WriteLameTag();
+    void SetupDownmix(uint32_t channelMask);
+
+    lame_global_flags* m_lame;
+    Output* m_output;
+    SampleFormat m_format;
+    SampleType m_sampleType;
+    int m_encodeChannels;               // LAME takes mono or stereo
+    bool m_downmix;                     // More than two input channels are folded into stereo
+    std::vector<float> m_leftGains;     // Downmix: weight of each input channel in left and right
+    std::vector<float> m_rightGains;
+    std::vector<float> m_convertBuffer; // One batch of input as interleaved float
+    std::vector<float> m_downmixBuffer; // One batch folded to stereo
+    std::vector<unsigned char> m_mp3Buffer; // Sized for the worst case of one batch
+};
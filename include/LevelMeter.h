@@ -0,0 +1,70 @@
+#pragma once
+
+#include "AudioBlock.h"
+#include "SampleFormat.h"
+#include <vector>
+
+// Peak and energy of one captured block, full scale = 1.0
+struct BlockLevel {
+    float peak = 0.0f;
+    float meanSquare = 0.0f;
+
+    float PeakDb() const;
+    float RmsDb() const;
+};
+
+// Block peak and RMS for a capture format, read according to its real sample type
+// (IEEE float, or 16/24/32-bit PCM) with the vectorized kernels
+class LevelMeter {
+public:
+    LevelMeter();
+
+    bool Initialize(const SampleFormat& format);
+
+    // False for layouts the meter can't read (e.g. padded samples)
+    bool CanMeasure() const { return m_sampleType != SampleType::Other; }
+
+    BlockLevel Measure(const uint8_t* data, uint32_t frames);
+
+private:
+    enum class SampleType {
+        Int16,
+        Int24,
+        Int32,
+        Float32,
+        Other
+    };
+
+    SampleType m_sampleType;
+    uint32_t m_channels;
+    std::vector<float> m_floatBuffer;  // Block as float, for 24- and 32-bit integer input
+};
+
+// Silence thresholds for skip-silence recording
+struct SilenceOptions {
+    float thresholdDb = -60.0f;     // Block RMS below this is quiet
+    float hysteresisDb = 6.0f;      // Quiet ends only once RMS rises this far above the threshold
+    float peakCeilingDb = -40.0f;   // A block with a peak above this is never quiet
+    uint32_t minSilenceMs = 500;    // Quiet stretches shorter than this are still recorded
+};
+
+// Decides which blocks skip-silence drops. Blocks are dropped only once the stream has
+// been quiet for the minimum duration, so pauses between words are kept, and hysteresis
+// stops a level hovering at the threshold from toggling on every block.
+class SilenceDetector {
+public:
+    SilenceDetector();
+
+    bool Initialize(const SampleFormat& format, const SilenceOptions& options);
+
+    // True if the block belongs to a silence long enough to skip. Blocks flagged
+    // silent count as quiet without being measured.
+    bool IsSilent(const AudioBlock& block);
+
+private:
+    LevelMeter m_meter;
+    SilenceOptions m_options;
+    uint64_t m_minSilenceFrames;
+    uint64_t m_quietFrames;         // Frames since the stream went quiet
+    bool m_quiet;
+};
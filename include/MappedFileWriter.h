@@ -0,0 +1,72 @@
+#pragma once
+
+#include "FileSink.h"
+#include "IoService.h"
+#include <windows.h>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+
+// File output through a sliding memory-mapped view over space reserved in large extents.
+// Reserving ahead keeps long recordings contiguous and turns per-write file growth into
+// one allocation per extent; Close trims the file back to the bytes actually written.
+// Periodic syncs flush the current view on the IoService's sync thread; sliding the window
+// waits for such a sync to finish first.
+class MappedFileWriter : public FileSink, private IoCompletionHandler {
+public:
+    explicit MappedFileWriter(const FileSinkOptions& options);
+    ~MappedFileWriter() override;
+
+    bool Open(const std::wstring& filename) override;
+    bool Write(const void* data, size_t size) override;
+    bool WriteAt(UINT64 offset, const void* data, UINT32 size) override;
+    bool Flush() override;
+
+    // Data is already in the mapped view; nothing to hand off
+    bool FlushAsync() override { return true; }
+    void Close() override;
+
+    bool IsOpen() const override { return m_handle != INVALID_HANDLE_VALUE; }
+    UINT64 GetPosition() const override { return m_position; }
+
+    // Data copied into the view is already part of the file
+    UINT64 GetSubmittedPosition() const override { return m_position; }
+
+    FileSyncStats GetSyncStats() const override;
+
+    // Extent and window sizes a writer with these options uses. The file always ends on
+    // an extent boundary until Close, and the zero-filled reserve past the data is
+    // shorter than one extent plus one window.
+    static void GetLayout(const FileSinkOptions& options, UINT64& extentBytes, UINT64& windowBytes);
+
+private:
+    void OnIoComplete(IoRequest* request, bool success) override;
+    void SyncIfDue();
+    void StartSync(const BYTE* view, UINT64 viewSize);
+    void WaitForSync();
+
+    bool GrowTo(UINT64 minimumSize);
+    bool MapWindow(UINT64 offset);
+    void UnmapWindow();
+
+    HANDLE m_handle;
+    HANDLE m_mapping;
+    BYTE* m_view;
+    UINT64 m_viewOffset;      // File offset of m_view[0]
+    UINT64 m_viewSize;
+    UINT64 m_allocated;       // Current file size including the reserved tail
+    UINT64 m_position;
+    UINT64 m_extentBytes;
+    UINT64 m_windowBytes;
+    UINT32 m_granularity;     // Mapping offsets must be multiples of this
+    bool m_failed;
+
+    FileSyncMode m_syncMode;
+    UINT32 m_syncIntervalMs;
+    ULONGLONG m_lastSyncTime;
+    mutable std::mutex m_syncMutex;
+    std::condition_variable m_syncCondition;
+    IoRequest m_syncRequest;
+    bool m_syncPending;
+    FileSyncStats m_syncStats;
+};
@@ -2,11 +2,23 @@
 
 #include <windows.h>
 #include <string>
+#include <vector>
+
+#include "FileSink.h"
+
+#ifdef AUDIOCAPTURE_MP3_LAME
+#include <mmreg.h>
+#include "LameEncoder.h"
+#else
 #include <mfapi.h>
 #include <mfidl.h>
 #include <mfreadwrite.h>
-#include <vector>
+#endif
 
+// MP3 writer. Uses Media Foundation by default; building with AUDIOCAPTURE_MP3_LAME
+// switches to a LAME backend that needs no COM and writes through a FileSink, so it
+// honours the sink mode and sync policy like the other encoders. The encoding itself
+// is LameEncoder; this class feeds it and owns the file.
 class Mp3Encoder {
 public:
     Mp3Encoder();
@@ -22,9 +34,29 @@ public:
     void Close();
 
     // Check if file is open
+#ifdef AUDIOCAPTURE_MP3_LAME
+    bool IsOpen() const { return m_encoder.IsOpen(); }
+#else
     bool IsOpen() const { return m_sinkWriter != nullptr; }
+#endif
+
+    // How the file is written (before Open). Media Foundation does its own file I/O,
+    // so only the LAME backend uses these.
+    void SetSinkOptions(const FileSinkOptions& options) { m_sinkOptions = options; }
+
+    // Syncs performed for the current (or last closed) file
+#ifdef AUDIOCAPTURE_MP3_LAME
+    FileSyncStats GetSyncStats() const { return m_file ? m_file->GetSyncStats() : FileSyncStats(); }
+#else
+    FileSyncStats GetSyncStats() const { return FileSyncStats(); }
+#endif
 
 private:
+#ifdef AUDIOCAPTURE_MP3_LAME
+    std::unique_ptr<FileSink> m_file;
+    std::unique_ptr<LameEncoder::Output> m_output;  // Hands m_encoder's stream to m_file
+    LameEncoder m_encoder;
+#else
     IMFSinkWriter* m_sinkWriter;
     DWORD m_streamIndex;
     WAVEFORMATEX m_inputFormat;
@@ -32,4 +64,6 @@ private:
     UINT64 m_rtStart;
     std::vector<BYTE> m_buffer;
     UINT32 m_samplesPerFrame;
+#endif
+    FileSinkOptions m_sinkOptions;
 };
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Minimal Ogg page builder (RFC 3533) for a single logical stream.
+// Packets are written straight into a reusable buffer that reserves room for the
+// page header in front of the body, so each finished page is one contiguous span.
+// Page boundaries follow libogg's ogg_stream_pageout/ogg_stream_flush rules, so the
+// same packet sequence produces byte-identical pages.
+class OggPageWriter {
+public:
+    OggPageWriter();
+
+    // Start a new logical stream
+    void Reset(uint32_t serialNumber);
+
+    // Reserve room for a packet of up to maxBytes and return where to write it.
+    // The pointer is valid until the next call on this object.
+    uint8_t* BeginPacket(size_t maxBytes);
+
+    // Finish the packet started by BeginPacket with its actual size
+    void CommitPacket(size_t bytes, int64_t granulePos, bool endOfStream);
+
+    // Copy a complete packet in (for headers and other pre-built packets)
+    void AddPacket(const uint8_t* data, size_t bytes, int64_t granulePos, bool endOfStream);
+
+    // Emit the next page if one is due (ogg_stream_pageout semantics).
+    // The page stays valid until the next call on this object.
+    bool PageOut(const uint8_t*& page, size_t& size);
+
+    // Emit the next page from whatever is pending (ogg_stream_flush semantics)
+    bool Flush(const uint8_t*& page, size_t& size);
+
+    // Granule position stamped on the most recent page (-1 if no packet ended on it)
+    int64_t GetLastPageGranule() const { return m_lastPageGranule; }
+
+    // Ogg CRC-32 (polynomial 0x04c11db7, no reflection, zero initial value)
+    static uint32_t Crc(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+private:
+    static constexpr size_t kMaxHeaderSize = 27 + 255;
+    static constexpr size_t kPageFillTarget = 4096;
+
+    bool EmitPage(bool force, size_t fillTarget, const uint8_t*& page, size_t& size);
+    void ReclaimReturnedBody();
+
+    std::vector<uint8_t> m_buffer;      // [header room][pending body bytes]
+    size_t m_bodyFill;                  // Pending body bytes (after the header room)
+    size_t m_bodyReturned;              // Body bytes handed out in the last page
+    std::vector<int> m_lacing;          // Segment sizes; 0x100 marks a packet's first segment
+    std::vector<int64_t> m_granules;    // Granule position in effect at each segment
+    int64_t m_granulePos;               // Granule position of the last packet added
+    int64_t m_lastPageGranule;
+    uint32_t m_serialNumber;
+    uint32_t m_pageSequence;
+    bool m_headerPageWritten;           // libogg's b_o_s
+    bool m_endOfStream;
+};
@@ -3,10 +3,30 @@
 #include <windows.h>
 #include <mmreg.h>
 #include <string>
-#include <fstream>
+#include <memory>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <opus/opus.h>
-#include <ogg/ogg.h>
+#include <opus/opus_multistream.h>
+#include "FileSink.h"
+#include "OggPageWriter.h"
+#include "Resampler.h"
+
+// Encoder settings for a recording; defaults suit archival music capture
+struct OpusEncoderConfig {
+    UINT32 bitrate = 128000;
+    float frameDurationMs = 20.0f;           // 2.5, 5, 10, 20, 40 or 60 ms
+    int application = OPUS_APPLICATION_AUDIO; // AUDIO, VOIP or RESTRICTED_LOWDELAY
+    UINT32 maxPageLatencyMs = 0;             // Force a page out after this much audio (0 = pages fill normally)
+    int complexity = 10;                      // 0-10, higher is slower and better
+    bool vbr = true;
+    int signal = OPUS_AUTO;                  // OPUS_SIGNAL_VOICE / OPUS_SIGNAL_MUSIC hint
+    bool dtx = false;                        // Discontinuous transmission during silence
+    int maxBandwidth = OPUS_BANDWIDTH_FULLBAND;
+    bool downmixToMono = false;              // Average all input channels into one
+};
 
 class OpusOggEncoder {
 public:
@@ -16,37 +36,142 @@ public:
     // Open Opus file for writing (OGG container)
     bool Open(const std::wstring& filename, const WAVEFORMATEX* format, UINT32 bitrate = 128000);
 
+    // Open with explicit frame duration, application and page latency settings
+    bool Open(const std::wstring& filename, const WAVEFORMATEX* format, const OpusEncoderConfig& config);
+
+    // Open a bitrate ladder: one independent Ogg Opus file per config, all fed from the same
+    // converted and resampled input and encoded in parallel. The rungs may differ in bitrate,
+    // VBR, complexity, signal, bandwidth and DTX; frame duration, application and downmix
+    // must match across rungs, and page latency is taken from the first config.
+    bool OpenLadder(const std::vector<std::wstring>& filenames, const WAVEFORMATEX* format,
+                    const std::vector<OpusEncoderConfig>& configs);
+
+    // Encode into a caller-supplied sink (e.g. an in-memory ring) instead of a new file.
+    // Each Ogg page reaches the sink as a single Write.
+    bool Open(std::unique_ptr<FileSink> sink, const WAVEFORMATEX* format, const OpusEncoderConfig& config);
+
     // Write audio data (PCM format)
     bool WriteData(const BYTE* data, UINT32 size);
 
-    // Close file and finalize
+    // Write frames of digital silence without converting any input. With DTX on, the
+    // encoder then sends its short silence packets.
+    bool WriteSilence(UINT32 frames);
+
+    // Close file(s) and finalize
     void Close();
 
     // Check if file is open
-    bool IsOpen() const { return m_file.is_open(); }
+    bool IsOpen() const { return !m_rungs.empty() && m_rungs[0].file && m_rungs[0].file->IsOpen(); }
+
+    // Choose how pages reach the disk. Takes effect at the next Open.
+    void SetSinkOptions(const FileSinkOptions& options) { m_sinkOptions = options; }
+
+    // Outputs of the current recording: 1, or the number of ladder rungs
+    size_t GetRungCount() const { return m_rungs.size(); }
+    const std::wstring& GetFileName(size_t rung) const { return m_rungs[rung].filename; }
+
+    // Sync latency metrics for the current file (or one ladder rung's)
+    FileSyncStats GetSyncStats(size_t rung = 0) const {
+        return rung < m_rungs.size() && m_rungs[rung].file ? m_rungs[rung].file->GetSyncStats() : FileSyncStats();
+    }
+
+    // Check that a finished file's last granule position covers exactly this many frames
+    // of audio at the given source rate
+    static bool VerifyFrameCount(const std::wstring& filename, UINT32 sampleRate, UINT64 frames);
 
 private:
+    enum class SampleType {
+        Int16,
+        Int24,
+        Int32,
+        Float32
+    };
+
+    // One Ogg Opus output: its own encoder, page writer and file. Packets are encoded
+    // straight into the page writer's buffer.
+    struct Rung {
+        std::wstring filename;
+        OpusEncoderConfig config;
+        std::unique_ptr<FileSink> file;
+        ::OpusEncoder* opusEncoder = nullptr;    // Mono/stereo
+        OpusMSEncoder* msEncoder = nullptr;      // Surround
+        OggPageWriter pages;
+        int64_t lastPageGranule = 0;             // Granule position of the last page written
+    };
+
     bool InitializeOggStream();
-    bool WriteOggHeaders();
-    bool WriteOggPage(bool flush = false);
-    bool EncodeBuffer();
+    bool CreateEncoder(Rung& rung);
+    bool WriteOggHeaders(Rung& rung);
+    bool WriteOggPage(Rung& rung, bool flush = false);
+    bool EncodeFrames(size_t frames, int64_t endGranule = -1);
+    bool EncodeRung(Rung& rung, size_t frames, int64_t endGranule);
+    bool EncodeFrame(Rung& rung, size_t pcmOffset, int64_t previousGranule, int64_t endGranule);
+    bool ConvertInput(const BYTE* data, UINT32 frames);
+    void AppendSilence(UINT32 frames);
+    bool EncodePending();
+    size_t PendingSamples() const;
+    void PadPendingFrame();
+    void CompactPendingBuffer();
     void WriteInt32LE(std::vector<unsigned char>& data, int32_t value);
+    void DestroyEncoders();
 
-    std::ofstream m_file;
-    std::wstring m_filename;
+    // Ladder worker pool: every rung encodes the same batch of frames on its own thread
+    void StartWorkers();
+    void StopWorkers();
+    void WorkerThread();
+    bool RunBatch(size_t frames, int64_t endGranule);
+    void EncodeClaimedRungs();
+
+    // Forward a control request to whichever encoder (single or multistream) the rung uses
+    template <typename... Args>
+    static int EncoderCtl(Rung& rung, Args... args) {
+        return rung.msEncoder ? opus_multistream_encoder_ctl(rung.msEncoder, args...)
+                              : opus_encoder_ctl(rung.opusEncoder, args...);
+    }
+
+    std::vector<Rung> m_rungs;
+    FileSinkOptions m_sinkOptions;
+    std::unique_ptr<FileSink> m_externalSink;  // Sink for the next Open, if supplied by the caller
     WAVEFORMATEX m_format;
+    SampleType m_sampleType;
+    size_t m_maxPacketBytes;
 
-    // Opus encoder and OGG stream
-    ::OpusEncoder* m_opusEncoder;
-    ogg_stream_state m_oggStream;
-    ogg_page m_oggPage;
-    ogg_packet m_oggPacket;
+    // Encoder layout
+    int m_encoderRate;               // Rate the encoder runs at (input rate if Opus supports it, else 48 kHz)
+    int m_encodeChannels;
+    int m_mappingFamily;             // 0 = mono/stereo, 1 = Vorbis surround order, 255 = discrete
+    int m_streamCount;
+    int m_coupledCount;
+    unsigned char m_streamMapping[255];
+    std::vector<int> m_channelOrder; // Source channel feeding each encoder channel
+    bool m_downmix;                  // Encoder channel is the average of all source channels
 
-    std::vector<BYTE> m_buffer;
+    // Input conversion and resampling. Buffers are sized in Open and reused for every frame.
+    StreamingResampler m_resampler;
+    bool m_resample;
+    bool m_nativeInt16;              // 16-bit input fed to opus_encode without float conversion
+    bool m_identityOrder;            // Encoder channels map 1:1 onto source channels
+    std::vector<float> m_convertBuffer;  // Input converted to float at the source rate
+    std::vector<float> m_pcmBuffer;      // Pending float samples at the encoder rate
+    std::vector<opus_int16> m_pcm16Buffer; // Pending samples on the native 16-bit path
+    size_t m_pcmReadPos;             // Samples of the pending buffer already encoded
+
+    OpusEncoderConfig m_config;      // Settings shared by every rung (the first rung's)
     UINT32 m_samplesPerFrame;
-    UINT32 m_bitrate;
+    UINT32 m_preSkip;                // In 48 kHz samples
     UINT64 m_totalSamples;
-    int m_serialno;
-    int64_t m_granulePos;
-    int64_t m_packetCount;
+    UINT64 m_inputFrames;            // Frames received at the source rate
+    int64_t m_granulePos;            // In 48 kHz samples, as required by Ogg Opus
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_batchMutex;
+    std::condition_variable m_batchCondition;
+    std::condition_variable m_batchDoneCondition;
+    UINT64 m_batchNumber;            // Bumped for every batch handed to the workers
+    size_t m_batchFrames;
+    int64_t m_batchEndGranule;
+    size_t m_nextRung;               // Next rung of the current batch to claim
+    size_t m_rungsRemaining;
+    bool m_batchFailed;
+    bool m_stopWorkers;
 };
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "OpusEncoder.h"
+#include "FileSink.h"
+#include <windows.h>
+#include <mmreg.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Retroactive recording: every session keeps its most recent audio in memory
+struct PrerollOptions {
+    UINT32 seconds = 0;          // Length of the buffer (0 = off)
+    UINT32 bitrate = 32000;      // Opus bitrate the buffer is held at; constant, so memory use is fixed
+};
+
+// Always-on memory ring of a session's most recent audio, compressed as Ogg Opus pages
+// (30 minutes at 32 kbps is about 8 MB). Pages are stored in a fixed set of chunks
+// allocated up front, so memory use depends only on the length and bitrate. Save copies
+// the ring and queues it for one background thread that writes each copy out as a
+// standalone .opus file.
+class PrerollBuffer {
+public:
+    PrerollBuffer();
+    ~PrerollBuffer();
+
+    // Start buffering audio in format. The config's bitrate and profile settings are used;
+    // VBR is turned off so every second of audio costs the same.
+    bool Start(const WAVEFORMATEX* format, UINT32 seconds, const OpusEncoderConfig& config);
+
+    // Encode a captured block into the ring, dropping the oldest audio
+    bool WriteData(const BYTE* data, UINT32 size);
+    bool WriteSilence(UINT32 frames);
+
+    // Write the buffered audio to filename without waiting for the file
+    bool Save(const std::wstring& filename);
+
+    // Stop buffering, wait for queued saves and release the ring
+    void Stop();
+
+    bool IsActive() const { return m_encoder.IsOpen(); }
+
+    // How saved files reach the disk
+    void SetSinkOptions(const FileSinkOptions& options) { m_sinkOptions = options; }
+
+    // Memory held by the ring
+    size_t GetReservedBytes() const;
+
+    // Audio currently held, in milliseconds
+    UINT64 GetBufferedMs() const;
+
+private:
+    class RingSink;
+
+    struct Page {
+        size_t chunk;
+        size_t offset;
+        size_t size;
+        int64_t granule;     // -1 if no packet ends on the page
+        bool continued;      // Starts with the tail of a packet from the previous page
+    };
+
+    struct SaveJob {
+        std::wstring filename;
+        std::vector<BYTE> pages;
+        int64_t baseGranule;
+        FileSinkOptions options;
+    };
+
+    bool AddPage(const BYTE* data, size_t size);
+    void EvictOldest();
+    void SaveThread();
+
+    // Renumber the pages from the start of the file, rebase their granules and write them
+    static void WriteSnapshot(const std::wstring& filename, std::vector<BYTE> pages,
+                              int64_t baseGranule, FileSinkOptions options);
+
+    OpusOggEncoder m_encoder;
+    FileSinkOptions m_sinkOptions;
+
+    mutable std::mutex m_mutex;
+    std::vector<std::vector<BYTE>> m_chunks;
+    size_t m_writeChunk;
+    size_t m_writeOffset;
+    std::deque<Page> m_pages;
+    std::vector<BYTE> m_headerPages;  // OpusHead and OpusTags, written at the start of every save
+    int64_t m_durationGranules;       // Buffer length at 48 kHz
+    int64_t m_startGranule;           // Where the oldest page's audio starts
+    int64_t m_endGranule;             // Granule of the newest page
+
+    // Saves are written one at a time, in order, by a thread started with the first one
+    std::thread m_saveThread;
+    std::mutex m_saveMutex;
+    std::condition_variable m_saveCondition;
+    std::deque<SaveJob> m_saveQueue;
+    bool m_saveStop;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "RecordingOutput.h"
+#include <windows.h>
+#include <mmreg.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+// Sample layout an output takes its input in
+enum class SampleRepresentation {
+    Native,     // The captured format, unchanged
+    Float32,    // 32-bit IEEE float
+    Int16,      // 16-bit PCM
+    Int24       // Packed 24-bit PCM
+};
+
+// Every output of one capture session (any mix of formats, bitrates and destinations)
+// fed from the same captured blocks. Each input representation the outputs need is
+// converted once per block and shared by all outputs that take it.
+class RecordingFanout {
+public:
+    RecordingFanout();
+    ~RecordingFanout();
+
+    // Open another output for audio in captureFormat. Add every output before the first
+    // WriteData; all outputs must be given the same capture format.
+    bool Add(const std::wstring& filename, const WAVEFORMATEX* captureFormat, const RecordingOptions& options);
+
+    // Write a captured block (whole frames in the capture format) to every output
+    bool WriteData(const BYTE* data, UINT32 size);
+
+    // Write frames of digital silence to every output; nothing is converted
+    bool WriteSilence(UINT32 frames);
+
+    // Free the conversion buffers while the session is idle; the next block reallocates them
+    void ReleaseBuffers();
+
+    // Start the next segment of every output (see RecordingOutput::CutSegment)
+    bool CutSegment();
+
+    // Close every output
+    void Close();
+
+    bool IsOpen() const { return !m_outputs.empty(); }
+    size_t GetOutputCount() const { return m_outputs.size(); }
+
+    // Sync latency metrics for one output's current file
+    FileSyncStats GetSyncStats(size_t index) const;
+
+    // Representation an encoder consumes without converting again: FLAC takes integer
+    // PCM, Opus takes float or 16-bit PCM, WAV and MP3 take the captured format as is
+    static SampleRepresentation PreferredRepresentation(AudioFormat format, const WAVEFORMATEX* captureFormat);
+
+private:
+    enum class SampleType {
+        Int16,
+        Int24,
+        Int32,
+        Float32,
+        Other
+    };
+
+    struct Conversion {
+        SampleRepresentation representation;
+        std::vector<BYTE> formatData;    // Format the outputs are opened with
+        std::vector<BYTE> buffer;        // Converted block
+    };
+
+    struct Output {
+        std::unique_ptr<RecordingOutput> output;
+        size_t conversion;               // Index into m_conversions
+    };
+
+    static SampleType GetSampleType(const WAVEFORMATEX* format);
+    size_t FindConversion(SampleRepresentation representation, const std::vector<BYTE>& formatData);
+    const float* ToFloat(const BYTE* data, size_t samples);
+
+    std::vector<BYTE> m_captureFormat;
+    SampleType m_captureType;
+    std::vector<Conversion> m_conversions;
+    std::vector<Output> m_outputs;
+    std::vector<float> m_floatBuffer;    // Captured block as float: the Float32 input and the source of the others
+};
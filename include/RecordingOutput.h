@@ -0,0 +1,129 @@
+#pragma once
+
+#include "WavWriter.h"
+#include "Mp3Encoder.h"
+#include "OpusEncoder.h"
+#include "FlacEncoder.h"
+#include "CaptureJournal.h"
+#include <windows.h>
+#include <mmreg.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+enum class AudioFormat {
+    WAV,
+    MP3,
+    OPUS,
+    FLAC
+};
+
+// How a recording is cut into files
+struct SegmentOptions {
+    UINT32 segmentSeconds = 0;   // Start a new file after this much audio (0 = one file)
+    bool alignToClock = false;   // Cut at local-time multiples of segmentSeconds (3600 = top of every hour)
+    bool onDemand = false;       // Also cut whenever CutSegment is called (e.g. once per voice activation)
+};
+
+// Background conversion of finished WAV files (including _partN files)
+struct WavTranscodeOptions {
+    bool enabled = false;
+    AudioFormat format = AudioFormat::FLAC;  // FLAC or OPUS
+    UINT32 bitrate = 0;                      // FLAC compression level 0-8 (default 8)
+    OpusEncoderConfig opusConfig;
+    bool keepSource = false;                 // Keep the WAV once the conversion is verified
+};
+
+struct RecordingOptions {
+    AudioFormat format = AudioFormat::WAV;
+    UINT32 bitrate = 0;              // MP3: bits per second (default 192 kbps); FLAC: compression level 0-8 (default 5)
+    OpusEncoderConfig opusConfig;
+    std::vector<UINT32> opusLadder;  // OPUS: extra bitrates encoded in parallel to <name>_<N>k.opus (not when deferring)
+    FileSinkOptions sinkOptions;     // Ignored by MP3 through Media Foundation (LAME uses it)
+    SegmentOptions segments;
+    bool deferEncoding = false;      // Record raw PCM to <name>.acj and encode it in the background
+    WavTranscodeOptions wavTranscode; // WAV only: convert each finished file in the background
+};
+
+// One recording in any output format, optionally rotated into fixed-length segments.
+// Segments are cut at exact frame boundaries, so concatenating them gives back the
+// recorded audio. The next segment is opened ahead of time and finished segments are
+// closed on a background thread, so a rotation costs the writer no more than a pointer swap.
+class RecordingOutput {
+public:
+    RecordingOutput();
+    ~RecordingOutput();
+
+    // Open the first file. With rotation on, later segments are named <name>_segN<ext>
+    // (WAV files split at 4 GB already use _partN).
+    bool Open(const std::wstring& filename, const WAVEFORMATEX* format, const RecordingOptions& options);
+
+    // Write audio data (whole frames in the opened format)
+    bool WriteData(const BYTE* data, UINT32 size);
+
+    // Write frames of digital silence. FLAC and Opus encode them without any input
+    // conversion; the other formats are handed zeros.
+    bool WriteSilence(UINT32 frames);
+
+    // Close the current segment here and continue in the next one. Needs segments.onDemand
+    // or time-based rotation; a timed segment cut early starts a full-length one.
+    bool CutSegment();
+
+    // Close the current segment and wait for all background work
+    void Close();
+
+    bool IsOpen() const { return m_current != nullptr; }
+
+    // Sync latency metrics for the current segment
+    FileSyncStats GetSyncStats() const;
+
+private:
+    struct Segment {
+        std::wstring filename;
+        std::unique_ptr<WavWriter> wavWriter;
+        std::unique_ptr<Mp3Encoder> mp3Encoder;
+        std::unique_ptr<OpusOggEncoder> opusEncoder;
+        std::unique_ptr<FlacEncoder> flacEncoder;
+        std::unique_ptr<CaptureJournalWriter> journalWriter;
+    };
+
+    std::unique_ptr<Segment> OpenSegment(const std::wstring& filename);
+    FileSinkOptions SinkOptions() const;
+    bool WriteFrames(const BYTE* data, UINT32 frames);
+    bool WriteSegment(Segment& segment, const BYTE* data, UINT32 size);
+    bool WriteSegmentSilence(Segment& segment, UINT32 frames);
+    void CloseSegment(Segment& segment, bool encode = true);
+    void Rotate(bool atBoundary = false, UINT32 framesAfterCut = 0);
+    UINT64 SegmentLength(bool atBoundary, UINT32 framesAfterCut) const;
+    void RequestNextSegment();
+    std::wstring MakeSegmentName(UINT32 number) const;
+    void WorkerThread();
+
+    const WAVEFORMATEX* Format() const { return reinterpret_cast<const WAVEFORMATEX*>(m_formatData.data()); }
+
+    RecordingOptions m_options;
+    std::vector<BYTE> m_formatData;
+    std::wstring m_baseName;          // Filename up to the extension
+    std::wstring m_extension;
+    std::unique_ptr<Segment> m_current;
+    UINT32 m_segmentNumber;           // Number of the current segment (1-based)
+    UINT64 m_segmentFrames;           // Frames per segment (0 = no rotation)
+    UINT64 m_framesUntilRotation;
+    std::vector<BYTE> m_zeroBlock;    // Silence for formats without a silence path
+
+    // Background thread: opens the next segment and finalizes finished ones
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_workCondition;
+    std::condition_variable m_readyCondition;    // Signals the next segment's open attempt finished
+    std::wstring m_nextName;
+    bool m_openRequested;
+    bool m_openFailed;
+    std::unique_ptr<Segment> m_next;
+    std::deque<std::unique_ptr<Segment>> m_finished;
+    bool m_stopWorker;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Streaming polyphase resampler for interleaved float audio.
+// Uses a Kaiser-windowed sinc filter and keeps filter history between calls,
+// so consecutive blocks resample seamlessly without clicks at block edges.
+class StreamingResampler {
+public:
+    StreamingResampler();
+
+    // Configure conversion from inputRate to outputRate.
+    // Fails if the rate ratio cannot be expressed with a reasonably sized filter bank.
+    bool Initialize(uint32_t inputRate, uint32_t outputRate, uint32_t channels);
+
+    // Resample inputFrames interleaved frames and append the result to output
+    void Process(const float* input, uint32_t inputFrames, std::vector<float>& output);
+
+    // Push the filter tail out (call once after the last Process)
+    void Flush(std::vector<float>& output);
+
+    // Discard history and restart the stream
+    void Reset();
+
+    // Delay introduced by the filter, in output frames
+    uint32_t GetDelay() const { return m_delay; }
+
+    // Upper bound on output frames produced for inputFrames input frames
+    uint32_t GetMaxOutputFrames(uint32_t inputFrames) const;
+
+    bool IsInitialized() const { return m_upFactor != 0; }
+
+private:
+    uint32_t m_channels;
+    uint32_t m_upFactor;     // L: interpolation factor
+    uint32_t m_downFactor;   // M: decimation factor
+    uint32_t m_taps;         // Taps per polyphase branch
+    uint32_t m_delay;
+    uint64_t m_position;     // Read position in units of 1/L input frames
+    std::vector<float> m_filter;   // m_upFactor branches of m_taps coefficients (time-reversed)
+    std::vector<float> m_history;  // Interleaved input frames still needed by the filter
+};
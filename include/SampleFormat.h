@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+// Layout of interleaved samples, as the stages that only read and write samples (level
+// meter, activation gate, mixer) need it. Free of Windows types, like AudioBlock, so
+// those stages build and run anywhere; AudioCapture::GetSampleFormat describes a capture.
+struct SampleFormat {
+    uint32_t sampleRate = 0;
+    uint16_t channels = 0;
+    uint16_t bitsPerSample = 0;     // Container size of one sample
+    uint16_t blockAlign = 0;        // Bytes per frame
+    bool isFloat = false;           // IEEE float; otherwise signed integer PCM
+
+    // Tightly packed samples, blockAlign = channels * bitsPerSample / 8
+    static SampleFormat Packed(uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample, bool isFloat) {
+        SampleFormat format;
+        format.sampleRate = sampleRate;
+        format.channels = channels;
+        format.bitsPerSample = bitsPerSample;
+        format.blockAlign = static_cast<uint16_t>(channels * bitsPerSample / 8);
+        format.isFloat = isFloat;
+        return format;
+    }
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "AudioBlock.h"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Stand-in for AudioCapture that plays a scripted sequence of sine tones and silent
+// packets through the same block callback, so the capture pipeline (gates, silence
+// detection, mixing, encoders) can be driven without WASAPI, as the unit tests do. Samples are 16-bit PCM
+// or 32-bit float, interleaved. Silence added with AddSilence arrives as flagged
+// silent blocks; a tone of amplitude 0 arrives as real zero samples.
+class SyntheticSource {
+public:
+    using DataCallback = std::function<void(const AudioBlock& block)>;
+
+    SyntheticSource();
+
+    // bitsPerSample is 16 (PCM) or 32 (float); blocks hold at most blockFrames frames
+    bool Initialize(uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample, uint32_t blockFrames);
+
+    void SetDataCallback(DataCallback callback) { m_dataCallback = std::move(callback); }
+
+    // Queue frames of a sine tone (amplitude as a fraction of full scale) or of silence
+    void AddTone(uint32_t frames, float frequency, float amplitude);
+    void AddSilence(uint32_t frames);
+
+    // Deliver everything queued, one block at a time, on the calling thread. A block
+    // never spans two queued parts, as a WASAPI packet is either silent or not.
+    void Run();
+
+    uint32_t GetBlockAlign() const { return m_channels * m_bitsPerSample / 8; }
+
+private:
+    struct Part {
+        uint32_t frames;
+        float frequency;
+        float amplitude;
+        bool silent;
+    };
+
+    void Generate(const Part& part, uint32_t frames);
+
+    uint32_t m_sampleRate;
+    uint16_t m_channels;
+    uint16_t m_bitsPerSample;
+    uint32_t m_blockFrames;
+    double m_phase;                 // Tone phase in cycles, carried across blocks
+    std::vector<Part> m_parts;
+    std::vector<uint8_t> m_buffer;
+    DataCallback m_dataCallback;
+};
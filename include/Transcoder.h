@@ -0,0 +1,68 @@
+#pragma once
+
+#include "RecordingOutput.h"
+#include "CaptureJournal.h"
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Process-wide background encoder for deferred recordings and finished WAV files. Jobs
+// run in parallel on a pool of background-priority threads with the existing encoders.
+// A source is deleted only after the encoded file is verified to hold every frame; a job
+// interrupted by shutdown keeps its source so it can be queued again on the next run.
+// Targets are written under a ".partial" name and renamed when complete; a job whose
+// target name is already taken fails and keeps its source.
+class Transcoder {
+public:
+    static Transcoder& Instance();
+
+    // Queue a journal; the target file is the journal's name without ".acj"
+    void EnqueueJournal(const std::wstring& journalPath);
+
+    // Queue a finished WAV file; the target replaces its extension with .flac or .opus
+    void EnqueueWav(const std::wstring& wavPath, const WavTranscodeOptions& options);
+
+    // Queue every journal in a directory, e.g. ones left behind by a crash. Journals still
+    // being recorded can't be opened for reading and are skipped when their turn comes.
+    void EnqueueDirectory(const std::wstring& directory);
+
+    // Jobs queued or running
+    size_t GetPendingCount() const;
+
+private:
+    struct Job {
+        std::wstring source;
+        bool journal;                    // Capture journal; otherwise a finished WAV file
+        WavTranscodeOptions wavOptions;
+    };
+
+    Transcoder();
+    ~Transcoder();
+
+    Transcoder(const Transcoder&) = delete;
+    Transcoder& operator=(const Transcoder&) = delete;
+
+    void Enqueue(Job job);
+    void WorkerThread();
+    bool TranscodeJournal(const std::wstring& journalPath);
+    bool TranscodeWav(const std::wstring& wavPath, const WavTranscodeOptions& wavOptions);
+
+    // Encoder settings recorded in the journal, raised to offline quality
+    static RecordingOptions MakeOptions(const JournalFileHeader& header);
+
+    // Confirm a finished target holds exactly the frames fed to it
+    static bool VerifyTarget(const std::wstring& targetPath, AudioFormat format,
+                             const WAVEFORMATEX* sourceFormat, UINT64 frames);
+
+    std::vector<std::thread> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queueCondition;
+    std::deque<Job> m_queue;
+    size_t m_running;
+    std::atomic<bool> m_stop;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <windows.h>
+#include <mmreg.h>
+#include <string>
+#include <vector>
+
+// Sequential reader for finished WAV files, RIFF or RF64 (as written by WavWriter)
+class WavReader {
+public:
+    WavReader();
+    ~WavReader();
+
+    bool Open(const std::wstring& filename);
+    void Close();
+
+    bool IsOpen() const { return m_handle != INVALID_HANDLE_VALUE; }
+
+    const WAVEFORMATEX* GetFormat() const { return reinterpret_cast<const WAVEFORMATEX*>(m_formatData.data()); }
+
+    // Whole frames in the data chunk
+    UINT64 GetFrameCount() const;
+
+    // Read up to size bytes of audio data; bytesRead is 0 at the end of the data chunk
+    bool Read(BYTE* data, UINT32 size, UINT32& bytesRead);
+
+private:
+    bool ReadAt(UINT64 offset, void* data, DWORD size);
+
+    HANDLE m_handle;
+    std::vector<BYTE> m_formatData;  // WAVEFORMATEX or WAVEFORMATEXTENSIBLE
+    UINT64 m_dataStart;
+    UINT64 m_dataSize;
+    UINT64 m_readPosition;           // Bytes of the data chunk already read
+};
@@ -5,8 +5,15 @@
 #include <ks.h>
 #include <ksmedia.h>
 #include <string>
-#include <fstream>
 #include <vector>
+#include <memory>
+#include "FileSink.h"
+
+// How recordings larger than a RIFF file can address (4 GB) are stored
+enum class WavLargeFileMode {
+    Rf64,   // One file, promoted to RF64 (EBU Tech 3306) on Close if it passes 4 GB
+    Split   // Plain RIFF files split into _part2, _part3, ... before 4 GB
+};
 
 class WavWriter {
 public:
@@ -14,7 +21,8 @@ public:
     ~WavWriter();
 
     // Open WAV file for writing
-    bool Open(const std::wstring& filename, const WAVEFORMATEX* format);
+    bool Open(const std::wstring& filename, const WAVEFORMATEX* format,
+              WavLargeFileMode largeFileMode = WavLargeFileMode::Rf64);
 
     // Write audio data
     bool WriteData(const BYTE* data, UINT32 size);
@@ -23,21 +31,53 @@ public:
     void Close();
 
     // Check if file is open
-    bool IsOpen() const { return m_file.is_open(); }
+    bool IsOpen() const { return m_file && m_file->IsOpen(); }
+
+    // Choose the output mode and durability policy. Takes effect at the next Open.
+    void SetSinkOptions(const FileSinkOptions& options) { m_sinkOptions = options; }
+
+    // Sync latency metrics for the current file
+    FileSyncStats GetSyncStats() const { return m_file ? m_file->GetSyncStats() : FileSyncStats(); }
+
+    // Every file of the current recording: the opened file, then any _partN files
+    const std::vector<std::wstring>& GetFileNames() const { return m_fileNames; }
+
+    // Rewrite the header sizes periodically so a crash leaves a playable file.
+    // Either limit may be 0 to disable it. Takes effect at the next Open.
+    void SetHeaderCommitInterval(UINT32 milliseconds, UINT64 bytes);
+
+    // Repair the RIFF/RF64 sizes of a file left behind by a crash, from its actual length.
+    // A file whose header already covers its whole length is left untouched. Pass the sink
+    // options the file was written with: only mapped output leaves a zero-filled reserve
+    // behind the audio, and only then are trailing zeros trimmed.
+    static bool RecoverFile(const std::wstring& filename,
+                            const FileSinkOptions& sinkOptions = FileSinkOptions());
 
 private:
     void WriteWavHeader();
-    void UpdateWavHeader();
+    void UpdateWavHeader(UINT64 fileSize);
+    void CommitHeaderIfDue();
     bool SplitToNextFile();  // Open next file part seamlessly
 
-    static constexpr UINT64 MAX_FILE_SIZE = 4000000000ULL; // ~3.7GB safety limit
+    static constexpr UINT64 MAX_FILE_SIZE = 4000000000ULL; // ~3.7GB safety limit (split mode)
+    static constexpr UINT32 DS64_SIZE = 28;                 // ds64 body without a chunk table
+    static constexpr UINT32 DEFAULT_COMMIT_INTERVAL_MS = 5000;
 
-    std::ofstream m_file;
+    std::unique_ptr<FileSink> m_file; // Buffered or mapped output; WriteData only copies into it
+    FileSinkOptions m_sinkOptions;
     std::wstring m_filename;
     std::wstring m_baseFilename;     // Base filename without extension
+    std::vector<std::wstring> m_fileNames;
     std::vector<BYTE> m_formatData;  // Store full format (WAVEFORMATEX or WAVEFORMATEXTENSIBLE)
-    UINT32 m_dataSize;               // Data size in current file
+    WavLargeFileMode m_largeFileMode;
+    UINT64 m_dataSize;               // Data size in current file
     UINT64 m_totalDataSize;          // Total data written across all parts
     UINT32 m_filePartNumber;         // Current file part (1, 2, 3...)
-    std::streampos m_dataStartPos;
+    UINT64 m_dataStartPos;
+
+    // Periodic header commits
+    UINT32 m_commitIntervalMs;
+    UINT64 m_commitIntervalBytes;
+    UINT64 m_lastCommitTime;         // GetTickCount64 at the last commit
+    UINT64 m_lastCommitSize;         // File size described by the last commit
 };
@@ -0,0 +1,311 @@
+#include "ActivationGate.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+uint64_t MsToFrames(uint32_t ms, uint32_t sampleRate) {
+    return static_cast<uint64_t>(ms) * sampleRate / 1000;
+}
+
+std::tm LocalTimeNow() {
+    std::time_t now = std::time(nullptr);
+    std::tm local = {};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    return local;
+}
+
+} // namespace
+
+ActivationGate::ActivationGate()
+    : m_sampleType(SampleType::Other)
+    , m_sampleRate(0)
+    , m_blockAlign(0)
+    , m_channels(0)
+    , m_attackFrames(0)
+    , m_holdFrames(0)
+    , m_releaseFrames(0)
+    , m_state(State::Closed)
+    , m_activeFrames(0)
+    , m_quietFrames(0)
+    , m_releasePosition(0)
+    , m_thresholdPower(0.0f)
+    , m_levelDb(-200.0f)
+    , m_ringStart(0)
+    , m_ringFill(0)
+    , m_activationCount(0)
+    , m_recordedFrames(0)
+    , m_activationStartFrame(0)
+{
+    std::memset(&m_activationTime, 0, sizeof(m_activationTime));
+}
+
+ActivationGate::~ActivationGate() {
+    Close();
+}
+
+bool ActivationGate::Initialize(const SampleFormat& format, const ActivationOptions& options) {
+    if (format.blockAlign == 0 || format.sampleRate == 0) {
+        return false;
+    }
+    bool isFloat = format.isFloat;
+
+    // Only tightly packed samples are measured and faded
+    m_meter.Initialize(format);
+    m_sampleType = SampleType::Other;
+    if (format.blockAlign == format.channels * format.bitsPerSample / 8) {
+        switch (format.bitsPerSample) {
+        case 16:
+            m_sampleType = isFloat ? SampleType::Other : SampleType::Int16;
+            break;
+        case 24:
+            m_sampleType = isFloat ? SampleType::Other : SampleType::Int24;
+            break;
+        case 32:
+            m_sampleType = isFloat ? SampleType::Float32 : SampleType::Int32;
+            break;
+        }
+    }
+
+    m_options = options;
+    m_sampleRate = format.sampleRate;
+    m_blockAlign = format.blockAlign;
+    m_channels = format.channels;
+    m_attackFrames = MsToFrames(options.attackMs, m_sampleRate);
+    m_holdFrames = MsToFrames(options.holdMs, m_sampleRate);
+    m_releaseFrames = MsToFrames(options.releaseMs, m_sampleRate);
+    m_thresholdPower = std::pow(10.0f, options.thresholdDb / 10.0f);
+
+    m_ring.assign(static_cast<size_t>(MsToFrames(options.prerollMs + options.attackMs, m_sampleRate)) * m_blockAlign, 0);
+    m_ringStart = 0;
+    m_ringFill = 0;
+
+    m_state = State::Closed;
+    m_activeFrames = 0;
+    m_activationCount = 0;
+    m_recordedFrames = 0;
+    return true;
+}
+
+void ActivationGate::Process(const AudioBlock& block) {
+    uint32_t frames = block.frames;
+    if (frames == 0) {
+        return;
+    }
+
+    // Blocks the meter can't read always count as activity
+    bool active = false;
+    if (block.silent) {
+        m_levelDb = BlockLevel().RmsDb();
+    } else {
+        BlockLevel level = m_meter.Measure(block.data, frames);
+        m_levelDb = level.RmsDb();
+        active = !m_meter.CanMeasure() || level.meanSquare >= m_thresholdPower;
+    }
+
+    switch (m_state) {
+    case State::Closed:
+        m_activeFrames = active ? m_activeFrames + frames : 0;
+        if (active && m_activeFrames >= m_attackFrames) {
+            BeginActivation();
+            FlushPreroll();
+            Emit(block);
+            m_state = State::Open;
+        } else {
+            PushPreroll(block);
+        }
+        break;
+
+    case State::Open:
+    case State::Hold:
+        Emit(block);
+        if (active) {
+            m_state = State::Open;
+            m_quietFrames = 0;
+            break;
+        }
+
+        m_state = State::Hold;
+        m_quietFrames += frames;
+        if (m_quietFrames >= m_holdFrames) {
+            m_state = State::Release;
+            m_releasePosition = 0;
+            if (m_releaseFrames == 0) {
+                EndActivation();
+            }
+        }
+        break;
+
+    case State::Release:
+        if (active) {
+            Emit(block);
+            m_state = State::Open;
+            m_quietFrames = 0;
+            break;
+        }
+
+        EmitFaded(block);
+        m_releasePosition += frames;
+        if (m_releasePosition >= m_releaseFrames) {
+            EndActivation();
+        }
+        break;
+    }
+}
+
+void ActivationGate::PushPreroll(const AudioBlock& block) {
+    size_t capacity = m_ring.size();
+    if (capacity == 0) {
+        return;
+    }
+
+    // Silent blocks are written as zeros
+    const uint8_t* data = block.data;
+    size_t size = block.size;
+
+    // A block longer than the ring replaces it outright
+    if (size >= capacity) {
+        if (block.silent) {
+            std::memset(m_ring.data(), 0, capacity);
+        } else {
+            std::memcpy(m_ring.data(), data + (size - capacity), capacity);
+        }
+        m_ringStart = 0;
+        m_ringFill = capacity;
+        return;
+    }
+
+    size_t end = (m_ringStart + m_ringFill) % capacity;
+    size_t first = std::min<size_t>(size, capacity - end);
+    if (block.silent) {
+        std::memset(m_ring.data() + end, 0, first);
+        std::memset(m_ring.data(), 0, size - first);
+    } else {
+        std::memcpy(m_ring.data() + end, data, first);
+        std::memcpy(m_ring.data(), data + first, size - first);
+    }
+
+    m_ringFill += size;
+    if (m_ringFill > capacity) {
+        m_ringStart = (m_ringStart + m_ringFill - capacity) % capacity;
+        m_ringFill = capacity;
+    }
+}
+
+void ActivationGate::FlushPreroll() {
+    // The ring holds whole frames, so both halves of a wrapped ring do too
+    size_t first = std::min(m_ringFill, m_ring.size() - m_ringStart);
+    if (first > 0) {
+        Emit(AudioBlock::Samples(m_ring.data() + m_ringStart, static_cast<uint32_t>(first), m_blockAlign));
+    }
+    if (m_ringFill > first) {
+        Emit(AudioBlock::Samples(m_ring.data(), static_cast<uint32_t>(m_ringFill - first), m_blockAlign));
+    }
+    m_ringStart = 0;
+    m_ringFill = 0;
+}
+
+void ActivationGate::Emit(const AudioBlock& block) {
+    m_recordedFrames += block.frames;
+    if (m_dataCallback) {
+        m_dataCallback(block);
+    }
+}
+
+void ActivationGate::EmitFaded(const AudioBlock& block) {
+    // Silence needs no fading
+    if (block.silent) {
+        Emit(block);
+        return;
+    }
+
+    uint32_t frames = block.frames;
+    m_fadeBuffer.assign(block.data, block.data + block.size);
+    uint8_t* frame = m_fadeBuffer.data();
+
+    // Linear fade from the current release position down to silence
+    for (uint32_t f = 0; f < frames; f++, frame += m_blockAlign) {
+        uint64_t position = m_releasePosition + f;
+        float gain = position < m_releaseFrames
+            ? 1.0f - static_cast<float>(position) / static_cast<float>(m_releaseFrames) : 0.0f;
+
+        for (uint32_t ch = 0; ch < m_channels; ch++) {
+            switch (m_sampleType) {
+            case SampleType::Float32: {
+                float* sample = reinterpret_cast<float*>(frame) + ch;
+                *sample *= gain;
+                break;
+            }
+            case SampleType::Int16: {
+                int16_t* sample = reinterpret_cast<int16_t*>(frame) + ch;
+                *sample = static_cast<int16_t>(*sample * gain);
+                break;
+            }
+            case SampleType::Int24: {
+                uint8_t* sample = frame + ch * 3;
+                int32_t value = ((static_cast<int32_t>(sample[0]) << 8) |
+                                 (static_cast<int32_t>(sample[1]) << 16) |
+                                 (static_cast<int32_t>(sample[2]) << 24)) >> 8;
+                value = static_cast<int32_t>(value * gain);
+                sample[0] = static_cast<uint8_t>(value);
+                sample[1] = static_cast<uint8_t>(value >> 8);
+                sample[2] = static_cast<uint8_t>(value >> 16);
+                break;
+            }
+            case SampleType::Int32: {
+                int32_t* sample = reinterpret_cast<int32_t*>(frame) + ch;
+                *sample = static_cast<int32_t>(*sample * static_cast<double>(gain));
+                break;
+            }
+            case SampleType::Other:
+                break;
+            }
+        }
+    }
+
+    Emit(AudioBlock::Samples(m_fadeBuffer.data(), block.size, m_blockAlign));
+}
+
+void ActivationGate::BeginActivation() {
+    m_activationCount++;
+    m_activationStartFrame = m_recordedFrames;
+    m_activationTime = LocalTimeNow();
+    if (m_activationCallback) {
+        m_activationCallback(true, m_activationCount);
+    }
+}
+
+void ActivationGate::EndActivation() {
+    m_state = State::Closed;
+    m_activeFrames = 0;
+    m_quietFrames = 0;
+    m_ringStart = 0;
+    m_ringFill = 0;
+
+    if (m_labelCallback) {
+        char line[96];
+        int length = std::snprintf(line, sizeof(line), "%.6f\t%.6f\t%02d:%02d:%02d\n",
+                                   static_cast<double>(m_activationStartFrame) / m_sampleRate,
+                                   static_cast<double>(m_recordedFrames) / m_sampleRate,
+                                   m_activationTime.tm_hour, m_activationTime.tm_min, m_activationTime.tm_sec);
+        if (length > 0) {
+            m_labelCallback(line, static_cast<size_t>(length));
+        }
+    }
+
+    if (m_activationCallback) {
+        m_activationCallback(false, m_activationCount);
+    }
+}
+
+void ActivationGate::Close() {
+    if (m_state != State::Closed) {
+        EndActivation();
+    }
+}
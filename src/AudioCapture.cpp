@@ -134,8 +134,8 @@ AudioCapture::AudioCapture()
     , m_waveFormat(nullptr)
     , m_isCapturing(false)
     , m_isPaused(false)
+    , m_pollIntervalMs(DEFAULT_POLL_MS)
     , m_targetProcessId(0)
-    , m_volumeMultiplier(1.0f)  // Default to 100% volume
     , m_isProcessSpecific(false)
     , m_isInputDevice(false)
     , m_passthroughEnabled(false)
@@ -170,6 +170,24 @@ AudioCapture::~AudioCapture() {
     // Don't call CoUninitialize - main thread will handle it
 }
 
+SampleFormat AudioCapture::GetSampleFormat() const {
+    SampleFormat format;
+    if (!m_waveFormat) {
+        return format;
+    }
+
+    format.sampleRate = m_waveFormat->nSamplesPerSec;
+    format.channels = m_waveFormat->nChannels;
+    format.bitsPerSample = m_waveFormat->wBitsPerSample;
+    format.blockAlign = m_waveFormat->nBlockAlign;
+    format.isFloat = (m_waveFormat->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+    if (m_waveFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE && m_waveFormat->cbSize >= 22) {
+        const WAVEFORMATEXTENSIBLE* wfex = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(m_waveFormat);
+        format.isFloat = (wfex->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+    }
+    return format;
+}
+
 bool AudioCapture::Initialize(DWORD processId) {
     m_targetProcessId = processId;
 
@@ -551,6 +569,9 @@ bool AudioCapture::Start() {
         return false;
     }
 
+    // The gain kernel is chosen once per session, for the capture format
+    m_gain.Initialize(m_waveFormat);
+
     // Start audio client
     HRESULT hr = m_audioClient->Start();
     if (FAILED(hr)) {
@@ -619,46 +640,6 @@ void AudioCapture::Resume() {
     }
 }
 
-void AudioCapture::ApplyVolumeToBuffer(BYTE* data, UINT32 size) {
-    if (!data || !m_waveFormat || size == 0) {
-        return;
-    }
-
-    if (m_volumeMultiplier >= 1.0f) {
-        return; // No adjustment needed
-    }
-
-    // Check if this is WAVEFORMATEXTENSIBLE
-    bool isExtensible = (m_waveFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE &&
-                         m_waveFormat->cbSize >= 22);
-
-    // Determine the actual format
-    bool isFloat = false;
-    if (isExtensible) {
-        WAVEFORMATEXTENSIBLE* wfex = reinterpret_cast<WAVEFORMATEXTENSIBLE*>(m_waveFormat);
-        isFloat = (wfex->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
-    } else {
-        isFloat = (m_waveFormat->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
-    }
-
-    if (isFloat && m_waveFormat->wBitsPerSample == 32) {
-        // 32-bit float PCM
-        float* samples = reinterpret_cast<float*>(data);
-        UINT32 numSamples = size / sizeof(float);
-        for (UINT32 i = 0; i < numSamples; i++) {
-            samples[i] = samples[i] * m_volumeMultiplier;
-        }
-    }
-    else if (m_waveFormat->wBitsPerSample == 16) {
-        // 16-bit PCM
-        int16_t* samples = reinterpret_cast<int16_t*>(data);
-        UINT32 numSamples = size / sizeof(int16_t);
-        for (UINT32 i = 0; i < numSamples; i++) {
-            samples[i] = static_cast<int16_t>(samples[i] * m_volumeMultiplier);
-        }
-    }
-}
-
 void AudioCapture::CaptureThread() {
     // Validate required members
     if (!m_captureClient || !m_waveFormat) {
@@ -669,10 +650,9 @@ void AudioCapture::CaptureThread() {
     DWORD taskIndex = 0;
     HANDLE hTask = AvSetMmThreadCharacteristics(L"Audio", &taskIndex);
 
-    // Poll every 10ms
-    const DWORD sleepMs = 10;
-
     while (m_isCapturing) {
+        // Poll every 10ms unless told otherwise
+        DWORD sleepMs = m_passthroughEnabled ? DEFAULT_POLL_MS : std::min<DWORD>(m_pollIntervalMs, MAX_POLL_MS);
         Sleep(sleepMs);
 
         // Check if we should stop
@@ -699,18 +679,24 @@ void AudioCapture::CaptureThread() {
             // Calculate buffer size
             UINT32 bufferSize = numFramesAvailable * m_waveFormat->nBlockAlign;
 
-            // Send data to callback - even if silent, send zeros to keep stream continuous
+            // Send data to callback - silent packets too, as a length only, to keep the stream continuous
             if (m_dataCallback && bufferSize > 0) {
                 if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
-                    // For silent buffers, send zeros
-                    std::vector<BYTE> silence(bufferSize, 0);
-                    m_dataCallback(silence.data(), bufferSize);
+                    // Keep any volume ramp in step with the stream
+                    m_gain.Process(nullptr, nullptr, numFramesAvailable);
+                    m_dataCallback(AudioBlock::Silence(numFramesAvailable, m_waveFormat->nBlockAlign));
                 }
                 else if (data) {
-                    // Apply volume adjustment
-                    std::vector<BYTE> buffer(data, data + bufferSize);
-                    ApplyVolumeToBuffer(buffer.data(), bufferSize);
-                    m_dataCallback(buffer.data(), bufferSize);
+                    // Apply volume while copying out of the device buffer; at unity the packet is passed as is
+                    const BYTE* samples = data;
+                    if (!m_gain.IsUnity()) {
+                        if (m_gainBuffer.size() < bufferSize) {
+                            m_gainBuffer.resize(bufferSize);
+                        }
+                        m_gain.Process(data, m_gainBuffer.data(), numFramesAvailable);
+                        samples = m_gainBuffer.data();
+                    }
+                    m_dataCallback(AudioBlock::Samples(samples, bufferSize, m_waveFormat->nBlockAlign));
 
                     // If passthrough is enabled, also send to render device
                     if (m_passthroughEnabled && m_audioRenderClient && m_renderClient) {
@@ -731,7 +717,7 @@ void AudioCapture::CaptureThread() {
                                 if (SUCCEEDED(m_audioRenderClient->GetBuffer(framesToWrite, &renderBuffer))) {
                                     // Copy audio data to render buffer
                                     UINT32 bytesToCopy = framesToWrite * m_waveFormat->nBlockAlign;
-                                    memcpy(renderBuffer, buffer.data(), bytesToCopy);
+                                    memcpy(renderBuffer, samples, bytesToCopy);
 
                                     m_audioRenderClient->ReleaseBuffer(framesToWrite, 0);
                                 }
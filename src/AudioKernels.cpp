@@ -0,0 +1,446 @@
+#include "AudioKernels.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_KERNELS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace AudioKernels {
+
+namespace {
+
+// Soft clip knee, as a fraction of full scale
+const float kSoftClipKnee = 0.8f;
+
+// Below the knee samples pass unchanged; above it the excess u (in units of the headroom
+// left) maps to u / (1 + u), which starts at slope 1 and approaches full scale. NaN passes.
+inline float SoftClip(float x, float knee, float range) {
+    float magnitude = std::fabs(x);
+    if (!(magnitude > knee)) {
+        return x;
+    }
+    float over = (magnitude - knee) / range;
+    float bent = knee + range * (over / (1.0f + over));
+    return x < 0.0f ? -bent : bent;
+}
+
+#ifdef AUDIO_KERNELS_SSE2
+inline __m128 SoftClip4(__m128 x, __m128 knee, __m128 range) {
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000u)));
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 magnitude = _mm_andnot_ps(signMask, x);
+    __m128 over = _mm_div_ps(_mm_sub_ps(magnitude, knee), range);
+    __m128 bent = _mm_add_ps(knee, _mm_mul_ps(range, _mm_div_ps(over, _mm_add_ps(one, over))));
+    bent = _mm_or_ps(bent, _mm_and_ps(x, signMask));
+    __m128 above = _mm_cmpgt_ps(magnitude, knee);
+    return _mm_or_ps(_mm_and_ps(above, bent), _mm_andnot_ps(above, x));
+}
+#endif
+
+} // namespace
+
+void Int16ToFloat(const int16_t* input, float* output, size_t count) {
+    const float scale = 1.0f / 32768.0f;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        // Sign-extend 16 -> 32 bits by unpacking into the high half and shifting back down
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#endif
+
+    for (; i < count; i++) {
+        output[i] = input[i] * scale;
+    }
+}
+
+void Int32ToFloat(const int32_t* input, float* output, size_t count) {
+    const float scale = 1.0f / 2147483648.0f;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4) {
+        __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(samples), vscale));
+    }
+#endif
+
+    for (; i < count; i++) {
+        output[i] = static_cast<float>(input[i]) * scale;
+    }
+}
+
+void Int24ToFloat(const uint8_t* input, float* output, size_t count) {
+    const float scale = 1.0f / 8388608.0f;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    // Four samples (12 bytes) per step: shift the vector so each sample starts at byte 0,
+    // gather those first lanes into one vector, then move the 24 bits to the top of each
+    // lane and shift back down to sign-extend. Each step loads 16 bytes, so the loop stops
+    // while at least two samples remain past the four it converts.
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 6 <= count; i += 4) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 3));
+        __m128i first = _mm_unpacklo_epi32(packed, _mm_srli_si128(packed, 3));
+        __m128i second = _mm_unpacklo_epi32(_mm_srli_si128(packed, 6), _mm_srli_si128(packed, 9));
+        __m128i samples = _mm_unpacklo_epi64(first, second);
+        samples = _mm_srai_epi32(_mm_slli_epi32(samples, 8), 8);
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(samples), vscale));
+    }
+#endif
+
+    for (; i < count; i++) {
+        const uint8_t* sample = input + i * 3;
+        int32_t value = (static_cast<int32_t>(sample[0]) << 8) |
+                        (static_cast<int32_t>(sample[1]) << 16) |
+                        (static_cast<int32_t>(sample[2]) << 24);
+        output[i] = (value >> 8) * scale;
+    }
+}
+
+void FloatToInt16(const float* input, int16_t* output, size_t count) {
+    const float scale = 32768.0f;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    // Clip before converting: out-of-range conversions produce INT_MIN. NaN clips to the minimum.
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vmin = _mm_set1_ps(-32768.0f);
+    const __m128 vmax = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128 lo = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(input + i), vscale), vmin), vmax);
+        __m128 hi = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(input + i + 4), vscale), vmin), vmax);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+    }
+#endif
+
+    for (; i < count; i++) {
+        float value = input[i] * scale;
+        value = value > -32768.0f ? value : -32768.0f;
+        value = value < 32767.0f ? value : 32767.0f;
+        output[i] = static_cast<int16_t>(std::lrintf(value));
+    }
+}
+
+void FloatToInt24(const float* input, uint8_t* output, size_t count) {
+    const float scale = 8388608.0f;
+    for (size_t i = 0; i < count; i++) {
+        float value = input[i] * scale;
+        value = value > -8388608.0f ? value : -8388608.0f;
+        value = value < 8388607.0f ? value : 8388607.0f;
+        int32_t sample = static_cast<int32_t>(std::lrintf(value));
+        uint8_t* dest = output + i * 3;
+        dest[0] = static_cast<uint8_t>(sample);
+        dest[1] = static_cast<uint8_t>(sample >> 8);
+        dest[2] = static_cast<uint8_t>(sample >> 16);
+    }
+}
+
+float SumSquares(const float* input, size_t count) {
+    float partial[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    __m128 sum = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 samples = _mm_loadu_ps(input + i);
+        sum = _mm_add_ps(sum, _mm_mul_ps(samples, samples));
+    }
+    _mm_storeu_ps(partial, sum);
+#else
+    for (; i + 4 <= count; i += 4) {
+        for (int lane = 0; lane < 4; lane++) {
+            partial[lane] += input[i + lane] * input[i + lane];
+        }
+    }
+#endif
+
+    float total = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+    for (; i < count; i++) {
+        total += input[i] * input[i];
+    }
+    return total;
+}
+
+uint64_t SumSquaresInt16(const int16_t* input, size_t count) {
+    uint64_t total = 0;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    // Each pair of squares fits in 32 unsigned bits (at most 2^31); widen to 64 before adding
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        __m128i pairs = _mm_madd_epi16(samples, samples);
+        sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(pairs, zero));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(pairs, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    total = lanes[0] + lanes[1];
+#endif
+
+    for (; i < count; i++) {
+        total += static_cast<uint64_t>(static_cast<int32_t>(input[i]) * input[i]);
+    }
+    return total;
+}
+
+float PeakAbs(const float* input, size_t count) {
+    float peak = 0.0f;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    // Clear the sign bit; maxps returns its second operand for NaN, so NaN never wins
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 vpeak = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        vpeak = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(input + i), absMask), vpeak);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, vpeak);
+    for (float lane : lanes) {
+        peak = lane > peak ? lane : peak;
+    }
+#endif
+
+    for (; i < count; i++) {
+        float value = std::fabs(input[i]);
+        peak = value > peak ? value : peak;
+    }
+    return peak;
+}
+
+int PeakAbsInt16(const int16_t* input, size_t count) {
+    int peak = 0;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    // |x| as max(x, 0 - x) with a saturating subtract, so -32768 becomes 32767
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vpeak = zero;
+    for (; i + 8 <= count; i += 8) {
+        __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        __m128i magnitude = _mm_max_epi16(samples, _mm_subs_epi16(zero, samples));
+        vpeak = _mm_max_epi16(vpeak, magnitude);
+    }
+    int16_t lanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), vpeak);
+    for (int16_t lane : lanes) {
+        peak = lane > peak ? lane : peak;
+    }
+#endif
+
+    for (; i < count; i++) {
+        int value = input[i] < 0 ? -static_cast<int>(input[i]) : input[i];
+        value = value < 32767 ? value : 32767;
+        peak = value > peak ? value : peak;
+    }
+    return peak;
+}
+
+bool IsAllZero(const uint8_t* data, size_t size) {
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 64 <= size; i += 64) {
+        const __m128i* block = reinterpret_cast<const __m128i*>(data + i);
+        __m128i bits = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(block), _mm_loadu_si128(block + 1)),
+                                    _mm_or_si128(_mm_loadu_si128(block + 2), _mm_loadu_si128(block + 3)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+#else
+    for (; i + 8 <= size; i += 8) {
+        uint64_t bits;
+        std::memcpy(&bits, data + i, sizeof(bits));
+        if (bits != 0) {
+            return false;
+        }
+    }
+#endif
+
+    for (; i < size; i++) {
+        if (data[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IsAllZeroFloat(const float* input, size_t count) {
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    // Everything but the sign bit must be clear
+    const __m128i magnitudeMask = _mm_set1_epi32(0x7FFFFFFF);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        const __m128i* block = reinterpret_cast<const __m128i*>(input + i);
+        __m128i bits = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(block), _mm_loadu_si128(block + 1)),
+                                    _mm_or_si128(_mm_loadu_si128(block + 2), _mm_loadu_si128(block + 3)));
+        bits = _mm_and_si128(bits, magnitudeMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, zero)) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        uint32_t bits;
+        std::memcpy(&bits, input + i, sizeof(bits));
+        if ((bits & 0x7FFFFFFF) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ApplyGain(const float* input, float* output, size_t count, float gain, float step, bool softClip) {
+    const float knee = kSoftClipKnee;
+    const float range = 1.0f - kSoftClipKnee;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    // Per-lane gains come from the sample index rather than a running sum, so both paths agree
+    const __m128 vgain = _mm_set1_ps(gain);
+    const __m128 vstep = _mm_set1_ps(step);
+    const __m128 vknee = _mm_set1_ps(knee);
+    const __m128 vrange = _mm_set1_ps(range);
+    const __m128 four = _mm_set1_ps(4.0f);
+    __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 value = _mm_mul_ps(_mm_loadu_ps(input + i), _mm_add_ps(vgain, _mm_mul_ps(vstep, index)));
+        if (softClip) {
+            value = SoftClip4(value, vknee, vrange);
+        }
+        _mm_storeu_ps(output + i, value);
+        index = _mm_add_ps(index, four);
+    }
+#endif
+
+    for (; i < count; i++) {
+        float value = input[i] * (gain + step * static_cast<float>(i));
+        output[i] = softClip ? SoftClip(value, knee, range) : value;
+    }
+}
+
+void ApplyGainInt16(const int16_t* input, int16_t* output, size_t count, float gain, float step, bool softClip) {
+    const float knee = kSoftClipKnee * 32768.0f;
+    const float range = 32768.0f - knee;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    const __m128 vgain = _mm_set1_ps(gain);
+    const __m128 vstep = _mm_set1_ps(step);
+    const __m128 vknee = _mm_set1_ps(knee);
+    const __m128 vrange = _mm_set1_ps(range);
+    const __m128 vmin = _mm_set1_ps(-32768.0f);
+    const __m128 vmax = _mm_set1_ps(32767.0f);
+    const __m128 four = _mm_set1_ps(4.0f);
+    __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16));
+        lo = _mm_mul_ps(lo, _mm_add_ps(vgain, _mm_mul_ps(vstep, index)));
+        index = _mm_add_ps(index, four);
+        hi = _mm_mul_ps(hi, _mm_add_ps(vgain, _mm_mul_ps(vstep, index)));
+        index = _mm_add_ps(index, four);
+        if (softClip) {
+            lo = SoftClip4(lo, vknee, vrange);
+            hi = SoftClip4(hi, vknee, vrange);
+        }
+        lo = _mm_min_ps(_mm_max_ps(lo, vmin), vmax);
+        hi = _mm_min_ps(_mm_max_ps(hi, vmin), vmax);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+    }
+#endif
+
+    for (; i < count; i++) {
+        float value = static_cast<float>(input[i]) * (gain + step * static_cast<float>(i));
+        if (softClip) {
+            value = SoftClip(value, knee, range);
+        }
+        value = value > -32768.0f ? value : -32768.0f;
+        value = value < 32767.0f ? value : 32767.0f;
+        output[i] = static_cast<int16_t>(std::lrintf(value));
+    }
+}
+
+void ApplyGainInt32(const int32_t* input, int32_t* output, size_t count, float gain, float step, bool softClip) {
+    // Scaled in float, so to 24 significant bits - the real depth of 32-bit capture formats.
+    // The upper clip is the largest float below 2^31.
+    const float knee = kSoftClipKnee * 2147483648.0f;
+    const float range = 2147483648.0f - knee;
+    size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+    const __m128 vgain = _mm_set1_ps(gain);
+    const __m128 vstep = _mm_set1_ps(step);
+    const __m128 vknee = _mm_set1_ps(knee);
+    const __m128 vrange = _mm_set1_ps(range);
+    const __m128 vmin = _mm_set1_ps(-2147483648.0f);
+    const __m128 vmax = _mm_set1_ps(2147483520.0f);
+    const __m128 four = _mm_set1_ps(4.0f);
+    __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 value = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i)));
+        value = _mm_mul_ps(value, _mm_add_ps(vgain, _mm_mul_ps(vstep, index)));
+        index = _mm_add_ps(index, four);
+        if (softClip) {
+            value = SoftClip4(value, vknee, vrange);
+        }
+        value = _mm_min_ps(_mm_max_ps(value, vmin), vmax);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_cvtps_epi32(value));
+    }
+#endif
+
+    for (; i < count; i++) {
+        float value = static_cast<float>(input[i]) * (gain + step * static_cast<float>(i));
+        if (softClip) {
+            value = SoftClip(value, knee, range);
+        }
+        value = value > -2147483648.0f ? value : -2147483648.0f;
+        value = value < 2147483520.0f ? value : 2147483520.0f;
+        output[i] = static_cast<int32_t>(std::lrintf(value));
+    }
+}
+
+void ApplyGainInt24(const uint8_t* input, uint8_t* output, size_t count, float gain, float step, bool softClip) {
+    const float knee = kSoftClipKnee * 8388608.0f;
+    const float range = 8388608.0f - knee;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* sample = input + i * 3;
+        int32_t packed = (static_cast<int32_t>(sample[0]) << 8) |
+                         (static_cast<int32_t>(sample[1]) << 16) |
+                         (static_cast<int32_t>(sample[2]) << 24);
+        float value = static_cast<float>(packed >> 8) * (gain + step * static_cast<float>(i));
+        if (softClip) {
+            value = SoftClip(value, knee, range);
+        }
+        value = value > -8388608.0f ? value : -8388608.0f;
+        value = value < 8388607.0f ? value : 8388607.0f;
+        int32_t result = static_cast<int32_t>(std::lrintf(value));
+        uint8_t* dest = output + i * 3;
+        dest[0] = static_cast<uint8_t>(result);
+        dest[1] = static_cast<uint8_t>(result >> 8);
+        dest[2] = static_cast<uint8_t>(result >> 16);
+    }
+}
+
+} // namespace AudioKernels
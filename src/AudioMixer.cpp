@@ -1,28 +1,28 @@
 #include "AudioMixer.h"
+#include "AudioKernels.h"
 #include <algorithm>
 #include <cstring>
 
 AudioMixer::AudioMixer() : m_initialized(false) {
-    memset(&m_format, 0, sizeof(m_format));
 }
 
 AudioMixer::~AudioMixer() {
     Clear();
 }
 
-bool AudioMixer::Initialize(const WAVEFORMATEX* format) {
-    if (!format) {
+bool AudioMixer::Initialize(const SampleFormat& format) {
+    if (format.blockAlign == 0 || format.sampleRate == 0) {
         return false;
     }
 
     std::lock_guard<std::mutex> lock(m_mutex);
-    memcpy(&m_format, format, sizeof(WAVEFORMATEX));
+    m_format = format;
     m_initialized = true;
     return true;
 }
 
-void AudioMixer::AddAudioData(DWORD sourceId, const BYTE* data, UINT32 size, const WAVEFORMATEX* sourceFormat) {
-    if (!m_initialized || !data || size == 0 || !sourceFormat) {
+void AudioMixer::AddAudioData(uint32_t sourceId, const AudioBlock& block, const SampleFormat& sourceFormat) {
+    if (!m_initialized || (!block.data && !block.silent) || block.size == 0 || sourceFormat.sampleRate == 0) {
         return;
     }
 
@@ -32,19 +32,51 @@ void AudioMixer::AddAudioData(DWORD sourceId, const BYTE* data, UINT32 size, con
     AudioBuffer& buffer = m_buffers[sourceId];
 
     // Check if resampling is needed
-    if (sourceFormat->nSamplesPerSec != m_format.nSamplesPerSec ||
-        sourceFormat->nChannels != m_format.nChannels ||
-        sourceFormat->wBitsPerSample != m_format.wBitsPerSample) {
+    bool resample = sourceFormat.sampleRate != m_format.sampleRate ||
+                    sourceFormat.channels != m_format.channels ||
+                    sourceFormat.bitsPerSample != m_format.bitsPerSample;
+
+    if (block.silent) {
+        // Zeros of the length the resampled block would have
+        size_t size = block.size;
+        if (resample) {
+            double ratio = (double)m_format.sampleRate / (double)sourceFormat.sampleRate;
+            size = static_cast<size_t>((uint32_t)(block.frames * ratio)) * m_format.blockAlign;
+        }
+        Append(buffer, nullptr, size, false);
+        return;
+    }
+
+    // All-zero blocks (muted or paused sources) are found here, once, and mixed as silence
+    bool active = (sourceFormat.bitsPerSample == 32)
+        ? !AudioKernels::IsAllZeroFloat(reinterpret_cast<const float*>(block.data), block.size / sizeof(float))
+        : !AudioKernels::IsAllZero(block.data, block.size);
+
+    if (resample) {
         // Resample the audio to match target format
-        std::vector<BYTE> resampledData = ResampleAudio(data, size, sourceFormat);
-        buffer.data.insert(buffer.data.end(), resampledData.begin(), resampledData.end());
+        std::vector<uint8_t> resampledData = ResampleAudio(block.data, block.size, sourceFormat);
+        Append(buffer, resampledData.data(), resampledData.size(), active);
     } else {
         // No resampling needed, append directly
+        Append(buffer, block.data, block.size, active);
+    }
+}
+
+void AudioMixer::Append(AudioBuffer& buffer, const uint8_t* data, size_t size, bool active) {
+    if (data) {
         buffer.data.insert(buffer.data.end(), data, data + size);
+    } else {
+        buffer.data.resize(buffer.data.size() + size, 0);
+    }
+
+    if (!buffer.spans.empty() && buffer.spans.back().active == active) {
+        buffer.spans.back().end = buffer.data.size();
+    } else {
+        buffer.spans.push_back({ buffer.data.size(), active });
     }
 }
 
-bool AudioMixer::GetMixedAudio(std::vector<BYTE>& outBuffer) {
+bool AudioMixer::GetMixedAudio(std::vector<uint8_t>& outBuffer) {
     if (!m_initialized) {
         return false;
     }
@@ -56,9 +88,9 @@ bool AudioMixer::GetMixedAudio(std::vector<BYTE>& outBuffer) {
     }
 
     // Find the minimum amount of data available across all sources
-    UINT32 minDataAvailable = UINT32_MAX;
+    uint32_t minDataAvailable = UINT32_MAX;
     for (const auto& pair : m_buffers) {
-        UINT32 available = static_cast<UINT32>(pair.second.data.size()) - pair.second.readPosition;
+        uint32_t available = static_cast<uint32_t>(pair.second.data.size()) - pair.second.readPosition;
         if (available < minDataAvailable) {
             minDataAvailable = available;
         }
@@ -69,37 +101,54 @@ bool AudioMixer::GetMixedAudio(std::vector<BYTE>& outBuffer) {
     }
 
     // Calculate frame count
-    UINT32 bytesPerFrame = m_format.nBlockAlign;
-    UINT32 frameCount = minDataAvailable / bytesPerFrame;
+    uint32_t bytesPerFrame = m_format.blockAlign;
+    uint32_t frameCount = minDataAvailable / bytesPerFrame;
 
     if (frameCount == 0) {
         return false;
     }
 
-    UINT32 bytesToMix = frameCount * bytesPerFrame;
+    uint32_t bytesToMix = frameCount * bytesPerFrame;
 
     // Prepare output buffer
     outBuffer.resize(bytesToMix);
 
-    // If only one source, just copy the data
-    if (m_buffers.size() == 1) {
-        const AudioBuffer& buffer = m_buffers.begin()->second;
-        memcpy(outBuffer.data(), buffer.data.data() + buffer.readPosition, bytesToMix);
-        m_buffers.begin()->second.readPosition += bytesToMix;
-    }
-    else {
-        // Multiple sources - need to mix
-        std::vector<const BYTE*> sources;
+    // Mix in stretches over which no source changes between active and silent
+    std::vector<const uint8_t*> sources;
+    sources.reserve(m_buffers.size());
+    uint32_t mixed = 0;
+    while (mixed < bytesToMix) {
+        uint32_t stretch = bytesToMix - mixed;
+        sources.clear();
+
         for (auto& pair : m_buffers) {
-            sources.push_back(pair.second.data.data() + pair.second.readPosition);
-        }
+            AudioBuffer& buffer = pair.second;
+            size_t position = buffer.readPosition + mixed;
+            while (buffer.spans.front().end <= position) {
+                buffer.spans.pop_front();
+            }
 
-        MixSamples(sources, outBuffer.data(), frameCount);
+            const Span& span = buffer.spans.front();
+            stretch = static_cast<uint32_t>(std::min<size_t>(stretch, span.end - position));
+            if (span.active) {
+                sources.push_back(buffer.data.data() + position);
+            }
+        }
 
-        // Update read positions for all sources
-        for (auto& pair : m_buffers) {
-            pair.second.readPosition += bytesToMix;
+        // Spans hold whole blocks, so stretches are whole frames
+        uint8_t* dest = outBuffer.data() + mixed;
+        if (sources.empty()) {
+            memset(dest, 0, stretch);
+        } else if (sources.size() == 1) {
+            memcpy(dest, sources[0], stretch);
+        } else {
+            MixSamples(sources, dest, stretch / bytesPerFrame);
         }
+        mixed += stretch;
+    }
+
+    for (auto& pair : m_buffers) {
+        pair.second.readPosition += bytesToMix;
     }
 
     // Clean up consumed data
@@ -109,11 +158,18 @@ bool AudioMixer::GetMixedAudio(std::vector<BYTE>& outBuffer) {
         // If we've read everything, erase old data
         if (buffer.readPosition >= buffer.data.size()) {
             buffer.data.clear();
+            buffer.spans.clear();
             buffer.readPosition = 0;
         }
         // If we've read a significant amount, compact the buffer
-        else if (buffer.readPosition > static_cast<UINT32>(48000 * m_format.nBlockAlign)) { // Keep last second
+        else if (buffer.readPosition > static_cast<uint32_t>(48000 * m_format.blockAlign)) { // Keep last second
             buffer.data.erase(buffer.data.begin(), buffer.data.begin() + buffer.readPosition);
+            while (buffer.spans.front().end <= buffer.readPosition) {
+                buffer.spans.pop_front();
+            }
+            for (Span& span : buffer.spans) {
+                span.end -= buffer.readPosition;
+            }
             buffer.readPosition = 0;
         }
 
@@ -123,23 +179,23 @@ bool AudioMixer::GetMixedAudio(std::vector<BYTE>& outBuffer) {
     return true;
 }
 
-void AudioMixer::MixSamples(const std::vector<const BYTE*>& sources, BYTE* dest, UINT32 frameCount) {
+void AudioMixer::MixSamples(const std::vector<const uint8_t*>& sources, uint8_t* dest, uint32_t frameCount) {
     if (sources.empty() || !dest) {
         return;
     }
 
-    UINT32 channels = m_format.nChannels;
-    UINT32 bitsPerSample = m_format.wBitsPerSample;
+    uint32_t channels = m_format.channels;
+    uint32_t bitsPerSample = m_format.bitsPerSample;
 
     if (bitsPerSample == 16) {
         // 16-bit PCM mixing
         int16_t* destSamples = reinterpret_cast<int16_t*>(dest);
-        UINT32 sampleCount = frameCount * channels;
+        uint32_t sampleCount = frameCount * channels;
 
-        for (UINT32 i = 0; i < sampleCount; i++) {
+        for (uint32_t i = 0; i < sampleCount; i++) {
             int32_t sum = 0;
 
-            for (const BYTE* source : sources) {
+            for (const uint8_t* source : sources) {
                 const int16_t* sourceSamples = reinterpret_cast<const int16_t*>(source);
                 sum += sourceSamples[i];
             }
@@ -154,12 +210,12 @@ void AudioMixer::MixSamples(const std::vector<const BYTE*>& sources, BYTE* dest,
     else if (bitsPerSample == 32) {
         // 32-bit float mixing
         float* destSamples = reinterpret_cast<float*>(dest);
-        UINT32 sampleCount = frameCount * channels;
+        uint32_t sampleCount = frameCount * channels;
 
-        for (UINT32 i = 0; i < sampleCount; i++) {
+        for (uint32_t i = 0; i < sampleCount; i++) {
             float sum = 0.0f;
 
-            for (const BYTE* source : sources) {
+            for (const uint8_t* source : sources) {
                 const float* sourceSamples = reinterpret_cast<const float*>(source);
                 sum += sourceSamples[i];
             }
@@ -178,41 +234,41 @@ void AudioMixer::Clear() {
     m_buffers.clear();
 }
 
-std::vector<BYTE> AudioMixer::ResampleAudio(const BYTE* data, UINT32 size, const WAVEFORMATEX* sourceFormat) {
+std::vector<uint8_t> AudioMixer::ResampleAudio(const uint8_t* data, uint32_t size, const SampleFormat& sourceFormat) {
     // Calculate number of frames in source data
-    UINT32 sourceBytesPerFrame = sourceFormat->nBlockAlign;
-    UINT32 sourceFrameCount = size / sourceBytesPerFrame;
+    uint32_t sourceBytesPerFrame = sourceFormat.blockAlign;
+    uint32_t sourceFrameCount = size / sourceBytesPerFrame;
 
     // Calculate target frame count based on sample rate ratio
-    double ratio = (double)m_format.nSamplesPerSec / (double)sourceFormat->nSamplesPerSec;
-    UINT32 targetFrameCount = (UINT32)(sourceFrameCount * ratio);
+    double ratio = (double)m_format.sampleRate / (double)sourceFormat.sampleRate;
+    uint32_t targetFrameCount = (uint32_t)(sourceFrameCount * ratio);
 
     // Calculate target buffer size
-    UINT32 targetBytesPerFrame = m_format.nBlockAlign;
-    UINT32 targetSize = targetFrameCount * targetBytesPerFrame;
+    uint32_t targetBytesPerFrame = m_format.blockAlign;
+    uint32_t targetSize = targetFrameCount * targetBytesPerFrame;
 
-    std::vector<BYTE> resampledData(targetSize);
+    std::vector<uint8_t> resampledData(targetSize);
 
     // Only support 32-bit float for now (most common for WASAPI)
-    if (sourceFormat->wBitsPerSample == 32 && m_format.wBitsPerSample == 32) {
+    if (sourceFormat.bitsPerSample == 32 && m_format.bitsPerSample == 32) {
         const float* sourceSamples = reinterpret_cast<const float*>(data);
         float* targetSamples = reinterpret_cast<float*>(resampledData.data());
 
-        UINT32 sourceChannels = sourceFormat->nChannels;
-        UINT32 targetChannels = m_format.nChannels;
+        uint32_t sourceChannels = sourceFormat.channels;
+        uint32_t targetChannels = m_format.channels;
 
         // Linear interpolation resampling
-        for (UINT32 targetFrame = 0; targetFrame < targetFrameCount; targetFrame++) {
+        for (uint32_t targetFrame = 0; targetFrame < targetFrameCount; targetFrame++) {
             // Calculate source position (floating point)
             double sourcePos = (double)targetFrame / ratio;
-            UINT32 sourceFrameLow = (UINT32)sourcePos;
-            UINT32 sourceFrameHigh = std::min(sourceFrameLow + 1, sourceFrameCount - 1);
+            uint32_t sourceFrameLow = (uint32_t)sourcePos;
+            uint32_t sourceFrameHigh = std::min(sourceFrameLow + 1, sourceFrameCount - 1);
             float frac = (float)(sourcePos - sourceFrameLow);
 
             // Interpolate each channel
-            for (UINT32 ch = 0; ch < targetChannels; ch++) {
+            for (uint32_t ch = 0; ch < targetChannels; ch++) {
                 // Handle channel count mismatch
-                UINT32 sourceCh = (ch < sourceChannels) ? ch : (sourceChannels - 1);
+                uint32_t sourceCh = (ch < sourceChannels) ? ch : (sourceChannels - 1);
 
                 float sampleLow = sourceSamples[sourceFrameLow * sourceChannels + sourceCh];
                 float sampleHigh = sourceSamples[sourceFrameHigh * sourceChannels + sourceCh];
@@ -222,22 +278,22 @@ std::vector<BYTE> AudioMixer::ResampleAudio(const BYTE* data, UINT32 size, const
             }
         }
     }
-    else if (sourceFormat->wBitsPerSample == 16 && m_format.wBitsPerSample == 16) {
+    else if (sourceFormat.bitsPerSample == 16 && m_format.bitsPerSample == 16) {
         // 16-bit PCM resampling
         const int16_t* sourceSamples = reinterpret_cast<const int16_t*>(data);
         int16_t* targetSamples = reinterpret_cast<int16_t*>(resampledData.data());
 
-        UINT32 sourceChannels = sourceFormat->nChannels;
-        UINT32 targetChannels = m_format.nChannels;
+        uint32_t sourceChannels = sourceFormat.channels;
+        uint32_t targetChannels = m_format.channels;
 
-        for (UINT32 targetFrame = 0; targetFrame < targetFrameCount; targetFrame++) {
+        for (uint32_t targetFrame = 0; targetFrame < targetFrameCount; targetFrame++) {
             double sourcePos = (double)targetFrame / ratio;
-            UINT32 sourceFrameLow = (UINT32)sourcePos;
-            UINT32 sourceFrameHigh = std::min(sourceFrameLow + 1, sourceFrameCount - 1);
+            uint32_t sourceFrameLow = (uint32_t)sourcePos;
+            uint32_t sourceFrameHigh = std::min(sourceFrameLow + 1, sourceFrameCount - 1);
             float frac = (float)(sourcePos - sourceFrameLow);
 
-            for (UINT32 ch = 0; ch < targetChannels; ch++) {
-                UINT32 sourceCh = (ch < sourceChannels) ? ch : (sourceChannels - 1);
+            for (uint32_t ch = 0; ch < targetChannels; ch++) {
+                uint32_t sourceCh = (ch < sourceChannels) ? ch : (sourceChannels - 1);
 
                 int16_t sampleLow = sourceSamples[sourceFrameLow * sourceChannels + sourceCh];
                 int16_t sampleHigh = sourceSamples[sourceFrameHigh * sourceChannels + sourceCh];
@@ -0,0 +1,446 @@
+#include "BufferedFileWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr size_t kBufferAlignment = 4096;  // Page aligned so blocks suit unbuffered I/O too
+constexpr UINT32 kDefaultSectorSize = 4096;
+constexpr UINT32 kHeadSize = 4096;         // Direct mode: patchable range at the start of the file
+
+UINT32 RoundUpToSector(UINT32 size, UINT32 sector) {
+    return (size + sector - 1) / sector * sector;
+}
+
+// About one second of data per block, in whole multiples of the smallest block
+size_t BlockSizeFor(UINT32 bytesPerSecond) {
+    const size_t minSize = BufferedFileWriter::MIN_BUFFER_SIZE;
+    if (bytesPerSecond == 0) {
+        return BufferedFileWriter::MAX_BUFFER_SIZE;
+    }
+    size_t size = (static_cast<size_t>(bytesPerSecond) + minSize - 1) / minSize * minSize;
+    return std::min(size, BufferedFileWriter::MAX_BUFFER_SIZE);
+}
+
+} // namespace
+
+BufferedFileWriter::BufferedFileWriter(const FileSinkOptions& options)
+    : m_handle(INVALID_HANDLE_VALUE)
+    , m_directIo(options.mode == FileSinkMode::Direct)
+    , m_bufferSize(BlockSizeFor(options.bytesPerSecond))
+    , m_maxLatencyMs(options.maxLatencyMs)
+    , m_sectorSize(kDefaultSectorSize)
+    , m_headBlock(nullptr)
+    , m_syncMode(options.syncMode)
+    , m_syncIntervalMs(options.syncIntervalMs)
+    , m_lastSyncTime(0)
+    , m_writeInProgress(false)
+    , m_syncPending(false)
+    , m_current(nullptr)
+    , m_currentFill(0)
+    , m_currentWritten(0)
+    , m_currentStartTime(0)
+    , m_currentOffset(0)
+    , m_position(0)
+    , m_failed(false)
+{
+}
+
+BufferedFileWriter::~BufferedFileWriter() {
+    Close();
+    FreeBuffers();
+}
+
+bool BufferedFileWriter::Open(const std::wstring& filename) {
+    if (IsOpen()) {
+        return false;
+    }
+
+    // Blocks are allocated by AcquireBuffer as needed and reused across files
+    if (m_directIo && !m_headBlock) {
+        m_headBlock = static_cast<BYTE*>(_aligned_malloc(kHeadSize, kBufferAlignment));
+        if (!m_headBlock) {
+            return false;
+        }
+    }
+
+    DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_OVERLAPPED;
+    if (m_directIo) {
+        flags |= FILE_FLAG_NO_BUFFERING;
+    }
+
+    m_handle = CreateFileW(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           CREATE_ALWAYS, flags, nullptr);
+    if (m_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    // Writes are issued and completed by the shared I/O service
+    if (!IoService::Instance().Register(m_handle)) {
+        CloseHandle(m_handle);
+        m_handle = INVALID_HANDLE_VALUE;
+        return false;
+    }
+
+    if (m_directIo) {
+        // Unbuffered writes must be multiples of the volume's sector size. Blocks are
+        // page aligned, so sectors up to a page are supported.
+        FILE_STORAGE_INFO storage = {};
+        m_sectorSize = kDefaultSectorSize;
+        if (GetFileInformationByHandleEx(m_handle, FileStorageInfo, &storage, sizeof(storage)) &&
+            storage.PhysicalBytesPerSectorForPerformance != 0 &&
+            storage.PhysicalBytesPerSectorForPerformance <= kBufferAlignment) {
+            m_sectorSize = storage.PhysicalBytesPerSectorForPerformance;
+        }
+        std::memset(m_headBlock, 0, kHeadSize);
+    }
+
+    m_freeBuffers.assign(m_allBuffers.begin(), m_allBuffers.end());
+    m_queue.clear();
+    m_current = nullptr;
+    m_currentFill = 0;
+    m_currentOffset = 0;
+    m_position = 0;
+    m_failed = false;
+    m_writeInProgress = false;
+    m_syncPending = false;
+    m_syncStats = FileSyncStats();
+    m_lastSyncTime = GetTickCount64();
+    return true;
+}
+
+bool BufferedFileWriter::Write(const void* data, size_t size) {
+    if (!IsOpen() || m_failed) {
+        return false;
+    }
+
+    const BYTE* src = static_cast<const BYTE*>(data);
+    while (size > 0) {
+        if (!m_current && !AcquireBuffer()) {
+            return false;
+        }
+
+        size_t chunk = std::min(size, m_bufferSize - m_currentFill);
+        std::memcpy(m_current + m_currentFill, src, chunk);
+        m_currentFill += chunk;
+        m_position += chunk;
+        src += chunk;
+        size -= chunk;
+
+        if (m_currentFill == m_bufferSize && !SubmitCurrentBuffer()) {
+            return false;
+        }
+    }
+
+    // Don't let a slow stream sit in a block that takes minutes to fill
+    if (m_maxLatencyMs > 0 && m_current && GetTickCount64() - m_currentStartTime >= m_maxLatencyMs) {
+        FlushAsync();
+    }
+
+    if (m_syncMode == FileSyncMode::Periodic) {
+        SyncIfDue();
+    }
+    return true;
+}
+
+bool BufferedFileWriter::WriteAt(UINT64 offset, const void* data, UINT32 size) {
+    if (!IsOpen() || m_failed || size > MAX_PATCH_SIZE) {
+        return false;
+    }
+
+    // Patches inside the block still being filled are applied in place. In direct mode a
+    // patch to sectors a partial write already covered makes the next write include them.
+    if (m_current && offset >= m_currentOffset && offset + size <= m_currentOffset + m_currentFill) {
+        std::memcpy(m_current + (offset - m_currentOffset), data, size);
+        m_currentWritten = std::min(m_currentWritten, static_cast<size_t>(offset - m_currentOffset));
+        return true;
+    }
+
+    // Direct mode can only patch the retained first page
+    if (m_directIo && offset + size > kHeadSize) {
+        return false;
+    }
+
+    PendingWrite patch;
+    patch.size = size;
+    patch.offset = offset;
+    std::memcpy(patch.patch, data, size);
+    Enqueue(patch);
+    return true;
+}
+
+bool BufferedFileWriter::Flush() {
+    if (!IsOpen()) {
+        return false;
+    }
+
+    FlushAsync();
+    return WaitForWrites();
+}
+
+bool BufferedFileWriter::FlushAsync() {
+    if (!IsOpen()) {
+        return false;
+    }
+
+    if (m_current && m_currentFill > m_currentWritten) {
+        if (m_directIo) {
+            QueuePartialBlock();
+        } else {
+            SubmitCurrentBuffer();
+        }
+    }
+    return !m_failed;
+}
+
+void BufferedFileWriter::Close() {
+    if (!IsOpen()) {
+        return;
+    }
+
+    // Waits for the last completion, so no request refers to this file afterwards
+    Flush();
+
+    // Return the unused block, if any, to the pool
+    if (m_current) {
+        m_freeBuffers.push_back(m_current);
+        m_current = nullptr;
+    }
+
+    // Direct writes end on a sector boundary; cut the padding off
+    if (m_directIo) {
+        FILE_END_OF_FILE_INFO endOfFile = {};
+        endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(m_position);
+        SetFileInformationByHandle(m_handle, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile));
+    }
+
+    // The end of a file is a segment boundary for both sync policies
+    if (m_syncMode != FileSyncMode::None) {
+        QueueSync();
+        WaitForWrites();
+    }
+
+    IoService::Instance().Unregister(m_handle);
+    CloseHandle(m_handle);
+    m_handle = INVALID_HANDLE_VALUE;
+}
+
+FileSyncStats BufferedFileWriter::GetSyncStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_syncStats;
+}
+
+void BufferedFileWriter::SyncIfDue() {
+    ULONGLONG now = GetTickCount64();
+    if (now - m_lastSyncTime < m_syncIntervalMs) {
+        return;
+    }
+
+    // Don't stack syncs behind a slow one; try again on the next write
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_syncPending) {
+            return;
+        }
+    }
+    m_lastSyncTime = now;
+
+    // Hand off the partial block so the sync covers everything written so far
+    FlushAsync();
+    QueueSync();
+}
+
+void BufferedFileWriter::QueueSync() {
+    PendingWrite sync;
+    sync.sync = true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_syncPending = true;
+    }
+    Enqueue(sync);
+}
+
+bool BufferedFileWriter::WaitForWrites() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCondition.wait(lock, [this] { return m_queue.empty() && !m_writeInProgress; });
+    return !m_failed;
+}
+
+bool BufferedFileWriter::AcquireBuffer() {
+    m_current = TakeFreeBuffer();
+    if (!m_current) {
+        return false;
+    }
+
+    m_currentFill = 0;
+    m_currentWritten = 0;
+    m_currentOffset = m_position;
+    m_currentStartTime = GetTickCount64();
+    return true;
+}
+
+BYTE* BufferedFileWriter::TakeFreeBuffer() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // Grow the pool up to BUFFER_COUNT before waiting for a block to come back
+    if (m_freeBuffers.empty() && m_allBuffers.size() < static_cast<size_t>(BUFFER_COUNT)) {
+        BYTE* buffer = static_cast<BYTE*>(_aligned_malloc(m_bufferSize, kBufferAlignment));
+        if (buffer) {
+            m_allBuffers.push_back(buffer);
+            m_freeBuffers.push_back(buffer);
+        }
+    }
+
+    // Only blocks when the disk has fallen a full pool behind the caller
+    m_doneCondition.wait(lock, [this] { return !m_freeBuffers.empty() || m_failed || m_allBuffers.empty(); });
+    if (m_failed || m_freeBuffers.empty()) {
+        return nullptr;
+    }
+
+    BYTE* buffer = m_freeBuffers.back();
+    m_freeBuffers.pop_back();
+    return buffer;
+}
+
+bool BufferedFileWriter::SubmitCurrentBuffer() {
+    PendingWrite block;
+    block.buffer = m_current;
+    block.start = static_cast<UINT32>(m_currentWritten / m_sectorSize * m_sectorSize);
+    block.size = static_cast<UINT32>(m_currentFill);
+    block.offset = m_currentOffset;
+    Enqueue(block);
+
+    m_current = nullptr;
+    m_currentFill = 0;
+    m_currentWritten = 0;
+    return !m_failed;
+}
+
+void BufferedFileWriter::QueuePartialBlock() {
+    // Direct mode: write the partial block padded to whole sectors but keep filling it.
+    // The kernel reads an unbuffered write straight from its buffer, so the sectors not
+    // yet on disk are written from a copy and the block itself is never in flight while
+    // the caller appends to it. The padding is overwritten when the block is written
+    // again, and that write starts at the sector holding the current end.
+    BYTE* copy = TakeFreeBuffer();
+    if (!copy) {
+        return;
+    }
+
+    size_t start = m_currentWritten / m_sectorSize * m_sectorSize;
+    size_t padded = RoundUpToSector(static_cast<UINT32>(m_currentFill), m_sectorSize);
+    std::memcpy(copy, m_current + start, m_currentFill - start);
+    std::memset(copy + (m_currentFill - start), 0, padded - m_currentFill);
+
+    PendingWrite block;
+    block.buffer = copy;
+    block.size = static_cast<UINT32>(m_currentFill - start);
+    block.offset = m_currentOffset + start;
+    Enqueue(block);
+
+    m_currentWritten = m_currentFill;
+    m_currentStartTime = GetTickCount64();
+}
+
+void BufferedFileWriter::Enqueue(const PendingWrite& op) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(op);
+    if (!m_writeInProgress) {
+        StartNextWrite();
+    }
+}
+
+void BufferedFileWriter::StartNextWrite() {
+    // Called with m_mutex held and no write in flight
+    if (m_failed) {
+        // Nothing more reaches the file; just hand the blocks back
+        for (const PendingWrite& op : m_queue) {
+            if (op.buffer) {
+                m_freeBuffers.push_back(op.buffer);
+            }
+            if (op.sync) {
+                m_syncPending = false;
+            }
+        }
+        m_queue.clear();
+    }
+
+    if (m_queue.empty()) {
+        m_writeInProgress = false;
+        m_doneCondition.notify_all();
+        return;
+    }
+
+    m_inFlight = m_queue.front();
+    m_queue.pop_front();
+    m_writeInProgress = true;
+
+    m_request.type = m_inFlight.sync ? IoRequestType::Sync : IoRequestType::Write;
+    m_request.file = m_handle;
+    m_request.transferred = 0;
+    m_request.handler = this;
+    m_request.syncMicros = 0;
+
+    if (m_inFlight.sync) {
+        m_request.data = nullptr;
+        m_request.size = 0;
+        m_request.offset = 0;
+    } else if (!m_directIo) {
+        m_request.data = m_inFlight.buffer ? m_inFlight.buffer : m_inFlight.patch;
+        m_request.size = m_inFlight.size;
+        m_request.offset = m_inFlight.offset;
+    } else if (!m_inFlight.buffer) {
+        // Header patch: update the retained first page and rewrite it whole
+        std::memcpy(m_headBlock + m_inFlight.offset, m_inFlight.patch, m_inFlight.size);
+        m_request.data = m_headBlock;
+        m_request.size = RoundUpToSector(kHeadSize, m_sectorSize);
+        m_request.offset = 0;
+    } else {
+        // Sectors an earlier partial write of this block already covered are skipped
+        UINT64 offset = m_inFlight.offset + m_inFlight.start;
+        const BYTE* data = m_inFlight.buffer + m_inFlight.start;
+
+        // Keep the first page's current contents for later patches
+        if (offset < kHeadSize) {
+            UINT32 headBytes = static_cast<UINT32>(std::min<UINT64>(m_inFlight.size - m_inFlight.start, kHeadSize - offset));
+            std::memcpy(m_headBlock + offset, data, headBytes);
+        }
+
+        // Blocks start on sector boundaries; the tail of a short block is padding that
+        // a later write or the final trim replaces
+        m_request.data = data;
+        m_request.size = RoundUpToSector(m_inFlight.size, m_sectorSize) - m_inFlight.start;
+        m_request.offset = offset;
+    }
+
+    IoService::Instance().Submit(&m_request);
+}
+
+void BufferedFileWriter::OnIoComplete(IoRequest* request, bool success) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!success) {
+        m_failed = true;
+    }
+    if (m_inFlight.sync) {
+        m_syncStats.Record(request->syncMicros, success);
+        m_syncPending = false;
+    }
+    if (m_inFlight.buffer) {
+        m_freeBuffers.push_back(m_inFlight.buffer);
+    }
+    m_doneCondition.notify_all();
+    StartNextWrite();
+}
+
+void BufferedFileWriter::FreeBuffers() {
+    for (BYTE* buffer : m_allBuffers) {
+        _aligned_free(buffer);
+    }
+    m_allBuffers.clear();
+    m_freeBuffers.clear();
+
+    if (m_headBlock) {
+        _aligned_free(m_headBlock);
+        m_headBlock = nullptr;
+    }
+}
@@ -0,0 +1,274 @@
+#include "CaptureJournal.h"
+#include "OggPageWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char kFileMagic[4] = { 'A', 'C', 'J', '1' };
+const char kChunkMagic[4] = { 'A', 'C', 'J', 'C' };
+
+// Bounds that reject a damaged chunk header before it drives a huge allocation
+constexpr UINT32 kMaxFormatSize = 1024;
+constexpr UINT32 kMaxPayloadSize = 64 * 1024 * 1024;
+
+UINT64 CurrentFileTime() {
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    return (static_cast<UINT64>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+}
+
+// Same CRC-32 as Ogg pages; the chunk is checked with its crc field zeroed
+UINT32 ChunkCrc(const JournalChunkHeader& header, const BYTE* format, const BYTE* payload) {
+    JournalChunkHeader copy = header;
+    copy.crc = 0;
+    UINT32 crc = OggPageWriter::Crc(reinterpret_cast<const uint8_t*>(&copy), sizeof(copy));
+    crc = OggPageWriter::Crc(format, header.formatSize, crc);
+    return OggPageWriter::Crc(payload, header.payloadSize, crc);
+}
+
+} // namespace
+
+CaptureJournalWriter::CaptureJournalWriter()
+    : m_payloadOffset(0)
+    , m_payloadFill(0)
+    , m_payloadCapacity(0)
+    , m_blockAlign(0)
+    , m_samplePosition(0)
+{
+}
+
+CaptureJournalWriter::~CaptureJournalWriter() {
+    Close();
+}
+
+bool CaptureJournalWriter::Open(const std::wstring& filename, const WAVEFORMATEX* format,
+                                UINT32 targetFormat, UINT32 bitrate, const OpusEncoderConfig& opusConfig) {
+    if (IsOpen() || !format || format->nBlockAlign == 0) {
+        return false;
+    }
+
+    // Build the chunk template once: header, then the format every chunk repeats
+    UINT32 formatSize = sizeof(WAVEFORMATEX) + (format->wFormatTag != WAVE_FORMAT_PCM ? format->cbSize : 0);
+    m_blockAlign = format->nBlockAlign;
+    m_payloadCapacity = static_cast<size_t>(format->nSamplesPerSec) * CHUNK_MILLISECONDS / 1000 * m_blockAlign;
+    m_payloadCapacity = std::max<size_t>(m_payloadCapacity, m_blockAlign);
+    m_payloadOffset = sizeof(JournalChunkHeader) + formatSize;
+    m_chunk.assign(m_payloadOffset + m_payloadCapacity, 0);
+
+    JournalChunkHeader* chunk = reinterpret_cast<JournalChunkHeader*>(m_chunk.data());
+    std::memcpy(chunk->magic, kChunkMagic, sizeof(kChunkMagic));
+    chunk->formatSize = formatSize;
+    std::memcpy(m_chunk.data() + sizeof(JournalChunkHeader), format, formatSize);
+
+    m_file = FileSink::Create(m_sinkOptions);
+    if (!m_file->Open(filename)) {
+        return false;
+    }
+
+    JournalFileHeader header = {};
+    std::memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+    header.headerSize = sizeof(JournalFileHeader);
+    header.targetFormat = targetFormat;
+    header.bitrate = bitrate;
+    header.opusBitrate = opusConfig.bitrate;
+    header.opusFrameTenthsMs = static_cast<UINT32>(opusConfig.frameDurationMs * 10.0f + 0.5f);
+    header.opusApplication = opusConfig.application;
+    header.opusComplexity = opusConfig.complexity;
+    header.opusSignal = opusConfig.signal;
+    header.opusMaxBandwidth = opusConfig.maxBandwidth;
+    header.opusVbr = opusConfig.vbr ? 1 : 0;
+    header.opusDtx = opusConfig.dtx ? 1 : 0;
+    header.opusDownmixToMono = opusConfig.downmixToMono ? 1 : 0;
+
+    m_payloadFill = 0;
+    m_samplePosition = 0;
+    return m_file->Write(&header, sizeof(header));
+}
+
+bool CaptureJournalWriter::WriteData(const BYTE* data, UINT32 size) {
+    if (!IsOpen()) {
+        return false;
+    }
+
+    while (size > 0) {
+        if (m_payloadFill == 0) {
+            reinterpret_cast<JournalChunkHeader*>(m_chunk.data())->timestamp = CurrentFileTime();
+        }
+
+        size_t chunk = std::min<size_t>(size, m_payloadCapacity - m_payloadFill);
+        std::memcpy(m_chunk.data() + m_payloadOffset + m_payloadFill, data, chunk);
+        m_payloadFill += chunk;
+        data += chunk;
+        size -= static_cast<UINT32>(chunk);
+
+        if (m_payloadFill == m_payloadCapacity && !WriteChunk()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CaptureJournalWriter::Close() {
+    if (!IsOpen()) {
+        return;
+    }
+
+    if (m_payloadFill > 0) {
+        WriteChunk();
+    }
+    m_file->Close();
+}
+
+bool CaptureJournalWriter::WriteChunk() {
+    // Only whole frames go into a chunk; a split frame's tail starts the next one
+    size_t payloadSize = m_payloadFill - m_payloadFill % m_blockAlign;
+    size_t leftover = m_payloadFill - payloadSize;
+
+    JournalChunkHeader* chunk = reinterpret_cast<JournalChunkHeader*>(m_chunk.data());
+    chunk->payloadSize = static_cast<UINT32>(payloadSize);
+    chunk->samplePosition = m_samplePosition;
+    chunk->crc = ChunkCrc(*chunk, m_chunk.data() + sizeof(JournalChunkHeader), m_chunk.data() + m_payloadOffset);
+
+    // Hand each chunk to the disk right away, so a crash loses at most the chunk being filled
+    bool success = payloadSize == 0 ||
+        (m_file->Write(m_chunk.data(), m_payloadOffset + payloadSize) && m_file->FlushAsync());
+
+    m_samplePosition += payloadSize / m_blockAlign;
+    if (leftover > 0) {
+        std::memmove(m_chunk.data() + m_payloadOffset, m_chunk.data() + m_payloadOffset + payloadSize, leftover);
+    }
+    m_payloadFill = leftover;
+
+    // A split frame starts the next chunk now; otherwise the next data to arrive does
+    if (leftover > 0) {
+        reinterpret_cast<JournalChunkHeader*>(m_chunk.data())->timestamp = CurrentFileTime();
+    }
+    return success;
+}
+
+CaptureJournalReader::CaptureJournalReader()
+    : m_handle(INVALID_HANDLE_VALUE)
+    , m_offset(0)
+    , m_fileSize(0)
+    , m_largestChunk(0)
+    , m_header()
+{
+}
+
+CaptureJournalReader::~CaptureJournalReader() {
+    Close();
+}
+
+bool CaptureJournalReader::Open(const std::wstring& filename) {
+    Close();
+
+    m_handle = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_handle, &fileSize)) {
+        Close();
+        return false;
+    }
+    m_fileSize = static_cast<UINT64>(fileSize.QuadPart);
+    m_largestChunk = 0;
+
+    m_offset = 0;
+    if (!Read(&m_header, sizeof(m_header)) ||
+        std::memcmp(m_header.magic, kFileMagic, sizeof(kFileMagic)) != 0 ||
+        m_header.headerSize < sizeof(JournalFileHeader)) {
+        Close();
+        return false;
+    }
+
+    // Later versions may append settings to the header
+    m_offset = m_header.headerSize;
+    return true;
+}
+
+void CaptureJournalReader::Close() {
+    if (m_handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_handle);
+        m_handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+JournalChunkStatus CaptureJournalReader::ReadChunk(JournalChunkHeader& chunk, std::vector<BYTE>& format,
+                                                   std::vector<BYTE>& payload) {
+    if (m_handle == INVALID_HANDLE_VALUE || m_offset >= m_fileSize) {
+        return JournalChunkStatus::End;
+    }
+
+    UINT64 chunkOffset = m_offset;
+    if (!Read(&chunk, sizeof(chunk))) {
+        return Damaged(chunkOffset, sizeof(chunk));
+    }
+
+    if (std::memcmp(chunk.magic, kChunkMagic, sizeof(kChunkMagic)) != 0 ||
+        chunk.formatSize < sizeof(WAVEFORMATEX) || chunk.formatSize > kMaxFormatSize ||
+        chunk.payloadSize > kMaxPayloadSize) {
+        return Damaged(chunkOffset, 0);
+    }
+
+    UINT64 chunkSize = sizeof(chunk) + static_cast<UINT64>(chunk.formatSize) + chunk.payloadSize;
+    format.resize(chunk.formatSize);
+    payload.resize(chunk.payloadSize);
+    if (!Read(format.data(), chunk.formatSize) || !Read(payload.data(), chunk.payloadSize) ||
+        ChunkCrc(chunk, format.data(), payload.data()) != chunk.crc) {
+        return Damaged(chunkOffset, chunkSize);
+    }
+
+    m_largestChunk = std::max(m_largestChunk, chunkSize);
+    return JournalChunkStatus::Chunk;
+}
+
+JournalChunkStatus CaptureJournalReader::Damaged(UINT64 chunkOffset, UINT64 declaredSize) {
+    // A crash can only damage the tail: the last chunk's own extent, at most one chunk's
+    // worth of partly written data, or zeros from preallocation and sector padding
+    UINT64 remaining = m_fileSize - chunkOffset;
+    if ((declaredSize > 0 && declaredSize >= remaining) ||
+        (m_largestChunk > 0 && remaining <= m_largestChunk) ||
+        IsZeroFrom(chunkOffset)) {
+        return JournalChunkStatus::Torn;
+    }
+    return JournalChunkStatus::Corrupt;
+}
+
+bool CaptureJournalReader::IsZeroFrom(UINT64 offset) {
+    m_offset = offset;
+    std::vector<BYTE> block(64 * 1024);
+    while (m_offset < m_fileSize) {
+        UINT32 size = static_cast<UINT32>(std::min<UINT64>(block.size(), m_fileSize - m_offset));
+        if (!Read(block.data(), size)) {
+            return false;
+        }
+        if (std::any_of(block.begin(), block.begin() + size, [](BYTE value) { return value != 0; })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CaptureJournalReader::Read(void* data, UINT32 size) {
+    BYTE* dest = static_cast<BYTE*>(data);
+    while (size > 0) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(m_offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(m_offset >> 32);
+
+        DWORD read = 0;
+        if (!ReadFile(m_handle, dest, size, &read, &overlapped) || read == 0) {
+            return false;
+        }
+
+        dest += read;
+        size -= read;
+        m_offset += read;
+    }
+    return true;
+}
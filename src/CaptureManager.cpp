@@ -1,21 +1,52 @@
 #include "CaptureManager.h"
+#include "Transcoder.h"
+#include "WavWriter.h"
+#include <objbase.h>
 #include <algorithm>
 #include <chrono>
 
+namespace {
+
+// Default Opus bitrates when the caller doesn't choose one. Speech stays transparent at
+// 32 kbps; music-oriented bitrates are wasted on it.
+const UINT32 kMusicDefaultBitrate = 128000;
+const UINT32 kVoiceDefaultBitrate = 32000;
+
+// Audio kept while a deferred open runs; anything past this is only counted, and
+// recorded as silence once the outputs are open so the timeline keeps its length
+const UINT32 kMaxHeldMs = 5000;
+
+} // namespace
+
 CaptureManager::CaptureManager()
-    : m_mixedRecordingEnabled(false), m_mixerThreadRunning(false) {
+    : m_deferEncoding(false), m_downmixToMono(false), m_mixedRecordingEnabled(false), m_mixerThreadRunning(false) {
 }
 
 CaptureManager::~CaptureManager() {
     DisableMixedRecording();
     StopAllCaptures();
+    if (m_recoveryThread.joinable()) {
+        m_recoveryThread.join();
+    }
 }
 
 bool CaptureManager::StartCapture(DWORD processId, const std::wstring& processName,
                                   const std::wstring& outputPath, AudioFormat format,
                                   UINT32 bitrate, bool skipSilence,
                                   const std::wstring& passthroughDeviceId,
-                                  bool monitorOnly) {
+                                  bool monitorOnly, EncodingProfile profile) {
+    RecordingTarget target;
+    target.outputPath = outputPath;
+    target.format = format;
+    target.bitrate = bitrate;
+    return StartCapture(processId, processName, std::vector<RecordingTarget>(1, target),
+                        skipSilence, passthroughDeviceId, monitorOnly, profile);
+}
+
+bool CaptureManager::StartCapture(DWORD processId, const std::wstring& processName,
+                                  const std::vector<RecordingTarget>& targets,
+                                  bool skipSilence, const std::wstring& passthroughDeviceId,
+                                  bool monitorOnly, EncodingProfile profile) {
     std::lock_guard<std::mutex> lock(m_mutex);
 
     // Check if already capturing this process
@@ -27,8 +58,9 @@ bool CaptureManager::StartCapture(DWORD processId, const std::wstring& processNa
     auto session = std::make_unique<CaptureSession>();
     session->processId = processId;
     session->processName = processName;
-    session->outputFile = outputPath;
-    session->format = format;
+    session->outputFile = targets.empty() ? std::wstring() : targets[0].outputPath;
+    session->format = targets.empty() ? AudioFormat::WAV : targets[0].format;
+    session->profile = profile;
     session->isActive = false;
     session->bytesWritten = 0;
     session->skipSilence = skipSilence;
@@ -48,47 +80,22 @@ bool CaptureManager::StartCapture(DWORD processId, const std::wstring& processNa
         }
     }
 
-    // Create appropriate encoder (skip if monitor-only mode)
-    const WAVEFORMATEX* waveFormat = session->capture->GetFormat();
-    bool encoderReady = monitorOnly; // If monitor-only, skip encoder setup
-
-    if (!monitorOnly) {
-        switch (format) {
-        case AudioFormat::WAV:
-            session->wavWriter = std::make_unique<WavWriter>();
-            encoderReady = session->wavWriter->Open(outputPath, waveFormat);
-            break;
-
-        case AudioFormat::MP3:
-            session->mp3Encoder = std::make_unique<Mp3Encoder>();
-            // Use provided bitrate or default to 192000 (192 kbps)
-            encoderReady = session->mp3Encoder->Open(outputPath, waveFormat,
-                                                      bitrate > 0 ? bitrate : 192000);
-            break;
-
-        case AudioFormat::OPUS:
-            session->opusEncoder = std::make_unique<OpusOggEncoder>();
-            // Use provided bitrate or default to 128000 (128 kbps)
-            encoderReady = session->opusEncoder->Open(outputPath, waveFormat,
-                                                       bitrate > 0 ? bitrate : 128000);
-            break;
-
-        case AudioFormat::FLAC:
-            session->flacEncoder = std::make_unique<FlacEncoder>();
-            // Use bitrate as compression level (0-8), default to 5
-            encoderReady = session->flacEncoder->Open(outputPath, waveFormat,
-                                                       bitrate > 0 ? std::min(bitrate, 8u) : 5);
-            break;
-        }
-
-        if (!encoderReady) {
+    // Create the outputs (skip if monitor-only mode, or until the first audio if deferred)
+    StartIdleDetection(session.get(), targets);
+    if (!monitorOnly && session->deferredTargets.empty()) {
+        if (!OpenOutputs(session.get(), targets)) {
             return false;
         }
+        StartActivation(session.get());
     }
 
+    // Pre-roll runs whether or not the session records
+    StartPreroll(session.get());
+    StartSilenceDetection(session.get());
+
     // Set audio data callback
-    session->capture->SetDataCallback([this, processId](const BYTE* data, UINT32 size) {
-        OnAudioData(processId, data, size);
+    session->capture->SetDataCallback([this, processId](const AudioBlock& block) {
+        OnAudioData(processId, block);
     });
 
     // Start capture
@@ -105,7 +112,22 @@ bool CaptureManager::StartCapture(DWORD processId, const std::wstring& processNa
 bool CaptureManager::StartCaptureFromDevice(DWORD sessionId, const std::wstring& deviceName,
                                             const std::wstring& deviceId, bool isInputDevice,
                                             const std::wstring& outputPath, AudioFormat format,
-                                            UINT32 bitrate, bool skipSilence, bool monitorOnly) {
+                                            UINT32 bitrate, bool skipSilence, bool monitorOnly,
+                                            EncodingProfile profile) {
+    RecordingTarget target;
+    target.outputPath = outputPath;
+    target.format = format;
+    target.bitrate = bitrate;
+    return StartCaptureFromDevice(sessionId, deviceName, deviceId, isInputDevice,
+                                  std::vector<RecordingTarget>(1, target),
+                                  skipSilence, monitorOnly, profile);
+}
+
+bool CaptureManager::StartCaptureFromDevice(DWORD sessionId, const std::wstring& deviceName,
+                                            const std::wstring& deviceId, bool isInputDevice,
+                                            const std::vector<RecordingTarget>& targets,
+                                            bool skipSilence, bool monitorOnly,
+                                            EncodingProfile profile) {
     std::lock_guard<std::mutex> lock(m_mutex);
 
     // Check if already capturing this session
@@ -117,12 +139,13 @@ bool CaptureManager::StartCaptureFromDevice(DWORD sessionId, const std::wstring&
     auto session = std::make_unique<CaptureSession>();
     session->processId = sessionId;
     session->processName = deviceName;
-    session->outputFile = outputPath;
-    session->format = format;
+    session->outputFile = targets.empty() ? std::wstring() : targets[0].outputPath;
+    session->format = targets.empty() ? AudioFormat::WAV : targets[0].format;
     session->isActive = false;
     session->bytesWritten = 0;
     session->skipSilence = skipSilence;
     session->monitorOnly = monitorOnly;
+    session->profile = profile;
 
     // Create audio capture for device
     session->capture = std::make_unique<AudioCapture>();
@@ -130,44 +153,22 @@ bool CaptureManager::StartCaptureFromDevice(DWORD sessionId, const std::wstring&
         return false;
     }
 
-    // Create appropriate encoder (skip if monitor-only mode)
-    const WAVEFORMATEX* waveFormat = session->capture->GetFormat();
-    bool encoderReady = monitorOnly; // If monitor-only, skip encoder setup
-
-    if (!monitorOnly) {
-        switch (format) {
-        case AudioFormat::WAV:
-            session->wavWriter = std::make_unique<WavWriter>();
-            encoderReady = session->wavWriter->Open(outputPath, waveFormat);
-            break;
-
-        case AudioFormat::MP3:
-            session->mp3Encoder = std::make_unique<Mp3Encoder>();
-            encoderReady = session->mp3Encoder->Open(outputPath, waveFormat,
-                                                      bitrate > 0 ? bitrate : 192000);
-            break;
-
-        case AudioFormat::OPUS:
-            session->opusEncoder = std::make_unique<OpusOggEncoder>();
-            encoderReady = session->opusEncoder->Open(outputPath, waveFormat,
-                                                       bitrate > 0 ? bitrate : 128000);
-            break;
-
-        case AudioFormat::FLAC:
-            session->flacEncoder = std::make_unique<FlacEncoder>();
-            encoderReady = session->flacEncoder->Open(outputPath, waveFormat,
-                                                       bitrate > 0 ? std::min(bitrate, 8u) : 5);
-            break;
-        }
-
-        if (!encoderReady) {
+    // Create the outputs (skip if monitor-only mode, or until the first audio if deferred)
+    StartIdleDetection(session.get(), targets);
+    if (!monitorOnly && session->deferredTargets.empty()) {
+        if (!OpenOutputs(session.get(), targets)) {
             return false;
         }
+        StartActivation(session.get());
     }
 
+    // Pre-roll runs whether or not the session records
+    StartPreroll(session.get());
+    StartSilenceDetection(session.get());
+
     // Set audio data callback
-    session->capture->SetDataCallback([this, sessionId](const BYTE* data, UINT32 size) {
-        OnAudioData(sessionId, data, size);
+    session->capture->SetDataCallback([this, sessionId](const AudioBlock& block) {
+        OnAudioData(sessionId, block);
     });
 
     // Start capture
@@ -200,24 +201,316 @@ bool CaptureManager::StopCapture(DWORD processId) {
         session->capture->Stop();
     }
 
-    // Close encoders
-    if (session->wavWriter) {
-        session->wavWriter->Close();
+    // A deferred open still running: wait for it and record what was held for it
+    if (session->openThread.joinable()) {
+        FinishDeferredOpen(session.get(), true);
+    }
+
+    // End an activation in progress and finish its label
+    if (session->gate) {
+        session->gate->Close();
+    }
+    if (session->labels) {
+        session->labels->Close();
     }
-    if (session->mp3Encoder) {
-        session->mp3Encoder->Close();
+    if (session->idle) {
+        session->idle->Close();
     }
-    if (session->opusEncoder) {
-        session->opusEncoder->Close();
+
+    // Close the outputs (waits for segments still being finalized)
+    if (session->outputs) {
+        session->outputs->Close();
     }
-    if (session->flacEncoder) {
-        session->flacEncoder->Close();
+
+    // Waits for pre-roll saves still being written
+    if (session->preroll) {
+        session->preroll->Stop();
     }
 
     // Session will be automatically destroyed when it goes out of scope
     return true;
 }
 
+OpusEncoderConfig CaptureManager::MakeOpusConfig(EncodingProfile profile, UINT32 bitrate) const {
+    OpusEncoderConfig config;
+    config.bitrate = bitrate > 0 ? bitrate : kMusicDefaultBitrate;
+    config.downmixToMono = m_downmixToMono;
+
+    if (profile == EncodingProfile::Voice) {
+        // SILK-oriented voice mode: super-wideband cap, DTX so silence costs almost nothing
+        config.application = OPUS_APPLICATION_VOIP;
+        config.signal = OPUS_SIGNAL_VOICE;
+        config.dtx = true;
+        config.maxBandwidth = OPUS_BANDWIDTH_SUPERWIDEBAND;
+        config.complexity = 5;
+        config.bitrate = bitrate > 0 ? bitrate : kVoiceDefaultBitrate;
+    }
+
+    return config;
+}
+
+RecordingOptions CaptureManager::MakeRecordingOptions(AudioFormat format, UINT32 bitrate, EncodingProfile profile) const {
+    RecordingOptions options;
+    options.format = format;
+    options.bitrate = bitrate;
+    options.opusConfig = MakeOpusConfig(profile, bitrate);
+    options.sinkOptions = m_sinkOptions;
+    options.segments = m_segmentOptions;
+    options.deferEncoding = m_deferEncoding;
+    options.wavTranscode = m_wavTranscode;
+    options.opusLadder = m_opusLadder;
+
+    // Each activation starts a new segment
+    if (m_activationOptions.enabled && m_activationOptions.segmentPerActivation) {
+        options.segments.onDemand = true;
+    }
+    return options;
+}
+
+bool CaptureManager::OpenOutputs(CaptureSession* session, const std::vector<RecordingTarget>& targets) {
+    std::vector<RecordingOptions> options;
+    for (const RecordingTarget& target : targets) {
+        options.push_back(MakeRecordingOptions(target.format, target.bitrate, session->profile));
+    }
+
+    session->outputs = CreateOutputs(session->capture->GetFormat(), targets, options);
+    return session->outputs != nullptr;
+}
+
+std::unique_ptr<RecordingFanout> CaptureManager::CreateOutputs(const WAVEFORMATEX* format,
+                                                               const std::vector<RecordingTarget>& targets,
+                                                               const std::vector<RecordingOptions>& options) {
+    if (targets.empty()) {
+        return nullptr;
+    }
+
+    // Every target shares the one capture; the fan-out converts samples once per representation
+    auto outputs = std::make_unique<RecordingFanout>();
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (!outputs->Add(targets[i].outputPath, format, options[i])) {
+            outputs->Close();
+            return nullptr;
+        }
+    }
+
+    return outputs;
+}
+
+void CaptureManager::StartDeferredOpen(CaptureSession* session) {
+    std::vector<RecordingTarget> targets;
+    targets.swap(session->deferredTargets);
+
+    // Settings are read here, under m_mutex; creating the files and starting the encoders
+    // happens on a thread of its own so the capture thread never waits on it
+    std::vector<RecordingOptions> options;
+    for (const RecordingTarget& target : targets) {
+        options.push_back(MakeRecordingOptions(target.format, target.bitrate, session->profile));
+    }
+
+    session->openFinished = false;
+    session->openThread = std::thread([session, targets, options]() {
+        // The Media Foundation MP3 path needs COM on the thread that opens the file
+        HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+        session->openedOutputs = CreateOutputs(session->capture->GetFormat(), targets, options);
+        if (SUCCEEDED(comResult)) {
+            CoUninitialize();
+        }
+        session->openFinished = true;
+    });
+}
+
+bool CaptureManager::FinishDeferredOpen(CaptureSession* session, bool wait) {
+    if (!wait && !session->openFinished) {
+        return false;
+    }
+    session->openThread.join();
+
+    // The recording starts with the held audio; a failed open leaves the session monitoring only
+    session->outputs = std::move(session->openedOutputs);
+    if (session->outputs) {
+        StartActivation(session);
+    }
+
+    std::deque<HeldBlock> held;
+    held.swap(session->heldBlocks);
+    session->heldFrames = 0;
+    UINT32 blockAlign = session->capture->GetFormat()->nBlockAlign;
+    for (const HeldBlock& block : held) {
+        RecordBlock(session, block.silent ? AudioBlock::Silence(block.frames, blockAlign)
+                                          : AudioBlock::Samples(block.data.data(),
+                                                                static_cast<UINT32>(block.data.size()), blockAlign));
+    }
+
+    // Audio that didn't fit came after everything held; it goes in as silence of the same
+    // length, a second at a time, so what follows stays in place
+    UINT64 dropped = session->droppedFrames;
+    session->droppedFrames = 0;
+    UINT32 second = session->capture->GetFormat()->nSamplesPerSec;
+    while (dropped > 0) {
+        UINT32 frames = static_cast<UINT32>(std::min<UINT64>(dropped, second));
+        RecordBlock(session, AudioBlock::Silence(frames, blockAlign));
+        dropped -= frames;
+    }
+    return true;
+}
+
+void CaptureManager::HoldBlock(CaptureSession* session, const AudioBlock& block) {
+    UINT64 maxFrames = static_cast<UINT64>(session->capture->GetFormat()->nSamplesPerSec) * kMaxHeldMs / 1000;
+    if (session->droppedFrames > 0 || session->heldFrames + block.frames > maxFrames) {
+        session->droppedFrames += block.frames;
+        return;
+    }
+
+    HeldBlock held;
+    if (!block.silent) {
+        held.data.assign(block.data, block.data + block.size);
+    }
+    held.frames = block.frames;
+    held.silent = block.silent;
+    session->heldBlocks.push_back(std::move(held));
+    session->heldFrames += block.frames;
+}
+
+void CaptureManager::StartPreroll(CaptureSession* session) {
+    if (m_prerollOptions.seconds == 0) {
+        return;
+    }
+
+    // A session without a pre-roll still records; the buffer is best effort
+    session->preroll = std::make_unique<PrerollBuffer>();
+    session->preroll->SetSinkOptions(m_sinkOptions);
+    if (!session->preroll->Start(session->capture->GetFormat(), m_prerollOptions.seconds,
+                                 MakeOpusConfig(session->profile, m_prerollOptions.bitrate))) {
+        session->preroll.reset();
+    }
+}
+
+void CaptureManager::StartActivation(CaptureSession* session) {
+    if (!m_activationOptions.enabled || !session->outputs) {
+        return;
+    }
+
+    session->gate = std::make_unique<ActivationGate>();
+    if (!session->gate->Initialize(session->capture->GetSampleFormat(), m_activationOptions)) {
+        session->gate.reset();
+        return;
+    }
+
+    // Runs on the capture thread inside OnAudioData, with m_mutex held
+    session->gate->SetDataCallback([session](const AudioBlock& block) {
+        bool written = block.silent ? session->outputs->WriteSilence(block.frames)
+                                    : session->outputs->WriteData(block.data, block.size);
+        if (written) {
+            session->bytesWritten += block.size;
+        }
+    });
+
+    if (m_activationOptions.segmentPerActivation) {
+        // The first activation goes into the file opened at start, later ones into _segN
+        session->gate->SetActivationCallback([session](bool active, UINT32 number) {
+            if (active && number > 1) {
+                session->outputs->CutSegment();
+            }
+        });
+    } else {
+        session->labels = FileSink::Create(m_sinkOptions);
+        if (!session->labels->Open(session->outputFile + L".labels.txt")) {
+            session->labels.reset();
+            return;
+        }
+        FileSink* labels = session->labels.get();
+        session->gate->SetLabelCallback([labels](const char* line, size_t length) {
+            labels->Write(line, length);
+        });
+    }
+}
+
+void CaptureManager::StartSilenceDetection(CaptureSession* session) {
+    if (!session->skipSilence) {
+        return;
+    }
+
+    // Formats the meter can't read are recorded in full
+    session->silence = std::make_unique<SilenceDetector>();
+    if (!session->silence->Initialize(session->capture->GetSampleFormat(), m_silenceOptions)) {
+        session->silence.reset();
+    }
+}
+
+void CaptureManager::StartIdleDetection(CaptureSession* session, const std::vector<RecordingTarget>& targets) {
+    if (!m_idleOptions.enabled) {
+        return;
+    }
+
+    bool defer = m_idleOptions.deferOpen && !session->monitorOnly && !targets.empty();
+    session->idle = std::make_unique<IdleDetector>();
+    if (!session->idle->Initialize(session->capture->GetFormat(), m_idleOptions, defer)) {
+        session->idle.reset();
+        return;
+    }
+
+    if (!m_idleOptions.padGaps && !session->monitorOnly) {
+        session->idle->SetMarkerFile(session->outputFile + L".gaps.txt", m_sinkOptions);
+    }
+    if (defer) {
+        session->deferredTargets = targets;
+        session->capture->SetPollInterval(m_idleOptions.idlePollMs);
+    }
+}
+
+bool CaptureManager::UpdateIdleState(CaptureSession* session, const AudioBlock& block) {
+    switch (session->idle->Process(block)) {
+    case IdleDetector::Action::Write:
+        return true;
+
+    case IdleDetector::Action::Suspend:
+        // Nothing past this point runs until audio returns; the device only needs draining
+        session->capture->SetPollInterval(m_idleOptions.idlePollMs);
+        if (session->outputs) {
+            session->outputs->ReleaseBuffers();
+        }
+        PadIdleGap(session, block.frames);
+        return false;
+
+    case IdleDetector::Action::Skip:
+        PadIdleGap(session, block.frames);
+        return false;
+
+    case IdleDetector::Action::Resume:
+        session->capture->SetPollInterval(AudioCapture::DEFAULT_POLL_MS);
+        if (!session->deferredTargets.empty()) {
+            // The recording starts here, once the outputs are open
+            StartDeferredOpen(session);
+            return true;
+        }
+        MarkIdleGap(session);
+        return true;
+    }
+
+    return true;
+}
+
+void CaptureManager::PadIdleGap(CaptureSession* session, UINT32 frames) {
+    // Level activation and skip silence would have dropped the gap anyway
+    if (!m_idleOptions.padGaps || !session->outputs || session->gate || session->silence) {
+        return;
+    }
+
+    // Padded as the gap goes by, one skipped block at a time through the outputs' silence
+    // paths, so no callback ever writes more than it was handed and a resume costs nothing
+    if (session->outputs->WriteSilence(frames)) {
+        session->bytesWritten += static_cast<UINT64>(frames) * session->capture->GetFormat()->nBlockAlign;
+    }
+}
+
+void CaptureManager::MarkIdleGap(CaptureSession* session) {
+    if (m_idleOptions.padGaps || !session->outputs || session->gate || session->silence) {
+        return;
+    }
+
+    session->idle->WriteMarker(session->bytesWritten / session->capture->GetFormat()->nBlockAlign);
+}
+
 void CaptureManager::StopAllCaptures() {
     // Get list of all session IDs first (with mutex held)
     std::vector<DWORD> sessionIds;
@@ -270,93 +563,172 @@ bool CaptureManager::IsCapturing(DWORD processId) const {
     return m_sessions.find(processId) != m_sessions.end();
 }
 
-void CaptureManager::OnAudioData(DWORD processId, const BYTE* data, UINT32 size) {
+void CaptureManager::SetSinkOptions(const FileSinkOptions& options) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sinkOptions = options;
+}
+
+void CaptureManager::SetSegmentOptions(const SegmentOptions& options) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_segmentOptions = options;
+}
+
+void CaptureManager::SetDeferredEncoding(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_deferEncoding = enabled;
+}
+
+void CaptureManager::SetWavTranscodeOptions(const WavTranscodeOptions& options) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wavTranscode = options;
+}
+
+void CaptureManager::SetOpusLadder(const std::vector<UINT32>& bitrates) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_opusLadder = bitrates;
+}
+
+void CaptureManager::SetIdleOptions(const IdleOptions& options) {
     std::lock_guard<std::mutex> lock(m_mutex);
+    m_idleOptions = options;
+}
+
+void CaptureManager::SetDownmixToMono(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_downmixToMono = enabled;
+}
+
+void CaptureManager::SetSilenceOptions(const SilenceOptions& options) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_silenceOptions = options;
+}
 
+void CaptureManager::SetActivationOptions(const ActivationOptions& options) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_activationOptions = options;
+}
+
+void CaptureManager::SetPrerollOptions(const PrerollOptions& options) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_prerollOptions = options;
+}
+
+bool CaptureManager::SavePreroll(DWORD processId, const std::wstring& outputPath) {
+    std::lock_guard<std::mutex> lock(m_mutex);
     auto it = m_sessions.find(processId);
-    if (it == m_sessions.end()) {
-        return;
+    if (it == m_sessions.end() || !it->second->preroll) {
+        return false;
     }
+    return it->second->preroll->Save(outputPath);
+}
 
-    CaptureSession* session = it->second.get();
+void CaptureManager::ResumeDeferredEncoding(const std::wstring& directory) {
+    Transcoder::Instance().EnqueueDirectory(directory);
+}
 
-    // Check for silence if skip silence is enabled
-    if (session->skipSilence && size > 0) {
-        const WAVEFORMATEX* format = session->capture->GetFormat();
-        if (format) {
-            bool isSilent = true;
-            UINT32 bytesPerSample = format->wBitsPerSample / 8;
-            UINT32 numSamples = size / bytesPerSample;
-
-            // Define silence threshold (very low amplitude)
-            const int16_t SILENCE_THRESHOLD_16 = 50;  // ~0.15% of max amplitude
-            const int32_t SILENCE_THRESHOLD_32 = 3276;  // ~0.01% of max amplitude
-
-            if (bytesPerSample == 2) {
-                // 16-bit samples
-                const int16_t* samples = reinterpret_cast<const int16_t*>(data);
-                for (UINT32 i = 0; i < numSamples; i++) {
-                    if (abs(samples[i]) > SILENCE_THRESHOLD_16) {
-                        isSilent = false;
-                        break;
-                    }
-                }
-            } else if (bytesPerSample == 4) {
-                // 32-bit samples
-                const int32_t* samples = reinterpret_cast<const int32_t*>(data);
-                for (UINT32 i = 0; i < numSamples; i++) {
-                    if (abs(samples[i]) > SILENCE_THRESHOLD_32) {
-                        isSilent = false;
-                        break;
-                    }
-                }
-            }
+void CaptureManager::RecoverInterruptedRecordings(const std::wstring& directory) {
+    if (m_recoveryThread.joinable()) {
+        m_recoveryThread.join();
+    }
 
-            // Skip writing if silent
-            if (isSilent) {
-                return;
-            }
-        }
+    std::wstring prefix = directory;
+    if (!prefix.empty() && prefix.back() != L'\\' && prefix.back() != L'/') {
+        prefix += L'\\';
     }
 
-    // Write data to appropriate encoder (skip if monitor-only mode)
-    if (!session->monitorOnly) {
-        bool success = false;
-        switch (session->format) {
-        case AudioFormat::WAV:
-            if (session->wavWriter) {
-                success = session->wavWriter->WriteData(data, size);
-            }
-            break;
+    // A mapped file's zero reserve can take a while to scan, so keep this off the caller
+    FileSinkOptions sinkOptions = m_sinkOptions;
+    m_recoveryThread = std::thread([prefix, sinkOptions]() {
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
 
-        case AudioFormat::MP3:
-            if (session->mp3Encoder) {
-                success = session->mp3Encoder->WriteData(data, size);
-            }
-            break;
+        WIN32_FIND_DATAW findData;
+        HANDLE find = FindFirstFileW((prefix + L"*.wav").c_str(), &findData);
+        if (find == INVALID_HANDLE_VALUE) {
+            return;
+        }
 
-        case AudioFormat::OPUS:
-            if (session->opusEncoder) {
-                success = session->opusEncoder->WriteData(data, size);
+        do {
+            // The pattern also matches short names, so check the real extension
+            size_t length = wcslen(findData.cFileName);
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && length > 4 &&
+                _wcsicmp(findData.cFileName + length - 4, L".wav") == 0) {
+                WavWriter::RecoverFile(prefix + findData.cFileName, sinkOptions);
             }
-            break;
+        } while (FindNextFileW(find, &findData));
+        FindClose(find);
+    });
+}
 
-        case AudioFormat::FLAC:
-            if (session->flacEncoder) {
-                success = session->flacEncoder->WriteData(data, size);
-            }
-            break;
-        }
+FileSyncStats CaptureManager::GetSyncStats(DWORD processId, size_t outputIndex) const {
+    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(m_mutex));
+    auto it = m_sessions.find(processId);
+    if (it == m_sessions.end()) {
+        return FileSyncStats();
+    }
 
-        if (success) {
-            session->bytesWritten += size;
+    const CaptureSession* session = it->second.get();
+    return session->outputs ? session->outputs->GetSyncStats(outputIndex) : FileSyncStats();
+}
+
+void CaptureManager::OnAudioData(DWORD processId, const AudioBlock& block) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_sessions.find(processId);
+    if (it == m_sessions.end()) {
+        return;
+    }
+
+    CaptureSession* session = it->second.get();
+
+    // The pre-roll keeps everything, silence included, so a save plays back as it happened
+    // Silent packets carry only their length; every stage takes its silence path
+    if (session->preroll) {
+        if (block.silent) {
+            session->preroll->WriteSilence(block.frames);
+        } else {
+            session->preroll->WriteData(block.data, block.size);
         }
     }
 
+    // Deferred outputs that have finished opening take over, starting with the audio held for them
+    if (session->openThread.joinable()) {
+        FinishDeferredOpen(session, false);
+    }
+
+    // A suspended session goes no further; the mixer still needs every source's timeline
+    bool record = !session->idle || UpdateIdleState(session, block);
+
+    // Outputs still being opened: hold the block until they are ready
+    if (record && session->openThread.joinable()) {
+        HoldBlock(session, block);
+        record = false;
+    }
+
+    if (record) {
+        RecordBlock(session, block);
+    }
+
     // If mixed recording is enabled, also send data to the mixer
     if (m_mixedRecordingEnabled && m_mixer) {
-        const WAVEFORMATEX* sessionFormat = session->capture->GetFormat();
-        m_mixer->AddAudioData(processId, data, size, sessionFormat);
+        m_mixer->AddAudioData(processId, block, session->capture->GetSampleFormat());
+    }
+}
+
+void CaptureManager::RecordBlock(CaptureSession* session, const AudioBlock& block) {
+    // Skip long silences if enabled (level activation replaces this)
+    if (session->silence && !session->gate && session->silence->IsSilent(block)) {
+        return;
+    }
+
+    // Write data to appropriate encoder (skip if monitor-only mode)
+    if (session->gate) {
+        session->gate->Process(block);
+    } else if (!session->monitorOnly && session->outputs) {
+        bool success = block.silent ? session->outputs->WriteSilence(block.frames)
+                                    : session->outputs->WriteData(block.data, block.size);
+        if (success) {
+            session->bytesWritten += block.size;
+        }
     }
 }
 
@@ -380,46 +752,19 @@ bool CaptureManager::EnableMixedRecording(const std::wstring& outputPath, AudioF
 
     // Create mixer
     m_mixer = std::make_unique<AudioMixer>();
-    if (!m_mixer->Initialize(waveFormat)) {
+    if (!m_mixer->Initialize(m_sessions.begin()->second->capture->GetSampleFormat())) {
         m_mixer.reset();
         return false;
     }
 
-    // Create appropriate encoder
-    m_mixedFormat = format;
-    bool encoderReady = false;
-
-    switch (format) {
-    case AudioFormat::WAV:
-        m_mixedWavWriter = std::make_unique<WavWriter>();
-        encoderReady = m_mixedWavWriter->Open(outputPath, waveFormat);
-        break;
-
-    case AudioFormat::MP3:
-        m_mixedMp3Encoder = std::make_unique<Mp3Encoder>();
-        encoderReady = m_mixedMp3Encoder->Open(outputPath, waveFormat,
-                                                bitrate > 0 ? bitrate : 192000);
-        break;
-
-    case AudioFormat::OPUS:
-        m_mixedOpusEncoder = std::make_unique<OpusOggEncoder>();
-        encoderReady = m_mixedOpusEncoder->Open(outputPath, waveFormat,
-                                                 bitrate > 0 ? bitrate : 128000);
-        break;
-
-    case AudioFormat::FLAC:
-        m_mixedFlacEncoder = std::make_unique<FlacEncoder>();
-        encoderReady = m_mixedFlacEncoder->Open(outputPath, waveFormat,
-                                                 bitrate > 0 ? std::min(bitrate, 8u) : 5);
-        break;
-    }
+    // Create the output
+    m_mixedOutput = std::make_unique<RecordingOutput>();
+    bool encoderReady = m_mixedOutput->Open(outputPath, waveFormat,
+                                            MakeRecordingOptions(format, bitrate, EncodingProfile::Music));
 
     if (!encoderReady) {
         m_mixer.reset();
-        m_mixedWavWriter.reset();
-        m_mixedMp3Encoder.reset();
-        m_mixedOpusEncoder.reset();
-        m_mixedFlacEncoder.reset();
+        m_mixedOutput.reset();
         return false;
     }
 
@@ -453,22 +798,10 @@ void CaptureManager::DisableMixedRecording() {
     // Now clean up
     std::lock_guard<std::mutex> lock(m_mixerMutex);
 
-    // Close encoders
-    if (m_mixedWavWriter) {
-        m_mixedWavWriter->Close();
-        m_mixedWavWriter.reset();
-    }
-    if (m_mixedMp3Encoder) {
-        m_mixedMp3Encoder->Close();
-        m_mixedMp3Encoder.reset();
-    }
-    if (m_mixedOpusEncoder) {
-        m_mixedOpusEncoder->Close();
-        m_mixedOpusEncoder.reset();
-    }
-    if (m_mixedFlacEncoder) {
-        m_mixedFlacEncoder->Close();
-        m_mixedFlacEncoder.reset();
+    // Close the output
+    if (m_mixedOutput) {
+        m_mixedOutput->Close();
+        m_mixedOutput.reset();
     }
 
     m_mixer.reset();
@@ -485,57 +818,25 @@ void CaptureManager::MixerThread() {
 
     while (m_mixerThreadRunning) {
         bool hasData = false;
-        AudioFormat currentFormat = AudioFormat::WAV;
-        WavWriter* wavWriter = nullptr;
-        Mp3Encoder* mp3Encoder = nullptr;
-        OpusOggEncoder* opusEncoder = nullptr;
-        FlacEncoder* flacEncoder = nullptr;
+        RecordingOutput* output = nullptr;
 
-        // Get mixed audio data and encoder pointers (with lock held)
+        // Get mixed audio data and the output pointer (with lock held)
         {
             std::lock_guard<std::mutex> lock(m_mixerMutex);
 
             if (m_mixer) {
                 hasData = m_mixer->GetMixedAudio(mixedBuffer);
-                currentFormat = m_mixedFormat;
 
-                // Get raw pointers to encoders (they're managed by unique_ptrs in CaptureManager)
+                // Raw pointer to the output (managed by a unique_ptr in CaptureManager)
                 if (hasData && !mixedBuffer.empty()) {
-                    wavWriter = m_mixedWavWriter.get();
-                    mp3Encoder = m_mixedMp3Encoder.get();
-                    opusEncoder = m_mixedOpusEncoder.get();
-                    flacEncoder = m_mixedFlacEncoder.get();
+                    output = m_mixedOutput.get();
                 }
             }
         }
 
         // Write data to encoder WITHOUT lock held - encoding can be slow!
-        if (hasData && !mixedBuffer.empty() && m_mixerThreadRunning) {
-            switch (currentFormat) {
-            case AudioFormat::WAV:
-                if (wavWriter) {
-                    wavWriter->WriteData(mixedBuffer.data(), static_cast<UINT32>(mixedBuffer.size()));
-                }
-                break;
-
-            case AudioFormat::MP3:
-                if (mp3Encoder) {
-                    mp3Encoder->WriteData(mixedBuffer.data(), static_cast<UINT32>(mixedBuffer.size()));
-                }
-                break;
-
-            case AudioFormat::OPUS:
-                if (opusEncoder) {
-                    opusEncoder->WriteData(mixedBuffer.data(), static_cast<UINT32>(mixedBuffer.size()));
-                }
-                break;
-
-            case AudioFormat::FLAC:
-                if (flacEncoder) {
-                    flacEncoder->WriteData(mixedBuffer.data(), static_cast<UINT32>(mixedBuffer.size()));
-                }
-                break;
-            }
+        if (output && m_mixerThreadRunning) {
+            output->WriteData(mixedBuffer.data(), static_cast<UINT32>(mixedBuffer.size()));
         }
 
         if (!hasData) {
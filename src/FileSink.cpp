@@ -0,0 +1,31 @@
+#include "FileSink.h"
+#include "BufferedFileWriter.h"
+#include "MappedFileWriter.h"
+
+bool ReadFileAt(HANDLE file, UINT64 offset, void* data, DWORD size) {
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD bytesRead = 0;
+    return ReadFile(file, data, size, &bytesRead, &overlapped) && bytesRead == size;
+}
+
+bool WriteFileAt(HANDLE file, UINT64 offset, const void* data, DWORD size) {
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD written = 0;
+    return WriteFile(file, data, size, &written, &overlapped) && written == size;
+}
+
+std::unique_ptr<FileSink> FileSink::Create(const FileSinkOptions& options) {
+    switch (options.mode) {
+    case FileSinkMode::Direct:
+        return std::make_unique<BufferedFileWriter>(options);
+    case FileSinkMode::Mapped:
+        return std::make_unique<MappedFileWriter>(options);
+    case FileSinkMode::Buffered:
+    default:
+        return std::make_unique<BufferedFileWriter>(options);
+    }
+}
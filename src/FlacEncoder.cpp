@@ -1,12 +1,16 @@
 #include "FlacEncoder.h"
+#include <ks.h>
+#include <ksmedia.h>
 #include <algorithm>
 #include <cstring>
 
 FlacEncoder::FlacEncoder()
-    : m_encoder(nullptr)
+    : m_writeOffset(0)
+    , m_encoder(nullptr)
     , m_samplesPerFrame(0)
     , m_compressionLevel(5)
-    , m_totalSamples(0) {
+    , m_totalSamples(0)
+    , m_isFloat(false) {
     memset(&m_format, 0, sizeof(m_format));
 }
 
@@ -21,18 +25,30 @@ bool FlacEncoder::Open(const std::wstring& filename, const WAVEFORMATEX* format,
 
     m_filename = filename;
     memcpy(&m_format, format, sizeof(WAVEFORMATEX));
+
+    // Determine the actual sample encoding
+    m_isFloat = (format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= 22) {
+        const WAVEFORMATEXTENSIBLE* wfex = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format);
+        m_isFloat = (wfex->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+    }
+    if (format->wBitsPerSample != 16 && format->wBitsPerSample != 24 && format->wBitsPerSample != 32) {
+        return false;
+    }
+
     m_compressionLevel = std::min(compressionLevel, 8u);
 
     // Open output file
-    m_file.open(filename, std::ios::binary);
-    if (!m_file.is_open()) {
+    m_file = FileSink::Create(m_sinkOptions);
+    if (!m_file->Open(filename)) {
         return false;
     }
+    m_writeOffset = 0;
 
     // Create FLAC encoder
     m_encoder = FLAC__stream_encoder_new();
     if (!m_encoder) {
-        m_file.close();
+        m_file->Close();
         return false;
     }
 
@@ -61,7 +77,7 @@ bool FlacEncoder::Open(const std::wstring& filename, const WAVEFORMATEX* format,
     if (init_status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
         FLAC__stream_encoder_delete(m_encoder);
         m_encoder = nullptr;
-        m_file.close();
+        m_file->Close();
         return false;
     }
 
@@ -85,14 +101,27 @@ FLAC__StreamEncoderWriteStatus FlacEncoder::WriteCallback(
     (void)current_frame;
 
     FlacEncoder* self = static_cast<FlacEncoder*>(client_data);
-    if (!self || !self->m_file.is_open()) {
+    if (!self || !self->m_file || !self->m_file->IsOpen()) {
         return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
     }
 
-    self->m_file.write(reinterpret_cast<const char*>(buffer), bytes);
-    if (self->m_file.fail()) {
-        return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+    FileSink* file = self->m_file.get();
+    if (self->m_writeOffset == file->GetPosition()) {
+        if (!file->Write(buffer, bytes)) {
+            return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+        }
+    } else {
+        // Rewriting earlier bytes (the STREAMINFO update at finish): send them as patches
+        for (size_t done = 0; done < bytes; ) {
+            UINT32 chunk = static_cast<UINT32>(std::min<size_t>(bytes - done, FileSink::MAX_PATCH_SIZE));
+            if (self->m_writeOffset + done + chunk > file->GetPosition() ||
+                !file->WriteAt(self->m_writeOffset + done, buffer + done, chunk)) {
+                return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+            }
+            done += chunk;
+        }
     }
+    self->m_writeOffset += bytes;
 
     return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
 }
@@ -105,14 +134,12 @@ FLAC__StreamEncoderSeekStatus FlacEncoder::SeekCallback(
     (void)encoder;
 
     FlacEncoder* self = static_cast<FlacEncoder*>(client_data);
-    if (!self || !self->m_file.is_open()) {
+    if (!self || !self->m_file || !self->m_file->IsOpen() ||
+        absolute_byte_offset > self->m_file->GetPosition()) {
         return FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR;
     }
 
-    self->m_file.seekp(static_cast<std::streamoff>(absolute_byte_offset), std::ios::beg);
-    if (self->m_file.fail()) {
-        return FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR;
-    }
+    self->m_writeOffset = absolute_byte_offset;
 
     return FLAC__STREAM_ENCODER_SEEK_STATUS_OK;
 }
@@ -125,14 +152,11 @@ FLAC__StreamEncoderTellStatus FlacEncoder::TellCallback(
     (void)encoder;
 
     FlacEncoder* self = static_cast<FlacEncoder*>(client_data);
-    if (!self || !self->m_file.is_open()) {
+    if (!self || !self->m_file || !self->m_file->IsOpen()) {
         return FLAC__STREAM_ENCODER_TELL_STATUS_ERROR;
     }
 
-    *absolute_byte_offset = static_cast<FLAC__uint64>(self->m_file.tellp());
-    if (self->m_file.fail()) {
-        return FLAC__STREAM_ENCODER_TELL_STATUS_ERROR;
-    }
+    *absolute_byte_offset = static_cast<FLAC__uint64>(self->m_writeOffset);
 
     return FLAC__STREAM_ENCODER_TELL_STATUS_OK;
 }
@@ -149,6 +173,65 @@ bool FlacEncoder::WriteData(const BYTE* data, UINT32 size) {
     return ProcessBuffer();
 }
 
+bool FlacEncoder::WriteSilence(UINT32 frames) {
+    if (!m_encoder) {
+        return false;
+    }
+
+    UINT32 bytesPerFrame = m_format.nChannels * (m_format.wBitsPerSample / 8);
+
+    // Complete a partly buffered block with zeros first
+    if (!m_buffer.empty()) {
+        UINT32 bufferedFrames = static_cast<UINT32>(m_buffer.size() / bytesPerFrame);
+        UINT32 fill = std::min(frames, m_samplesPerFrame - bufferedFrames % m_samplesPerFrame);
+        m_buffer.resize(m_buffer.size() + static_cast<size_t>(fill) * bytesPerFrame, 0);
+        frames -= fill;
+        if (!ProcessBuffer()) {
+            return false;
+        }
+    }
+
+    // Whole blocks go straight to the encoder
+    if (m_buffer.empty() && frames >= m_samplesPerFrame) {
+        m_zeroChannel.resize(m_samplesPerFrame, 0);
+        std::vector<const FLAC__int32*> channelBuffers(m_format.nChannels, m_zeroChannel.data());
+
+        while (frames >= m_samplesPerFrame) {
+            if (!FLAC__stream_encoder_process(m_encoder, channelBuffers.data(), m_samplesPerFrame)) {
+                return false;
+            }
+            m_totalSamples += m_samplesPerFrame;
+            frames -= m_samplesPerFrame;
+        }
+    }
+
+    m_buffer.resize(m_buffer.size() + static_cast<size_t>(frames) * bytesPerFrame, 0);
+    return true;
+}
+
+FLAC__int32 FlacEncoder::ReadSample(const BYTE* sample) const {
+    switch (m_format.wBitsPerSample) {
+    case 16:
+        return *reinterpret_cast<const int16_t*>(sample);
+    case 24:
+        // Sign-extend the packed little-endian sample
+        return static_cast<FLAC__int32>((static_cast<uint32_t>(sample[0]) << 8) |
+                                        (static_cast<uint32_t>(sample[1]) << 16) |
+                                        (static_cast<uint32_t>(sample[2]) << 24)) >> 8;
+    case 32:
+        if (m_isFloat) {
+            // Float [-1.0, 1.0] to 24-bit integer for FLAC
+            float f = *reinterpret_cast<const float*>(sample);
+            f = std::max(-1.0f, std::min(1.0f, f));
+            return static_cast<FLAC__int32>(f * 8388607.0f); // 2^23 - 1
+        }
+        // 32-bit integer PCM is stored as 24-bit
+        return *reinterpret_cast<const int32_t*>(sample) >> 8;
+    default:
+        return 0;
+    }
+}
+
 bool FlacEncoder::ProcessBuffer() {
     if (!m_encoder) {
         return false;
@@ -162,29 +245,7 @@ bool FlacEncoder::ProcessBuffer() {
         std::vector<FLAC__int32> flacBuffer(m_samplesPerFrame * m_format.nChannels);
 
         for (UINT32 i = 0; i < m_samplesPerFrame * m_format.nChannels; i++) {
-            FLAC__int32 sample = 0;
-
-            if (bytesPerSample == 2) {
-                // 16-bit PCM
-                int16_t s = *reinterpret_cast<const int16_t*>(&m_buffer[i * 2]);
-                sample = static_cast<FLAC__int32>(s);
-            } else if (bytesPerSample == 4) {
-                // Check if this is floating point audio (common in Windows)
-                // Windows often uses 32-bit float format
-                float f = *reinterpret_cast<const float*>(&m_buffer[i * 4]);
-
-                // Check if it looks like a float (typical range -1.0 to 1.0)
-                if (f >= -1.0f && f <= 1.0f) {
-                    // Convert float [-1.0, 1.0] to 24-bit integer for FLAC
-                    // Using 24-bit gives better quality without unnecessary precision
-                    sample = static_cast<FLAC__int32>(f * 8388607.0f); // 2^23 - 1
-                } else {
-                    // Assume it's 32-bit integer PCM
-                    sample = *reinterpret_cast<const int32_t*>(&m_buffer[i * 4]);
-                }
-            }
-
-            flacBuffer[i] = sample;
+            flacBuffer[i] = ReadSample(&m_buffer[i * bytesPerSample]);
         }
 
         // Prepare channel buffers
@@ -226,26 +287,7 @@ void FlacEncoder::Close() {
                 std::vector<FLAC__int32> flacBuffer(remainingSamples * m_format.nChannels);
 
                 for (UINT32 i = 0; i < remainingSamples * m_format.nChannels; i++) {
-                    FLAC__int32 sample = 0;
-
-                    if (bytesPerSample == 2) {
-                        int16_t s = *reinterpret_cast<const int16_t*>(&m_buffer[i * 2]);
-                        sample = static_cast<FLAC__int32>(s);
-                    } else if (bytesPerSample == 4) {
-                        // Check if this is floating point audio
-                        float f = *reinterpret_cast<const float*>(&m_buffer[i * 4]);
-
-                        // Check if it looks like a float (typical range -1.0 to 1.0)
-                        if (f >= -1.0f && f <= 1.0f) {
-                            // Convert float [-1.0, 1.0] to 24-bit integer for FLAC
-                            sample = static_cast<FLAC__int32>(f * 8388607.0f); // 2^23 - 1
-                        } else {
-                            // Assume it's 32-bit integer PCM
-                            sample = *reinterpret_cast<const int32_t*>(&m_buffer[i * 4]);
-                        }
-                    }
-
-                    flacBuffer[i] = sample;
+                    flacBuffer[i] = ReadSample(&m_buffer[i * bytesPerSample]);
                 }
 
                 std::vector<FLAC__int32*> channelBuffers(m_format.nChannels);
@@ -270,9 +312,32 @@ void FlacEncoder::Close() {
         m_encoder = nullptr;
     }
 
-    if (m_file.is_open()) {
-        m_file.close();
+    if (m_file) {
+        m_file->Close();
     }
 
     m_buffer.clear();
 }
+
+bool FlacEncoder::VerifyFrameCount(const std::wstring& filename, UINT64 frames) {
+    HANDLE file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    // "fLaC", the STREAMINFO block header, then STREAMINFO; the 36-bit total sample
+    // count is in its last five bytes before the MD5
+    BYTE header[26];
+    bool ok = ReadFileAt(file, 0, header, sizeof(header));
+    CloseHandle(file);
+    if (!ok || std::memcmp(header, "fLaC", 4) != 0 || (header[4] & 0x7F) != 0) {
+        return false;
+    }
+
+    UINT64 totalSamples = static_cast<UINT64>(header[21] & 0x0F) << 32;
+    for (int i = 22; i < 26; i++) {
+        totalSamples |= static_cast<UINT64>(header[i]) << ((25 - i) * 8);
+    }
+    return totalSamples == frames;
+}
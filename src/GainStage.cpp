@@ -0,0 +1,160 @@
+#include "GainStage.h"
+#include "AudioKernels.h"
+#include <ks.h>
+#include <ksmedia.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+GainStage::GainStage()
+    : m_targetGain(1.0f)
+    , m_softClip(true)
+    , m_rampShape(GainRamp::Exponential)
+    , m_rampMs(DEFAULT_RAMP_MS)
+    , m_sampleType(SampleType::Other)
+    , m_channels(0)
+    , m_blockAlign(0)
+    , m_gain(1.0f)
+    , m_rampStart(1.0f)
+    , m_rampTarget(1.0f)
+    , m_rampFrames(1)
+    , m_rampPosition(1)
+{
+}
+
+void GainStage::SetRamp(GainRamp shape, UINT32 rampMs) {
+    m_rampShape = shape;
+    m_rampMs = rampMs;
+}
+
+bool GainStage::Initialize(const WAVEFORMATEX* format) {
+    m_sampleType = SampleType::Other;
+    if (!format || format->nChannels == 0) {
+        return false;
+    }
+    m_channels = format->nChannels;
+    m_blockAlign = format->nBlockAlign;
+
+    m_gain = m_targetGain.load(std::memory_order_relaxed);
+    m_rampStart = m_gain;
+    m_rampTarget = m_gain;
+    m_rampFrames = std::max<UINT32>(1, static_cast<UINT32>(static_cast<UINT64>(m_rampMs) * format->nSamplesPerSec / 1000));
+    m_rampPosition = m_rampFrames;
+
+    bool isFloat = (format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= 22) {
+        const WAVEFORMATEXTENSIBLE* wfex = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format);
+        isFloat = (wfex->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+    }
+
+    // Only tightly packed samples can be scaled
+    if (format->nBlockAlign != format->nChannels * format->wBitsPerSample / 8) {
+        return false;
+    }
+
+    switch (format->wBitsPerSample) {
+    case 16:
+        m_sampleType = isFloat ? SampleType::Other : SampleType::Int16;
+        break;
+    case 24:
+        m_sampleType = isFloat ? SampleType::Other : SampleType::Int24;
+        break;
+    case 32:
+        m_sampleType = isFloat ? SampleType::Float32 : SampleType::Int32;
+        break;
+    }
+    return m_sampleType != SampleType::Other;
+}
+
+void GainStage::SetGain(float gain) {
+    // NaN fails both comparisons and becomes silence
+    gain = gain > 0.0f ? gain : 0.0f;
+    gain = gain < MAX_GAIN ? gain : MAX_GAIN;
+    m_targetGain.store(gain, std::memory_order_relaxed);
+}
+
+bool GainStage::IsUnity() const {
+    return m_sampleType == SampleType::Other ||
+           (m_gain == 1.0f && m_targetGain.load(std::memory_order_relaxed) == 1.0f);
+}
+
+void GainStage::Process(const BYTE* input, BYTE* output, UINT32 frames) {
+    float target = m_targetGain.load(std::memory_order_relaxed);
+    if (target != m_rampTarget) {
+        // Ramp from wherever the gain has got to, so a slider drag never jumps
+        m_rampStart = m_gain;
+        m_rampTarget = target;
+        m_rampPosition = 0;
+    }
+
+    bool softClip = m_softClip.load(std::memory_order_relaxed);
+    UINT32 done = 0;
+
+    // Each ramp segment is a linear step between two points on the ramp
+    while (m_rampPosition < m_rampFrames && done < frames) {
+        UINT32 segment = std::min({ frames - done, RAMP_SEGMENT_FRAMES, m_rampFrames - m_rampPosition });
+        m_rampPosition += segment;
+        float end = RampGainAt(m_rampPosition);
+        if (input) {
+            float step = (end - m_gain) / static_cast<float>(segment * m_channels);
+            Apply(input + done * m_blockAlign, output + done * m_blockAlign, segment, m_gain, step, softClip);
+        }
+        m_gain = end;
+        done += segment;
+    }
+
+    if (!input || done == frames) {
+        return;
+    }
+
+    if (m_gain != 1.0f) {
+        Apply(input + done * m_blockAlign, output + done * m_blockAlign, frames - done, m_gain, 0.0f, softClip);
+    }
+    else if (input != output) {
+        std::memcpy(output + done * m_blockAlign, input + done * m_blockAlign, (frames - done) * m_blockAlign);
+    }
+}
+
+float GainStage::RampGainAt(UINT32 position) const {
+    if (position >= m_rampFrames) {
+        return m_rampTarget;
+    }
+
+    float t = static_cast<float>(position) / static_cast<float>(m_rampFrames);
+    if (m_rampShape == GainRamp::Exponential) {
+        float from = std::max(m_rampStart, MIN_RAMP_GAIN);
+        float to = std::max(m_rampTarget, MIN_RAMP_GAIN);
+        return from * std::pow(to / from, t);
+    }
+    return m_rampStart + (m_rampTarget - m_rampStart) * t;
+}
+
+void GainStage::Apply(const BYTE* input, BYTE* output, UINT32 frames, float gain, float step, bool softClip) {
+    size_t count = static_cast<size_t>(frames) * m_channels;
+
+    // Soft clipping only matters while boosting
+    softClip = softClip && (gain > 1.0f || gain + step * static_cast<float>(count) > 1.0f);
+
+    switch (m_sampleType) {
+    case SampleType::Int16:
+        AudioKernels::ApplyGainInt16(reinterpret_cast<const int16_t*>(input), reinterpret_cast<int16_t*>(output),
+                                     count, gain, step, softClip);
+        break;
+    case SampleType::Int24:
+        AudioKernels::ApplyGainInt24(input, output, count, gain, step, softClip);
+        break;
+    case SampleType::Int32:
+        AudioKernels::ApplyGainInt32(reinterpret_cast<const int32_t*>(input), reinterpret_cast<int32_t*>(output),
+                                     count, gain, step, softClip);
+        break;
+    case SampleType::Float32:
+        AudioKernels::ApplyGain(reinterpret_cast<const float*>(input), reinterpret_cast<float*>(output),
+                                count, gain, step, softClip);
+        break;
+    case SampleType::Other:
+        if (input != output) {
+            std::memcpy(output, input, static_cast<size_t>(frames) * m_blockAlign);
+        }
+        break;
+    }
+}
@@ -0,0 +1,115 @@
+#include "IdleDetector.h"
+#include "AudioKernels.h"
+#include <ks.h>
+#include <ksmedia.h>
+#include <cstdio>
+#include <cstring>
+
+IdleDetector::IdleDetector()
+    : m_sampleRate(0)
+    , m_isFloat(false)
+    , m_suspendFrames(0)
+    , m_silentFrames(0)
+    , m_gapFrames(0)
+    , m_suspended(false)
+{
+    std::memset(&m_gapTime, 0, sizeof(m_gapTime));
+}
+
+IdleDetector::~IdleDetector() {
+    Close();
+}
+
+bool IdleDetector::Initialize(const WAVEFORMATEX* format, const IdleOptions& options, bool startSuspended) {
+    if (!format || format->nSamplesPerSec == 0) {
+        return false;
+    }
+
+    m_sampleRate = format->nSamplesPerSec;
+    m_isFloat = (format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= 22) {
+        const WAVEFORMATEXTENSIBLE* wfex = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format);
+        m_isFloat = (wfex->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+    }
+    m_isFloat = m_isFloat && format->wBitsPerSample == 32;
+    m_suspendFrames = static_cast<UINT64>(options.suspendAfterMs) * m_sampleRate / 1000;
+    m_silentFrames = 0;
+    m_gapFrames = 0;
+    m_suspended = startSuspended;
+    GetLocalTime(&m_gapTime);
+    return true;
+}
+
+IdleDetector::Action IdleDetector::Process(const AudioBlock& block) {
+    if (block.frames == 0) {
+        return m_suspended ? Action::Skip : Action::Write;
+    }
+
+    // Only digital silence counts, so a padded gap gives back exactly what was captured
+    bool silent = block.silent ||
+                  (m_isFloat ? AudioKernels::IsAllZeroFloat(reinterpret_cast<const float*>(block.data), block.size / sizeof(float))
+                             : AudioKernels::IsAllZero(block.data, block.size));
+
+    if (m_suspended) {
+        if (silent) {
+            m_gapFrames += block.frames;
+            return Action::Skip;
+        }
+        m_suspended = false;
+        m_silentFrames = 0;
+        return Action::Resume;
+    }
+
+    if (!silent) {
+        m_silentFrames = 0;
+        return Action::Write;
+    }
+
+    m_silentFrames += block.frames;
+    if (m_silentFrames < m_suspendFrames) {
+        return Action::Write;
+    }
+
+    m_suspended = true;
+    m_gapFrames = block.frames;
+    GetLocalTime(&m_gapTime);
+    return Action::Suspend;
+}
+
+void IdleDetector::SetMarkerFile(const std::wstring& filename, const FileSinkOptions& options) {
+    m_markerFilename = filename;
+    m_markerOptions = options;
+}
+
+void IdleDetector::WriteMarker(UINT64 positionFrames) {
+    if (m_markerFilename.empty()) {
+        return;
+    }
+
+    // Created on first use; a file that fails to open is not retried
+    if (!m_markers) {
+        m_markers = FileSink::Create(m_markerOptions);
+        if (!m_markers->Open(m_markerFilename)) {
+            m_markers.reset();
+            m_markerFilename.clear();
+            return;
+        }
+    }
+
+    // A point label at the cut: "position<TAB>position<TAB>gap 12.500 s from HH:MM:SS"
+    double position = static_cast<double>(positionFrames) / m_sampleRate;
+    char line[128];
+    int length = std::snprintf(line, sizeof(line), "%.6f\t%.6f\tgap %.3f s from %02u:%02u:%02u\n",
+                               position, position, static_cast<double>(m_gapFrames) / m_sampleRate,
+                               m_gapTime.wHour, m_gapTime.wMinute, m_gapTime.wSecond);
+    if (length > 0) {
+        m_markers->Write(line, static_cast<size_t>(length));
+    }
+}
+
+void IdleDetector::Close() {
+    if (m_markers) {
+        m_markers->Close();
+        m_markers.reset();
+    }
+}
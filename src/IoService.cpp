@@ -0,0 +1,218 @@
+#include "IoService.h"
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+// Completion keys: file handles are registered with kFileKey, kStopKey ends the service
+constexpr ULONG_PTR kFileKey = 1;
+constexpr ULONG_PTR kStopKey = 2;
+
+constexpr ULONG kMaxCompletionsPerWait = 64;
+
+} // namespace
+
+IoService& IoService::Instance() {
+    static IoService service;
+    return service;
+}
+
+IoService::IoService()
+    : m_port(nullptr)
+    , m_stop(false)
+{
+    m_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+    if (m_port) {
+        m_thread = std::thread(&IoService::CompletionThread, this);
+    }
+    m_syncThread = std::thread(&IoService::SyncThread, this);
+}
+
+IoService::~IoService() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_syncCondition.notify_one();
+    if (m_syncThread.joinable()) {
+        m_syncThread.join();
+    }
+    for (auto& volume : m_volumes) {
+        volume->condition.notify_one();
+        if (volume->thread.joinable()) {
+            volume->thread.join();
+        }
+    }
+
+    if (m_port) {
+        PostQueuedCompletionStatus(m_port, 0, kStopKey, nullptr);
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        CloseHandle(m_port);
+    }
+}
+
+bool IoService::Register(HANDLE file) {
+    if (!m_port || CreateIoCompletionPort(file, m_port, kFileKey, 0) != m_port) {
+        return false;
+    }
+    VolumeFor(file);
+    return true;
+}
+
+void IoService::Unregister(HANDLE file) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fileVolumes.erase(file);
+}
+
+IoService::Volume* IoService::VolumeFor(HANDLE file) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_fileVolumes.find(file);
+        if (it != m_fileVolumes.end()) {
+            return it->second;
+        }
+    }
+
+    // Files whose volume can't be determined share the thread for serial number 0
+    BY_HANDLE_FILE_INFORMATION info = {};
+    DWORD serialNumber = GetFileInformationByHandle(file, &info) ? info.dwVolumeSerialNumber : 0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Volume* volume = nullptr;
+    for (auto& candidate : m_volumes) {
+        if (candidate->serialNumber == serialNumber) {
+            volume = candidate.get();
+            break;
+        }
+    }
+    if (!volume) {
+        m_volumes.push_back(std::make_unique<Volume>());
+        volume = m_volumes.back().get();
+        volume->serialNumber = serialNumber;
+        volume->thread = std::thread(&IoService::IssueThread, this, volume);
+    }
+    m_fileVolumes[file] = volume;
+    return volume;
+}
+
+void IoService::Submit(IoRequest* request) {
+    if (request->type == IoRequestType::Sync) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_syncQueue.push_back(request);
+        }
+        m_syncCondition.notify_one();
+        return;
+    }
+
+    QueueWrite(request);
+}
+
+void IoService::QueueWrite(IoRequest* request) {
+    Volume* volume = VolumeFor(request->file);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        volume->queue.push_back(request);
+    }
+    volume->condition.notify_one();
+}
+
+void IoService::Issue(IoRequest* request) {
+    UINT64 offset = request->offset + request->transferred;
+    std::memset(&request->overlapped, 0, sizeof(request->overlapped));
+    request->overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    request->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    // Success or ERROR_IO_PENDING both post a completion packet to the port
+    if (!WriteFile(request->file, request->data + request->transferred,
+                   request->size - request->transferred, nullptr, &request->overlapped) &&
+        GetLastError() != ERROR_IO_PENDING) {
+        request->handler->OnIoComplete(request, false);
+    }
+}
+
+void IoService::IssueThread(Volume* volume) {
+    std::deque<IoRequest*> batch;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        volume->condition.wait(lock, [this, volume] { return !volume->queue.empty() || m_stop; });
+        if (volume->queue.empty()) {
+            break;
+        }
+
+        // Everything submitted since the last pass is issued without retaking the lock
+        batch.swap(volume->queue);
+        lock.unlock();
+        for (IoRequest* request : batch) {
+            Issue(request);
+        }
+        batch.clear();
+        lock.lock();
+    }
+}
+
+void IoService::CompletionThread() {
+    OVERLAPPED_ENTRY entries[kMaxCompletionsPerWait];
+
+    while (true) {
+        ULONG count = 0;
+        if (!GetQueuedCompletionStatusEx(m_port, entries, kMaxCompletionsPerWait, &count, INFINITE, FALSE)) {
+            continue;
+        }
+
+        bool stop = false;
+        for (ULONG i = 0; i < count; i++) {
+            if (entries[i].lpCompletionKey == kStopKey) {
+                stop = true;
+                continue;
+            }
+
+            IoRequest* request = reinterpret_cast<IoRequest*>(entries[i].lpOverlapped);
+            bool success = (request->overlapped.Internal == 0);  // STATUS_SUCCESS
+            DWORD bytes = entries[i].dwNumberOfBytesTransferred;
+
+            // The remainder of a short write goes back to its volume's issuing thread
+            if (success && bytes > 0 && request->transferred + bytes < request->size) {
+                request->transferred += bytes;
+                QueueWrite(request);
+                continue;
+            }
+
+            request->transferred += bytes;
+            request->handler->OnIoComplete(request, success && request->transferred == request->size);
+        }
+
+        if (stop) {
+            break;
+        }
+    }
+}
+
+void IoService::SyncThread() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_syncCondition.wait(lock, [this] { return !m_syncQueue.empty() || m_stop; });
+        if (m_syncQueue.empty()) {
+            break;
+        }
+
+        IoRequest* request = m_syncQueue.front();
+        m_syncQueue.pop_front();
+        lock.unlock();
+
+        // Pages written through a mapped view are pushed to the file first
+        auto start = std::chrono::steady_clock::now();
+        bool success = true;
+        if (request->data) {
+            success = FlushViewOfFile(request->data, request->size) != FALSE;
+        }
+        success = (FlushFileBuffers(request->file) != FALSE) && success;
+        request->syncMicros = static_cast<UINT64>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        request->handler->OnIoComplete(request, success);
+
+        lock.lock();
+    }
+}
@@ -0,0 +1,265 @@
+#include "LameEncoder.h"
+#include "AudioKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Input frames handed to LAME per call; larger writes are split into batches of this size
+constexpr uint32_t kBatchFrames = 8192;
+
+// Downmix weight of speakers off the front pair (centre, LFE, surrounds, heights)
+constexpr float kSurroundGain = 0.7071f;
+
+// WAVE speaker positions (the SPEAKER_* bits of ksmedia.h)
+constexpr uint32_t kFrontLeft = 0x1;
+constexpr uint32_t kFrontRight = 0x2;
+constexpr uint32_t kBackLeft = 0x10;
+constexpr uint32_t kBackRight = 0x20;
+constexpr uint32_t kFrontLeftOfCenter = 0x40;
+constexpr uint32_t kFrontRightOfCenter = 0x80;
+constexpr uint32_t kSideLeft = 0x200;
+constexpr uint32_t kSideRight = 0x400;
+constexpr uint32_t kTopFrontLeft = 0x1000;
+constexpr uint32_t kTopFrontRight = 0x4000;
+constexpr uint32_t kTopBackLeft = 0x8000;
+constexpr uint32_t kTopBackRight = 0x20000;
+
+// Worst-case MP3 output for a batch, per lame.h: 1.25 * samples + 7200
+size_t MaxMp3Bytes(uint32_t frames) {
+    return static_cast<size_t>(frames) + frames / 4 + 7200;
+}
+
+} // namespace
+
+LameEncoder::LameEncoder()
+    : m_lame(nullptr)
+    , m_output(nullptr)
+    , m_sampleType(SampleType::Int16)
+    , m_encodeChannels(0)
+    , m_downmix(false)
+{
+}
+
+LameEncoder::~LameEncoder() {
+    Finish();
+}
+
+bool LameEncoder::Open(const SampleFormat& format, uint32_t channelMask, uint32_t bitrate, Output* output) {
+    if (m_lame != nullptr || output == nullptr) {
+        return false;
+    }
+
+    if (format.channels == 0 || format.sampleRate == 0 || format.blockAlign == 0) {
+        return false;
+    }
+
+    switch (format.bitsPerSample) {
+    case 16:
+        m_sampleType = SampleType::Int16;
+        break;
+    case 24:
+        m_sampleType = SampleType::Int24;
+        break;
+    case 32:
+        m_sampleType = format.isFloat ? SampleType::Float32 : SampleType::Int32;
+        break;
+    default:
+        return false; // Unsupported format
+    }
+
+    m_format = format;
+    m_encodeChannels = std::min<int>(format.channels, 2);
+    SetupDownmix(channelMask);
+
+    // Configure LAME (it resamples internally if the input rate is not an MP3 rate)
+    m_lame = lame_init();
+    if (!m_lame) {
+        return false;
+    }
+
+    lame_set_in_samplerate(m_lame, static_cast<int>(format.sampleRate));
+    lame_set_num_channels(m_lame, m_encodeChannels);
+    lame_set_mode(m_lame, m_encodeChannels == 1 ? MONO : JOINT_STEREO);
+    lame_set_VBR(m_lame, vbr_off);
+    lame_set_brate(m_lame, static_cast<int>(bitrate / 1000));
+    lame_set_quality(m_lame, 2);
+    lame_set_bWriteVbrTag(m_lame, 1);           // Reserve the first frame for the Xing/LAME tag
+    lame_set_write_id3tag_automatic(m_lame, 0); // Keep that frame at offset 0
+
+    if (lame_init_params(m_lame) < 0) {
+        lame_close(m_lame);
+        m_lame = nullptr;
+        return false;
+    }
+
+    // Size the batch buffers once so encoding never allocates
+    m_convertBuffer.resize(static_cast<size_t>(kBatchFrames) * format.channels);
+    m_downmixBuffer.resize(m_downmix ? static_cast<size_t>(kBatchFrames) * 2 : 0);
+    m_mp3Buffer.resize(MaxMp3Bytes(kBatchFrames));
+
+    m_output = output;
+    return true;
+}
+
+void LameEncoder::SetupDownmix(uint32_t channelMask) {
+    const int channels = m_format.channels;
+    m_downmix = channels > 2;
+    m_leftGains.clear();
+    m_rightGains.clear();
+    if (!m_downmix) {
+        return;
+    }
+
+    // Speaker of each channel from the channel mask; without one, channels follow
+    // the standard WAVE order (front left, front right, centre, LFE, back left, ...)
+    const uint32_t leftSpeakers = kFrontLeft | kBackLeft | kFrontLeftOfCenter |
+                                  kSideLeft | kTopFrontLeft | kTopBackLeft;
+    const uint32_t rightSpeakers = kFrontRight | kBackRight | kFrontRightOfCenter |
+                                   kSideRight | kTopFrontRight | kTopBackRight;
+    const uint32_t frontSpeakers = kFrontLeft | kFrontRight | kFrontLeftOfCenter | kFrontRightOfCenter;
+
+    uint32_t mask = channelMask;
+    uint32_t speaker = 1;
+    float leftTotal = 0.0f;
+    float rightTotal = 0.0f;
+    for (int ch = 0; ch < channels; ch++) {
+        // Next speaker in the mask; channels beyond it are treated as centred
+        while (mask != 0 && speaker != 0 && (mask & speaker) == 0) {
+            speaker <<= 1;
+        }
+        uint32_t position = speaker;
+        speaker <<= 1;
+
+        float gain = (position & frontSpeakers) ? 1.0f : kSurroundGain;
+        float left = (position & rightSpeakers) ? 0.0f : gain;
+        float right = (position & leftSpeakers) ? 0.0f : gain;
+        m_leftGains.push_back(left);
+        m_rightGains.push_back(right);
+        leftTotal += left;
+        rightTotal += right;
+    }
+
+    // Normalize so that full-scale input on every channel stays within full scale
+    for (int ch = 0; ch < channels; ch++) {
+        m_leftGains[ch] = leftTotal > 0.0f ? m_leftGains[ch] / leftTotal : 0.0f;
+        m_rightGains[ch] = rightTotal > 0.0f ? m_rightGains[ch] / rightTotal : 0.0f;
+    }
+}
+
+bool LameEncoder::Encode(const uint8_t* data, uint32_t size) {
+    if (!m_lame) {
+        return false;
+    }
+
+    uint32_t blockAlign = m_format.blockAlign;
+    uint32_t frames = size / blockAlign;
+
+    while (frames > 0) {
+        uint32_t batch = std::min(frames, kBatchFrames);
+        if (!EncodeFrames(data, batch)) {
+            return false;
+        }
+        data += static_cast<size_t>(batch) * blockAlign;
+        frames -= batch;
+    }
+
+    return true;
+}
+
+bool LameEncoder::EncodeFrames(const uint8_t* data, uint32_t frames) {
+    const int channels = m_format.channels;
+    const uint32_t blockAlign = m_format.blockAlign;
+    const uint32_t bytesPerSample = m_format.bitsPerSample / 8;
+    const bool packed = (blockAlign == bytesPerSample * channels);
+
+    // Packed float input goes to LAME (or the downmix) without a copy
+    const float* pcm = reinterpret_cast<const float*>(data);
+    if (m_sampleType != SampleType::Float32 || !packed) {
+        // Convert the whole batch at once when the layout allows it, else frame by frame
+        size_t count = packed ? static_cast<size_t>(frames) * channels : static_cast<size_t>(channels);
+        uint32_t passes = packed ? 1 : frames;
+        for (uint32_t i = 0; i < passes; i++) {
+            const uint8_t* src = data + static_cast<size_t>(i) * blockAlign;
+            float* dest = m_convertBuffer.data() + static_cast<size_t>(i) * channels;
+            switch (m_sampleType) {
+            case SampleType::Int16:
+                AudioKernels::Int16ToFloat(reinterpret_cast<const int16_t*>(src), dest, count);
+                break;
+            case SampleType::Int24:
+                AudioKernels::Int24ToFloat(src, dest, count);
+                break;
+            case SampleType::Int32:
+                AudioKernels::Int32ToFloat(reinterpret_cast<const int32_t*>(src), dest, count);
+                break;
+            case SampleType::Float32:
+                std::memcpy(dest, src, count * sizeof(float));
+                break;
+            }
+        }
+        pcm = m_convertBuffer.data();
+    }
+
+    if (m_downmix) {
+        float* dest = m_downmixBuffer.data();
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            const float* source = pcm + static_cast<size_t>(frame) * channels;
+            float left = 0.0f;
+            float right = 0.0f;
+            for (int ch = 0; ch < channels; ch++) {
+                left += source[ch] * m_leftGains[ch];
+                right += source[ch] * m_rightGains[ch];
+            }
+            *dest++ = left;
+            *dest++ = right;
+        }
+        pcm = m_downmixBuffer.data();
+    }
+
+    int mp3Size = static_cast<int>(m_mp3Buffer.size());
+    int encodedBytes = (m_encodeChannels == 1)
+        ? lame_encode_buffer_ieee_float(m_lame, pcm, nullptr, static_cast<int>(frames), m_mp3Buffer.data(), mp3Size)
+        : lame_encode_buffer_interleaved_ieee_float(m_lame, pcm, static_cast<int>(frames), m_mp3Buffer.data(), mp3Size);
+
+    if (encodedBytes < 0) {
+        return false; // Encoding error
+    }
+
+    return encodedBytes == 0 || m_output->Write(m_mp3Buffer.data(), static_cast<size_t>(encodedBytes));
+}
+
+bool LameEncoder::WriteLameTag() {
+    // LAME wrote a placeholder first frame; overwrite it now that the frame count,
+    // encoder delay and padding are known so players report an exact duration
+    size_t tagSize = lame_get_lametag_frame(m_lame, nullptr, 0);
+    if (tagSize == 0) {
+        return true;
+    }
+
+    if (tagSize > m_mp3Buffer.size()) {
+        m_mp3Buffer.resize(tagSize);
+    }
+    tagSize = lame_get_lametag_frame(m_lame, m_mp3Buffer.data(), m_mp3Buffer.size());
+    return m_output->WriteAt(0, m_mp3Buffer.data(), tagSize);
+}
+
+bool LameEncoder::Finish() {
+    if (!m_lame) {
+        return false;
+    }
+
+    // Flush the encoder's remaining frames
+    bool ok = true;
+    int encodedBytes = lame_encode_flush(m_lame, m_mp3Buffer.data(), static_cast<int>(m_mp3Buffer.size()));
+    if (encodedBytes > 0) {
+        ok = m_output->Write(m_mp3Buffer.data(), static_cast<size_t>(encodedBytes));
+    }
+
+    ok = WriteLameTag() && ok;
+
+    lame_close(m_lame);
+    m_lame = nullptr;
+    m_output = nullptr;
+    return ok;
+}
@@ -0,0 +1,139 @@
+#include "LevelMeter.h"
+#include "AudioKernels.h"
+#include <cmath>
+
+namespace {
+
+// Keeps log10 finite for digital silence (-200 dBFS)
+const float kSilencePower = 1e-20f;
+
+} // namespace
+
+float BlockLevel::PeakDb() const {
+    return 10.0f * std::log10(peak * peak + kSilencePower);
+}
+
+float BlockLevel::RmsDb() const {
+    return 10.0f * std::log10(meanSquare + kSilencePower);
+}
+
+LevelMeter::LevelMeter()
+    : m_sampleType(SampleType::Other)
+    , m_channels(0)
+{
+}
+
+bool LevelMeter::Initialize(const SampleFormat& format) {
+    m_sampleType = SampleType::Other;
+    if (format.channels == 0) {
+        return false;
+    }
+    m_channels = format.channels;
+    bool isFloat = format.isFloat;
+
+    // Only tightly packed samples can be measured
+    if (format.blockAlign != format.channels * format.bitsPerSample / 8) {
+        return false;
+    }
+
+    switch (format.bitsPerSample) {
+    case 16:
+        m_sampleType = isFloat ? SampleType::Other : SampleType::Int16;
+        break;
+    case 24:
+        m_sampleType = isFloat ? SampleType::Other : SampleType::Int24;
+        break;
+    case 32:
+        m_sampleType = isFloat ? SampleType::Float32 : SampleType::Int32;
+        break;
+    }
+    return CanMeasure();
+}
+
+BlockLevel LevelMeter::Measure(const uint8_t* data, uint32_t frames) {
+    BlockLevel level;
+    size_t samples = static_cast<size_t>(frames) * m_channels;
+    if (samples == 0) {
+        return level;
+    }
+
+    const float* floats = nullptr;
+    switch (m_sampleType) {
+    case SampleType::Int16: {
+        const int16_t* pcm = reinterpret_cast<const int16_t*>(data);
+        level.peak = AudioKernels::PeakAbsInt16(pcm, samples) / 32768.0f;
+        level.meanSquare = static_cast<float>(static_cast<double>(AudioKernels::SumSquaresInt16(pcm, samples)) /
+                                              (32768.0 * 32768.0 * samples));
+        return level;
+    }
+    case SampleType::Float32:
+        floats = reinterpret_cast<const float*>(data);
+        break;
+    case SampleType::Int24:
+        m_floatBuffer.resize(samples);
+        AudioKernels::Int24ToFloat(data, m_floatBuffer.data(), samples);
+        floats = m_floatBuffer.data();
+        break;
+    case SampleType::Int32:
+        m_floatBuffer.resize(samples);
+        AudioKernels::Int32ToFloat(reinterpret_cast<const int32_t*>(data), m_floatBuffer.data(), samples);
+        floats = m_floatBuffer.data();
+        break;
+    case SampleType::Other:
+        return level;
+    }
+
+    level.peak = AudioKernels::PeakAbs(floats, samples);
+    level.meanSquare = AudioKernels::SumSquares(floats, samples) / samples;
+    return level;
+}
+
+SilenceDetector::SilenceDetector()
+    : m_minSilenceFrames(0)
+    , m_quietFrames(0)
+    , m_quiet(false)
+{
+}
+
+bool SilenceDetector::Initialize(const SampleFormat& format, const SilenceOptions& options) {
+    if (format.blockAlign == 0 || !m_meter.Initialize(format)) {
+        return false;
+    }
+
+    m_options = options;
+    m_minSilenceFrames = static_cast<uint64_t>(options.minSilenceMs) * format.sampleRate / 1000;
+    m_quietFrames = 0;
+    m_quiet = false;
+    return true;
+}
+
+bool SilenceDetector::IsSilent(const AudioBlock& block) {
+    uint32_t frames = block.frames;
+    if (frames == 0) {
+        return false;
+    }
+
+    if (block.silent) {
+        m_quiet = true;
+    } else {
+        BlockLevel level = m_meter.Measure(block.data, frames);
+        float rmsDb = level.RmsDb();
+        bool transient = level.PeakDb() >= m_options.peakCeilingDb;
+
+        if (m_quiet) {
+            m_quiet = !transient && rmsDb < m_options.thresholdDb + m_options.hysteresisDb;
+        } else {
+            m_quiet = !transient && rmsDb < m_options.thresholdDb;
+        }
+    }
+
+    if (!m_quiet) {
+        m_quietFrames = 0;
+        return false;
+    }
+
+    // Drop the block only if all of it lies past the minimum silence
+    bool skip = m_quietFrames >= m_minSilenceFrames;
+    m_quietFrames += frames;
+    return skip;
+}
@@ -0,0 +1,275 @@
+#include "MappedFileWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+UINT64 RoundUp(UINT64 value, UINT64 multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+UINT32 AllocationGranularity() {
+    SYSTEM_INFO info = {};
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity != 0 ? info.dwAllocationGranularity : 65536;
+}
+
+} // namespace
+
+MappedFileWriter::MappedFileWriter(const FileSinkOptions& options)
+    : m_handle(INVALID_HANDLE_VALUE)
+    , m_mapping(nullptr)
+    , m_view(nullptr)
+    , m_viewOffset(0)
+    , m_viewSize(0)
+    , m_allocated(0)
+    , m_position(0)
+    , m_extentBytes(0)
+    , m_windowBytes(0)
+    , m_granularity(AllocationGranularity())
+    , m_failed(false)
+    , m_syncMode(options.syncMode)
+    , m_syncIntervalMs(options.syncIntervalMs)
+    , m_lastSyncTime(0)
+    , m_syncPending(false)
+{
+    GetLayout(options, m_extentBytes, m_windowBytes);
+}
+
+void MappedFileWriter::GetLayout(const FileSinkOptions& options, UINT64& extentBytes, UINT64& windowBytes) {
+    // Views start on allocation-granularity boundaries, and an extent holds at least one view
+    UINT32 granularity = AllocationGranularity();
+    windowBytes = RoundUp(std::max<UINT64>(options.windowBytes, granularity), granularity);
+    extentBytes = RoundUp(std::max(options.extentBytes, windowBytes), granularity);
+}
+
+MappedFileWriter::~MappedFileWriter() {
+    Close();
+}
+
+bool MappedFileWriter::Open(const std::wstring& filename) {
+    if (IsOpen()) {
+        return false;
+    }
+
+    m_handle = CreateFileW(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    m_allocated = 0;
+    m_position = 0;
+    m_failed = false;
+    m_syncStats = FileSyncStats();
+    m_lastSyncTime = GetTickCount64();
+
+    if (!MapWindow(0)) {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MappedFileWriter::GrowTo(UINT64 minimumSize) {
+    UINT64 newSize = RoundUp(minimumSize, m_extentBytes);
+
+    // A mapping's size is fixed, so growing means replacing it. Views hold their own
+    // reference, but the caller always unmaps before growing.
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+
+    // Reserve the whole extent in one step so the filesystem can place it contiguously.
+    // Failing here (disk full) is reported cleanly instead of as a fault on a mapped page.
+    FILE_ALLOCATION_INFO allocation = {};
+    allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(newSize);
+    if (!SetFileInformationByHandle(m_handle, FileAllocationInfo, &allocation, sizeof(allocation))) {
+        return false;
+    }
+
+    // Creating the mapping extends the end of file to the new size
+    m_mapping = CreateFileMappingW(m_handle, nullptr, PAGE_READWRITE,
+                                   static_cast<DWORD>(newSize >> 32),
+                                   static_cast<DWORD>(newSize & 0xFFFFFFFF), nullptr);
+    if (!m_mapping) {
+        return false;
+    }
+
+    m_allocated = newSize;
+    return true;
+}
+
+bool MappedFileWriter::MapWindow(UINT64 offset) {
+    UnmapWindow();
+
+    if (offset + m_windowBytes > m_allocated && !GrowTo(offset + m_windowBytes)) {
+        m_failed = true;
+        return false;
+    }
+
+    m_view = static_cast<BYTE*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE,
+                                              static_cast<DWORD>(offset >> 32),
+                                              static_cast<DWORD>(offset & 0xFFFFFFFF),
+                                              static_cast<SIZE_T>(m_windowBytes)));
+    if (!m_view) {
+        m_failed = true;
+        return false;
+    }
+
+    m_viewOffset = offset;
+    m_viewSize = m_windowBytes;
+    return true;
+}
+
+void MappedFileWriter::UnmapWindow() {
+    // A background sync may still be flushing this view
+    WaitForSync();
+
+    // Unmapping does not wait for the pages to reach disk; the cache manager writes them back
+    if (m_view) {
+        UnmapViewOfFile(m_view);
+        m_view = nullptr;
+    }
+    m_viewSize = 0;
+}
+
+bool MappedFileWriter::Write(const void* data, size_t size) {
+    if (!IsOpen() || m_failed) {
+        return false;
+    }
+
+    const BYTE* src = static_cast<const BYTE*>(data);
+    while (size > 0) {
+        // Slide the window forward once the current one is full
+        if (!m_view || m_position >= m_viewOffset + m_viewSize) {
+            if (!MapWindow(m_position - m_position % m_granularity)) {
+                return false;
+            }
+        }
+
+        size_t chunk = static_cast<size_t>(std::min<UINT64>(size, m_viewOffset + m_viewSize - m_position));
+        std::memcpy(m_view + (m_position - m_viewOffset), src, chunk);
+        m_position += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+
+    if (m_syncMode == FileSyncMode::Periodic) {
+        SyncIfDue();
+    }
+    return true;
+}
+
+bool MappedFileWriter::WriteAt(UINT64 offset, const void* data, UINT32 size) {
+    if (!IsOpen() || m_failed || offset + size > m_allocated) {
+        return false;
+    }
+
+    if (m_view && offset >= m_viewOffset && offset + size <= m_viewOffset + m_viewSize) {
+        std::memcpy(m_view + (offset - m_viewOffset), data, size);
+        return true;
+    }
+
+    // Outside the window (e.g. the header): map just the pages around the patch
+    UINT64 base = offset - offset % m_granularity;
+    SIZE_T length = static_cast<SIZE_T>(offset - base + size);
+    BYTE* view = static_cast<BYTE*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE,
+                                                  static_cast<DWORD>(base >> 32),
+                                                  static_cast<DWORD>(base & 0xFFFFFFFF), length));
+    if (!view) {
+        return false;
+    }
+
+    std::memcpy(view + (offset - base), data, size);
+    UnmapViewOfFile(view);
+    return true;
+}
+
+bool MappedFileWriter::Flush() {
+    // Data in the view is already in the file cache; nothing is held back here
+    return IsOpen() && !m_failed;
+}
+
+void MappedFileWriter::Close() {
+    if (!IsOpen()) {
+        return;
+    }
+
+    UnmapWindow();
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+
+    // Give back the unused part of the last extent
+    FILE_END_OF_FILE_INFO endOfFile = {};
+    endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(m_position);
+    SetFileInformationByHandle(m_handle, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile));
+
+    // The end of a file is a segment boundary for both sync policies. The views are gone,
+    // so their pages are in the file cache and FlushFileBuffers alone covers them.
+    if (m_syncMode != FileSyncMode::None) {
+        StartSync(nullptr, 0);
+        WaitForSync();
+    }
+
+    CloseHandle(m_handle);
+    m_handle = INVALID_HANDLE_VALUE;
+    m_allocated = 0;
+}
+
+FileSyncStats MappedFileWriter::GetSyncStats() const {
+    std::lock_guard<std::mutex> lock(m_syncMutex);
+    return m_syncStats;
+}
+
+void MappedFileWriter::SyncIfDue() {
+    ULONGLONG now = GetTickCount64();
+    if (now - m_lastSyncTime < m_syncIntervalMs || !m_view) {
+        return;
+    }
+
+    // Don't stack syncs behind a slow one; try again on the next write
+    {
+        std::lock_guard<std::mutex> lock(m_syncMutex);
+        if (m_syncPending) {
+            return;
+        }
+    }
+    m_lastSyncTime = now;
+
+    // Earlier windows were unmapped, so their pages only need FlushFileBuffers
+    StartSync(m_view, m_position - m_viewOffset);
+}
+
+void MappedFileWriter::StartSync(const BYTE* view, UINT64 viewSize) {
+    {
+        std::lock_guard<std::mutex> lock(m_syncMutex);
+        m_syncPending = true;
+    }
+
+    m_syncRequest.type = IoRequestType::Sync;
+    m_syncRequest.file = m_handle;
+    m_syncRequest.data = view;
+    m_syncRequest.size = static_cast<UINT32>(viewSize);
+    m_syncRequest.offset = m_viewOffset;
+    m_syncRequest.transferred = 0;
+    m_syncRequest.handler = this;
+    m_syncRequest.syncMicros = 0;
+    IoService::Instance().Submit(&m_syncRequest);
+}
+
+void MappedFileWriter::WaitForSync() {
+    std::unique_lock<std::mutex> lock(m_syncMutex);
+    m_syncCondition.wait(lock, [this] { return !m_syncPending; });
+}
+
+void MappedFileWriter::OnIoComplete(IoRequest* request, bool success) {
+    std::lock_guard<std::mutex> lock(m_syncMutex);
+    m_syncStats.Record(request->syncMicros, success);
+    m_syncPending = false;
+    m_syncCondition.notify_all();
+}
@@ -1,10 +1,108 @@
 #include "Mp3Encoder.h"
-#include <mftransform.h>
-#include <wmcodecdsp.h>
 #include <cstring>
 #include <ks.h>
 #include <ksmedia.h>
 
+#ifdef AUDIOCAPTURE_MP3_LAME
+
+#include <algorithm>
+
+namespace {
+
+// The encoder's stream, written through the file sink
+class SinkOutput : public LameEncoder::Output {
+public:
+    explicit SinkOutput(FileSink* file) : m_file(file) {}
+
+    bool Write(const uint8_t* data, size_t size) override {
+        return m_file->Write(data, size);
+    }
+
+    bool WriteAt(uint64_t offset, const uint8_t* data, size_t size) override {
+        // The sink patches at most MAX_PATCH_SIZE bytes at a time
+        for (size_t done = 0; done < size; done += FileSink::MAX_PATCH_SIZE) {
+            UINT32 chunk = static_cast<UINT32>(std::min<size_t>(size - done, FileSink::MAX_PATCH_SIZE));
+            if (!m_file->WriteAt(offset + done, data + done, chunk)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    FileSink* m_file;
+};
+
+} // namespace
+
+Mp3Encoder::Mp3Encoder() {
+}
+
+Mp3Encoder::~Mp3Encoder() {
+    Close();
+}
+
+bool Mp3Encoder::Open(const std::wstring& filename, const WAVEFORMATEX* format, UINT32 bitrate) {
+    if (m_encoder.IsOpen()) {
+        return false;
+    }
+
+    // Determine the actual sample encoding and, for surround input, the speaker layout
+    bool isFloat = (format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+    DWORD channelMask = 0;
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= 22) {
+        const WAVEFORMATEXTENSIBLE* wfex = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format);
+        isFloat = (wfex->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+        channelMask = wfex->dwChannelMask;
+    }
+
+    SampleFormat sampleFormat;
+    sampleFormat.sampleRate = format->nSamplesPerSec;
+    sampleFormat.channels = format->nChannels;
+    sampleFormat.bitsPerSample = format->wBitsPerSample;
+    sampleFormat.blockAlign = format->nBlockAlign;
+    sampleFormat.isFloat = isFloat;
+
+    // Open output file
+    m_file = FileSink::Create(m_sinkOptions);
+    if (!m_file->Open(filename)) {
+        m_file.reset();
+        return false;
+    }
+
+    m_output = std::make_unique<SinkOutput>(m_file.get());
+    if (!m_encoder.Open(sampleFormat, channelMask, bitrate, m_output.get())) {
+        m_file->Close();
+        DeleteFileW(filename.c_str());
+        m_output.reset();
+        m_file.reset();
+        return false;
+    }
+
+    return true;
+}
+
+bool Mp3Encoder::WriteData(const BYTE* data, UINT32 size) {
+    return m_encoder.Encode(data, size);
+}
+
+void Mp3Encoder::Close() {
+    if (!m_encoder.IsOpen()) {
+        return;
+    }
+
+    m_encoder.Finish();
+
+    // The sink stays around so GetSyncStats still reports on the closed file
+    m_file->Close();
+    m_output.reset();
+}
+
+#else
+
+#include <mftransform.h>
+#include <wmcodecdsp.h>
+
 Mp3Encoder::Mp3Encoder()
     : m_sinkWriter(nullptr)
     , m_streamIndex(0)
@@ -172,3 +270,5 @@ void Mp3Encoder::Close() {
 
     m_buffer.clear();
 }
+
+#endif // AUDIOCAPTURE_MP3_LAME
@@ -0,0 +1,258 @@
+#include "OggPageWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t kCrcPolynomial = 0x04c11db7;
+constexpr size_t kInitialBodyCapacity = 64 * 1024;
+
+// Slicing-by-8 tables for the MSB-first Ogg CRC. Table 0 is the classic bytewise
+// table; table k advances a byte through k further zero bytes.
+struct CrcTables {
+    uint32_t table[8][256];
+
+    CrcTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t r = i << 24;
+            for (int bit = 0; bit < 8; bit++) {
+                r = (r & 0x80000000u) ? (r << 1) ^ kCrcPolynomial : (r << 1);
+            }
+            table[0][i] = r;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t prev = table[k - 1][i];
+                table[k][i] = (prev << 8) ^ table[0][prev >> 24];
+            }
+        }
+    }
+};
+
+const CrcTables& GetCrcTables() {
+    static const CrcTables tables;
+    return tables;
+}
+
+} // namespace
+
+OggPageWriter::OggPageWriter()
+    : m_bodyFill(0)
+    , m_bodyReturned(0)
+    , m_granulePos(0)
+    , m_lastPageGranule(-1)
+    , m_serialNumber(0)
+    , m_pageSequence(0)
+    , m_headerPageWritten(false)
+    , m_endOfStream(false)
+{
+}
+
+void OggPageWriter::Reset(uint32_t serialNumber) {
+    if (m_buffer.size() < kMaxHeaderSize + kInitialBodyCapacity) {
+        m_buffer.resize(kMaxHeaderSize + kInitialBodyCapacity);
+    }
+    m_lacing.clear();
+    m_granules.clear();
+    m_lacing.reserve(1024);
+    m_granules.reserve(1024);
+
+    m_bodyFill = 0;
+    m_bodyReturned = 0;
+    m_granulePos = 0;
+    m_lastPageGranule = -1;
+    m_serialNumber = serialNumber;
+    m_pageSequence = 0;
+    m_headerPageWritten = false;
+    m_endOfStream = false;
+}
+
+uint32_t OggPageWriter::Crc(const uint8_t* data, size_t size, uint32_t crc) {
+    const CrcTables& crcTables = GetCrcTables();
+    const uint32_t (*t)[256] = crcTables.table;
+
+    while (size >= 8) {
+        crc ^= (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+               (static_cast<uint32_t>(data[2]) << 8) | data[3];
+        crc = t[7][crc >> 24] ^ t[6][(crc >> 16) & 0xff] ^ t[5][(crc >> 8) & 0xff] ^ t[4][crc & 0xff] ^
+              t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    while (size--) {
+        crc = (crc << 8) ^ t[0][((crc >> 24) & 0xff) ^ *data++];
+    }
+    return crc;
+}
+
+void OggPageWriter::ReclaimReturnedBody() {
+    if (m_bodyReturned == 0) {
+        return;
+    }
+
+    // Slide the unpaged remainder back to just after the header room
+    m_bodyFill -= m_bodyReturned;
+    if (m_bodyFill > 0) {
+        std::memmove(&m_buffer[kMaxHeaderSize], &m_buffer[kMaxHeaderSize + m_bodyReturned], m_bodyFill);
+    }
+    m_bodyReturned = 0;
+}
+
+uint8_t* OggPageWriter::BeginPacket(size_t maxBytes) {
+    ReclaimReturnedBody();
+
+    size_t needed = kMaxHeaderSize + m_bodyFill + maxBytes;
+    if (m_buffer.size() < needed) {
+        m_buffer.resize(std::max(needed, m_buffer.size() * 2));
+    }
+    return &m_buffer[kMaxHeaderSize + m_bodyFill];
+}
+
+void OggPageWriter::CommitPacket(size_t bytes, int64_t granulePos, bool endOfStream) {
+    m_bodyFill += bytes;
+
+    // A packet is laced as 255-byte segments plus a final short (possibly empty) one.
+    // Only the final segment carries the packet's granule position.
+    size_t segments = bytes / 255 + 1;
+    size_t first = m_lacing.size();
+    for (size_t i = 0; i + 1 < segments; i++) {
+        m_lacing.push_back(255);
+        m_granules.push_back(m_granulePos);
+    }
+    m_lacing.push_back(static_cast<int>(bytes % 255));
+    m_granules.push_back(granulePos);
+    m_lacing[first] |= 0x100;
+
+    m_granulePos = granulePos;
+    if (endOfStream) {
+        m_endOfStream = true;
+    }
+}
+
+void OggPageWriter::AddPacket(const uint8_t* data, size_t bytes, int64_t granulePos, bool endOfStream) {
+    uint8_t* dest = BeginPacket(bytes);
+    if (bytes > 0) {
+        std::memcpy(dest, data, bytes);
+    }
+    CommitPacket(bytes, granulePos, endOfStream);
+}
+
+bool OggPageWriter::PageOut(const uint8_t*& page, size_t& size) {
+    bool force = !m_lacing.empty() && (m_endOfStream || !m_headerPageWritten);
+    return EmitPage(force, kPageFillTarget, page, size);
+}
+
+bool OggPageWriter::Flush(const uint8_t*& page, size_t& size) {
+    return EmitPage(true, kPageFillTarget, page, size);
+}
+
+bool OggPageWriter::EmitPage(bool force, size_t fillTarget, const uint8_t*& page, size_t& size) {
+    ReclaimReturnedBody();
+
+    size_t maxSegments = std::min<size_t>(m_lacing.size(), 255);
+    if (maxSegments == 0) {
+        return false;
+    }
+
+    size_t segments = 0;
+    int64_t granulePos = -1;
+
+    if (!m_headerPageWritten) {
+        // The first page carries only the first packet
+        granulePos = 0;
+        for (segments = 0; segments < maxSegments; segments++) {
+            if ((m_lacing[segments] & 0xff) < 255) {
+                segments++;
+                break;
+            }
+        }
+    } else {
+        // Avoid spanning pages needlessly and keep at least four packets per page
+        // unless the body is already over the fill target
+        size_t accumulated = 0;
+        int packetsDone = 0;
+        int packetJustDone = 0;
+        for (segments = 0; segments < maxSegments; segments++) {
+            if (accumulated > fillTarget && packetJustDone >= 4) {
+                force = true;
+                break;
+            }
+            accumulated += m_lacing[segments] & 0xff;
+            if ((m_lacing[segments] & 0xff) < 255) {
+                granulePos = m_granules[segments];
+                packetJustDone = ++packetsDone;
+            } else {
+                packetJustDone = 0;
+            }
+        }
+        if (segments == 255) {
+            force = true;
+        }
+    }
+
+    if (!force) {
+        return false;
+    }
+
+    // Build the header directly in front of the body so the page is contiguous
+    size_t headerSize = 27 + segments;
+    uint8_t* header = &m_buffer[kMaxHeaderSize - headerSize];
+
+    std::memcpy(header, "OggS", 4);
+    header[4] = 0;  // Stream structure version
+
+    header[5] = 0;
+    if ((m_lacing[0] & 0x100) == 0) {
+        header[5] |= 0x01;  // Continued packet
+    }
+    if (!m_headerPageWritten) {
+        header[5] |= 0x02;  // Beginning of stream
+    }
+    if (m_endOfStream && m_lacing.size() == segments) {
+        header[5] |= 0x04;  // End of stream
+    }
+    m_headerPageWritten = true;
+
+    uint64_t granuleBits = static_cast<uint64_t>(granulePos);
+    for (int i = 6; i < 14; i++) {
+        header[i] = static_cast<uint8_t>(granuleBits & 0xff);
+        granuleBits >>= 8;
+    }
+
+    uint32_t serial = m_serialNumber;
+    for (int i = 14; i < 18; i++) {
+        header[i] = static_cast<uint8_t>(serial & 0xff);
+        serial >>= 8;
+    }
+
+    uint32_t sequence = m_pageSequence++;
+    for (int i = 18; i < 22; i++) {
+        header[i] = static_cast<uint8_t>(sequence & 0xff);
+        sequence >>= 8;
+    }
+
+    // Checksum is computed with this field zeroed
+    header[22] = header[23] = header[24] = header[25] = 0;
+
+    size_t bodySize = 0;
+    header[26] = static_cast<uint8_t>(segments);
+    for (size_t i = 0; i < segments; i++) {
+        header[27 + i] = static_cast<uint8_t>(m_lacing[i] & 0xff);
+        bodySize += header[27 + i];
+    }
+
+    m_lacing.erase(m_lacing.begin(), m_lacing.begin() + segments);
+    m_granules.erase(m_granules.begin(), m_granules.begin() + segments);
+    m_bodyReturned = bodySize;
+
+    uint32_t crc = Crc(header, headerSize + bodySize);
+    header[22] = static_cast<uint8_t>(crc & 0xff);
+    header[23] = static_cast<uint8_t>((crc >> 8) & 0xff);
+    header[24] = static_cast<uint8_t>((crc >> 16) & 0xff);
+    header[25] = static_cast<uint8_t>((crc >> 24) & 0xff);
+
+    m_lastPageGranule = granulePos;
+    page = header;
+    size = headerSize + bodySize;
+    return true;
+}
@@ -1,21 +1,84 @@
 #include "OpusEncoder.h"
+#include "AudioKernels.h"
 #include <cstring>
 #include <ctime>
 #include <algorithm>
+#include <ks.h>
+#include <ksmedia.h>
+
+namespace {
+
+// Ogg Opus timestamps (granule positions and pre-skip) are always in 48 kHz samples
+const int kOpusGranuleRate = 48000;
+
+// Largest packet a single Opus stream can produce (RFC 6716 + self-delimiting overhead)
+const int kMaxPacketBytesPerStream = 1275 * 3 + 7;
+
+// WAVE channel order -> Vorbis channel order expected by mapping family 1
+// (encoder channel i takes source channel kVorbisOrder[channels - 1][i])
+const int kVorbisOrder[8][8] = {
+    { 0 },
+    { 0, 1 },
+    { 0, 2, 1 },
+    { 0, 1, 2, 3 },
+    { 0, 2, 1, 3, 4 },
+    { 0, 2, 1, 4, 5, 3 },
+    { 0, 2, 1, 5, 6, 4, 3 },
+    { 0, 2, 1, 6, 7, 4, 5, 3 },
+};
+
+bool IsNativeOpusRate(DWORD rate) {
+    return rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 || rate == 48000;
+}
+
+// Frame durations Opus accepts, in tenths of a millisecond (2.5 to 60 ms)
+bool IsValidFrameDuration(int tenthsMs) {
+    return tenthsMs == 25 || tenthsMs == 50 || tenthsMs == 100 ||
+           tenthsMs == 200 || tenthsMs == 400 || tenthsMs == 600;
+}
+
+// Total size of the Ogg page starting at data, or 0 if it doesn't fit in size bytes
+size_t OggPageSize(const BYTE* data, size_t size) {
+    if (size < 27 || std::memcmp(data, "OggS", 4) != 0 || size < 27u + data[26]) {
+        return 0;
+    }
+    size_t pageSize = 27 + data[26];
+    for (int i = 0; i < data[26]; i++) {
+        pageSize += data[27 + i];
+    }
+    return pageSize <= size ? pageSize : 0;
+}
+
+} // namespace
 
 OpusOggEncoder::OpusOggEncoder()
-    : m_opusEncoder(nullptr)
+    : m_sampleType(SampleType::Float32)
+    , m_maxPacketBytes(0)
+    , m_encoderRate(kOpusGranuleRate)
+    , m_encodeChannels(0)
+    , m_mappingFamily(0)
+    , m_streamCount(1)
+    , m_coupledCount(0)
+    , m_downmix(false)
+    , m_resample(false)
+    , m_nativeInt16(false)
+    , m_identityOrder(true)
+    , m_pcmReadPos(0)
     , m_samplesPerFrame(960) // 20ms at 48kHz
-    , m_bitrate(128000)
+    , m_preSkip(0)
     , m_totalSamples(0)
-    , m_serialno(0)
+    , m_inputFrames(0)
     , m_granulePos(0)
-    , m_packetCount(0)
+    , m_batchNumber(0)
+    , m_batchFrames(0)
+    , m_batchEndGranule(-1)
+    , m_nextRung(0)
+    , m_rungsRemaining(0)
+    , m_batchFailed(false)
+    , m_stopWorkers(false)
 {
     std::memset(&m_format, 0, sizeof(WAVEFORMATEX));
-    std::memset(&m_oggStream, 0, sizeof(ogg_stream_state));
-    std::memset(&m_oggPage, 0, sizeof(ogg_page));
-    std::memset(&m_oggPacket, 0, sizeof(ogg_packet));
+    std::memset(m_streamMapping, 0, sizeof(m_streamMapping));
 }
 
 OpusOggEncoder::~OpusOggEncoder() {
@@ -29,65 +92,231 @@ void OpusOggEncoder::WriteInt32LE(std::vector<unsigned char>& data, int32_t valu
     data.push_back((value >> 24) & 0xFF);
 }
 
+void OpusOggEncoder::DestroyEncoders() {
+    for (Rung& rung : m_rungs) {
+        if (rung.opusEncoder) {
+            opus_encoder_destroy(rung.opusEncoder);
+            rung.opusEncoder = nullptr;
+        }
+        if (rung.msEncoder) {
+            opus_multistream_encoder_destroy(rung.msEncoder);
+            rung.msEncoder = nullptr;
+        }
+    }
+}
+
 bool OpusOggEncoder::Open(const std::wstring& filename, const WAVEFORMATEX* format, UINT32 bitrate) {
-    if (m_file.is_open()) {
+    OpusEncoderConfig config;
+    config.bitrate = bitrate;
+    return Open(filename, format, config);
+}
+
+bool OpusOggEncoder::Open(const std::wstring& filename, const WAVEFORMATEX* format, const OpusEncoderConfig& config) {
+    return OpenLadder(std::vector<std::wstring>(1, filename), format, std::vector<OpusEncoderConfig>(1, config));
+}
+
+bool OpusOggEncoder::Open(std::unique_ptr<FileSink> sink, const WAVEFORMATEX* format, const OpusEncoderConfig& config) {
+    if (!sink) {
         return false;
     }
 
-    m_filename = filename;
-    m_format = *format;
-    m_bitrate = bitrate;
-    m_totalSamples = 0;
-    m_granulePos = 0;
-    m_packetCount = 0;
+    m_externalSink = std::move(sink);
+    bool opened = Open(std::wstring(), format, config);
+    m_externalSink.reset();
+    return opened;
+}
 
-    // Opus only supports 48kHz for encoding (or 24, 16, 12, 8 kHz)
-    // We'll use 48kHz as it's the highest quality
-    int opusSampleRate = 48000;
-    int opusChannels = std::min((int)format->nChannels, 2); // Stereo max
+bool OpusOggEncoder::OpenLadder(const std::vector<std::wstring>& filenames, const WAVEFORMATEX* format,
+                                const std::vector<OpusEncoderConfig>& configs) {
+    if (IsOpen() || !format || configs.empty() || filenames.size() != configs.size()) {
+        return false;
+    }
 
-    // Create Opus encoder
-    int error = 0;
-    m_opusEncoder = (::OpusEncoder*)opus_encoder_create(opusSampleRate, opusChannels, OPUS_APPLICATION_AUDIO, &error);
-    if (error != OPUS_OK || !m_opusEncoder) {
+    const OpusEncoderConfig& config = configs[0];
+    int frameTenthsMs = static_cast<int>(config.frameDurationMs * 10.0f + 0.5f);
+    if (!IsValidFrameDuration(frameTenthsMs)) {
         return false;
     }
 
-    // Configure encoder
-    opus_encoder_ctl(m_opusEncoder, OPUS_SET_BITRATE(bitrate));
-    opus_encoder_ctl(m_opusEncoder, OPUS_SET_VBR(1)); // Variable bitrate
-    opus_encoder_ctl(m_opusEncoder, OPUS_SET_COMPLEXITY(10)); // Max quality
-
-    // Frame size is 20ms at 48kHz = 960 samples
-    m_samplesPerFrame = 960;
-
-    // Initialize OGG stream with random serial number
-    m_serialno = static_cast<int>(static_cast<int64_t>(std::time(nullptr)) & 0x7fffffff);
-    if (ogg_stream_init(&m_oggStream, m_serialno) != 0) {
-        opus_encoder_destroy(m_opusEncoder);
-        m_opusEncoder = nullptr;
+    if (config.application != OPUS_APPLICATION_AUDIO &&
+        config.application != OPUS_APPLICATION_VOIP &&
+        config.application != OPUS_APPLICATION_RESTRICTED_LOWDELAY) {
         return false;
     }
 
-    // Open output file
-    m_file.open(filename, std::ios::binary | std::ios::out);
-    if (!m_file.is_open()) {
-        opus_encoder_destroy(m_opusEncoder);
-        ogg_stream_clear(&m_oggStream);
-        m_opusEncoder = nullptr;
+    // Every rung encodes the same frames of the same shared input
+    for (const OpusEncoderConfig& rungConfig : configs) {
+        if (rungConfig.frameDurationMs != config.frameDurationMs ||
+            rungConfig.application != config.application ||
+            rungConfig.downmixToMono != config.downmixToMono) {
+            return false;
+        }
+    }
+
+    if (format->nChannels == 0 || format->nChannels > 255 || format->nSamplesPerSec == 0) {
         return false;
     }
 
-    // Write Opus headers
-    if (!WriteOggHeaders()) {
-        Close();
+    // Determine the actual sample encoding
+    bool isFloat = (format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= 22) {
+        const WAVEFORMATEXTENSIBLE* wfex = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format);
+        isFloat = (wfex->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+    }
+
+    switch (format->wBitsPerSample) {
+    case 16:
+        m_sampleType = SampleType::Int16;
+        break;
+    case 24:
+        m_sampleType = SampleType::Int24;
+        break;
+    case 32:
+        m_sampleType = isFloat ? SampleType::Float32 : SampleType::Int32;
+        break;
+    default:
+        return false; // Unsupported format
+    }
+
+    m_format = *format;
+    m_config = config;
+    m_totalSamples = 0;
+    m_inputFrames = 0;
+    m_granulePos = 0;
+    m_pcmBuffer.clear();
+    m_pcm16Buffer.clear();
+    m_pcmReadPos = 0;
+
+    // Opus encodes natively at 8, 12, 16, 24 or 48 kHz; anything else (e.g. 44.1 kHz)
+    // is resampled to 48 kHz so pitch and duration are preserved
+    m_resample = !IsNativeOpusRate(format->nSamplesPerSec);
+    m_encoderRate = m_resample ? kOpusGranuleRate : static_cast<int>(format->nSamplesPerSec);
+    m_downmix = config.downmixToMono && format->nChannels > 1;
+    m_encodeChannels = m_downmix ? 1 : format->nChannels;
+
+    if (m_resample && !m_resampler.Initialize(format->nSamplesPerSec, kOpusGranuleRate, m_encodeChannels)) {
         return false;
     }
 
+    // Plain encoder for mono/stereo, multistream surround encoder beyond that
+    m_channelOrder.resize(m_encodeChannels);
+    if (m_encodeChannels <= 2) {
+        m_mappingFamily = 0;
+        m_streamCount = 1;
+        m_coupledCount = m_encodeChannels - 1;
+        for (int ch = 0; ch < m_encodeChannels; ch++) {
+            m_channelOrder[ch] = ch;
+        }
+    }
+    else {
+        // Family 1 covers the standard layouts up to 7.1; larger counts use discrete family 255
+        m_mappingFamily = (m_encodeChannels <= 8) ? 1 : 255;
+        for (int ch = 0; ch < m_encodeChannels; ch++) {
+            m_channelOrder[ch] = (m_mappingFamily == 1) ? kVorbisOrder[m_encodeChannels - 1][ch] : ch;
+        }
+    }
+
+    // Frame size at the encoder rate (20ms = 960 samples at 48kHz)
+    m_samplesPerFrame = static_cast<UINT32>(m_encoderRate) * frameTenthsMs / 10000;
+
+    // 16-bit input that needs no resampling or downmix goes straight to opus_encode
+    m_identityOrder = !m_downmix;
+    for (int ch = 0; ch < m_encodeChannels && m_identityOrder; ch++) {
+        m_identityOrder = (m_channelOrder[ch] == ch);
+    }
+    m_nativeInt16 = (m_sampleType == SampleType::Int16) && !m_resample && !m_downmix;
+
+    // Size the scratch buffers once so the encode loop never allocates: room for two frames
+    // plus 100 ms of capture (a typical WASAPI packet is 10 ms)
+    size_t inputFrames = format->nSamplesPerSec / 10;
+    size_t pendingSamples = (static_cast<size_t>(m_samplesPerFrame) * 2 + m_encoderRate / 10) * m_encodeChannels;
+    if (m_nativeInt16) {
+        m_pcm16Buffer.reserve(pendingSamples);
+    } else {
+        m_pcmBuffer.reserve(pendingSamples);
+        m_convertBuffer.reserve(inputFrames * m_encodeChannels);
+    }
+
+    // One encoder, page writer and file per rung; rungs get consecutive serial numbers
+    // starting from a random one
+    m_rungs.clear();
+    m_rungs.resize(configs.size());
+    uint32_t serialno = static_cast<uint32_t>(static_cast<int64_t>(std::time(nullptr)) & 0x7fffffff);
+
+    bool opened = true;
+    for (size_t i = 0; i < m_rungs.size() && opened; i++) {
+        Rung& rung = m_rungs[i];
+        rung.filename = filenames[i];
+        rung.config = configs[i];
+        rung.pages.Reset((serialno + static_cast<uint32_t>(i)) & 0x7fffffff);
+        opened = CreateEncoder(rung);
+    }
+
+    if (opened) {
+        // Pre-skip covers the encoder lookahead plus the resampler's filter delay. The
+        // lookahead depends only on rate and application, so it is the same for every rung.
+        opus_int32 lookahead = 0;
+        EncoderCtl(m_rungs[0], OPUS_GET_LOOKAHEAD(&lookahead));
+        m_preSkip = static_cast<UINT32>(lookahead) * (kOpusGranuleRate / m_encoderRate);
+        if (m_resample) {
+            m_preSkip += m_resampler.GetDelay();
+        }
+        m_maxPacketBytes = static_cast<size_t>(kMaxPacketBytesPerStream) * m_streamCount;
+
+        // Open output files and write the Opus headers
+        for (Rung& rung : m_rungs) {
+            rung.file = m_externalSink ? std::move(m_externalSink) : FileSink::Create(m_sinkOptions);
+            if (!rung.file->Open(rung.filename) || !WriteOggHeaders(rung)) {
+                opened = false;
+                break;
+            }
+        }
+    }
+
+    if (!opened) {
+        DestroyEncoders();
+        for (Rung& rung : m_rungs) {
+            if (rung.file) {
+                rung.file->Close();
+            }
+        }
+        m_rungs.clear();
+        m_resampler.Reset();
+        return false;
+    }
+
+    StartWorkers();
+    return true;
+}
+
+bool OpusOggEncoder::CreateEncoder(Rung& rung) {
+    int error = 0;
+    if (m_encodeChannels <= 2) {
+        rung.opusEncoder = opus_encoder_create(m_encoderRate, m_encodeChannels, rung.config.application, &error);
+        if (error != OPUS_OK || !rung.opusEncoder) {
+            return false;
+        }
+    }
+    else {
+        rung.msEncoder = opus_multistream_surround_encoder_create(m_encoderRate, m_encodeChannels, m_mappingFamily,
+                                                                  &m_streamCount, &m_coupledCount, m_streamMapping,
+                                                                  rung.config.application, &error);
+        if (error != OPUS_OK || !rung.msEncoder) {
+            return false;
+        }
+    }
+
+    // Configure encoder
+    EncoderCtl(rung, OPUS_SET_BITRATE(rung.config.bitrate));
+    EncoderCtl(rung, OPUS_SET_VBR(rung.config.vbr ? 1 : 0));
+    EncoderCtl(rung, OPUS_SET_COMPLEXITY(std::max(0, std::min(rung.config.complexity, 10))));
+    EncoderCtl(rung, OPUS_SET_SIGNAL(rung.config.signal));
+    EncoderCtl(rung, OPUS_SET_MAX_BANDWIDTH(rung.config.maxBandwidth));
+    EncoderCtl(rung, OPUS_SET_DTX(rung.config.dtx ? 1 : 0));
     return true;
 }
 
-bool OpusOggEncoder::WriteOggHeaders() {
+bool OpusOggEncoder::WriteOggHeaders(Rung& rung) {
     // Create OpusHead header
     std::vector<unsigned char> opusHead;
     opusHead.push_back('O');
@@ -99,9 +328,9 @@ bool OpusOggEncoder::WriteOggHeaders() {
     opusHead.push_back('a');
     opusHead.push_back('d');
     opusHead.push_back(1); // Version
-    opusHead.push_back(static_cast<unsigned char>(m_format.nChannels)); // Channel count
-    opusHead.push_back(0); // Pre-skip LSB
-    opusHead.push_back(0); // Pre-skip MSB
+    opusHead.push_back(static_cast<unsigned char>(m_encodeChannels)); // Channel count
+    opusHead.push_back(static_cast<unsigned char>(m_preSkip & 0xFF)); // Pre-skip LSB
+    opusHead.push_back(static_cast<unsigned char>((m_preSkip >> 8) & 0xFF)); // Pre-skip MSB
 
     // Original sample rate (little endian)
     WriteInt32LE(opusHead, static_cast<int32_t>(m_format.nSamplesPerSec));
@@ -110,26 +339,24 @@ bool OpusOggEncoder::WriteOggHeaders() {
     opusHead.push_back(0);
     opusHead.push_back(0);
 
-    // Channel mapping family (0 = mono/stereo)
-    opusHead.push_back(0);
+    // Channel mapping family (0 = mono/stereo, 1 = surround, 255 = discrete)
+    opusHead.push_back(static_cast<unsigned char>(m_mappingFamily));
 
-    // Create OGG packet for OpusHead
-    m_oggPacket.packet = opusHead.data();
-    m_oggPacket.bytes = static_cast<long>(opusHead.size());
-    m_oggPacket.b_o_s = 1; // Beginning of stream
-    m_oggPacket.e_o_s = 0;
-    m_oggPacket.granulepos = 0;
-    m_oggPacket.packetno = m_packetCount++;
+    // Multistream layout: stream count, coupled stream count, channel mapping table
+    if (m_mappingFamily != 0) {
+        opusHead.push_back(static_cast<unsigned char>(m_streamCount));
+        opusHead.push_back(static_cast<unsigned char>(m_coupledCount));
+        for (int ch = 0; ch < m_encodeChannels; ch++) {
+            opusHead.push_back(m_streamMapping[ch]);
+        }
+    }
 
     // Submit packet to OGG stream
-    if (ogg_stream_packetin(&m_oggStream, &m_oggPacket) != 0) {
-        return false;
-    }
+    rung.pages.AddPacket(opusHead.data(), opusHead.size(), 0, false);
 
-    // Write OGG page
-    while (ogg_stream_flush(&m_oggStream, &m_oggPage) != 0) {
-        m_file.write(reinterpret_cast<const char*>(m_oggPage.header), m_oggPage.header_len);
-        m_file.write(reinterpret_cast<const char*>(m_oggPage.body), m_oggPage.body_len);
+    // Headers must each sit on their own page
+    if (!WriteOggPage(rung, true)) {
+        return false;
     }
 
     // Create OpusTags header
@@ -153,157 +380,353 @@ bool OpusOggEncoder::WriteOggHeaders() {
     // User comment list length (0 comments)
     WriteInt32LE(opusTags, 0);
 
-    // Create OGG packet for OpusTags
-    m_oggPacket.packet = opusTags.data();
-    m_oggPacket.bytes = static_cast<long>(opusTags.size());
-    m_oggPacket.b_o_s = 0;
-    m_oggPacket.e_o_s = 0;
-    m_oggPacket.granulepos = 0;
-    m_oggPacket.packetno = m_packetCount++;
-
     // Submit packet to OGG stream
-    if (ogg_stream_packetin(&m_oggStream, &m_oggPacket) != 0) {
-        return false;
-    }
+    rung.pages.AddPacket(opusTags.data(), opusTags.size(), 0, false);
 
-    // Write OGG page
-    while (ogg_stream_flush(&m_oggStream, &m_oggPage) != 0) {
-        m_file.write(reinterpret_cast<const char*>(m_oggPage.header), m_oggPage.header_len);
-        m_file.write(reinterpret_cast<const char*>(m_oggPage.body), m_oggPage.body_len);
+    // Headers must each sit on their own page
+    if (!WriteOggPage(rung, true)) {
+        return false;
     }
 
     return true;
 }
 
 bool OpusOggEncoder::WriteData(const BYTE* data, UINT32 size) {
-    if (!m_file.is_open() || !m_opusEncoder) {
+    if (!IsOpen() || (!m_rungs[0].opusEncoder && !m_rungs[0].msEncoder)) {
         return false;
     }
 
-    // Add data to buffer
-    m_buffer.insert(m_buffer.end(), data, data + size);
+    UINT32 frames = size / m_format.nBlockAlign;
+    if (frames == 0) {
+        return true;
+    }
 
-    // Process complete frames
-    UINT32 frameSize = m_samplesPerFrame * m_format.nBlockAlign;
+    m_inputFrames += frames;
 
-    while (m_buffer.size() >= frameSize) {
-        if (!EncodeBuffer()) {
-            return false;
-        }
+    // Convert (and resample if needed) into the pending encoder-rate buffer once for all rungs
+    if (!ConvertInput(data, frames)) {
+        return false;
+    }
+
+    return EncodePending();
+}
+
+bool OpusOggEncoder::WriteSilence(UINT32 frames) {
+    if (!IsOpen() || (!m_rungs[0].opusEncoder && !m_rungs[0].msEncoder)) {
+        return false;
+    }
 
-        // Remove processed data from buffer
-        m_buffer.erase(m_buffer.begin(), m_buffer.begin() + frameSize);
+    if (frames == 0) {
+        return true;
     }
 
+    m_inputFrames += frames;
+    AppendSilence(frames);
+    return EncodePending();
+}
+
+bool OpusOggEncoder::EncodePending() {
+    // Process complete frames
+    size_t frameSamples = static_cast<size_t>(m_samplesPerFrame) * m_encodeChannels;
+    if (!EncodeFrames(PendingSamples() / frameSamples)) {
+        return false;
+    }
+
+    CompactPendingBuffer();
     return true;
 }
 
-bool OpusOggEncoder::EncodeBuffer() {
-    // Prepare PCM samples for encoding
-    int frameSamples = m_samplesPerFrame;
-    int channels = m_format.nChannels;
+void OpusOggEncoder::AppendSilence(UINT32 frames) {
+    const size_t samples = static_cast<size_t>(frames) * m_encodeChannels;
+
+    if (m_nativeInt16) {
+        m_pcm16Buffer.resize(m_pcm16Buffer.size() + samples, 0);
+        return;
+    }
+
+    // Zeros still pass through the resampler so the tail of the audio before them rings out
+    if (m_resample) {
+        m_convertBuffer.assign(samples, 0.0f);
+        m_resampler.Process(m_convertBuffer.data(), frames, m_pcmBuffer);
+        return;
+    }
+
+    m_pcmBuffer.resize(m_pcmBuffer.size() + samples, 0.0f);
+}
+
+size_t OpusOggEncoder::PendingSamples() const {
+    return (m_nativeInt16 ? m_pcm16Buffer.size() : m_pcmBuffer.size()) - m_pcmReadPos;
+}
+
+void OpusOggEncoder::PadPendingFrame() {
+    // Zero-fill up to one full frame (used only when closing)
+    size_t frameSamples = static_cast<size_t>(m_samplesPerFrame) * m_encodeChannels;
+    if (PendingSamples() >= frameSamples) {
+        return;
+    }
+
+    if (m_nativeInt16) {
+        m_pcm16Buffer.resize(m_pcmReadPos + frameSamples, 0);
+    } else {
+        m_pcmBuffer.resize(m_pcmReadPos + frameSamples, 0.0f);
+    }
+}
+
+void OpusOggEncoder::CompactPendingBuffer() {
+    // Move the leftover partial frame to the front; erase never shrinks capacity
+    if (m_pcmReadPos == 0) {
+        return;
+    }
+
+    if (m_nativeInt16) {
+        m_pcm16Buffer.erase(m_pcm16Buffer.begin(), m_pcm16Buffer.begin() + m_pcmReadPos);
+    } else {
+        m_pcmBuffer.erase(m_pcmBuffer.begin(), m_pcmBuffer.begin() + m_pcmReadPos);
+    }
+    m_pcmReadPos = 0;
+}
+
+bool OpusOggEncoder::ConvertInput(const BYTE* data, UINT32 frames) {
+    const UINT32 blockAlign = m_format.nBlockAlign;
+    const UINT32 bytesPerSample = m_format.wBitsPerSample / 8;
+    const int channels = m_encodeChannels;
+    const size_t samples = static_cast<size_t>(frames) * channels;
+
+    // Native 16-bit path: copy (reordering surround channels if needed), no conversion
+    if (m_nativeInt16) {
+        size_t base = m_pcm16Buffer.size();
+        m_pcm16Buffer.resize(base + samples);
+        opus_int16* dest16 = m_pcm16Buffer.data() + base;
+        const int16_t* source = reinterpret_cast<const int16_t*>(data);
+
+        if (m_identityOrder) {
+            std::memcpy(dest16, source, samples * sizeof(opus_int16));
+        } else {
+            for (UINT32 frame = 0; frame < frames; frame++) {
+                for (int ch = 0; ch < channels; ch++) {
+                    *dest16++ = source[static_cast<size_t>(frame) * channels + m_channelOrder[ch]];
+                }
+            }
+        }
+        return true;
+    }
 
-    // Convert PCM bytes to float samples for Opus
-    std::vector<float> pcmFloat(frameSamples * channels);
+    // Convert to float in encoder channel order
+    std::vector<float>& out = m_resample ? m_convertBuffer : m_pcmBuffer;
+    size_t base = m_resample ? 0 : out.size();
+    out.resize(base + samples);
+    float* dest = out.data() + base;
+
+    // Straight interleaved layout converts in bulk with the vectorized kernels
+    if (m_identityOrder && blockAlign == bytesPerSample * channels) {
+        switch (m_sampleType) {
+        case SampleType::Int16:
+            AudioKernels::Int16ToFloat(reinterpret_cast<const int16_t*>(data), dest, samples);
+            break;
+        case SampleType::Int24:
+            AudioKernels::Int24ToFloat(data, dest, samples);
+            break;
+        case SampleType::Int32:
+            AudioKernels::Int32ToFloat(reinterpret_cast<const int32_t*>(data), dest, samples);
+            break;
+        case SampleType::Float32:
+            std::memcpy(dest, data, samples * sizeof(float));
+            break;
+        }
 
-    if (m_format.wBitsPerSample == 16) {
-        // Convert 16-bit PCM to float
-        const int16_t* pcm16 = reinterpret_cast<const int16_t*>(m_buffer.data());
-        for (int i = 0; i < frameSamples * channels; i++) {
-            pcmFloat[i] = pcm16[i] / 32768.0f;
+        if (m_resample) {
+            m_resampler.Process(m_convertBuffer.data(), frames, m_pcmBuffer);
         }
+        return true;
     }
-    else if (m_format.wBitsPerSample == 32) {
-        // Assume float PCM
-        std::memcpy(pcmFloat.data(), m_buffer.data(), frameSamples * channels * sizeof(float));
+
+    // Downmix reads every source channel into a single encoder channel
+    const int sourceChannels = m_downmix ? m_format.nChannels : channels;
+    const float downmixScale = 1.0f / m_format.nChannels;
+
+    for (UINT32 frame = 0; frame < frames; frame++) {
+        const BYTE* frameData = data + static_cast<size_t>(frame) * blockAlign;
+        float mono = 0.0f;
+
+        for (int ch = 0; ch < sourceChannels; ch++) {
+            const BYTE* sample = frameData + (m_downmix ? ch : m_channelOrder[ch]) * bytesPerSample;
+            float value = 0.0f;
+
+            switch (m_sampleType) {
+            case SampleType::Int16:
+                value = *reinterpret_cast<const int16_t*>(sample) / 32768.0f;
+                break;
+            case SampleType::Int24: {
+                int32_t s24 = (static_cast<int32_t>(sample[0]) << 8) |
+                              (static_cast<int32_t>(sample[1]) << 16) |
+                              (static_cast<int32_t>(sample[2]) << 24);
+                value = (s24 >> 8) / 8388608.0f;
+                break;
+            }
+            case SampleType::Int32:
+                value = *reinterpret_cast<const int32_t*>(sample) / 2147483648.0f;
+                break;
+            case SampleType::Float32:
+                value = *reinterpret_cast<const float*>(sample);
+                break;
+            }
+
+            if (m_downmix) {
+                mono += value;
+            } else {
+                *dest++ = value;
+            }
+        }
+
+        if (m_downmix) {
+            *dest++ = mono * downmixScale;
+        }
     }
-    else {
-        return false; // Unsupported format
+
+    if (m_resample) {
+        m_resampler.Process(m_convertBuffer.data(), frames, m_pcmBuffer);
+    }
+
+    return true;
+}
+
+bool OpusOggEncoder::EncodeFrames(size_t frames, int64_t endGranule) {
+    // Encode frames from the front of the pending buffer into every rung
+    if (frames == 0) {
+        return true;
+    }
+
+    bool success = true;
+    if (m_workers.empty()) {
+        for (Rung& rung : m_rungs) {
+            success = EncodeRung(rung, frames, endGranule) && success;
+        }
+    } else {
+        success = RunBatch(frames, endGranule);
+    }
+
+    m_pcmReadPos += frames * m_samplesPerFrame * m_encodeChannels;
+    m_granulePos += static_cast<int64_t>(frames) * m_samplesPerFrame * (kOpusGranuleRate / m_encoderRate);
+    m_totalSamples += static_cast<UINT64>(frames) * m_samplesPerFrame;
+    return success;
+}
+
+bool OpusOggEncoder::EncodeRung(Rung& rung, size_t frames, int64_t endGranule) {
+    // Reads only the shared pending buffer and granule position, which stay untouched
+    // until every rung has finished the batch
+    size_t frameSamples = static_cast<size_t>(m_samplesPerFrame) * m_encodeChannels;
+    int64_t frameGranule = static_cast<int64_t>(m_samplesPerFrame) * (kOpusGranuleRate / m_encoderRate);
+
+    for (size_t frame = 0; frame < frames; frame++) {
+        bool last = (frame + 1 == frames);
+        if (!EncodeFrame(rung, m_pcmReadPos + frame * frameSamples,
+                         m_granulePos + static_cast<int64_t>(frame) * frameGranule,
+                         last ? endGranule : -1)) {
+            return false;
+        }
     }
+    return true;
+}
 
-    // Encode frame
-    std::vector<unsigned char> opusData(4000); // Max Opus packet size
-    int encodedBytes = opus_encode_float(m_opusEncoder, pcmFloat.data(), frameSamples,
-                                         opusData.data(), static_cast<opus_int32>(opusData.size()));
+bool OpusOggEncoder::EncodeFrame(Rung& rung, size_t pcmOffset, int64_t previousGranule, int64_t endGranule) {
+    // Encode one frame
+    int frameSamples = static_cast<int>(m_samplesPerFrame);
+    opus_int32 maxBytes = static_cast<opus_int32>(m_maxPacketBytes);
+    unsigned char* packet = rung.pages.BeginPacket(m_maxPacketBytes);
+
+    int encodedBytes = 0;
+    if (m_nativeInt16) {
+        const opus_int16* pcm = m_pcm16Buffer.data() + pcmOffset;
+        encodedBytes = rung.msEncoder
+            ? opus_multistream_encode(rung.msEncoder, pcm, frameSamples, packet, maxBytes)
+            : opus_encode(rung.opusEncoder, pcm, frameSamples, packet, maxBytes);
+    } else {
+        const float* pcm = m_pcmBuffer.data() + pcmOffset;
+        encodedBytes = rung.msEncoder
+            ? opus_multistream_encode_float(rung.msEncoder, pcm, frameSamples, packet, maxBytes)
+            : opus_encode_float(rung.opusEncoder, pcm, frameSamples, packet, maxBytes);
+    }
 
     if (encodedBytes < 0) {
         return false; // Encoding error
     }
 
-    // Update granule position
-    m_granulePos += frameSamples;
+    // Granule position after this frame (always counted at 48 kHz)
+    int64_t granulePos = previousGranule + static_cast<int64_t>(frameSamples) * (kOpusGranuleRate / m_encoderRate);
 
-    // Create OGG packet
-    m_oggPacket.packet = opusData.data();
-    m_oggPacket.bytes = static_cast<long>(encodedBytes);
-    m_oggPacket.b_o_s = 0;
-    m_oggPacket.e_o_s = 0;
-    m_oggPacket.granulepos = m_granulePos;
-    m_oggPacket.packetno = m_packetCount++;
+    // The final packet carries the true end position so decoders trim the padding
+    bool endOfStream = endGranule >= 0;
 
-    // Submit packet to OGG stream
-    if (ogg_stream_packetin(&m_oggStream, &m_oggPacket) != 0) {
+    // Commit the packet in place
+    rung.pages.CommitPacket(static_cast<size_t>(encodedBytes),
+                            endOfStream ? std::max(endGranule, previousGranule) : granulePos,
+                            endOfStream);
+
+    // Bound page latency for live consumers: flush once enough audio has accumulated
+    bool latencyFlush = m_config.maxPageLatencyMs > 0 &&
+        (granulePos - rung.lastPageGranule) >= static_cast<int64_t>(m_config.maxPageLatencyMs) * (kOpusGranuleRate / 1000);
+
+    // Write OGG pages
+    if (!WriteOggPage(rung, endOfStream || latencyFlush)) {
         return false;
     }
 
-    // Write OGG pages
-    while (ogg_stream_pageout(&m_oggStream, &m_oggPage) != 0) {
-        m_file.write(reinterpret_cast<const char*>(m_oggPage.header), m_oggPage.header_len);
-        m_file.write(reinterpret_cast<const char*>(m_oggPage.body), m_oggPage.body_len);
+    // Hand the page to the I/O service now so readers tailing the file see it
+    if (latencyFlush) {
+        return rung.file->FlushAsync();
     }
 
-    m_totalSamples += frameSamples;
     return true;
 }
 
 void OpusOggEncoder::Close() {
-    if (!m_file.is_open()) {
+    if (!IsOpen()) {
+        StopWorkers();
+        DestroyEncoders();
         return;
     }
 
-    // Encode any remaining samples
-    if (!m_buffer.empty()) {
-        // Pad buffer to frame size
-        UINT32 frameSize = m_samplesPerFrame * m_format.nBlockAlign;
-        if (m_buffer.size() < frameSize) {
-            m_buffer.resize(frameSize, 0);
+    if (m_rungs[0].opusEncoder || m_rungs[0].msEncoder) {
+        // Drain the resampler so its filter tail reaches the encoder
+        if (m_resample) {
+            m_resampler.Flush(m_pcmBuffer);
         }
-        EncodeBuffer();
-    }
 
-    // Write final OGG packet with e_o_s flag
-    if (m_opusEncoder) {
-        std::vector<unsigned char> emptyPacket(4000);
-        int encodedBytes = opus_encode_float(m_opusEncoder, nullptr, 0,
-                                             emptyPacket.data(), static_cast<opus_int32>(emptyPacket.size()));
+        // Keep encoding (padding with silence) until the pre-skip and encoder lookahead
+        // are covered, then mark the last packet with the exact end position
+        int64_t frameGranule = static_cast<int64_t>(m_samplesPerFrame) * (kOpusGranuleRate / m_encoderRate);
+        int64_t endGranule = m_preSkip +
+            static_cast<int64_t>(m_inputFrames * kOpusGranuleRate / m_format.nSamplesPerSec);
 
-        if (encodedBytes > 0) {
-            m_oggPacket.packet = emptyPacket.data();
-            m_oggPacket.bytes = static_cast<long>(encodedBytes);
-            m_oggPacket.b_o_s = 0;
-            m_oggPacket.e_o_s = 1; // End of stream
-            m_oggPacket.granulepos = m_granulePos;
-            m_oggPacket.packetno = m_packetCount++;
+        while (true) {
+            PadPendingFrame();
 
-            ogg_stream_packetin(&m_oggStream, &m_oggPacket);
+            bool last = (m_granulePos + frameGranule >= endGranule);
+            if (!EncodeFrames(1, last ? endGranule : -1) || last) {
+                break;
+            }
         }
     }
 
-    // Flush remaining OGG pages
-    while (ogg_stream_flush(&m_oggStream, &m_oggPage) != 0) {
-        m_file.write(reinterpret_cast<const char*>(m_oggPage.header), m_oggPage.header_len);
-        m_file.write(reinterpret_cast<const char*>(m_oggPage.body), m_oggPage.body_len);
+    StopWorkers();
+
+    // Flush remaining OGG pages and close every rung. The rungs stay so their file
+    // names and sync stats can still be read.
+    for (Rung& rung : m_rungs) {
+        WriteOggPage(rung, true);
     }
 
     // Clean up
-    if (m_opusEncoder) {
-        opus_encoder_destroy(m_opusEncoder);
-        m_opusEncoder = nullptr;
-    }
+    DestroyEncoders();
 
-    ogg_stream_clear(&m_oggStream);
-    m_file.close();
-    m_buffer.clear();
+    for (Rung& rung : m_rungs) {
+        rung.file->Close();
+    }
+    m_pcmBuffer.clear();
+    m_pcm16Buffer.clear();
+    m_pcmReadPos = 0;
+    m_convertBuffer.clear();
+    m_resampler.Reset();
 }
 
 bool OpusOggEncoder::InitializeOggStream() {
@@ -311,7 +734,158 @@ bool OpusOggEncoder::InitializeOggStream() {
     return true;
 }
 
-bool OpusOggEncoder::WriteOggPage(bool /*flush*/) {
-    // Already handled in EncodeBuffer()
+bool OpusOggEncoder::WriteOggPage(Rung& rung, bool flush) {
+    // Write out every completed page (or everything pending when flushing), one write per page
+    const uint8_t* page = nullptr;
+    size_t pageSize = 0;
+    while (flush ? rung.pages.Flush(page, pageSize) : rung.pages.PageOut(page, pageSize)) {
+        if (!rung.file->Write(page, pageSize)) {
+            return false;
+        }
+
+        int64_t pageGranule = rung.pages.GetLastPageGranule();
+        if (pageGranule > 0) {
+            rung.lastPageGranule = pageGranule;
+        }
+    }
+
     return true;
 }
+
+void OpusOggEncoder::StartWorkers() {
+    // The calling thread encodes one rung itself, so a single-rung file needs no workers
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t workerCount = std::min(m_rungs.size() - 1, static_cast<size_t>(hardwareThreads - 1));
+
+    m_stopWorkers = false;
+    m_batchNumber = 0;
+    for (size_t i = 0; i < workerCount; i++) {
+        m_workers.emplace_back(&OpusOggEncoder::WorkerThread, this);
+    }
+}
+
+void OpusOggEncoder::StopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_batchMutex);
+        m_stopWorkers = true;
+    }
+    m_batchCondition.notify_all();
+
+    for (std::thread& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    m_workers.clear();
+}
+
+void OpusOggEncoder::WorkerThread() {
+    UINT64 batchSeen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_batchMutex);
+            m_batchCondition.wait(lock, [this, batchSeen] {
+                return m_stopWorkers || m_batchNumber != batchSeen;
+            });
+            if (m_stopWorkers) {
+                return;
+            }
+            batchSeen = m_batchNumber;
+        }
+
+        EncodeClaimedRungs();
+    }
+}
+
+bool OpusOggEncoder::RunBatch(size_t frames, int64_t endGranule) {
+    {
+        std::lock_guard<std::mutex> lock(m_batchMutex);
+        m_batchFrames = frames;
+        m_batchEndGranule = endGranule;
+        m_nextRung = 0;
+        m_rungsRemaining = m_rungs.size();
+        m_batchFailed = false;
+        m_batchNumber++;
+    }
+    m_batchCondition.notify_all();
+
+    // Take rungs alongside the workers, then wait for the ones still running
+    EncodeClaimedRungs();
+
+    std::unique_lock<std::mutex> lock(m_batchMutex);
+    m_batchDoneCondition.wait(lock, [this] { return m_rungsRemaining == 0; });
+    return !m_batchFailed;
+}
+
+void OpusOggEncoder::EncodeClaimedRungs() {
+    while (true) {
+        size_t index;
+        size_t frames;
+        int64_t endGranule;
+        {
+            std::lock_guard<std::mutex> lock(m_batchMutex);
+            if (m_nextRung >= m_rungs.size() || m_rungsRemaining == 0) {
+                return;
+            }
+            index = m_nextRung++;
+            frames = m_batchFrames;
+            endGranule = m_batchEndGranule;
+        }
+
+        bool success = EncodeRung(m_rungs[index], frames, endGranule);
+
+        std::lock_guard<std::mutex> lock(m_batchMutex);
+        if (!success) {
+            m_batchFailed = true;
+        }
+        if (--m_rungsRemaining == 0) {
+            m_batchDoneCondition.notify_all();
+        }
+    }
+}
+
+bool OpusOggEncoder::VerifyFrameCount(const std::wstring& filename, UINT32 sampleRate, UINT64 frames) {
+    if (sampleRate == 0) {
+        return false;
+    }
+
+    HANDLE file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    // The pre-skip is in the OpusHead packet on the first page; the end position is the
+    // granule of the page that ends the file (a page is at most 65307 bytes)
+    LARGE_INTEGER fileSize = {};
+    BYTE head[27 + 255 + 19];
+    std::vector<BYTE> tail;
+    bool ok = GetFileSizeEx(file, &fileSize) && ReadFileAt(file, 0, head, sizeof(head));
+    if (ok) {
+        UINT64 size = static_cast<UINT64>(fileSize.QuadPart);
+        tail.resize(static_cast<size_t>(std::min<UINT64>(size, 65307)));
+        ok = ReadFileAt(file, size - tail.size(), tail.data(), static_cast<DWORD>(tail.size()));
+    }
+    CloseHandle(file);
+    if (!ok || std::memcmp(head, "OggS", 4) != 0) {
+        return false;
+    }
+
+    const BYTE* opusHead = head + 27 + head[26];
+    if (std::memcmp(opusHead, "OpusHead", 8) != 0) {
+        return false;
+    }
+    UINT32 preSkip = opusHead[10] | (opusHead[11] << 8);
+
+    // Find the page that runs exactly to the end of the file
+    for (size_t pos = tail.size() >= 27 ? tail.size() - 27 + 1 : 0; pos-- > 0;) {
+        if (OggPageSize(tail.data() + pos, tail.size() - pos) == tail.size() - pos) {
+            int64_t granule;
+            std::memcpy(&granule, tail.data() + pos + 6, sizeof(granule));
+            // Same end position Close writes
+            return granule == static_cast<int64_t>(preSkip) +
+                              static_cast<int64_t>(frames * kOpusGranuleRate / sampleRate);
+        }
+    }
+    return false;
+}
@@ -0,0 +1,324 @@
+#include "PrerollBuffer.h"
+#include "OggPageWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Every Ogg page (at most 65307 bytes) fits in one chunk
+constexpr size_t kChunkBytes = 64 * 1024;
+
+// Pages are forced out at least this often, so a save misses at most this much audio
+constexpr UINT32 kPageLatencyMs = 200;
+
+const int64_t kOpusGranuleRate = 48000;
+
+// Ogg page header fields
+constexpr size_t kHeaderTypeOffset = 5;
+constexpr size_t kGranuleOffset = 6;
+constexpr size_t kSequenceOffset = 18;
+constexpr size_t kCrcOffset = 22;
+constexpr BYTE kContinuedPacket = 0x01;
+constexpr BYTE kEndOfStream = 0x04;
+
+size_t PageSize(const BYTE* page) {
+    size_t size = 27 + page[26];
+    for (int i = 0; i < page[26]; i++) {
+        size += page[27 + i];
+    }
+    return size;
+}
+
+} // namespace
+
+// Hands each page the encoder writes to the ring instead of a file
+class PrerollBuffer::RingSink : public FileSink {
+public:
+    explicit RingSink(PrerollBuffer* owner) : m_owner(owner), m_open(false), m_position(0) {}
+
+    bool Open(const std::wstring&) override {
+        m_open = true;
+        m_position = 0;
+        return true;
+    }
+
+    bool Write(const void* data, size_t size) override {
+        if (!m_open) {
+            return false;
+        }
+        m_position += size;
+        return m_owner->AddPage(static_cast<const BYTE*>(data), size);
+    }
+
+    // Ogg pages are never patched after they are written
+    bool WriteAt(UINT64, const void*, UINT32) override { return false; }
+    bool Flush() override { return true; }
+    bool FlushAsync() override { return true; }
+    void Close() override { m_open = false; }
+    bool IsOpen() const override { return m_open; }
+    UINT64 GetPosition() const override { return m_position; }
+    UINT64 GetSubmittedPosition() const override { return m_position; }
+    FileSyncStats GetSyncStats() const override { return FileSyncStats(); }
+
+private:
+    PrerollBuffer* m_owner;
+    bool m_open;
+    UINT64 m_position;
+};
+
+PrerollBuffer::PrerollBuffer()
+    : m_writeChunk(0)
+    , m_writeOffset(0)
+    , m_durationGranules(0)
+    , m_startGranule(0)
+    , m_endGranule(0)
+    , m_saveStop(false)
+{
+}
+
+PrerollBuffer::~PrerollBuffer() {
+    Stop();
+}
+
+bool PrerollBuffer::Start(const WAVEFORMATEX* format, UINT32 seconds, const OpusEncoderConfig& config) {
+    if (IsActive() || !format || seconds == 0 || config.bitrate == 0) {
+        return false;
+    }
+
+    // Constant bitrate plus about 10% for page headers and lacing, with a spare chunk
+    // for the one being reused and one for rounding
+    UINT64 audioBytes = static_cast<UINT64>(seconds) * (config.bitrate / 8);
+    size_t chunkCount = static_cast<size_t>((audioBytes + audioBytes / 10) / kChunkBytes) + 2;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_chunks.assign(chunkCount, std::vector<BYTE>(kChunkBytes));
+        m_writeChunk = 0;
+        m_writeOffset = 0;
+        m_pages.clear();
+        m_headerPages.clear();
+        m_durationGranules = static_cast<int64_t>(seconds) * kOpusGranuleRate;
+        m_startGranule = 0;
+        m_endGranule = 0;
+    }
+
+    OpusEncoderConfig ringConfig = config;
+    ringConfig.vbr = false;
+    ringConfig.maxPageLatencyMs = kPageLatencyMs;
+    if (!m_encoder.Open(std::make_unique<RingSink>(this), format, ringConfig)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<std::vector<BYTE>>().swap(m_chunks);
+        return false;
+    }
+
+    return true;
+}
+
+bool PrerollBuffer::WriteData(const BYTE* data, UINT32 size) {
+    return IsActive() && m_encoder.WriteData(data, size);
+}
+
+bool PrerollBuffer::WriteSilence(UINT32 frames) {
+    return IsActive() && m_encoder.WriteSilence(frames);
+}
+
+bool PrerollBuffer::AddPage(const BYTE* data, size_t size) {
+    if (size < 27 || size > kChunkBytes) {
+        return false;
+    }
+
+    UINT32 sequence;
+    int64_t granule;
+    std::memcpy(&sequence, data + kSequenceOffset, sizeof(sequence));
+    std::memcpy(&granule, data + kGranuleOffset, sizeof(granule));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The first two pages are the stream headers every saved file starts with
+    if (sequence < 2) {
+        m_headerPages.insert(m_headerPages.end(), data, data + size);
+        return true;
+    }
+
+    // Move to the next chunk when this one is full, dropping the pages it still holds
+    // (always the oldest ones)
+    if (m_writeOffset + size > kChunkBytes) {
+        m_writeChunk = (m_writeChunk + 1) % m_chunks.size();
+        m_writeOffset = 0;
+        while (!m_pages.empty() && m_pages.front().chunk == m_writeChunk) {
+            EvictOldest();
+        }
+    }
+
+    std::memcpy(m_chunks[m_writeChunk].data() + m_writeOffset, data, size);
+
+    Page page;
+    page.chunk = m_writeChunk;
+    page.offset = m_writeOffset;
+    page.size = size;
+    page.granule = granule;
+    page.continued = (data[kHeaderTypeOffset] & kContinuedPacket) != 0;
+    m_pages.push_back(page);
+    m_writeOffset += size;
+
+    // Keep no more than the configured length
+    if (granule >= 0) {
+        m_endGranule = granule;
+    }
+    while (m_pages.size() > 1 && m_pages.front().granule >= 0 &&
+           m_endGranule - m_pages.front().granule >= m_durationGranules) {
+        EvictOldest();
+    }
+
+    return true;
+}
+
+void PrerollBuffer::EvictOldest() {
+    if (m_pages.front().granule >= 0) {
+        m_startGranule = m_pages.front().granule;
+    }
+    m_pages.pop_front();
+}
+
+bool PrerollBuffer::Save(const std::wstring& filename) {
+    std::vector<BYTE> snapshot;
+    int64_t baseGranule;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Start at the first whole packet and end at the last one
+        size_t first = 0;
+        baseGranule = m_startGranule;
+        while (first < m_pages.size() && (m_pages[first].continued || m_pages[first].granule < 0)) {
+            if (m_pages[first].granule >= 0) {
+                baseGranule = m_pages[first].granule;
+            }
+            first++;
+        }
+        size_t end = m_pages.size();
+        while (end > first && m_pages[end - 1].granule < 0) {
+            end--;
+        }
+        if (m_headerPages.empty() || first == end) {
+            return false;
+        }
+
+        size_t bytes = m_headerPages.size();
+        for (size_t i = first; i < end; i++) {
+            bytes += m_pages[i].size;
+        }
+        snapshot.reserve(bytes);
+        snapshot.insert(snapshot.end(), m_headerPages.begin(), m_headerPages.end());
+        for (size_t i = first; i < end; i++) {
+            const BYTE* page = m_chunks[m_pages[i].chunk].data() + m_pages[i].offset;
+            snapshot.insert(snapshot.end(), page, page + m_pages[i].size);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_saveMutex);
+        m_saveQueue.push_back({ filename, std::move(snapshot), baseGranule, m_sinkOptions });
+        if (!m_saveThread.joinable()) {
+            m_saveThread = std::thread(&PrerollBuffer::SaveThread, this);
+        }
+    }
+    m_saveCondition.notify_one();
+    return true;
+}
+
+void PrerollBuffer::SaveThread() {
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    // Every queued save is written before the thread exits
+    std::unique_lock<std::mutex> lock(m_saveMutex);
+    while (true) {
+        m_saveCondition.wait(lock, [this] { return !m_saveQueue.empty() || m_saveStop; });
+        if (m_saveQueue.empty()) {
+            break;
+        }
+
+        SaveJob job = std::move(m_saveQueue.front());
+        m_saveQueue.pop_front();
+        lock.unlock();
+
+        WriteSnapshot(job.filename, std::move(job.pages), job.baseGranule, job.options);
+
+        lock.lock();
+    }
+}
+
+void PrerollBuffer::WriteSnapshot(const std::wstring& filename, std::vector<BYTE> pages,
+                                  int64_t baseGranule, FileSinkOptions options) {
+    // Find the last page so it can carry the end-of-stream flag
+    size_t lastPage = 0;
+    for (size_t offset = 0; offset < pages.size(); offset += PageSize(pages.data() + offset)) {
+        lastPage = offset;
+    }
+
+    // Make the pages a stream of their own: sequence numbers follow the headers and the
+    // granules count from the start of the oldest buffered packet
+    UINT32 sequence = 0;
+    for (size_t offset = 0; offset < pages.size(); sequence++) {
+        BYTE* page = pages.data() + offset;
+        size_t size = PageSize(page);
+
+        if (sequence >= 2) {
+            int64_t granule;
+            std::memcpy(&granule, page + kGranuleOffset, sizeof(granule));
+            if (granule >= 0) {
+                granule -= baseGranule;
+                std::memcpy(page + kGranuleOffset, &granule, sizeof(granule));
+            }
+        }
+        std::memcpy(page + kSequenceOffset, &sequence, sizeof(sequence));
+        if (offset == lastPage) {
+            page[kHeaderTypeOffset] |= kEndOfStream;
+        }
+
+        UINT32 crc = 0;
+        std::memcpy(page + kCrcOffset, &crc, sizeof(crc));
+        crc = OggPageWriter::Crc(page, size);
+        std::memcpy(page + kCrcOffset, &crc, sizeof(crc));
+
+        offset += size;
+    }
+
+    std::unique_ptr<FileSink> file = FileSink::Create(options);
+    if (!file->Open(filename)) {
+        return;
+    }
+    bool written = file->Write(pages.data(), pages.size());
+    file->Close();
+    if (!written) {
+        DeleteFileW(filename.c_str());
+    }
+}
+
+void PrerollBuffer::Stop() {
+    m_encoder.Close();
+
+    if (m_saveThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_saveMutex);
+            m_saveStop = true;
+        }
+        m_saveCondition.notify_one();
+        m_saveThread.join();
+        m_saveStop = false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::vector<BYTE>>().swap(m_chunks);
+    m_pages.clear();
+    m_headerPages.clear();
+}
+
+size_t PrerollBuffer::GetReservedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_chunks.size() * kChunkBytes;
+}
+
+UINT64 PrerollBuffer::GetBufferedMs() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<UINT64>(m_endGranule - m_startGranule) * 1000 / kOpusGranuleRate;
+}
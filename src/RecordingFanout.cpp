@@ -0,0 +1,262 @@
+#include "RecordingFanout.h"
+#include "AudioKernels.h"
+#include <ks.h>
+#include <ksmedia.h>
+#include <cstring>
+
+namespace {
+
+UINT32 BitsPerSample(SampleRepresentation representation) {
+    switch (representation) {
+    case SampleRepresentation::Int16:
+        return 16;
+    case SampleRepresentation::Int24:
+        return 24;
+    case SampleRepresentation::Float32:
+    default:
+        return 32;
+    }
+}
+
+// The capture format with its samples changed to the given representation. Channel count,
+// rate and (for WAVEFORMATEXTENSIBLE) the channel mask are kept.
+std::vector<BYTE> MakeFormat(SampleRepresentation representation, const std::vector<BYTE>& captureFormat) {
+    std::vector<BYTE> formatData = captureFormat;
+    if (representation == SampleRepresentation::Native) {
+        return formatData;
+    }
+
+    bool isFloat = (representation == SampleRepresentation::Float32);
+    WAVEFORMATEX* format = reinterpret_cast<WAVEFORMATEX*>(formatData.data());
+    format->wBitsPerSample = static_cast<WORD>(BitsPerSample(representation));
+    format->nBlockAlign = static_cast<WORD>(format->nChannels * format->wBitsPerSample / 8);
+    format->nAvgBytesPerSec = format->nSamplesPerSec * format->nBlockAlign;
+
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= 22) {
+        WAVEFORMATEXTENSIBLE* wfex = reinterpret_cast<WAVEFORMATEXTENSIBLE*>(format);
+        wfex->Samples.wValidBitsPerSample = format->wBitsPerSample;
+        wfex->SubFormat = isFloat ? KSDATAFORMAT_SUBTYPE_IEEE_FLOAT : KSDATAFORMAT_SUBTYPE_PCM;
+    } else {
+        format->wFormatTag = isFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+        format->cbSize = 0;
+        formatData.resize(sizeof(WAVEFORMATEX));
+    }
+    return formatData;
+}
+
+} // namespace
+
+RecordingFanout::RecordingFanout()
+    : m_captureType(SampleType::Other)
+{
+}
+
+RecordingFanout::~RecordingFanout() {
+    Close();
+}
+
+bool RecordingFanout::Add(const std::wstring& filename, const WAVEFORMATEX* captureFormat, const RecordingOptions& options) {
+    if (!captureFormat || captureFormat->nBlockAlign == 0) {
+        return false;
+    }
+
+    // Keep the whole format, including any WAVEFORMATEXTENSIBLE tail
+    size_t formatSize = sizeof(WAVEFORMATEX) + (captureFormat->wFormatTag != WAVE_FORMAT_PCM ? captureFormat->cbSize : 0);
+    std::vector<BYTE> formatData(reinterpret_cast<const BYTE*>(captureFormat),
+                                 reinterpret_cast<const BYTE*>(captureFormat) + formatSize);
+    if (m_captureFormat.empty()) {
+        m_captureFormat = formatData;
+        m_captureType = GetSampleType(captureFormat);
+    } else if (formatData != m_captureFormat) {
+        return false;
+    }
+
+    SampleRepresentation representation = PreferredRepresentation(options.format, captureFormat);
+    std::vector<BYTE> outputFormat = MakeFormat(representation, m_captureFormat);
+
+    auto output = std::make_unique<RecordingOutput>();
+    if (!output->Open(filename, reinterpret_cast<const WAVEFORMATEX*>(outputFormat.data()), options)) {
+        return false;
+    }
+
+    Output entry;
+    entry.output = std::move(output);
+    entry.conversion = FindConversion(representation, outputFormat);
+    m_outputs.push_back(std::move(entry));
+    return true;
+}
+
+bool RecordingFanout::WriteData(const BYTE* data, UINT32 size) {
+    if (m_outputs.empty()) {
+        return false;
+    }
+
+    const WAVEFORMATEX* captureFormat = reinterpret_cast<const WAVEFORMATEX*>(m_captureFormat.data());
+    size_t samples = static_cast<size_t>(size / captureFormat->nBlockAlign) * captureFormat->nChannels;
+
+    // Convert once per representation; float is the common intermediate
+    const float* floats = nullptr;
+    for (Conversion& conversion : m_conversions) {
+        if (conversion.representation == SampleRepresentation::Native) {
+            continue;
+        }
+        if (!floats) {
+            floats = ToFloat(data, samples);
+        }
+
+        switch (conversion.representation) {
+        case SampleRepresentation::Int16:
+            conversion.buffer.resize(samples * sizeof(int16_t));
+            AudioKernels::FloatToInt16(floats, reinterpret_cast<int16_t*>(conversion.buffer.data()), samples);
+            break;
+        case SampleRepresentation::Int24:
+            conversion.buffer.resize(samples * 3);
+            AudioKernels::FloatToInt24(floats, conversion.buffer.data(), samples);
+            break;
+        case SampleRepresentation::Float32:
+        case SampleRepresentation::Native:
+            break;
+        }
+    }
+
+    bool success = true;
+    for (Output& entry : m_outputs) {
+        const Conversion& conversion = m_conversions[entry.conversion];
+        const BYTE* block = data;
+        UINT32 blockSize = size;
+        if (conversion.representation == SampleRepresentation::Float32) {
+            block = reinterpret_cast<const BYTE*>(floats);
+            blockSize = static_cast<UINT32>(samples * sizeof(float));
+        } else if (conversion.representation != SampleRepresentation::Native) {
+            block = conversion.buffer.data();
+            blockSize = static_cast<UINT32>(conversion.buffer.size());
+        }
+
+        if (!entry.output->WriteData(block, blockSize)) {
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool RecordingFanout::WriteSilence(UINT32 frames) {
+    bool success = !m_outputs.empty();
+    for (Output& entry : m_outputs) {
+        if (!entry.output->WriteSilence(frames)) {
+            success = false;
+        }
+    }
+    return success;
+}
+
+void RecordingFanout::ReleaseBuffers() {
+    for (Conversion& conversion : m_conversions) {
+        std::vector<BYTE>().swap(conversion.buffer);
+    }
+    std::vector<float>().swap(m_floatBuffer);
+}
+
+bool RecordingFanout::CutSegment() {
+    bool success = !m_outputs.empty();
+    for (Output& entry : m_outputs) {
+        if (!entry.output->CutSegment()) {
+            success = false;
+        }
+    }
+    return success;
+}
+
+void RecordingFanout::Close() {
+    for (Output& entry : m_outputs) {
+        entry.output->Close();
+    }
+    m_outputs.clear();
+    m_conversions.clear();
+    m_captureFormat.clear();
+}
+
+FileSyncStats RecordingFanout::GetSyncStats(size_t index) const {
+    return index < m_outputs.size() ? m_outputs[index].output->GetSyncStats() : FileSyncStats();
+}
+
+SampleRepresentation RecordingFanout::PreferredRepresentation(AudioFormat format, const WAVEFORMATEX* captureFormat) {
+    SampleType captured = GetSampleType(captureFormat);
+    if (captured == SampleType::Other) {
+        return SampleRepresentation::Native;
+    }
+
+    switch (format) {
+    case AudioFormat::FLAC:
+        return (captured == SampleType::Int16 || captured == SampleType::Int24)
+            ? SampleRepresentation::Native : SampleRepresentation::Int24;
+    case AudioFormat::OPUS:
+        return (captured == SampleType::Float32 || captured == SampleType::Int16)
+            ? SampleRepresentation::Native : SampleRepresentation::Float32;
+    case AudioFormat::WAV:
+    case AudioFormat::MP3:
+    default:
+        return SampleRepresentation::Native;
+    }
+}
+
+RecordingFanout::SampleType RecordingFanout::GetSampleType(const WAVEFORMATEX* format) {
+    bool isFloat = (format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+    if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE && format->cbSize >= 22) {
+        const WAVEFORMATEXTENSIBLE* wfex = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(format);
+        isFloat = (wfex->SubFormat == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+    }
+
+    // Only tightly packed samples can be converted
+    if (format->nBlockAlign != format->nChannels * format->wBitsPerSample / 8) {
+        return SampleType::Other;
+    }
+
+    switch (format->wBitsPerSample) {
+    case 16:
+        return isFloat ? SampleType::Other : SampleType::Int16;
+    case 24:
+        return isFloat ? SampleType::Other : SampleType::Int24;
+    case 32:
+        return isFloat ? SampleType::Float32 : SampleType::Int32;
+    default:
+        return SampleType::Other;
+    }
+}
+
+size_t RecordingFanout::FindConversion(SampleRepresentation representation, const std::vector<BYTE>& formatData) {
+    for (size_t i = 0; i < m_conversions.size(); i++) {
+        if (m_conversions[i].representation == representation) {
+            return i;
+        }
+    }
+
+    Conversion conversion;
+    conversion.representation = representation;
+    conversion.formatData = formatData;
+    m_conversions.push_back(std::move(conversion));
+    return m_conversions.size() - 1;
+}
+
+const float* RecordingFanout::ToFloat(const BYTE* data, size_t samples) {
+    if (m_captureType == SampleType::Float32) {
+        return reinterpret_cast<const float*>(data);
+    }
+
+    m_floatBuffer.resize(samples);
+    switch (m_captureType) {
+    case SampleType::Int16:
+        AudioKernels::Int16ToFloat(reinterpret_cast<const int16_t*>(data), m_floatBuffer.data(), samples);
+        break;
+    case SampleType::Int24:
+        AudioKernels::Int24ToFloat(data, m_floatBuffer.data(), samples);
+        break;
+    case SampleType::Int32:
+        AudioKernels::Int32ToFloat(reinterpret_cast<const int32_t*>(data), m_floatBuffer.data(), samples);
+        break;
+    case SampleType::Float32:
+    case SampleType::Other:
+        break;
+    }
+    return m_floatBuffer.data();
+}
@@ -0,0 +1,453 @@
+#include "RecordingOutput.h"
+#include "Transcoder.h"
+#include <objbase.h>
+#include <algorithm>
+#include <cstring>
+
+RecordingOutput::RecordingOutput()
+    : m_segmentNumber(0)
+    , m_segmentFrames(0)
+    , m_framesUntilRotation(0)
+    , m_openRequested(false)
+    , m_openFailed(false)
+    , m_stopWorker(false)
+{
+}
+
+RecordingOutput::~RecordingOutput() {
+    Close();
+}
+
+bool RecordingOutput::Open(const std::wstring& filename, const WAVEFORMATEX* format, const RecordingOptions& options) {
+    if (IsOpen() || !format || format->nBlockAlign == 0) {
+        return false;
+    }
+
+    m_options = options;
+
+    // Keep the whole format, including any WAVEFORMATEXTENSIBLE tail
+    size_t formatSize = sizeof(WAVEFORMATEX) + (format->wFormatTag != WAVE_FORMAT_PCM ? format->cbSize : 0);
+    m_formatData.assign(reinterpret_cast<const BYTE*>(format), reinterpret_cast<const BYTE*>(format) + formatSize);
+
+    // Split off the extension so segments can be numbered before it
+    size_t dot = filename.find_last_of(L'.');
+    size_t slash = filename.find_last_of(L"\\/");
+    if (dot != std::wstring::npos && (slash == std::wstring::npos || dot > slash)) {
+        m_baseName = filename.substr(0, dot);
+        m_extension = filename.substr(dot);
+    } else {
+        m_baseName = filename;
+        m_extension.clear();
+    }
+
+    m_current = OpenSegment(filename);
+    if (!m_current) {
+        return false;
+    }
+    m_segmentNumber = 1;
+
+    m_segmentFrames = static_cast<UINT64>(options.segments.segmentSeconds) * format->nSamplesPerSec;
+    if (m_segmentFrames == 0 && !options.segments.onDemand) {
+        return true;
+    }
+
+    // The first segment runs to the next clock boundary
+    m_framesUntilRotation = SegmentLength(false, 0);
+
+    m_stopWorker = false;
+    m_openFailed = false;
+    m_worker = std::thread(&RecordingOutput::WorkerThread, this);
+    RequestNextSegment();
+    return true;
+}
+
+bool RecordingOutput::WriteData(const BYTE* data, UINT32 size) {
+    return data && WriteFrames(data, size / Format()->nBlockAlign);
+}
+
+bool RecordingOutput::WriteSilence(UINT32 frames) {
+    return WriteFrames(nullptr, frames);
+}
+
+bool RecordingOutput::WriteFrames(const BYTE* data, UINT32 frames) {
+    if (!m_current) {
+        return false;
+    }
+
+    // Null data stands for silence
+    UINT32 blockAlign = Format()->nBlockAlign;
+    auto write = [&](UINT32 count) {
+        return data ? WriteSegment(*m_current, data, count * blockAlign)
+                    : WriteSegmentSilence(*m_current, count);
+    };
+
+    if (m_segmentFrames == 0) {
+        return write(frames);
+    }
+
+    // Cut the buffer at the boundary frame; the rest starts the next segment
+    bool success = true;
+    while (frames > 0) {
+        if (frames < m_framesUntilRotation) {
+            m_framesUntilRotation -= frames;
+            return write(frames) && success;
+        }
+
+        UINT32 head = static_cast<UINT32>(m_framesUntilRotation);
+        if (head > 0) {
+            success = write(head) && success;
+        }
+        if (data) {
+            data += static_cast<size_t>(head) * blockAlign;
+        }
+        frames -= head;
+
+        Rotate(true, frames);
+    }
+
+    return success;
+}
+
+bool RecordingOutput::CutSegment() {
+    if (!m_current || !m_worker.joinable()) {
+        return false;
+    }
+
+    UINT32 segmentNumber = m_segmentNumber;
+    Rotate();
+    return m_segmentNumber != segmentNumber;
+}
+
+void RecordingOutput::Close() {
+    if (!m_current) {
+        return;
+    }
+
+    CloseSegment(*m_current);
+    m_current.reset();
+
+    // The worker finalizes everything queued before it stops
+    if (m_worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_openRequested = false;
+            m_stopWorker = true;
+        }
+        m_workCondition.notify_one();
+        m_worker.join();
+    }
+
+    // A segment opened ahead of time but never reached holds only headers
+    if (m_next) {
+        CloseSegment(*m_next, false);
+        DeleteFileW(m_next->filename.c_str());
+        if (m_next->opusEncoder) {
+            for (size_t rung = 1; rung < m_next->opusEncoder->GetRungCount(); rung++) {
+                DeleteFileW(m_next->opusEncoder->GetFileName(rung).c_str());
+            }
+        }
+        m_next.reset();
+    }
+
+    m_segmentFrames = 0;
+}
+
+FileSyncStats RecordingOutput::GetSyncStats() const {
+    if (!m_current) {
+        return FileSyncStats();
+    }
+    if (m_current->journalWriter) {
+        return m_current->journalWriter->GetSyncStats();
+    }
+
+    switch (m_options.format) {
+    case AudioFormat::WAV:
+        return m_current->wavWriter->GetSyncStats();
+    case AudioFormat::OPUS:
+        return m_current->opusEncoder->GetSyncStats();
+    case AudioFormat::FLAC:
+        return m_current->flacEncoder->GetSyncStats();
+    case AudioFormat::MP3:
+        return m_current->mp3Encoder->GetSyncStats();
+    default:
+        return FileSyncStats();
+    }
+}
+
+UINT64 RecordingOutput::SegmentLength(bool atBoundary, UINT32 framesAfterCut) const {
+    if (!m_options.segments.alignToClock || m_segmentFrames == 0) {
+        return m_segmentFrames;
+    }
+
+    // Measured from the wall clock every time, so drift between the audio clock and the
+    // local time (or a clock adjustment) is corrected at the next cut instead of building up.
+    // The clock reads the time of the end of the current buffer, framesAfterCut past the cut.
+    SYSTEMTIME now;
+    GetLocalTime(&now);
+    UINT64 msOfDay = ((now.wHour * 60ULL + now.wMinute) * 60ULL + now.wSecond) * 1000ULL + now.wMilliseconds;
+    UINT64 periodMs = static_cast<UINT64>(m_options.segments.segmentSeconds) * 1000ULL;
+    UINT64 remainingMs = periodMs - msOfDay % periodMs;
+
+    // A cut made at a boundary can read the clock just before it; aim for the next one
+    if (atBoundary && remainingMs < periodMs / 2) {
+        remainingMs += periodMs;
+    }
+
+    UINT64 frames = remainingMs * Format()->nSamplesPerSec / 1000ULL + framesAfterCut;
+    return frames > 0 ? frames : m_segmentFrames;
+}
+
+void RecordingOutput::Rotate(bool atBoundary, UINT32 framesAfterCut) {
+    std::unique_ptr<Segment> next;
+    {
+        // Normally the next segment has been open for a whole segment length already
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_readyCondition.wait(lock, [this] { return m_next || m_openFailed; });
+        next = std::move(m_next);
+        m_openFailed = false;
+    }
+
+    m_framesUntilRotation = SegmentLength(atBoundary, framesAfterCut);
+
+    if (!next) {
+        // Couldn't open the next file: keep recording into this one and retry next time
+        RequestNextSegment();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.push_back(std::move(m_current));
+    }
+    m_current = std::move(next);
+    m_segmentNumber++;
+    RequestNextSegment();
+}
+
+void RecordingOutput::RequestNextSegment() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nextName = MakeSegmentName(m_segmentNumber + 1);
+        m_openRequested = true;
+    }
+    m_workCondition.notify_one();
+}
+
+std::wstring RecordingOutput::MakeSegmentName(UINT32 number) const {
+    return m_baseName + L"_seg" + std::to_wstring(number) + m_extension;
+}
+
+FileSinkOptions RecordingOutput::SinkOptions() const {
+    // Tell the sink roughly how fast this output grows so its blocks hold about a second
+    FileSinkOptions options = m_options.sinkOptions;
+    if (options.bytesPerSecond == 0) {
+        bool encoded = !m_options.deferEncoding || m_options.format == AudioFormat::WAV;
+        switch (encoded ? m_options.format : AudioFormat::WAV) {
+        case AudioFormat::MP3:
+            options.bytesPerSecond = (m_options.bitrate > 0 ? m_options.bitrate : 192000) / 8;
+            break;
+        case AudioFormat::OPUS:
+            options.bytesPerSecond = m_options.opusConfig.bitrate / 8;
+            break;
+        case AudioFormat::FLAC:
+            options.bytesPerSecond = Format()->nAvgBytesPerSec / 2;  // Typical lossless ratio
+            break;
+        case AudioFormat::WAV:
+        default:
+            options.bytesPerSecond = Format()->nAvgBytesPerSec;
+            break;
+        }
+    }
+    return options;
+}
+
+std::unique_ptr<RecordingOutput::Segment> RecordingOutput::OpenSegment(const std::wstring& filename) {
+    auto segment = std::make_unique<Segment>();
+    segment->filename = filename;
+    const FileSinkOptions sinkOptions = SinkOptions();
+
+    // Deferred recordings capture raw PCM now; the transcoder writes the real file later.
+    // WAV has nothing to encode and is always written directly.
+    if (m_options.deferEncoding && m_options.format != AudioFormat::WAV) {
+        segment->filename = filename + L".acj";
+        segment->journalWriter = std::make_unique<CaptureJournalWriter>();
+        segment->journalWriter->SetSinkOptions(sinkOptions);
+        if (!segment->journalWriter->Open(segment->filename, Format(), static_cast<UINT32>(m_options.format),
+                                          m_options.bitrate, m_options.opusConfig)) {
+            return nullptr;
+        }
+        return segment;
+    }
+
+    bool ready = false;
+    switch (m_options.format) {
+    case AudioFormat::WAV:
+        segment->wavWriter = std::make_unique<WavWriter>();
+        segment->wavWriter->SetSinkOptions(sinkOptions);
+        ready = segment->wavWriter->Open(filename, Format());
+        break;
+
+    case AudioFormat::MP3:
+        segment->mp3Encoder = std::make_unique<Mp3Encoder>();
+        segment->mp3Encoder->SetSinkOptions(sinkOptions);
+        // Use provided bitrate or default to 192000 (192 kbps)
+        ready = segment->mp3Encoder->Open(filename, Format(),
+                                          m_options.bitrate > 0 ? m_options.bitrate : 192000);
+        break;
+
+    case AudioFormat::OPUS: {
+        // Each ladder bitrate adds a rung written next to the main file as <name>_<N>k<ext>
+        std::vector<std::wstring> filenames(1, filename);
+        std::vector<OpusEncoderConfig> configs(1, m_options.opusConfig);
+        std::wstring stem = filename.substr(0, filename.size() - m_extension.size());
+        for (UINT32 bitrate : m_options.opusLadder) {
+            filenames.push_back(stem + L"_" + std::to_wstring(bitrate / 1000) + L"k" + m_extension);
+            configs.push_back(m_options.opusConfig);
+            configs.back().bitrate = bitrate;
+        }
+
+        segment->opusEncoder = std::make_unique<OpusOggEncoder>();
+        segment->opusEncoder->SetSinkOptions(sinkOptions);
+        ready = segment->opusEncoder->OpenLadder(filenames, Format(), configs);
+        break;
+    }
+
+    case AudioFormat::FLAC:
+        segment->flacEncoder = std::make_unique<FlacEncoder>();
+        segment->flacEncoder->SetSinkOptions(sinkOptions);
+        // Use bitrate as compression level (0-8), default to 5
+        ready = segment->flacEncoder->Open(filename, Format(),
+                                           m_options.bitrate > 0 ? std::min(m_options.bitrate, 8u) : 5);
+        break;
+    }
+
+    if (!ready) {
+        return nullptr;
+    }
+    return segment;
+}
+
+bool RecordingOutput::WriteSegment(Segment& segment, const BYTE* data, UINT32 size) {
+    if (segment.journalWriter) {
+        return segment.journalWriter->WriteData(data, size);
+    }
+
+    switch (m_options.format) {
+    case AudioFormat::WAV:
+        return segment.wavWriter->WriteData(data, size);
+    case AudioFormat::MP3:
+        return segment.mp3Encoder->WriteData(data, size);
+    case AudioFormat::OPUS:
+        return segment.opusEncoder->WriteData(data, size);
+    case AudioFormat::FLAC:
+        return segment.flacEncoder->WriteData(data, size);
+    }
+    return false;
+}
+
+bool RecordingOutput::WriteSegmentSilence(Segment& segment, UINT32 frames) {
+    if (!segment.journalWriter) {
+        switch (m_options.format) {
+        case AudioFormat::OPUS:
+            return segment.opusEncoder->WriteSilence(frames);
+        case AudioFormat::FLAC:
+            return segment.flacEncoder->WriteSilence(frames);
+        case AudioFormat::WAV:
+        case AudioFormat::MP3:
+            break;
+        }
+    }
+
+    // Journals, WAV and MP3 store the samples themselves
+    UINT32 blockAlign = Format()->nBlockAlign;
+    if (m_zeroBlock.empty()) {
+        m_zeroBlock.resize(static_cast<size_t>(Format()->nSamplesPerSec / 10) * blockAlign, 0);
+    }
+    UINT32 chunkFrames = static_cast<UINT32>(m_zeroBlock.size() / blockAlign);
+
+    bool success = true;
+    while (frames > 0) {
+        UINT32 count = std::min(frames, chunkFrames);
+        success = WriteSegment(segment, m_zeroBlock.data(), count * blockAlign) && success;
+        frames -= count;
+    }
+    return success;
+}
+
+void RecordingOutput::CloseSegment(Segment& segment, bool encode) {
+    if (segment.journalWriter) {
+        segment.journalWriter->Close();
+        if (encode) {
+            Transcoder::Instance().EnqueueJournal(segment.filename);
+        }
+    }
+    if (segment.wavWriter) {
+        segment.wavWriter->Close();
+        if (encode && m_options.wavTranscode.enabled) {
+            for (const std::wstring& filename : segment.wavWriter->GetFileNames()) {
+                Transcoder::Instance().EnqueueWav(filename, m_options.wavTranscode);
+            }
+        }
+    }
+    if (segment.mp3Encoder) {
+        segment.mp3Encoder->Close();
+    }
+    if (segment.opusEncoder) {
+        segment.opusEncoder->Close();
+    }
+    if (segment.flacEncoder) {
+        segment.flacEncoder->Close();
+    }
+}
+
+void RecordingOutput::WorkerThread() {
+    // The Media Foundation MP3 path needs COM on every thread that opens or closes a file
+    HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_workCondition.wait(lock, [this] {
+            return !m_finished.empty() || m_openRequested || m_stopWorker;
+        });
+
+        // Open first: the writer may be waiting for the next segment
+        if (m_openRequested) {
+            m_openRequested = false;
+            std::wstring filename = m_nextName;
+            lock.unlock();
+
+            std::unique_ptr<Segment> segment = OpenSegment(filename);
+
+            lock.lock();
+            if (segment) {
+                m_next = std::move(segment);
+            } else {
+                m_openFailed = true;
+            }
+            m_readyCondition.notify_all();
+            continue;
+        }
+
+        if (!m_finished.empty()) {
+            std::unique_ptr<Segment> segment = std::move(m_finished.front());
+            m_finished.pop_front();
+            lock.unlock();
+
+            // Flushing, trailer writes and the final sync all happen here, off the audio path
+            CloseSegment(*segment);
+            segment.reset();
+
+            lock.lock();
+            continue;
+        }
+
+        if (m_stopWorker) {
+            break;
+        }
+    }
+    lock.unlock();
+
+    if (SUCCEEDED(comResult)) {
+        CoUninitialize();
+    }
+}
@@ -0,0 +1,165 @@
+#include "Resampler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr uint32_t kBaseTaps = 32;          // Taps per branch when upsampling
+constexpr uint32_t kMaxTaps = 256;          // Cap for steep decimation ratios
+constexpr uint32_t kMaxPhases = 1024;       // Largest supported interpolation factor
+constexpr double kRolloff = 0.92;           // Passband edge relative to Nyquist
+constexpr double kKaiserBeta = 8.0;         // ~80 dB stopband attenuation
+constexpr double kPi = 3.14159265358979323846;
+
+uint32_t Gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind (for the Kaiser window)
+double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    double halfX = x / 2.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (halfX / k) * (halfX / k);
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+} // namespace
+
+StreamingResampler::StreamingResampler()
+    : m_channels(0)
+    , m_upFactor(0)
+    , m_downFactor(0)
+    , m_taps(0)
+    , m_delay(0)
+    , m_position(0)
+{
+}
+
+bool StreamingResampler::Initialize(uint32_t inputRate, uint32_t outputRate, uint32_t channels) {
+    m_upFactor = 0;
+    if (inputRate == 0 || outputRate == 0 || channels == 0) {
+        return false;
+    }
+
+    uint32_t divisor = Gcd(inputRate, outputRate);
+    uint32_t up = outputRate / divisor;
+    uint32_t down = inputRate / divisor;
+    if (up > kMaxPhases || down > kMaxPhases * 8) {
+        return false;
+    }
+
+    // Keep the transition band the same width in input terms when decimating
+    uint32_t taps = kBaseTaps;
+    if (down > up) {
+        taps = std::min(kMaxTaps, (kBaseTaps * down + up - 1) / up);
+    }
+
+    // Design the prototype low-pass at the upsampled rate (inputRate * up)
+    uint32_t length = up * taps;
+    double center = (length - 1) / 2.0;
+    double cutoff = 0.5 / up * std::min(1.0, static_cast<double>(up) / down) * kRolloff;
+    double windowNorm = BesselI0(kKaiserBeta);
+
+    m_filter.assign(static_cast<size_t>(length), 0.0f);
+    std::vector<double> prototype(length);
+    for (uint32_t n = 0; n < length; n++) {
+        double t = n - center;
+        double sinc = (t == 0.0) ? 1.0 : std::sin(2.0 * kPi * cutoff * t) / (2.0 * kPi * cutoff * t);
+        double ratio = (length > 1) ? (2.0 * n / (length - 1) - 1.0) : 0.0;
+        double window = BesselI0(kKaiserBeta * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) / windowNorm;
+        prototype[n] = 2.0 * cutoff * sinc * window;
+    }
+
+    // Split into polyphase branches, time-reversed so each output is a forward dot product,
+    // and normalize every branch to unity DC gain
+    for (uint32_t phase = 0; phase < up; phase++) {
+        double sum = 0.0;
+        for (uint32_t j = 0; j < taps; j++) {
+            sum += prototype[phase + j * up];
+        }
+        for (uint32_t j = 0; j < taps; j++) {
+            double coeff = (sum != 0.0) ? prototype[phase + j * up] / sum : 0.0;
+            m_filter[phase * taps + (taps - 1 - j)] = static_cast<float>(coeff);
+        }
+    }
+
+    m_channels = channels;
+    m_upFactor = up;
+    m_downFactor = down;
+    m_taps = taps;
+    m_delay = static_cast<uint32_t>(center / down + 0.5);
+    Reset();
+    return true;
+}
+
+void StreamingResampler::Reset() {
+    // Prime with silence so the first output frames have full filter history
+    m_history.assign(static_cast<size_t>(m_taps > 0 ? m_taps - 1 : 0) * m_channels, 0.0f);
+    m_position = 0;
+}
+
+uint32_t StreamingResampler::GetMaxOutputFrames(uint32_t inputFrames) const {
+    if (m_downFactor == 0) {
+        return 0;
+    }
+    return static_cast<uint32_t>((static_cast<uint64_t>(inputFrames) + m_taps) * m_upFactor / m_downFactor + 1);
+}
+
+void StreamingResampler::Process(const float* input, uint32_t inputFrames, std::vector<float>& output) {
+    if (m_upFactor == 0 || (!input && inputFrames > 0)) {
+        return;
+    }
+
+    m_history.insert(m_history.end(), input, input + static_cast<size_t>(inputFrames) * m_channels);
+    output.reserve(output.size() + static_cast<size_t>(GetMaxOutputFrames(inputFrames)) * m_channels);
+
+    const uint64_t bufferFrames = m_history.size() / m_channels;
+    const uint32_t channels = m_channels;
+    const uint32_t taps = m_taps;
+
+    while (true) {
+        uint64_t index = m_position / m_upFactor;
+        if (index + taps > bufferFrames) {
+            break;
+        }
+
+        const float* coeffs = &m_filter[(m_position % m_upFactor) * taps];
+        const float* frames = &m_history[static_cast<size_t>(index) * channels];
+
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            float acc = 0.0f;
+            for (uint32_t k = 0; k < taps; k++) {
+                acc += coeffs[k] * frames[k * channels + ch];
+            }
+            output.push_back(acc);
+        }
+
+        m_position += m_downFactor;
+    }
+
+    // Drop input frames that no future output can reference
+    uint64_t consumed = std::min<uint64_t>(m_position / m_upFactor, bufferFrames);
+    m_history.erase(m_history.begin(), m_history.begin() + static_cast<size_t>(consumed) * channels);
+    m_position -= consumed * m_upFactor;
+}
+
+void StreamingResampler::Flush(std::vector<float>& output) {
+    if (m_upFactor == 0) {
+        return;
+    }
+
+    std::vector<float> silence(static_cast<size_t>(m_taps) * m_channels, 0.0f);
+    Process(silence.data(), m_taps, output);
+}
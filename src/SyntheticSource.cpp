@@ -0,0 +1,88 @@
+#include "SyntheticSource.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const double kTwoPi = 6.283185307179586;
+
+} // namespace
+
+SyntheticSource::SyntheticSource()
+    : m_sampleRate(0)
+    , m_channels(0)
+    , m_bitsPerSample(0)
+    , m_blockFrames(0)
+    , m_phase(0.0)
+{
+}
+
+bool SyntheticSource::Initialize(uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample, uint32_t blockFrames) {
+    if (sampleRate == 0 || channels == 0 || blockFrames == 0 || (bitsPerSample != 16 && bitsPerSample != 32)) {
+        return false;
+    }
+
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_bitsPerSample = bitsPerSample;
+    m_blockFrames = blockFrames;
+    m_phase = 0.0;
+    m_parts.clear();
+    m_buffer.resize(static_cast<size_t>(blockFrames) * GetBlockAlign());
+    return true;
+}
+
+void SyntheticSource::AddTone(uint32_t frames, float frequency, float amplitude) {
+    m_parts.push_back({ frames, frequency, amplitude, false });
+}
+
+void SyntheticSource::AddSilence(uint32_t frames) {
+    m_parts.push_back({ frames, 0.0f, 0.0f, true });
+}
+
+void SyntheticSource::Run() {
+    for (const Part& part : m_parts) {
+        for (uint32_t done = 0; done < part.frames; ) {
+            uint32_t frames = std::min(m_blockFrames, part.frames - done);
+            done += frames;
+
+            if (part.silent) {
+                if (m_dataCallback) {
+                    m_dataCallback(AudioBlock::Silence(frames, GetBlockAlign()));
+                }
+                continue;
+            }
+
+            Generate(part, frames);
+            if (m_dataCallback) {
+                m_dataCallback(AudioBlock::Samples(m_buffer.data(), frames * GetBlockAlign(), GetBlockAlign()));
+            }
+        }
+    }
+    m_parts.clear();
+}
+
+void SyntheticSource::Generate(const Part& part, uint32_t frames) {
+    double step = static_cast<double>(part.frequency) / m_sampleRate;
+    uint8_t* out = m_buffer.data();
+
+    for (uint32_t f = 0; f < frames; f++) {
+        // Adding +0 turns the -0.0 of a zero amplitude times a negative sine into +0.0,
+        // so a silent tone is all-zero bits as well as zero valued
+        float value = part.amplitude * static_cast<float>(std::sin(kTwoPi * m_phase)) + 0.0f;
+        m_phase += step;
+        m_phase -= std::floor(m_phase);
+
+        for (uint16_t ch = 0; ch < m_channels; ch++) {
+            if (m_bitsPerSample == 16) {
+                int16_t sample = static_cast<int16_t>(std::lrintf(std::max(-1.0f, std::min(value, 32767.0f / 32768.0f)) * 32768.0f));
+                std::memcpy(out, &sample, sizeof(sample));
+                out += sizeof(sample);
+            } else {
+                std::memcpy(out, &value, sizeof(value));
+                out += sizeof(value);
+            }
+        }
+    }
+}
@@ -0,0 +1,339 @@
+#include "Transcoder.h"
+#include "IoService.h"
+#include "WavReader.h"
+#include <objbase.h>
+#include <algorithm>
+
+namespace {
+
+const wchar_t kJournalExtension[] = L".acj";
+constexpr size_t kJournalExtensionLength = 4;
+
+// Appended to a journal that can't be transcoded in full, so it is kept but not retried
+const wchar_t kDamagedSuffix[] = L".bad";
+
+// Targets are encoded under this suffix and renamed once verified, so a failed job or a
+// crash never leaves a partial file that looks finished
+const wchar_t kPartialSuffix[] = L".partial";
+
+bool FileExists(const std::wstring& path) {
+    return GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+bool HasJournalExtension(const std::wstring& path) {
+    return path.size() > kJournalExtensionLength &&
+        _wcsicmp(path.c_str() + path.size() - kJournalExtensionLength, kJournalExtension) == 0;
+}
+
+} // namespace
+
+Transcoder& Transcoder::Instance() {
+    static Transcoder transcoder;
+    return transcoder;
+}
+
+Transcoder::Transcoder()
+    : m_running(0)
+    , m_stop(false)
+{
+    // Outputs write through the IoService; make sure it outlives this object
+    IoService::Instance();
+
+    // Encoding is CPU-bound: one worker per core, leaving one for the live capture path
+    unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency());
+    workerCount = std::max(1u, workerCount - 1);
+    for (unsigned int i = 0; i < workerCount; i++) {
+        m_workers.emplace_back(&Transcoder::WorkerThread, this);
+    }
+}
+
+Transcoder::~Transcoder() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_queueCondition.notify_all();
+    for (std::thread& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void Transcoder::EnqueueJournal(const std::wstring& journalPath) {
+    Job job;
+    job.source = journalPath;
+    job.journal = true;
+    Enqueue(std::move(job));
+}
+
+void Transcoder::EnqueueWav(const std::wstring& wavPath, const WavTranscodeOptions& options) {
+    Job job;
+    job.source = wavPath;
+    job.journal = false;
+    job.wavOptions = options;
+    Enqueue(std::move(job));
+}
+
+void Transcoder::Enqueue(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(job));
+    }
+    m_queueCondition.notify_one();
+}
+
+void Transcoder::EnqueueDirectory(const std::wstring& directory) {
+    std::wstring prefix = directory;
+    if (!prefix.empty() && prefix.back() != L'\\' && prefix.back() != L'/') {
+        prefix += L'\\';
+    }
+
+    WIN32_FIND_DATAW findData;
+    HANDLE find = FindFirstFileW((prefix + L"*" + kJournalExtension).c_str(), &findData);
+    if (find == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    do {
+        // The pattern also matches short names, so check the real extension
+        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && HasJournalExtension(findData.cFileName)) {
+            EnqueueJournal(prefix + findData.cFileName);
+        }
+    } while (FindNextFileW(find, &findData));
+    FindClose(find);
+}
+
+size_t Transcoder::GetPendingCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size() + m_running;
+}
+
+void Transcoder::WorkerThread() {
+    // Lowest CPU, I/O and memory priority: live capture always comes first
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    // The Media Foundation MP3 path needs COM on this thread
+    HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_queueCondition.wait(lock, [this] { return !m_queue.empty() || m_stop; });
+        if (m_stop) {
+            break;
+        }
+
+        Job job = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_running++;
+        lock.unlock();
+
+        if (job.journal) {
+            TranscodeJournal(job.source);
+        } else {
+            TranscodeWav(job.source, job.wavOptions);
+        }
+
+        lock.lock();
+        m_running--;
+    }
+    lock.unlock();
+
+    if (SUCCEEDED(comResult)) {
+        CoUninitialize();
+    }
+}
+
+bool Transcoder::TranscodeJournal(const std::wstring& journalPath) {
+    if (!HasJournalExtension(journalPath)) {
+        return false;
+    }
+
+    CaptureJournalReader reader;
+    if (!reader.Open(journalPath)) {
+        return false;
+    }
+
+    // Never replace a file that already has the target's name
+    std::wstring targetPath = journalPath.substr(0, journalPath.size() - kJournalExtensionLength);
+    std::wstring partialPath = targetPath + kPartialSuffix;
+    if (FileExists(targetPath)) {
+        return false;
+    }
+    RecordingOptions options = MakeOptions(reader.GetHeader());
+
+    // The output opens with the first chunk's format. The journal is complete at its clean
+    // end, or at a final chunk torn by a crash; a damaged chunk with more data after it, or
+    // a chunk in another format (the writer never changes format), means audio would be lost.
+    RecordingOutput output;
+    JournalChunkHeader chunk;
+    std::vector<BYTE> firstFormat;
+    std::vector<BYTE> format;
+    std::vector<BYTE> payload;
+    UINT64 frames = 0;
+    bool success = true;
+    bool damaged = false;
+
+    while (!m_stop) {
+        JournalChunkStatus status = reader.ReadChunk(chunk, format, payload);
+        if (status != JournalChunkStatus::Chunk) {
+            damaged = (status == JournalChunkStatus::Corrupt);
+            break;
+        }
+
+        if (!output.IsOpen()) {
+            firstFormat = format;
+            if (!output.Open(partialPath, reinterpret_cast<const WAVEFORMATEX*>(firstFormat.data()), options)) {
+                success = false;
+                break;
+            }
+        } else if (format != firstFormat) {
+            damaged = true;
+            break;
+        }
+
+        if (!payload.empty() && !output.WriteData(payload.data(), static_cast<UINT32>(payload.size()))) {
+            success = false;
+            break;
+        }
+        frames += payload.size() / reinterpret_cast<const WAVEFORMATEX*>(firstFormat.data())->nBlockAlign;
+    }
+
+    bool interrupted = m_stop;
+    bool opened = output.IsOpen();
+    output.Close();
+    reader.Close();
+
+    // Keep the journal unless the target provably holds all of it; a partial target would
+    // only be mistaken for a finished file. A damaged journal is set aside for recovery by
+    // hand instead of being queued again on every run.
+    if (interrupted || !success || damaged ||
+        (opened && !VerifyTarget(partialPath, options.format,
+                                 reinterpret_cast<const WAVEFORMATEX*>(firstFormat.data()), frames))) {
+        DeleteFileW(partialPath.c_str());
+        if (damaged) {
+            MoveFileExW(journalPath.c_str(), (journalPath + kDamagedSuffix).c_str(), MOVEFILE_REPLACE_EXISTING);
+        }
+        return false;
+    }
+
+    // Without MOVEFILE_REPLACE_EXISTING, a file created under the target's name meanwhile wins
+    if (opened && !MoveFileExW(partialPath.c_str(), targetPath.c_str(), MOVEFILE_WRITE_THROUGH)) {
+        DeleteFileW(partialPath.c_str());
+        return false;
+    }
+
+    DeleteFileW(journalPath.c_str());
+    return true;
+}
+
+bool Transcoder::TranscodeWav(const std::wstring& wavPath, const WavTranscodeOptions& wavOptions) {
+    if (wavOptions.format != AudioFormat::FLAC && wavOptions.format != AudioFormat::OPUS) {
+        return false;
+    }
+
+    WavReader reader;
+    if (!reader.Open(wavPath)) {
+        return false;
+    }
+
+    size_t dot = wavPath.find_last_of(L'.');
+    size_t slash = wavPath.find_last_of(L"\\/");
+    std::wstring targetPath = (dot != std::wstring::npos && (slash == std::wstring::npos || dot > slash))
+        ? wavPath.substr(0, dot) : wavPath;
+    targetPath += (wavOptions.format == AudioFormat::FLAC) ? L".flac" : L".opus";
+    std::wstring partialPath = targetPath + kPartialSuffix;
+    if (FileExists(targetPath)) {
+        return false;
+    }
+
+    RecordingOptions options;
+    options.format = wavOptions.format;
+    options.bitrate = (wavOptions.format == AudioFormat::FLAC && wavOptions.bitrate == 0) ? 8 : wavOptions.bitrate;
+    options.opusConfig = wavOptions.opusConfig;
+
+    RecordingOutput output;
+    if (!output.Open(partialPath, reader.GetFormat(), options)) {
+        DeleteFileW(partialPath.c_str());
+        return false;
+    }
+
+    // About a second of audio per read
+    const WAVEFORMATEX* format = reader.GetFormat();
+    UINT32 blockSize = std::max<UINT32>(format->nAvgBytesPerSec / format->nBlockAlign, 1) * format->nBlockAlign;
+    std::vector<BYTE> buffer(blockSize);
+    UINT64 frames = 0;
+    bool success = true;
+
+    while (!m_stop) {
+        UINT32 bytesRead = 0;
+        if (!reader.Read(buffer.data(), blockSize, bytesRead)) {
+            success = false;
+            break;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        if (!output.WriteData(buffer.data(), bytesRead)) {
+            success = false;
+            break;
+        }
+        frames += bytesRead / format->nBlockAlign;
+    }
+
+    bool interrupted = m_stop;
+    output.Close();
+
+    // The source is only given up once the target provably holds all of it
+    if (interrupted || !success || frames != reader.GetFrameCount() ||
+        !VerifyTarget(partialPath, wavOptions.format, format, frames) ||
+        !MoveFileExW(partialPath.c_str(), targetPath.c_str(), MOVEFILE_WRITE_THROUGH)) {
+        reader.Close();
+        DeleteFileW(partialPath.c_str());
+        return false;
+    }
+
+    reader.Close();
+    if (!wavOptions.keepSource) {
+        DeleteFileW(wavPath.c_str());
+    }
+    return true;
+}
+
+bool Transcoder::VerifyTarget(const std::wstring& targetPath, AudioFormat format,
+                              const WAVEFORMATEX* sourceFormat, UINT64 frames) {
+    switch (format) {
+    case AudioFormat::FLAC:
+        return FlacEncoder::VerifyFrameCount(targetPath, frames);
+    case AudioFormat::OPUS:
+        return OpusOggEncoder::VerifyFrameCount(targetPath, sourceFormat->nSamplesPerSec, frames);
+    case AudioFormat::MP3:
+    case AudioFormat::WAV:
+    default:
+        // MP3 can't be checked without decoding it
+        return true;
+    }
+}
+
+RecordingOptions Transcoder::MakeOptions(const JournalFileHeader& header) {
+    RecordingOptions options;
+    options.format = static_cast<AudioFormat>(header.targetFormat);
+    options.bitrate = header.bitrate;
+
+    options.opusConfig.bitrate = header.opusBitrate;
+    options.opusConfig.frameDurationMs = header.opusFrameTenthsMs / 10.0f;
+    options.opusConfig.application = header.opusApplication;
+    options.opusConfig.signal = header.opusSignal;
+    options.opusConfig.maxBandwidth = header.opusMaxBandwidth;
+    options.opusConfig.vbr = header.opusVbr != 0;
+    options.opusConfig.dtx = header.opusDtx != 0;
+    options.opusConfig.downmixToMono = header.opusDownmixToMono != 0;
+
+    // Not bound by real time: use the slowest, best settings
+    options.opusConfig.complexity = 10;
+    if (options.format == AudioFormat::FLAC && options.bitrate == 0) {
+        options.bitrate = 8;
+    }
+
+    return options;
+}
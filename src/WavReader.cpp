@@ -0,0 +1,114 @@
+#include "WavReader.h"
+#include "FileSink.h"
+#include <algorithm>
+#include <cstring>
+
+WavReader::WavReader()
+    : m_handle(INVALID_HANDLE_VALUE)
+    , m_dataStart(0)
+    , m_dataSize(0)
+    , m_readPosition(0)
+{
+}
+
+WavReader::~WavReader() {
+    Close();
+}
+
+bool WavReader::Open(const std::wstring& filename) {
+    Close();
+
+    m_handle = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize = {};
+    BYTE riffHeader[12];
+    if (!GetFileSizeEx(m_handle, &fileSize) || !ReadAt(0, riffHeader, sizeof(riffHeader)) ||
+        (std::memcmp(riffHeader, "RIFF", 4) != 0 && std::memcmp(riffHeader, "RF64", 4) != 0) ||
+        std::memcmp(riffHeader + 8, "WAVE", 4) != 0) {
+        Close();
+        return false;
+    }
+
+    // Walk the chunks up to the audio data; RF64 keeps the real data size in ds64
+    UINT64 size = static_cast<UINT64>(fileSize.QuadPart);
+    UINT64 offset = 12;
+    UINT64 ds64DataSize = 0;
+    m_formatData.clear();
+    m_dataStart = 0;
+
+    while (offset + 8 <= size) {
+        BYTE chunkHeader[8];
+        if (!ReadAt(offset, chunkHeader, sizeof(chunkHeader))) {
+            break;
+        }
+        UINT32 chunkSize = 0;
+        std::memcpy(&chunkSize, chunkHeader + 4, 4);
+
+        if (std::memcmp(chunkHeader, "data", 4) == 0) {
+            m_dataStart = offset + 8;
+            m_dataSize = (chunkSize == 0xFFFFFFFF && ds64DataSize != 0) ? ds64DataSize : chunkSize;
+            break;
+        }
+        if (std::memcmp(chunkHeader, "ds64", 4) == 0 && chunkSize >= 24) {
+            ReadAt(offset + 16, &ds64DataSize, 8);
+        }
+        if (std::memcmp(chunkHeader, "fmt ", 4) == 0 && chunkSize >= 16 && chunkSize <= 1024) {
+            m_formatData.assign(std::max<size_t>(chunkSize, sizeof(WAVEFORMATEX)), 0);
+            if (!ReadAt(offset + 8, m_formatData.data(), chunkSize)) {
+                m_formatData.clear();
+            }
+        }
+        offset += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    if (m_dataStart == 0 || m_formatData.empty() || GetFormat()->nBlockAlign == 0) {
+        Close();
+        return false;
+    }
+
+    // A file cut short holds less than its header claims
+    m_dataSize = std::min(m_dataSize, size - std::min(size, m_dataStart));
+    m_readPosition = 0;
+    return true;
+}
+
+void WavReader::Close() {
+    if (m_handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_handle);
+        m_handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+UINT64 WavReader::GetFrameCount() const {
+    return m_formatData.empty() ? 0 : m_dataSize / GetFormat()->nBlockAlign;
+}
+
+bool WavReader::Read(BYTE* data, UINT32 size, UINT32& bytesRead) {
+    bytesRead = 0;
+    if (!IsOpen()) {
+        return false;
+    }
+
+    // Stop at the last whole frame
+    UINT64 frameBytes = GetFrameCount() * GetFormat()->nBlockAlign;
+    UINT32 chunk = static_cast<UINT32>(std::min<UINT64>(size, frameBytes - std::min(frameBytes, m_readPosition)));
+    if (chunk == 0) {
+        return true;
+    }
+
+    if (!ReadAt(m_dataStart + m_readPosition, data, chunk)) {
+        return false;
+    }
+
+    m_readPosition += chunk;
+    bytesRead = chunk;
+    return true;
+}
+
+bool WavReader::ReadAt(UINT64 offset, void* data, DWORD size) {
+    return ReadFileAt(m_handle, offset, data, size);
+}
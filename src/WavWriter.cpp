@@ -1,11 +1,18 @@
 #include "WavWriter.h"
+#include "MappedFileWriter.h"
+#include <algorithm>
 #include <cstring>
 
 WavWriter::WavWriter()
-    : m_dataSize(0)
+    : m_largeFileMode(WavLargeFileMode::Rf64)
+    , m_dataSize(0)
     , m_totalDataSize(0)
     , m_filePartNumber(1)
     , m_dataStartPos(0)
+    , m_commitIntervalMs(DEFAULT_COMMIT_INTERVAL_MS)
+    , m_commitIntervalBytes(0)
+    , m_lastCommitTime(0)
+    , m_lastCommitSize(0)
 {
 }
 
@@ -13,12 +20,14 @@ WavWriter::~WavWriter() {
     Close();
 }
 
-bool WavWriter::Open(const std::wstring& filename, const WAVEFORMATEX* format) {
-    if (m_file.is_open()) {
+bool WavWriter::Open(const std::wstring& filename, const WAVEFORMATEX* format, WavLargeFileMode largeFileMode) {
+    if (IsOpen()) {
         return false;
     }
 
     m_filename = filename;
+    m_fileNames.assign(1, filename);
+    m_largeFileMode = largeFileMode;
     m_dataSize = 0;
 
     // Extract base filename (remove extension) for multi-part file naming
@@ -44,48 +53,78 @@ bool WavWriter::Open(const std::wstring& filename, const WAVEFORMATEX* format) {
     std::memcpy(m_formatData.data(), format, formatSize);
 
     // Open file
-    m_file.open(filename, std::ios::binary | std::ios::out);
-    if (!m_file.is_open()) {
+    m_file = FileSink::Create(m_sinkOptions);
+    if (!m_file->Open(filename)) {
         return false;
     }
 
     // Write initial header (will be updated when closing)
     WriteWavHeader();
-    m_dataStartPos = m_file.tellp();
+    m_dataStartPos = m_file->GetPosition();
+    m_lastCommitTime = GetTickCount64();
+    m_lastCommitSize = m_dataStartPos;
 
     return true;
 }
 
+void WavWriter::SetHeaderCommitInterval(UINT32 milliseconds, UINT64 bytes) {
+    m_commitIntervalMs = milliseconds;
+    m_commitIntervalBytes = bytes;
+}
+
 bool WavWriter::WriteData(const BYTE* data, UINT32 size) {
-    if (!m_file.is_open()) {
+    if (!IsOpen()) {
         return false;
     }
 
     // Calculate current file size (header + data)
-    // WAV header structure: RIFF(4) + size(4) + WAVE(4) + fmt(4) + fmtsize(4) + fmtdata + data(4) + datasize(4) + audiodata
-    UINT64 currentFileSize = 12 + 8 + static_cast<UINT64>(m_formatData.size()) + 8 + m_dataSize;
+    UINT64 currentFileSize = m_dataStartPos + m_dataSize;
 
-    // Check if writing this data would exceed the 4GB limit
-    if (currentFileSize + size > MAX_FILE_SIZE) {
+    // In split mode, check if writing this data would exceed the 4GB limit
+    if (m_largeFileMode == WavLargeFileMode::Split && currentFileSize + size > MAX_FILE_SIZE) {
         // Split to next file part before writing
         if (!SplitToNextFile()) {
             return false;
         }
     }
 
-    m_file.write(reinterpret_cast<const char*>(data), size);
+    // Only a copy into the current block; the writer thread does the disk I/O
+    if (!m_file->Write(data, size)) {
+        return false;
+    }
     m_dataSize += size;
     m_totalDataSize += size;
 
-    return m_file.good();
+    CommitHeaderIfDue();
+    return true;
+}
+
+void WavWriter::CommitHeaderIfDue() {
+    // Only data already handed to the writer thread is described, so the queued
+    // header patch can never claim bytes that are not yet on disk
+    UINT64 submitted = m_file->GetSubmittedPosition();
+    if (submitted <= m_lastCommitSize) {
+        return;
+    }
+
+    UINT64 now = GetTickCount64();
+    bool timeDue = m_commitIntervalMs > 0 && now - m_lastCommitTime >= m_commitIntervalMs;
+    bool bytesDue = m_commitIntervalBytes > 0 && submitted - m_lastCommitSize >= m_commitIntervalBytes;
+    if (!timeDue && !bytesDue) {
+        return;
+    }
+
+    UpdateWavHeader(submitted);
+    m_lastCommitTime = now;
+    m_lastCommitSize = submitted;
 }
 
 bool WavWriter::SplitToNextFile() {
     // Update current file's header with final sizes
-    UpdateWavHeader();
+    UpdateWavHeader(m_file->GetPosition());
 
-    // Close current file
-    m_file.close();
+    // Close current file (drains its pending blocks)
+    m_file->Close();
 
     // Increment part number
     m_filePartNumber++;
@@ -99,30 +138,32 @@ bool WavWriter::SplitToNextFile() {
     m_dataSize = 0;
 
     // Open new file
-    m_file.open(newFilename, std::ios::binary | std::ios::out);
-    if (!m_file.is_open()) {
+    if (!m_file->Open(newFilename)) {
         return false;
     }
 
     // Write header for new file
     WriteWavHeader();
-    m_dataStartPos = m_file.tellp();
+    m_dataStartPos = m_file->GetPosition();
+    m_lastCommitTime = GetTickCount64();
+    m_lastCommitSize = m_dataStartPos;
 
     // Update current filename
     m_filename = newFilename;
+    m_fileNames.push_back(newFilename);
 
     return true;
 }
 
 void WavWriter::Close() {
-    if (!m_file.is_open()) {
+    if (!IsOpen()) {
         return;
     }
 
     // Update header with final size
-    UpdateWavHeader();
+    UpdateWavHeader(m_file->GetPosition());
 
-    m_file.close();
+    m_file->Close();
     m_dataSize = 0;
 }
 
@@ -131,43 +172,219 @@ void WavWriter::WriteWavHeader() {
         return;
     }
 
+    // Assemble the header and hand it over in one write
+    UINT32 fmtSize = static_cast<UINT32>(m_formatData.size());
+    UINT32 junkSize = DS64_SIZE;
+    UINT32 zero = 0;  // RIFF and data sizes are updated later
+    BYTE junk[DS64_SIZE] = {};
+    std::vector<BYTE> header;
+    header.reserve(12 + 8 + DS64_SIZE + 8 + fmtSize + 8);
+
+    auto append = [&header](const void* data, size_t size) {
+        const BYTE* bytes = static_cast<const BYTE*>(data);
+        header.insert(header.end(), bytes, bytes + size);
+    };
+
     // Write RIFF header
-    m_file.write("RIFF", 4);
-    UINT32 riffSize = 0;  // Will be updated later
-    m_file.write(reinterpret_cast<const char*>(&riffSize), 4);
-    m_file.write("WAVE", 4);
+    append("RIFF", 4);
+    append(&zero, 4);
+    append("WAVE", 4);
+
+    // Reserve room for a ds64 chunk; readers skip JUNK, and Close turns it into ds64
+    // if the file outgrows 32-bit sizes
+    append("JUNK", 4);
+    append(&junkSize, 4);
+    append(junk, sizeof(junk));
 
     // Write fmt chunk
-    m_file.write("fmt ", 4);
-    UINT32 fmtSize = static_cast<UINT32>(m_formatData.size());
-    m_file.write(reinterpret_cast<const char*>(&fmtSize), 4);
-    m_file.write(reinterpret_cast<const char*>(m_formatData.data()), fmtSize);
+    append("fmt ", 4);
+    append(&fmtSize, 4);
+    append(m_formatData.data(), fmtSize);
 
     // Write data chunk header
-    m_file.write("data", 4);
-    UINT32 dataSize = 0;  // Will be updated later
-    m_file.write(reinterpret_cast<const char*>(&dataSize), 4);
+    append("data", 4);
+    append(&zero, 4);
+
+    m_file->Write(header.data(), header.size());
 }
 
-void WavWriter::UpdateWavHeader() {
-    if (!m_file.is_open()) {
+void WavWriter::UpdateWavHeader(UINT64 fileSize) {
+    if (!IsOpen()) {
         return;
     }
 
-    // Save current position
-    auto currentPos = m_file.tellp();
+    // Patches are queued behind the data already handed to the writer
+    UINT64 riffSize = fileSize - 8;
+    UINT64 dataSize = fileSize - m_dataStartPos;
+    UINT64 dataSizeOffset = m_dataStartPos - 4;
+
+    if (riffSize <= 0xFFFFFFFFULL && dataSize <= 0xFFFFFFFFULL) {
+        // Plain RIFF: 32-bit sizes in place, JUNK stays as padding
+        UINT32 riffSize32 = static_cast<UINT32>(riffSize);
+        UINT32 dataSize32 = static_cast<UINT32>(dataSize);
+        m_file->WriteAt(4, &riffSize32, 4);
+        m_file->WriteAt(dataSizeOffset, &dataSize32, 4);
+        return;
+    }
 
-    // Update RIFF size (offset 4)
-    m_file.seekp(4);
-    UINT32 riffSize = static_cast<UINT32>(currentPos) - 8;
-    m_file.write(reinterpret_cast<const char*>(&riffSize), 4);
+    // RF64: the 32-bit fields are set to -1 and the real sizes live in ds64
+    UINT32 sizeMarker = 0xFFFFFFFF;
+    UINT32 ds64Size = DS64_SIZE;
+    UINT32 blockAlign = reinterpret_cast<const WAVEFORMATEX*>(m_formatData.data())->nBlockAlign;
+    UINT64 sampleCount = blockAlign ? dataSize / blockAlign : 0;
+    UINT32 tableLength = 0;
+
+    BYTE riffHeader[8];
+    std::memcpy(riffHeader, "RF64", 4);
+    std::memcpy(riffHeader + 4, &sizeMarker, 4);
+
+    BYTE ds64[8 + DS64_SIZE];
+    std::memcpy(ds64, "ds64", 4);
+    std::memcpy(ds64 + 4, &ds64Size, 4);
+    std::memcpy(ds64 + 8, &riffSize, 8);
+    std::memcpy(ds64 + 16, &dataSize, 8);
+    std::memcpy(ds64 + 24, &sampleCount, 8);
+    std::memcpy(ds64 + 32, &tableLength, 4);
+
+    m_file->WriteAt(12, ds64, sizeof(ds64));
+    m_file->WriteAt(dataSizeOffset, &sizeMarker, 4);
+    m_file->WriteAt(0, riffHeader, sizeof(riffHeader));
+}
 
-    // Update data size (offset = 12 + 4 + 4 + fmtSize + 4)
-    // = 12 (RIFF header) + 8 (fmt chunk header) + fmtSize + 4 (data chunk ID)
-    UINT32 dataSizeOffset = 12 + 8 + static_cast<UINT32>(m_formatData.size()) + 4;
-    m_file.seekp(dataSizeOffset);
-    m_file.write(reinterpret_cast<const char*>(&m_dataSize), 4);
+bool WavWriter::RecoverFile(const std::wstring& filename, const FileSinkOptions& sinkOptions) {
+    HANDLE file = CreateFileW(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    bool recovered = false;
+    LARGE_INTEGER fileSize = {};
+    BYTE riffHeader[12];
+
+    if (GetFileSizeEx(file, &fileSize) &&
+        ReadFileAt(file, 0, riffHeader, sizeof(riffHeader)) &&
+        (std::memcmp(riffHeader, "RIFF", 4) == 0 || std::memcmp(riffHeader, "RF64", 4) == 0) &&
+        std::memcmp(riffHeader + 8, "WAVE", 4) == 0) {
+
+        // Walk the chunks in front of the audio: fmt, JUNK/ds64 and anything else
+        // up to the data chunk header
+        UINT64 size = static_cast<UINT64>(fileSize.QuadPart);
+        UINT64 offset = 12;
+        UINT64 ds64Offset = 0;
+        UINT32 blockAlign = 0;
+        UINT64 dataStart = 0;
+        UINT64 committedData = 0;   // Data size recorded by the last header commit
+        UINT32 riffSize32 = 0;
+        std::memcpy(&riffSize32, riffHeader + 4, 4);
+        UINT64 declaredSize = 8ULL + riffSize32;  // File length the header describes
+
+        while (offset + 8 <= size) {
+            BYTE chunkHeader[8];
+            if (!ReadFileAt(file, offset, chunkHeader, sizeof(chunkHeader))) {
+                break;
+            }
+            UINT32 chunkSize = 0;
+            std::memcpy(&chunkSize, chunkHeader + 4, 4);
+
+            if (std::memcmp(chunkHeader, "data", 4) == 0) {
+                dataStart = offset + 8;
+                committedData = chunkSize;
+                BYTE ds64Tag[4];
+                if (chunkSize == 0xFFFFFFFF && ds64Offset != 0 &&
+                    ReadFileAt(file, ds64Offset, ds64Tag, 4) && std::memcmp(ds64Tag, "ds64", 4) == 0) {
+                    UINT64 riffSize = 0;
+                    ReadFileAt(file, ds64Offset + 8, &riffSize, 8);
+                    ReadFileAt(file, ds64Offset + 16, &committedData, 8);
+                    declaredSize = riffSize + 8;
+                }
+                break;
+            }
+            if ((std::memcmp(chunkHeader, "JUNK", 4) == 0 || std::memcmp(chunkHeader, "ds64", 4) == 0) &&
+                chunkSize >= DS64_SIZE && offset == 12) {
+                ds64Offset = offset;
+            }
+            if (std::memcmp(chunkHeader, "fmt ", 4) == 0 && chunkSize >= 16) {
+                WAVEFORMATEX format = {};
+                if (ReadFileAt(file, offset + 8, &format, 16)) {
+                    blockAlign = format.nBlockAlign;
+                }
+            }
+            offset += 8 + chunkSize + (chunkSize & 1);
+        }
 
-    // Restore position
-    m_file.seekp(currentPos);
+        if (dataStart != 0 && declaredSize == size) {
+            // Finalized (the header describes the whole file, trailing chunks included)
+            recovered = true;
+        } else if (dataStart != 0 && blockAlign != 0 && size >= dataStart) {
+            // Mapped output reserves space ahead of the data, and after a crash that reserve
+            // is still zero-filled. Such a file still ends on an extent boundary, and the
+            // reserve is shorter than an extent plus a window, so zeros are trimmed no further
+            // back than that or the last committed size. Zeros at the end of any other file
+            // are audio (digital silence) and are kept.
+            UINT64 trimFloor = size;
+            UINT64 extentBytes = 0;
+            UINT64 windowBytes = 0;
+            MappedFileWriter::GetLayout(sinkOptions, extentBytes, windowBytes);
+            if (sinkOptions.mode == FileSinkMode::Mapped && size % extentBytes == 0) {
+                UINT64 committedEnd = std::min(size, dataStart + committedData);
+                UINT64 reserveStart = size > extentBytes + windowBytes ? size - extentBytes - windowBytes : 0;
+                trimFloor = std::max(committedEnd, reserveStart);
+            }
+            std::vector<BYTE> tail(64 * 1024);
+            while (size > trimFloor) {
+                UINT64 chunk = std::min<UINT64>(tail.size(), size - trimFloor);
+                if (!ReadFileAt(file, size - chunk, tail.data(), static_cast<DWORD>(chunk))) {
+                    break;
+                }
+                size_t nonZero = static_cast<size_t>(chunk);
+                while (nonZero > 0 && tail[nonZero - 1] == 0) {
+                    nonZero--;
+                }
+                size -= chunk - nonZero;
+                if (nonZero > 0) {
+                    break;
+                }
+            }
+
+            // Drop any partially written frame at the end
+            UINT64 dataSize = (size - dataStart) / blockAlign * blockAlign;
+            UINT64 endOfFile = dataStart + dataSize;
+            bool ok = true;
+            if (endOfFile != static_cast<UINT64>(fileSize.QuadPart)) {
+                FILE_END_OF_FILE_INFO endInfo = {};
+                endInfo.EndOfFile.QuadPart = static_cast<LONGLONG>(endOfFile);
+                ok = SetFileInformationByHandle(file, FileEndOfFileInfo, &endInfo, sizeof(endInfo)) != FALSE;
+            }
+
+            UINT64 riffSize = endOfFile - 8;
+            if (ok && riffSize <= 0xFFFFFFFFULL) {
+                UINT32 riffSize32 = static_cast<UINT32>(riffSize);
+                UINT32 dataSize32 = static_cast<UINT32>(dataSize);
+                ok = WriteFileAt(file, 0, "RIFF", 4) &&
+                     WriteFileAt(file, 4, &riffSize32, 4) &&
+                     WriteFileAt(file, dataStart - 4, &dataSize32, 4);
+                if (ok && ds64Offset != 0) {
+                    ok = WriteFileAt(file, ds64Offset, "JUNK", 4);
+                }
+            } else if (ok && ds64Offset != 0) {
+                UINT32 sizeMarker = 0xFFFFFFFF;
+                UINT64 sampleCount = dataSize / blockAlign;
+                ok = WriteFileAt(file, ds64Offset, "ds64", 4) &&
+                     WriteFileAt(file, ds64Offset + 8, &riffSize, 8) &&
+                     WriteFileAt(file, ds64Offset + 16, &dataSize, 8) &&
+                     WriteFileAt(file, ds64Offset + 24, &sampleCount, 8) &&
+                     WriteFileAt(file, dataStart - 4, &sizeMarker, 4) &&
+                     WriteFileAt(file, 0, "RF64", 4) &&
+                     WriteFileAt(file, 4, &sizeMarker, 4);
+            } else {
+                ok = false;  // Too large for RIFF and no room reserved for ds64
+            }
+            recovered = ok && FlushFileBuffers(file);
+        }
+    }
+
+    CloseHandle(file);
+    return recovered;
 }
+
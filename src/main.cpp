@@ -29,6 +29,7 @@ HWND g_hStartBtn;
 HWND g_hStopAllBtn;
 HWND g_hPauseAllBtn;
 HWND g_hResumeAllBtn;
+HWND g_hSaveBufferBtn;
 HWND g_hFormatCombo;
 HWND g_hOutputPath;
 HWND g_hBrowseBtn;
@@ -70,10 +71,13 @@ const UINT WM_APP_RESTORE_FOCUS = WM_APP + 1;
 bool g_captureButtonStops = false;
 bool g_restoreFocusOnActivate = false;
 
-// Volume settings (0-100%)
+// Volume settings (0-200%; above 100% boosts)
 float g_processVolume = 100.0f;  // Default to 100%
 float g_microphoneVolume = 100.0f;  // Default to 100%
 
+// Microphone sessions use ids from here up, clear of real process ids
+const DWORD kMicrophoneSessionBaseId = 0xFFFF0000;
+
 std::unique_ptr<ProcessEnumerator> g_processEnum;
 std::unique_ptr<CaptureManager> g_captureManager;
 std::unique_ptr<AudioDeviceEnumerator> g_audioDeviceEnum;
@@ -83,6 +87,12 @@ int g_pendingMicrophoneDeviceIndex = -1;
 bool g_useWinRT = false;  // Track whether we initialized with WinRT or COM
 bool g_supportsProcessCapture = false;  // Track whether OS supports process-specific capture
 
+// Recording engine options from the "capture" section of settings.json. They have no
+// controls; the section is kept as loaded and written back on save.
+json g_captureSettings = json::object();
+UINT32 g_prerollSeconds = 0;  // Length of every session's pre-roll buffer (0 = off)
+EncodingProfile g_inputDeviceProfile = EncodingProfile::Voice;  // Microphones and line-in; the chosen bitrate still applies
+
 // Tray icon
 NOTIFYICONDATA g_nid = {};
 bool g_isMinimizedToTray = false;
@@ -97,6 +107,8 @@ void RefreshProcessList();
 void UpdateProcessListLabel();
 void StartCapture();
 void StopCapture();
+void SavePrerollBuffer();
+void ApplyVolumeToSessions();
 void UpdateRecordingList();
 void EnsureRecordingListFocusItem();
 void BrowseOutputFolder();
@@ -108,6 +120,7 @@ bool EnsureDirectoryExists(const std::wstring& path);
 std::wstring SanitizeFileName(const std::wstring& name);
 void LoadSettings();
 void SaveSettings();
+void ApplyCaptureSettings();
 std::wstring GetSettingsFilePath();
 std::string WStringToString(const std::wstring& wstr);
 std::wstring StringToWString(const std::string& str);
@@ -251,6 +264,17 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int nCmdShow) {
     g_processEnum = std::make_unique<ProcessEnumerator>();
     g_captureManager = std::make_unique<CaptureManager>();
     g_audioDeviceEnum = std::make_unique<AudioDeviceEnumerator>();
+    ApplyCaptureSettings();
+
+    // Repair recordings a crash left unfinalized in the output folder, and encode the
+    // journals an earlier run didn't get to (whether or not deferred encoding is still on)
+    wchar_t outputPath[MAX_PATH];
+    GetWindowTextW(g_hOutputPath, outputPath, MAX_PATH);
+    std::wstring outputFolder = NormalizeOutputPath(outputPath);
+    if (!outputFolder.empty()) {
+        g_captureManager->RecoverInterruptedRecordings(outputFolder);
+        g_captureManager->ResumeDeferredEncoding(outputFolder);
+    }
 
     ShowWindow(g_hWnd, nCmdShow);
     UpdateWindow(g_hWnd);
@@ -438,6 +462,10 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             }
             break;
 
+        case IDC_SAVE_BUFFER_BTN:
+            SavePrerollBuffer();
+            break;
+
         case IDC_BROWSE_BTN:
             BrowseOutputFolder();
             break;
@@ -558,6 +586,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         SetWindowPos(g_hStopAllBtn, nullptr, 230, topOffset + 115, 100, 30, SWP_NOZORDER);
         SetWindowPos(g_hPauseAllBtn, nullptr, 340, topOffset + 115, 100, 30, SWP_NOZORDER);
         SetWindowPos(g_hResumeAllBtn, nullptr, 450, topOffset + 115, 100, 30, SWP_NOZORDER);
+        SetWindowPos(g_hSaveBufferBtn, nullptr, 560, topOffset + 115, 100, 30, SWP_NOZORDER);
         SetWindowPos(g_hRecordingListLabel, nullptr, 10, topOffset + 155, 200, 20, SWP_NOZORDER);
         SetWindowPos(g_hRecordingList, nullptr, 10, topOffset + 175, width - 20, height - (topOffset + 225), SWP_NOZORDER);
         SetWindowPos(g_hStatusText, nullptr, 10, height - 40, width - 20, 30, SWP_NOZORDER);
@@ -589,6 +618,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             wchar_t volumeText[64];
             swprintf_s(volumeText, L"Process Volume: %d%%", pos);
             SetWindowText(g_hProcessVolumeLabel, volumeText);
+            ApplyVolumeToSessions();
         }
         else if (hSlider == g_hMicrophoneVolumeSlider) {
             int pos = (int)SendMessage(g_hMicrophoneVolumeSlider, TBM_GETPOS, 0, 0);
@@ -597,6 +627,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             wchar_t volumeText[64];
             swprintf_s(volumeText, L"Microphone Volume: %d%%", pos);
             SetWindowText(g_hMicrophoneVolumeLabel, volumeText);
+            ApplyVolumeToSessions();
         }
         return 0;
     }
@@ -605,6 +636,20 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
+// Push the slider volumes to the running sessions; each one ramps to its new volume
+void ApplyVolumeToSessions() {
+    if (!g_captureManager) {
+        return;
+    }
+
+    for (auto* session : g_captureManager->GetActiveSessions()) {
+        if (session->capture) {
+            float volume = session->processId >= kMicrophoneSessionBaseId ? g_microphoneVolume : g_processVolume;
+            session->capture->SetVolume(volume / 100.0f);
+        }
+    }
+}
+
 void InitializeControls(HWND hwnd) {
     // Determine visibility based on OS support
     DWORD processListVisibility = g_supportsProcessCapture ? (WS_CHILD | WS_VISIBLE) : WS_CHILD;
@@ -900,16 +945,16 @@ void InitializeControls(HWND hwnd) {
         hwnd, (HMENU)IDC_PROCESS_VOLUME_LABEL, g_hInst, nullptr
     );
 
-    // Process volume slider (0-100)
+    // Process volume slider (0-200)
     g_hProcessVolumeSlider = CreateWindowEx(
         0, TRACKBAR_CLASS, L"",
         WS_CHILD | WS_VISIBLE | WS_TABSTOP | TBS_HORZ | TBS_AUTOTICKS,
         150, 298, 200, 20,
         hwnd, (HMENU)IDC_PROCESS_VOLUME_SLIDER, g_hInst, nullptr
     );
-    SendMessage(g_hProcessVolumeSlider, TBM_SETRANGE, TRUE, MAKELONG(0, 100));
+    SendMessage(g_hProcessVolumeSlider, TBM_SETRANGE, TRUE, MAKELONG(0, 200));
     SendMessage(g_hProcessVolumeSlider, TBM_SETPOS, TRUE, 100);
-    SendMessage(g_hProcessVolumeSlider, TBM_SETTICFREQ, 10, 0);
+    SendMessage(g_hProcessVolumeSlider, TBM_SETTICFREQ, 20, 0);
 
     // Microphone volume label (initially hidden)
     g_hMicrophoneVolumeLabel = CreateWindow(
@@ -919,16 +964,16 @@ void InitializeControls(HWND hwnd) {
         hwnd, (HMENU)IDC_MICROPHONE_VOLUME_LABEL, g_hInst, nullptr
     );
 
-    // Microphone volume slider (0-100, initially hidden)
+    // Microphone volume slider (0-200, initially hidden)
     g_hMicrophoneVolumeSlider = CreateWindowEx(
         0, TRACKBAR_CLASS, L"",
         WS_CHILD | WS_TABSTOP | TBS_HORZ | TBS_AUTOTICKS,
         510, 298, 200, 20,
         hwnd, (HMENU)IDC_MICROPHONE_VOLUME_SLIDER, g_hInst, nullptr
     );
-    SendMessage(g_hMicrophoneVolumeSlider, TBM_SETRANGE, TRUE, MAKELONG(0, 100));
+    SendMessage(g_hMicrophoneVolumeSlider, TBM_SETRANGE, TRUE, MAKELONG(0, 200));
     SendMessage(g_hMicrophoneVolumeSlider, TBM_SETPOS, TRUE, 100);
-    SendMessage(g_hMicrophoneVolumeSlider, TBM_SETTICFREQ, 10, 0);
+    SendMessage(g_hMicrophoneVolumeSlider, TBM_SETTICFREQ, 20, 0);
 
     // Output path label
     g_hOutputPathLabel = CreateWindow(
@@ -988,6 +1033,14 @@ void InitializeControls(HWND hwnd) {
         hwnd, (HMENU)IDC_RESUME_ALL_BTN, g_hInst, nullptr
     );
 
+    // Save Buffer button (hidden unless the pre-roll buffer is on)
+    g_hSaveBufferBtn = CreateWindow(
+        L"BUTTON", L"Save B&uffer",
+        WS_CHILD | WS_TABSTOP | BS_PUSHBUTTON | WS_DISABLED,
+        560, 360, 100, 30,
+        hwnd, (HMENU)IDC_SAVE_BUFFER_BTN, g_hInst, nullptr
+    );
+
     // Recording list label
     g_hRecordingListLabel = CreateWindow(
         L"STATIC", L"Active &Recordings:",
@@ -1387,7 +1440,7 @@ void StartCapture() {
 
         // Start capture with bitrate, skip silence option, passthrough device, and monitor-only mode
         if (g_captureManager->StartCapture(processId, processName, fullPath, format, bitrate, skipSilence, passthroughDeviceId, captureMonitorOnly)) {
-            // Apply process volume setting (convert from 0-100 to 0.0-1.0)
+            // Apply process volume setting (convert from 0-200 to 0.0-2.0)
             auto sessions = g_captureManager->GetActiveSessions();
             for (auto* session : sessions) {
                 if (session->processId == processId && session->capture) {
@@ -1425,7 +1478,6 @@ void StartCapture() {
     // Handle microphone capture if enabled (and not in monitor-only mode)
     if (captureMicrophone && !monitorOnly && g_audioDeviceEnum) {
         const auto& inputDevices = g_audioDeviceEnum->GetInputDevices();
-        const DWORD kMicrophoneSessionBaseId = 0xFFFF0000;
 
         for (size_t micDeviceIndex : micDeviceIndices) {
             if (micDeviceIndex >= inputDevices.size()) {
@@ -1479,7 +1531,8 @@ void StartCapture() {
                 format,
                 bitrate,
                 skipSilence,
-                micMonitorOnly)) {
+                micMonitorOnly,
+                g_inputDeviceProfile)) {
                 auto sessions = g_captureManager->GetActiveSessions();
                 for (auto* session : sessions) {
                     if (session->processId == micProcessId && session->capture) {
@@ -1539,6 +1592,55 @@ void StopCapture() {
     }
 }
 
+void SavePrerollBuffer() {
+    // Get selected recording
+    int selectedIndex = ListView_GetNextItem(g_hRecordingList, -1, LVNI_SELECTED);
+    if (selectedIndex < 0) {
+        MessageBox(g_hWnd, L"Please select a recording to save the buffer of.", L"No Recording Selected", MB_OK | MB_ICONWARNING);
+        return;
+    }
+
+    wchar_t nameBuf[256];
+    wchar_t pidStr[32];
+    ListView_GetItemText(g_hRecordingList, selectedIndex, 0, nameBuf, 256);
+    ListView_GetItemText(g_hRecordingList, selectedIndex, 1, pidStr, 32);
+    DWORD processId = (DWORD)wcstoul(pidStr, nullptr, 10);
+
+    wchar_t outputPath[MAX_PATH];
+    GetWindowTextW(g_hOutputPath, outputPath, MAX_PATH);
+    std::wstring basePath = NormalizeOutputPath(outputPath);
+    if (basePath.empty() || !EnsureDirectoryExists(basePath)) {
+        MessageBox(g_hWnd, L"Please choose a valid output folder.", L"Invalid Output Folder", MB_OK | MB_ICONWARNING);
+        return;
+    }
+    if (basePath.back() != L'\\') {
+        basePath += L'\\';
+    }
+
+    // Remove .exe extension from process name if present
+    std::wstring cleanName = nameBuf;
+    size_t exePos = cleanName.find(L".exe");
+    if (exePos != std::wstring::npos) {
+        cleanName = cleanName.substr(0, exePos);
+    }
+
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    wchar_t timestamp[64];
+    swprintf_s(timestamp, L"%04d_%02d_%02d-%02d_%02d_%02d",
+        st.wYear, st.wMonth, st.wDay,
+        st.wHour, st.wMinute, st.wSecond);
+
+    // The file is written in the background; capture carries on
+    std::wstring bufferPath = basePath + SanitizeFileName(cleanName) + L"-buffer-" + timestamp + L".opus";
+    if (g_captureManager->SavePreroll(processId, bufferPath)) {
+        std::wstring status = L"Saving buffer to " + bufferPath;
+        SetWindowText(g_hStatusText, status.c_str());
+    } else {
+        MessageBox(g_hWnd, L"This recording has no buffered audio to save.", L"Save Buffer", MB_OK | MB_ICONWARNING);
+    }
+}
+
 void UpdateRecordingList() {
     // Save currently selected PID before updating
     DWORD selectedPID = 0;
@@ -1607,6 +1709,10 @@ void UpdateRecordingList() {
     g_captureButtonStops = ListView_GetNextItem(g_hRecordingList, -1, LVNI_SELECTED) >= 0;
     SetWindowText(g_hStartBtn, g_captureButtonStops ? L"&Stop Capture" : L"&Start Capture");
 
+    // Save Buffer acts on the selected recording
+    ShowWindow(g_hSaveBufferBtn, g_prerollSeconds > 0 ? SW_SHOW : SW_HIDE);
+    EnableWindow(g_hSaveBufferBtn, g_prerollSeconds > 0 && g_captureButtonStops);
+
     // Show/enable Stop All, Pause All, and Resume All buttons if there are multiple captures
     if (sessions.size() >= 2) {
         ShowWindow(g_hStopAllBtn, SW_SHOW);
@@ -1888,7 +1994,7 @@ void LoadSettings() {
             // Load process volume
             if (settings.contains("processVolume") && settings["processVolume"].is_number()) {
                 float volume = settings["processVolume"];
-                if (volume >= 0.0f && volume <= 100.0f) {
+                if (volume >= 0.0f && volume <= 200.0f) {
                     g_processVolume = volume;
                     SendMessage(g_hProcessVolumeSlider, TBM_SETPOS, TRUE, (int)volume);
                     wchar_t volumeText[64];
@@ -1900,7 +2006,7 @@ void LoadSettings() {
             // Load microphone volume
             if (settings.contains("microphoneVolume") && settings["microphoneVolume"].is_number()) {
                 float volume = settings["microphoneVolume"];
-                if (volume >= 0.0f && volume <= 100.0f) {
+                if (volume >= 0.0f && volume <= 200.0f) {
                     g_microphoneVolume = volume;
                     SendMessage(g_hMicrophoneVolumeSlider, TBM_SETPOS, TRUE, (int)volume);
                     wchar_t volumeText[64];
@@ -1908,6 +2014,11 @@ void LoadSettings() {
                     SetWindowText(g_hMicrophoneVolumeLabel, volumeText);
                 }
             }
+
+            // Load recording engine options (applied once the capture manager exists)
+            if (settings.contains("capture") && settings["capture"].is_object()) {
+                g_captureSettings = settings["capture"];
+            }
         }
         catch (...) {
             // If parsing fails, just use defaults
@@ -1978,6 +2089,11 @@ void SaveSettings() {
     settings["processVolume"] = g_processVolume;
     settings["microphoneVolume"] = g_microphoneVolume;
 
+    // Keep the recording engine options as they were loaded
+    if (!g_captureSettings.empty()) {
+        settings["capture"] = g_captureSettings;
+    }
+
     // Write to file
     std::wstring settingsPath = GetSettingsFilePath();
     std::ofstream file(settingsPath);
@@ -1987,6 +2103,120 @@ void SaveSettings() {
     }
 }
 
+void ApplyCaptureSettings() {
+    if (!g_captureManager) {
+        return;
+    }
+
+    const json& capture = g_captureSettings;
+    try {
+        // Output mode and durability
+        if (capture.contains("sink") && capture["sink"].is_object()) {
+            const json& sink = capture["sink"];
+            FileSinkOptions options;
+            std::string mode = sink.value("mode", "buffered");
+            if (mode == "direct") {
+                options.mode = FileSinkMode::Direct;
+            } else if (mode == "mapped") {
+                options.mode = FileSinkMode::Mapped;
+            }
+            std::string sync = sink.value("sync", "none");
+            if (sync == "periodic") {
+                options.syncMode = FileSyncMode::Periodic;
+            } else if (sync == "segment") {
+                options.syncMode = FileSyncMode::OnSegment;
+            }
+            options.syncIntervalMs = sink.value("syncIntervalMs", options.syncIntervalMs);
+            options.maxLatencyMs = sink.value("maxLatencyMs", options.maxLatencyMs);
+            g_captureManager->SetSinkOptions(options);
+        }
+
+        // Segment rotation
+        if (capture.contains("segments") && capture["segments"].is_object()) {
+            const json& segments = capture["segments"];
+            SegmentOptions options;
+            options.segmentSeconds = segments.value("seconds", options.segmentSeconds);
+            options.alignToClock = segments.value("alignToClock", options.alignToClock);
+            g_captureManager->SetSegmentOptions(options);
+        }
+
+        // Raw journals encoded in the background
+        if (capture.contains("deferredEncoding") && capture["deferredEncoding"].is_boolean()) {
+            g_captureManager->SetDeferredEncoding(capture["deferredEncoding"].get<bool>());
+        }
+
+        // Background conversion of finished WAV files
+        if (capture.contains("wavTranscode") && capture["wavTranscode"].is_object()) {
+            const json& transcode = capture["wavTranscode"];
+            WavTranscodeOptions options;
+            options.enabled = transcode.value("enabled", true);
+            options.keepSource = transcode.value("keepSource", options.keepSource);
+            UINT32 bitrate = transcode.value("bitrate", 0u);
+            if (transcode.value("format", "flac") == "opus") {
+                options.format = AudioFormat::OPUS;
+                if (bitrate > 0) {
+                    options.opusConfig.bitrate = bitrate;
+                }
+            } else {
+                options.bitrate = bitrate;  // FLAC compression level
+            }
+            g_captureManager->SetWavTranscodeOptions(options);
+        }
+
+        // Extra Opus bitrates
+        if (capture.contains("opusLadder") && capture["opusLadder"].is_array()) {
+            g_captureManager->SetOpusLadder(capture["opusLadder"].get<std::vector<UINT32>>());
+        }
+
+        // Level-activated recording
+        if (capture.contains("activation") && capture["activation"].is_object()) {
+            const json& activation = capture["activation"];
+            ActivationOptions options;
+            options.enabled = activation.value("enabled", true);
+            options.thresholdDb = activation.value("thresholdDb", options.thresholdDb);
+            options.attackMs = activation.value("attackMs", options.attackMs);
+            options.holdMs = activation.value("holdMs", options.holdMs);
+            options.releaseMs = activation.value("releaseMs", options.releaseMs);
+            options.prerollMs = activation.value("prerollMs", options.prerollMs);
+            options.segmentPerActivation = activation.value("segmentPerActivation", options.segmentPerActivation);
+            g_captureManager->SetActivationOptions(options);
+        }
+
+        // Pre-roll buffer of every session, saved with the Save Buffer button
+        if (capture.contains("preroll") && capture["preroll"].is_object()) {
+            const json& preroll = capture["preroll"];
+            PrerollOptions options;
+            options.seconds = preroll.value("seconds", options.seconds);
+            options.bitrate = preroll.value("bitrate", options.bitrate);
+            g_captureManager->SetPrerollOptions(options);
+            g_prerollSeconds = options.seconds;
+        }
+
+        // Encoder tuning of input devices, and mono Opus for any session
+        if (capture.contains("inputProfile") && capture["inputProfile"].is_string()) {
+            g_inputDeviceProfile = capture["inputProfile"].get<std::string>() == "music" ? EncodingProfile::Music
+                                                                                        : EncodingProfile::Voice;
+        }
+        if (capture.contains("downmixToMono") && capture["downmixToMono"].is_boolean()) {
+            g_captureManager->SetDownmixToMono(capture["downmixToMono"].get<bool>());
+        }
+
+        // Suspension of silent sessions
+        if (capture.contains("idle") && capture["idle"].is_object()) {
+            const json& idle = capture["idle"];
+            IdleOptions options;
+            options.enabled = idle.value("enabled", true);
+            options.suspendAfterMs = idle.value("suspendAfterMs", options.suspendAfterMs);
+            options.padGaps = idle.value("padGaps", options.padGaps);
+            options.deferOpen = idle.value("deferOpen", options.deferOpen);
+            g_captureManager->SetIdleOptions(options);
+        }
+    }
+    catch (...) {
+        // A value of the wrong type leaves it and the options after it at their defaults
+    }
+}
+
 void OnFormatChanged() {
     int formatIndex = (int)SendMessage(g_hFormatCombo, CB_GETCURSEL, 0, 0);
 
@@ -2563,7 +2793,7 @@ void ApplySettingsFromJson(const json& preset) {
         // Load volumes
         if (preset.contains("processVolume") && preset["processVolume"].is_number()) {
             float volume = preset["processVolume"];
-            if (volume >= 0.0f && volume <= 100.0f) {
+            if (volume >= 0.0f && volume <= 200.0f) {
                 g_processVolume = volume;
                 SendMessage(g_hProcessVolumeSlider, TBM_SETPOS, TRUE, (int)volume);
                 wchar_t volumeText[64];
@@ -2574,7 +2804,7 @@ void ApplySettingsFromJson(const json& preset) {
 
         if (preset.contains("microphoneVolume") && preset["microphoneVolume"].is_number()) {
             float volume = preset["microphoneVolume"];
-            if (volume >= 0.0f && volume <= 100.0f) {
+            if (volume >= 0.0f && volume <= 200.0f) {
                 g_microphoneVolume = volume;
                 SendMessage(g_hMicrophoneVolumeSlider, TBM_SETPOS, TRUE, (int)volume);
                 wchar_t volumeText[64];
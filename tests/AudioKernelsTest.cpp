@@ -0,0 +1,91 @@
+// Checks the packed 24-bit conversions against a plain scalar reference: every sample
+// count around the vector width (so the SSE2 steps and the scalar tail both run), the
+// extremes of the range, and a round trip through FloatToInt24.
+
+#include "AudioKernels.h"
+#include "TestSupport.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+int32_t ReadInt24(const uint8_t* sample) {
+    int32_t value = (static_cast<int32_t>(sample[0]) << 8) |
+                    (static_cast<int32_t>(sample[1]) << 16) |
+                    (static_cast<int32_t>(sample[2]) << 24);
+    return value >> 8;
+}
+
+void WriteInt24(uint8_t* dest, int32_t value) {
+    dest[0] = static_cast<uint8_t>(value);
+    dest[1] = static_cast<uint8_t>(value >> 8);
+    dest[2] = static_cast<uint8_t>(value >> 16);
+}
+
+// Deterministic 24-bit samples, with both extremes and the values either side of zero
+std::vector<uint8_t> MakeSamples(size_t count, uint32_t seed) {
+    const int32_t edges[] = { -8388608, 8388607, 0, -1, 1 };
+    std::vector<uint8_t> bytes(count * 3);
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 1103515245u + 12345u;
+        int32_t value = static_cast<int32_t>(seed >> 8) - 8388608;
+        if (i % 7 < 5 && (i / 7) % 3 == 0) {
+            value = edges[i % 7];
+        }
+        WriteInt24(bytes.data() + i * 3, value);
+    }
+    return bytes;
+}
+
+void TestInt24ToFloat() {
+    for (size_t count = 0; count <= 40; count++) {
+        std::vector<uint8_t> input = MakeSamples(count, static_cast<uint32_t>(count));
+
+        // Exactly sized output with a guard value behind it: nothing may be written past count
+        std::vector<float> output(count + 1, 12345.0f);
+        AudioKernels::Int24ToFloat(input.data(), output.data(), count);
+        CHECK(output[count] == 12345.0f);
+
+        bool match = true;
+        for (size_t i = 0; i < count; i++) {
+            float expected = static_cast<float>(ReadInt24(input.data() + i * 3)) / 8388608.0f;
+            match = match && output[i] == expected;
+        }
+        CHECK(match);
+    }
+}
+
+// Unaligned input: the conversion may start anywhere in a buffer
+void TestInt24ToFloatOffset() {
+    std::vector<uint8_t> samples = MakeSamples(64, 99);
+    for (size_t offset = 0; offset < 4; offset++) {
+        std::vector<uint8_t> shifted(offset, 0xAB);
+        shifted.insert(shifted.end(), samples.begin(), samples.end());
+        std::vector<float> aligned(64);
+        std::vector<float> unaligned(64);
+        AudioKernels::Int24ToFloat(samples.data(), aligned.data(), 64);
+        AudioKernels::Int24ToFloat(shifted.data() + offset, unaligned.data(), 64);
+        CHECK(std::memcmp(aligned.data(), unaligned.data(), 64 * sizeof(float)) == 0);
+    }
+}
+
+// 24-bit values are exact in float, so converting back gives the same bytes
+void TestInt24RoundTrip() {
+    const size_t count = 1001;
+    std::vector<uint8_t> input = MakeSamples(count, 7);
+    std::vector<float> floats(count);
+    std::vector<uint8_t> output(count * 3);
+    AudioKernels::Int24ToFloat(input.data(), floats.data(), count);
+    AudioKernels::FloatToInt24(floats.data(), output.data(), count);
+    CHECK(output == input);
+}
+
+}  // namespace
+
+int main() {
+    TestInt24ToFloat();
+    TestInt24ToFloatOffset();
+    TestInt24RoundTrip();
+    return TestSupport::Result("AudioKernelsTest");
+}
@@ -0,0 +1,254 @@
+// Writes a capture journal, damages copies of it the ways a crash can and the ways it
+// can't, and checks how CaptureJournalReader classifies each: a torn tail (the last
+// chunk cut short or damaged, preallocated zeros) ends the journal as Torn after every
+// intact chunk; damage with more data after it is Corrupt.
+
+#include "CaptureJournal.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr UINT32 kSampleRate = 8000;
+constexpr UINT32 kBlockAlign = 4;         // 16-bit stereo
+constexpr UINT32 kFrames = kSampleRate * 7 / 2;   // Three full chunks and a half one
+
+struct Journal {
+    std::vector<BYTE> bytes;
+    std::vector<BYTE> audio;               // Everything written
+    std::vector<UINT64> chunkOffsets;      // Start of each chunk
+};
+
+std::wstring TempPath(const wchar_t* name) {
+    wchar_t tempDir[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempDir);
+    return std::wstring(tempDir) + L"CaptureJournalTest_" + std::to_wstring(GetCurrentProcessId()) + L"_" + name;
+}
+
+std::vector<BYTE> ReadAll(const std::wstring& path) {
+    std::vector<BYTE> bytes;
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return bytes;
+    }
+    LARGE_INTEGER size = {};
+    GetFileSizeEx(file, &size);
+    bytes.resize(static_cast<size_t>(size.QuadPart));
+    OVERLAPPED overlapped = {};
+    DWORD read = 0;
+    if (!bytes.empty() && (!ReadFile(file, bytes.data(), static_cast<DWORD>(bytes.size()), &read, &overlapped) ||
+                           read != bytes.size())) {
+        bytes.clear();
+    }
+    CloseHandle(file);
+    return bytes;
+}
+
+bool WriteAll(const std::wstring& path, const std::vector<BYTE>& bytes) {
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    OVERLAPPED overlapped = {};
+    DWORD written = 0;
+    bool ok = WriteFile(file, bytes.data(), static_cast<DWORD>(bytes.size()), &written, &overlapped) &&
+              written == bytes.size();
+    CloseHandle(file);
+    return ok;
+}
+
+// A journal of kFrames of noise, written in uneven blocks, and where its chunks start
+Journal MakeJournal() {
+    Journal journal;
+    WAVEFORMATEX format = {};
+    format.wFormatTag = WAVE_FORMAT_PCM;
+    format.nChannels = 2;
+    format.nSamplesPerSec = kSampleRate;
+    format.wBitsPerSample = 16;
+    format.nBlockAlign = kBlockAlign;
+    format.nAvgBytesPerSec = kSampleRate * kBlockAlign;
+
+    journal.audio.resize(static_cast<size_t>(kFrames) * kBlockAlign);
+    UINT32 seed = 1;
+    for (BYTE& byte : journal.audio) {
+        seed = seed * 1103515245u + 12345u;
+        byte = static_cast<BYTE>(seed >> 16) | 1;    // Never zero, so damage can't read as padding
+    }
+
+    std::wstring path = TempPath(L"source.acj");
+    CaptureJournalWriter writer;
+    if (!writer.Open(path, &format, 0, 0, OpusEncoderConfig())) {
+        return journal;
+    }
+    for (size_t offset = 0; offset < journal.audio.size(); ) {
+        size_t size = std::min<size_t>(journal.audio.size() - offset, 1234 * kBlockAlign + 2);
+        writer.WriteData(journal.audio.data() + offset, static_cast<UINT32>(size));
+        offset += size;
+    }
+    writer.Close();
+    journal.bytes = ReadAll(path);
+    DeleteFileW(path.c_str());
+
+    // Walk the chunk headers
+    UINT64 offset = sizeof(JournalFileHeader);
+    while (offset + sizeof(JournalChunkHeader) <= journal.bytes.size()) {
+        JournalChunkHeader chunk;
+        std::memcpy(&chunk, journal.bytes.data() + offset, sizeof(chunk));
+        journal.chunkOffsets.push_back(offset);
+        offset += sizeof(chunk) + chunk.formatSize + chunk.payloadSize;
+    }
+    return journal;
+}
+
+struct ReadResult {
+    bool opened = false;
+    size_t chunks = 0;
+    std::vector<BYTE> audio;               // Payloads of the intact chunks, in order
+    bool positionsMatch = true;            // Each chunk starts where the previous ended
+    JournalChunkStatus end = JournalChunkStatus::Chunk;
+};
+
+ReadResult ReadJournal(const std::vector<BYTE>& bytes) {
+    ReadResult result;
+    std::wstring path = TempPath(L"damaged.acj");
+    if (!WriteAll(path, bytes)) {
+        return result;
+    }
+
+    CaptureJournalReader reader;
+    result.opened = reader.Open(path);
+    if (result.opened) {
+        JournalChunkHeader chunk;
+        std::vector<BYTE> format;
+        std::vector<BYTE> payload;
+        while ((result.end = reader.ReadChunk(chunk, format, payload)) == JournalChunkStatus::Chunk) {
+            result.positionsMatch = result.positionsMatch && chunk.samplePosition == result.audio.size() / kBlockAlign;
+            result.audio.insert(result.audio.end(), payload.begin(), payload.end());
+            result.chunks++;
+        }
+        reader.Close();
+    }
+    DeleteFileW(path.c_str());
+    return result;
+}
+
+// Audio held by the first count chunks
+std::vector<BYTE> AudioBefore(const Journal& journal, size_t count) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        JournalChunkHeader chunk;
+        std::memcpy(&chunk, journal.bytes.data() + journal.chunkOffsets[i], sizeof(chunk));
+        bytes += chunk.payloadSize;
+    }
+    return std::vector<BYTE>(journal.audio.begin(), journal.audio.begin() + bytes);
+}
+
+void CheckTorn(const char* name, const Journal& journal, const std::vector<BYTE>& bytes, size_t intactChunks) {
+    ReadResult result = ReadJournal(bytes);
+    CHECK(result.opened);
+    CHECK(result.chunks == intactChunks);
+    CHECK(result.positionsMatch);
+    CHECK(result.audio == AudioBefore(journal, intactChunks));
+    if (result.end != JournalChunkStatus::Torn) {
+        std::fprintf(stderr, "%s: not reported as torn\n", name);
+    }
+    CHECK(result.end == JournalChunkStatus::Torn);
+}
+
+void CheckCorrupt(const char* name, const std::vector<BYTE>& bytes, size_t intactChunks) {
+    ReadResult result = ReadJournal(bytes);
+    CHECK(result.opened);
+    CHECK(result.chunks == intactChunks);
+    if (result.end != JournalChunkStatus::Corrupt) {
+        std::fprintf(stderr, "%s: not reported as corrupt\n", name);
+    }
+    CHECK(result.end == JournalChunkStatus::Corrupt);
+}
+
+// Whole frames in one-second chunks, each where the last ended, and a clean end
+void TestIntact(const Journal& journal) {
+    CHECK(journal.chunkOffsets.size() == 4);
+    ReadResult result = ReadJournal(journal.bytes);
+    CHECK(result.opened);
+    CHECK(result.chunks == journal.chunkOffsets.size());
+    CHECK(result.positionsMatch);
+    CHECK(result.audio == journal.audio);
+    CHECK(result.end == JournalChunkStatus::End);
+}
+
+// What a crash leaves: the last chunk cut anywhere or never fully written, and the
+// zeros of preallocation or sector padding behind the last complete chunk
+void TestTornTails(const Journal& journal) {
+    const size_t last = journal.chunkOffsets.size() - 1;
+    const UINT64 lastOffset = journal.chunkOffsets[last];
+
+    std::vector<BYTE> bytes(journal.bytes.begin(), journal.bytes.begin() + lastOffset + 10);
+    CheckTorn("cut in the last header", journal, bytes, last);
+
+    bytes.assign(journal.bytes.begin(), journal.bytes.end() - 1);
+    CheckTorn("cut in the last payload", journal, bytes, last);
+
+    bytes = journal.bytes;
+    bytes[bytes.size() - 100] ^= 0x40;
+    CheckTorn("last payload damaged", journal, bytes, last);
+
+    // A garbled header declares nothing; what follows is no longer than a chunk
+    bytes = journal.bytes;
+    bytes[lastOffset] = 'X';
+    CheckTorn("last header damaged", journal, bytes, last);
+
+    // A full-size final chunk cut one byte short
+    UINT64 secondLast = journal.chunkOffsets[last - 1];
+    bytes.assign(journal.bytes.begin(), journal.bytes.begin() + lastOffset);
+    bytes.insert(bytes.end(), journal.bytes.begin() + secondLast, journal.bytes.begin() + lastOffset - 1);
+    CheckTorn("full chunk cut short", journal, bytes, last);
+
+    bytes = journal.bytes;
+    bytes.insert(bytes.end(), 1024 * 1024, 0);
+    CheckTorn("preallocated zeros", journal, bytes, last + 1);
+
+    bytes.assign(journal.bytes.begin(), journal.bytes.begin() + lastOffset);
+    bytes.resize(bytes.size() + 300 * 1024, 0);
+    CheckTorn("zeros where the last chunk was", journal, bytes, last);
+}
+
+// Damage a crash can't cause: a bad chunk with whole chunks of data after it
+void TestCorruption(const Journal& journal) {
+    for (size_t damaged = 0; damaged + 1 < journal.chunkOffsets.size() - 1; damaged++) {
+        std::vector<BYTE> bytes = journal.bytes;
+        bytes[journal.chunkOffsets[damaged] + sizeof(JournalChunkHeader) + 64] ^= 0x01;
+        CheckCorrupt("payload damaged mid-journal", bytes, damaged);
+
+        bytes = journal.bytes;
+        bytes[journal.chunkOffsets[damaged]] = 'X';
+        CheckCorrupt("chunk magic damaged mid-journal", bytes, damaged);
+    }
+
+    // Non-zero bytes after zeros are not padding
+    std::vector<BYTE> bytes = journal.bytes;
+    bytes.insert(bytes.end(), 256 * 1024, 0);
+    bytes.insert(bytes.end(), 16, 0x55);
+    CheckCorrupt("data after zeros", bytes, journal.chunkOffsets.size());
+}
+
+}  // namespace
+
+int main() {
+    Journal journal = MakeJournal();
+    CHECK(!journal.bytes.empty());
+    if (journal.bytes.empty() || journal.chunkOffsets.size() < 3) {
+        return TestSupport::Result("CaptureJournalTest");
+    }
+
+    TestIntact(journal);
+    TestTornTails(journal);
+    TestCorruption(journal);
+    return TestSupport::Result("CaptureJournalTest");
+}
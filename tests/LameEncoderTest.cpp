@@ -0,0 +1,240 @@
+// Encodes through LameEncoder into memory and checks the stream it leaves: a well-formed
+// frame sequence, a LAME tag that describes it exactly for every input sample type, and
+// surround channels reaching the encoder.
+
+#include "LameEncoder.h"
+#include "TestSupport.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t kSampleRate = 48000;
+constexpr uint32_t kSamplesPerFrame = 1152;     // MPEG-1 Layer III
+constexpr uint32_t kSurround51 = 0x3F;          // FL FR FC LFE BL BR
+
+// The stream as a file would hold it
+class MemoryOutput : public LameEncoder::Output {
+public:
+    bool Write(const uint8_t* data, size_t size) override {
+        bytes.insert(bytes.end(), data, data + size);
+        return true;
+    }
+
+    bool WriteAt(uint64_t offset, const uint8_t* data, size_t size) override {
+        if (offset + size > bytes.size()) {
+            return false;
+        }
+        std::memcpy(bytes.data() + offset, data, size);
+        return true;
+    }
+
+    std::vector<uint8_t> bytes;
+};
+
+// Interleaved samples of a 1 kHz tone on the channels selected by toneMask
+std::vector<uint8_t> MakeTone(const SampleFormat& format, uint32_t frames, uint32_t toneMask) {
+    const uint32_t bytesPerSample = format.bitsPerSample / 8;
+    std::vector<uint8_t> pcm(static_cast<size_t>(frames) * format.blockAlign);
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        double value = std::sin(2.0 * 3.14159265358979 * 1000.0 * frame / kSampleRate) * 0.5;
+        for (uint16_t ch = 0; ch < format.channels; ch++) {
+            double sample = ((toneMask >> ch) & 1) ? value : 0.0;
+            uint8_t* dest = pcm.data() + static_cast<size_t>(frame) * format.blockAlign + ch * bytesPerSample;
+            if (format.isFloat) {
+                float f = static_cast<float>(sample);
+                std::memcpy(dest, &f, 4);
+            } else {
+                int32_t scaled = static_cast<int32_t>(sample * 2147483647.0);
+                std::memcpy(dest, reinterpret_cast<uint8_t*>(&scaled) + (4 - bytesPerSample), bytesPerSample);
+            }
+        }
+    }
+    return pcm;
+}
+
+bool Encode(const SampleFormat& format, uint32_t channelMask, const std::vector<uint8_t>& pcm,
+            std::vector<uint8_t>& stream) {
+    MemoryOutput output;
+    LameEncoder encoder;
+    if (!encoder.Open(format, channelMask, 192000, &output)) {
+        return false;
+    }
+
+    // Uneven write sizes so batches straddle the encoder's internal batch size
+    const uint8_t* data = pcm.data();
+    size_t remaining = pcm.size();
+    size_t chunk = static_cast<size_t>(4801) * format.blockAlign;
+    bool ok = true;
+    while (remaining > 0) {
+        size_t size = remaining < chunk ? remaining : chunk;
+        ok = encoder.Encode(data, static_cast<uint32_t>(size)) && ok;
+        data += size;
+        remaining -= size;
+    }
+    ok = encoder.Finish() && ok;
+    stream = output.bytes;
+    return ok;
+}
+
+uint32_t ReadBigEndian(const uint8_t* data, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) value = (value << 8) | data[i];
+    return value;
+}
+
+// Size of the MPEG-1 Layer III frame starting at data, or 0 if there is no valid header
+size_t FrameSize(const uint8_t* data, size_t available) {
+    static const uint32_t kBitrates[16] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0};
+    static const uint32_t kSampleRates[4] = {44100, 48000, 32000, 0};
+    if (available < 4 || data[0] != 0xFF || (data[1] & 0xFE) != 0xFA) {
+        return 0;   // Not frame sync + MPEG-1 + Layer III
+    }
+    uint32_t bitrate = kBitrates[data[2] >> 4] * 1000;
+    uint32_t sampleRate = kSampleRates[(data[2] >> 2) & 3];
+    if (bitrate == 0 || sampleRate == 0) {
+        return 0;
+    }
+    return 144 * bitrate / sampleRate + ((data[2] >> 1) & 1);
+}
+
+// Walks the whole stream as MPEG frames and checks the tag frame against it
+void CheckStream(const char* name, const std::vector<uint8_t>& stream, uint32_t inputFrames) {
+    size_t offset = 0;
+    size_t frames = 0;
+    size_t tagSize = 0;
+    while (offset < stream.size()) {
+        size_t size = FrameSize(stream.data() + offset, stream.size() - offset);
+        if (size == 0 || offset + size > stream.size()) {
+            std::fprintf(stderr, "%s: bad frame at offset %zu\n", name, offset);
+            break;
+        }
+        if (frames == 0) tagSize = size;
+        offset += size;
+        frames++;
+    }
+    CHECK(offset == stream.size());
+    CHECK(frames > 1);
+    if (tagSize == 0) {
+        return;
+    }
+
+    // The first frame holds the Info (CBR Xing) tag, rewritten at Finish with the final counts
+    const uint8_t* tag = nullptr;
+    for (size_t i = 4; i + 4 <= tagSize; i++) {
+        if (std::memcmp(stream.data() + i, "Info", 4) == 0 || std::memcmp(stream.data() + i, "Xing", 4) == 0) {
+            tag = stream.data() + i;
+            break;
+        }
+    }
+    CHECK(tag != nullptr);
+    if (tag == nullptr) {
+        return;
+    }
+    uint32_t flags = ReadBigEndian(tag + 4, 4);
+    CHECK((flags & 1) != 0);
+    CHECK(ReadBigEndian(tag + 8, 4) == frames - 1);
+
+    // LAME extension: encoder delay and padding make the decoded length sample-exact
+    size_t lameOffset = 8 + ((flags & 1) ? 4 : 0) + ((flags & 2) ? 4 : 0) + ((flags & 4) ? 100 : 0) + ((flags & 8) ? 4 : 0);
+    const uint8_t* lame = tag + lameOffset;
+    CHECK(std::memcmp(lame, "LAME", 4) == 0);
+    uint32_t delayPadding = ReadBigEndian(lame + 21, 3);
+    uint32_t delay = delayPadding >> 12;
+    uint32_t padding = delayPadding & 0xFFF;
+    CHECK((frames - 1) * kSamplesPerFrame - delay - padding == inputFrames);
+}
+
+// Every sample type the capture can deliver gives a complete, exactly tagged stream
+void TestSampleTypes() {
+    const uint32_t inputFrames = kSampleRate * 3 + 123;
+    const SampleFormat formats[] = {
+        SampleFormat::Packed(kSampleRate, 2, 16, false),
+        SampleFormat::Packed(kSampleRate, 2, 24, false),
+        SampleFormat::Packed(kSampleRate, 2, 32, false),
+        SampleFormat::Packed(kSampleRate, 2, 32, true),
+        SampleFormat::Packed(kSampleRate, 1, 16, false),
+    };
+    for (const SampleFormat& format : formats) {
+        std::vector<uint8_t> stream;
+        CHECK(Encode(format, 0, MakeTone(format, inputFrames, 0x3), stream));
+        CheckStream("sample types", stream, inputFrames);
+    }
+
+    // Encoding is deterministic, and at a constant bitrate the stream's size depends only
+    // on its duration, whatever the sample type
+    SampleFormat int16 = SampleFormat::Packed(kSampleRate, 2, 16, false);
+    SampleFormat int24 = SampleFormat::Packed(kSampleRate, 2, 24, false);
+    std::vector<uint8_t> first;
+    std::vector<uint8_t> second;
+    CHECK(Encode(int16, 0, MakeTone(int16, inputFrames, 0x3), first));
+    CHECK(Encode(int16, 0, MakeTone(int16, inputFrames, 0x3), second));
+    CHECK(first == second);
+    CHECK(Encode(int24, 0, MakeTone(int24, inputFrames, 0x3), second));
+    CHECK(first.size() == second.size());
+}
+
+// Frames wider than their samples (e.g. 24-bit samples in 32-bit containers) are read
+// frame by frame and give the same stream as the packed layout
+void TestPaddedFrames() {
+    const uint32_t inputFrames = kSampleRate;
+    SampleFormat packed = SampleFormat::Packed(kSampleRate, 2, 16, false);
+    SampleFormat padded = packed;
+    padded.blockAlign = 8;
+
+    std::vector<uint8_t> packedPcm = MakeTone(packed, inputFrames, 0x3);
+    std::vector<uint8_t> paddedPcm(static_cast<size_t>(inputFrames) * padded.blockAlign, 0xCD);
+    for (uint32_t frame = 0; frame < inputFrames; frame++) {
+        std::memcpy(paddedPcm.data() + static_cast<size_t>(frame) * padded.blockAlign,
+                    packedPcm.data() + static_cast<size_t>(frame) * packed.blockAlign, packed.blockAlign);
+    }
+
+    std::vector<uint8_t> packedStream;
+    std::vector<uint8_t> paddedStream;
+    CHECK(Encode(packed, 0, packedPcm, packedStream));
+    CHECK(Encode(padded, 0, paddedPcm, paddedStream));
+    CHECK(packedStream == paddedStream);
+}
+
+void TestSurroundIsDownmixed() {
+    const uint32_t inputFrames = kSampleRate;
+    SampleFormat format = SampleFormat::Packed(kSampleRate, 6, 16, false);
+
+    // Tone only on centre, LFE and the surrounds: before the downmix these were dropped
+    // and the stream was indistinguishable from silence
+    std::vector<uint8_t> silent;
+    std::vector<uint8_t> silentAgain;
+    std::vector<uint8_t> surround;
+    CHECK(Encode(format, kSurround51, MakeTone(format, inputFrames, 0), silent));
+    CHECK(Encode(format, kSurround51, MakeTone(format, inputFrames, 0), silentAgain));
+    CHECK(Encode(format, kSurround51, MakeTone(format, inputFrames, 0x3C), surround));
+    CheckStream("surround", surround, inputFrames);
+
+    CHECK(silent == silentAgain);
+    CHECK(silent.size() == surround.size());
+    CHECK(silent != surround);
+}
+
+void TestRejectsUnsupportedFormats() {
+    MemoryOutput output;
+    LameEncoder encoder;
+    CHECK(!encoder.Open(SampleFormat::Packed(kSampleRate, 2, 8, false), 0, 192000, &output));
+    CHECK(!encoder.Open(SampleFormat::Packed(kSampleRate, 0, 16, false), 0, 192000, &output));
+    CHECK(!encoder.Open(SampleFormat::Packed(kSampleRate, 2, 16, false), 0, 192000, nullptr));
+    CHECK(!encoder.IsOpen());
+    CHECK(!encoder.Encode(nullptr, 0));
+    CHECK(output.bytes.empty());
+}
+
+}  // namespace
+
+int main() {
+    TestSampleTypes();
+    TestPaddedFrames();
+    TestSurroundIsDownmixed();
+    TestRejectsUnsupportedFormats();
+    return TestSupport::Result("LameEncoderTest");
+}
@@ -0,0 +1,154 @@
+// Encodes through the LAME backend of Mp3Encoder and checks the file it leaves: for
+// every sink mode, exactly the stream LameEncoder produces (tag frame included), and
+// sync stats. The stream itself is checked by LameEncoderTest.
+
+#include "Mp3Encoder.h"
+#include "TestSupport.h"
+
+#include <ks.h>
+#include <ksmedia.h>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr UINT32 kSampleRate = 48000;
+constexpr UINT32 kChunkFrames = 4801;         // Uneven writes, so batches straddle the encoder's batch size
+
+struct EncodeResult {
+    bool ok = false;
+    std::vector<BYTE> file;
+    FileSyncStats syncStats;
+};
+
+WAVEFORMATEXTENSIBLE MakeFormat(WORD channels, DWORD channelMask) {
+    WAVEFORMATEXTENSIBLE format = {};
+    format.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+    format.Format.nChannels = channels;
+    format.Format.nSamplesPerSec = kSampleRate;
+    format.Format.wBitsPerSample = 16;
+    format.Format.nBlockAlign = static_cast<WORD>(channels * 2);
+    format.Format.nAvgBytesPerSec = kSampleRate * format.Format.nBlockAlign;
+    format.Format.cbSize = 22;
+    format.Samples.wValidBitsPerSample = 16;
+    format.dwChannelMask = channelMask;
+    format.SubFormat = KSDATAFORMAT_SUBTYPE_PCM;
+    return format;
+}
+
+// Interleaved 16-bit PCM with a 1 kHz tone on the channels selected by toneMask
+std::vector<int16_t> MakeTone(WORD channels, UINT32 frames, UINT32 toneMask) {
+    std::vector<int16_t> pcm(static_cast<size_t>(frames) * channels);
+    for (UINT32 frame = 0; frame < frames; frame++) {
+        double value = std::sin(2.0 * 3.14159265358979 * 1000.0 * frame / kSampleRate);
+        for (WORD ch = 0; ch < channels; ch++) {
+            bool tone = (toneMask >> ch) & 1;
+            pcm[static_cast<size_t>(frame) * channels + ch] = tone ? static_cast<int16_t>(value * 16000.0) : 0;
+        }
+    }
+    return pcm;
+}
+
+EncodeResult Encode(const WAVEFORMATEXTENSIBLE& format, const std::vector<int16_t>& pcm, FileSinkOptions options) {
+    wchar_t tempDir[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempDir);
+    std::wstring path = std::wstring(tempDir) + L"Mp3EncoderTest_" + std::to_wstring(GetCurrentProcessId()) + L".mp3";
+
+    EncodeResult result;
+    Mp3Encoder encoder;
+    encoder.SetSinkOptions(options);
+    if (!encoder.Open(path, &format.Format, 192000)) {
+        return result;
+    }
+
+    const BYTE* data = reinterpret_cast<const BYTE*>(pcm.data());
+    size_t remaining = pcm.size() * sizeof(int16_t);
+    size_t chunk = kChunkFrames * format.Format.nBlockAlign;
+    result.ok = true;
+    while (remaining > 0) {
+        size_t size = remaining < chunk ? remaining : chunk;
+        result.ok = encoder.WriteData(data, static_cast<UINT32>(size)) && result.ok;
+        data += size;
+        remaining -= size;
+    }
+    encoder.Close();
+    result.syncStats = encoder.GetSyncStats();
+
+    std::ifstream file(path, std::ios::binary);
+    result.file.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    file.close();
+    DeleteFileW(path.c_str());
+    return result;
+}
+
+// The same samples, written the same way, through LameEncoder into memory
+std::vector<BYTE> EncodeInMemory(const WAVEFORMATEXTENSIBLE& format, const std::vector<int16_t>& pcm) {
+    struct MemoryOutput : LameEncoder::Output {
+        bool Write(const uint8_t* data, size_t size) override {
+            bytes.insert(bytes.end(), data, data + size);
+            return true;
+        }
+        bool WriteAt(uint64_t offset, const uint8_t* data, size_t size) override {
+            if (offset + size > bytes.size()) {
+                return false;
+            }
+            std::memcpy(bytes.data() + offset, data, size);
+            return true;
+        }
+        std::vector<BYTE> bytes;
+    };
+
+    MemoryOutput output;
+    LameEncoder encoder;
+    SampleFormat sampleFormat = SampleFormat::Packed(format.Format.nSamplesPerSec, format.Format.nChannels, 16, false);
+    if (!encoder.Open(sampleFormat, format.dwChannelMask, 192000, &output)) {
+        return std::vector<BYTE>();
+    }
+
+    const BYTE* data = reinterpret_cast<const BYTE*>(pcm.data());
+    size_t remaining = pcm.size() * sizeof(int16_t);
+    size_t chunk = kChunkFrames * format.Format.nBlockAlign;
+    bool ok = true;
+    while (remaining > 0) {
+        size_t size = remaining < chunk ? remaining : chunk;
+        ok = encoder.Encode(data, static_cast<uint32_t>(size)) && ok;
+        data += size;
+        remaining -= size;
+    }
+    ok = encoder.Finish() && ok;
+    return ok ? output.bytes : std::vector<BYTE>();
+}
+
+void TestSinkModes(WORD channels, DWORD channelMask) {
+    const UINT32 inputFrames = kSampleRate * 3 + 123;
+    WAVEFORMATEXTENSIBLE format = MakeFormat(channels, channelMask);
+    std::vector<int16_t> pcm = MakeTone(channels, inputFrames, 0x3F);
+
+    std::vector<BYTE> reference = EncodeInMemory(format, pcm);
+    CHECK(!reference.empty());
+
+    const FileSinkMode modes[] = {FileSinkMode::Buffered, FileSinkMode::Direct, FileSinkMode::Mapped};
+    for (FileSinkMode mode : modes) {
+        FileSinkOptions options;
+        options.mode = mode;
+        options.syncMode = FileSyncMode::OnSegment;
+        EncodeResult result = Encode(format, pcm, options);
+        CHECK(result.ok);
+        CHECK(result.syncStats.syncCount >= 1);
+        CHECK(result.syncStats.failedSyncs == 0);
+        CHECK(result.file == reference);
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestSinkModes(2, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+    TestSinkModes(6, KSAUDIO_SPEAKER_5POINT1);
+    return TestSupport::Result("Mp3EncoderTest");
+}
@@ -0,0 +1,190 @@
+// Compares OggPageWriter against libogg: the same packet sequence must produce
+// byte-identical pages, including page boundaries, granules, flags and CRCs.
+
+#include "OggPageWriter.h"
+#include "TestSupport.h"
+
+#include <ogg/ogg.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Packet {
+    std::vector<uint8_t> data;
+    int64_t granulePos;
+    bool flushAfter;    // Force out everything pending, as the encoders do after headers
+};
+
+std::vector<uint8_t> MuxWithLibogg(const std::vector<Packet>& packets, uint32_t serialNumber) {
+    std::vector<uint8_t> stream;
+    auto append = [&stream](const ogg_page& page) {
+        stream.insert(stream.end(), page.header, page.header + page.header_len);
+        stream.insert(stream.end(), page.body, page.body + page.body_len);
+    };
+
+    ogg_stream_state state;
+    ogg_stream_init(&state, static_cast<int>(serialNumber));
+    ogg_page page;
+    for (size_t i = 0; i < packets.size(); i++) {
+        static uint8_t empty = 0;
+        ogg_packet packet = {};
+        packet.packet = packets[i].data.empty() ? &empty : const_cast<uint8_t*>(packets[i].data.data());
+        packet.bytes = static_cast<long>(packets[i].data.size());
+        packet.b_o_s = i == 0;
+        packet.e_o_s = i + 1 == packets.size();
+        packet.granulepos = packets[i].granulePos;
+        packet.packetno = static_cast<ogg_int64_t>(i);
+        ogg_stream_packetin(&state, &packet);
+
+        if (packets[i].flushAfter) {
+            while (ogg_stream_flush(&state, &page)) append(page);
+        } else {
+            while (ogg_stream_pageout(&state, &page)) append(page);
+        }
+    }
+    while (ogg_stream_flush(&state, &page)) append(page);
+    ogg_stream_clear(&state);
+    return stream;
+}
+
+// Alternates between the copying and the in-place packet paths so both are covered
+std::vector<uint8_t> MuxWithOggPageWriter(const std::vector<Packet>& packets, uint32_t serialNumber) {
+    std::vector<uint8_t> stream;
+    const uint8_t* page = nullptr;
+    size_t size = 0;
+    auto append = [&]() { stream.insert(stream.end(), page, page + size); };
+
+    OggPageWriter writer;
+    writer.Reset(serialNumber);
+    for (size_t i = 0; i < packets.size(); i++) {
+        const Packet& packet = packets[i];
+        bool endOfStream = i + 1 == packets.size();
+        if (i % 2 == 0) {
+            writer.AddPacket(packet.data.data(), packet.data.size(), packet.granulePos, endOfStream);
+        } else {
+            uint8_t* target = writer.BeginPacket(packet.data.size());
+            std::copy(packet.data.begin(), packet.data.end(), target);
+            writer.CommitPacket(packet.data.size(), packet.granulePos, endOfStream);
+        }
+
+        if (packet.flushAfter) {
+            while (writer.Flush(page, size)) append();
+        } else {
+            while (writer.PageOut(page, size)) append();
+        }
+    }
+    while (writer.Flush(page, size)) append();
+    return stream;
+}
+
+std::vector<uint8_t> RandomBytes(std::mt19937& random, size_t size) {
+    std::vector<uint8_t> bytes(size);
+    for (uint8_t& byte : bytes) byte = static_cast<uint8_t>(random());
+    return bytes;
+}
+
+void CheckIdentical(const char* name, const std::vector<Packet>& packets, uint32_t serialNumber) {
+    std::vector<uint8_t> expected = MuxWithLibogg(packets, serialNumber);
+    std::vector<uint8_t> actual = MuxWithOggPageWriter(packets, serialNumber);
+
+    size_t common = std::min(expected.size(), actual.size());
+    size_t mismatch = 0;
+    while (mismatch < common && expected[mismatch] == actual[mismatch]) mismatch++;
+    if (mismatch < common || expected.size() != actual.size()) {
+        std::fprintf(stderr, "%s: streams differ at byte %zu (libogg %zu bytes, OggPageWriter %zu bytes)\n",
+                     name, mismatch, expected.size(), actual.size());
+    }
+    CHECK(!expected.empty());
+    CHECK(expected == actual);
+}
+
+// Opus-style stream: two header packets flushed onto their own pages, then
+// 20 ms audio packets with an occasional latency flush
+void TestOpusLikeStream() {
+    std::mt19937 random(1);
+    std::vector<Packet> packets;
+    packets.push_back({RandomBytes(random, 19), 0, true});
+    packets.push_back({RandomBytes(random, 61), 0, true});
+    int64_t granule = 0;
+    for (int i = 0; i < 3000; i++) {
+        granule += 960;
+        packets.push_back({RandomBytes(random, 3 + random() % 400), granule, i % 250 == 249});
+    }
+    CheckIdentical("opus-like", packets, 0x12345678);
+}
+
+// Lacing edge cases: empty packets, exact multiples of 255 and packets spanning
+// several pages (pages where no packet ends carry granule -1)
+void TestLacingEdges() {
+    std::mt19937 random(2);
+    const size_t sizes[] = {0, 1, 254, 255, 256, 510, 0, 765, 4096, 65024, 65025, 65026,
+                            70000, 3, 255 * 255 * 2, 100000, 0, 0, 12};
+    std::vector<Packet> packets;
+    int64_t granule = 0;
+    for (size_t size : sizes) {
+        granule += 1024;
+        packets.push_back({RandomBytes(random, size), granule, false});
+    }
+    CheckIdentical("lacing-edges", packets, 0xdeadbeef);
+}
+
+// Many tiny packets fill the 255-entry segment table before the 4 KiB body target
+void TestSegmentTableLimit() {
+    std::mt19937 random(3);
+    std::vector<Packet> packets;
+    int64_t granule = 0;
+    for (int i = 0; i < 2000; i++) {
+        granule += 120;
+        packets.push_back({RandomBytes(random, random() % 4), granule, i % 700 == 699});
+    }
+    CheckIdentical("segment-table", packets, 7);
+}
+
+// A lone header packet followed by end of stream
+void TestShortStreams() {
+    std::mt19937 random(4);
+    CheckIdentical("single-packet", {{RandomBytes(random, 42), 0, false}}, 1);
+    CheckIdentical("header-then-eos", {{RandomBytes(random, 19), 0, true}, {RandomBytes(random, 300), 960, false}}, 2);
+}
+
+void TestCrc() {
+    // The checksum libogg stores in a page must match Crc over the page with the field zeroed
+    std::mt19937 random(5);
+    std::vector<uint8_t> body = RandomBytes(random, 1000);
+    ogg_stream_state state;
+    ogg_stream_init(&state, 99);
+    ogg_packet packet = {};
+    packet.packet = body.data();
+    packet.bytes = static_cast<long>(body.size());
+    packet.b_o_s = 1;
+    ogg_stream_packetin(&state, &packet);
+    ogg_page page;
+    CHECK(ogg_stream_flush(&state, &page) != 0);
+
+    std::vector<uint8_t> bytes(page.header, page.header + page.header_len);
+    bytes.insert(bytes.end(), page.body, page.body + page.body_len);
+    uint32_t stored = bytes[22] | (bytes[23] << 8) | (bytes[24] << 16) | (static_cast<uint32_t>(bytes[25]) << 24);
+    bytes[22] = bytes[23] = bytes[24] = bytes[25] = 0;
+    CHECK(OggPageWriter::Crc(bytes.data(), bytes.size()) == stored);
+
+    // Chained computation matches a single pass
+    uint32_t partial = OggPageWriter::Crc(bytes.data(), 100);
+    CHECK(OggPageWriter::Crc(bytes.data() + 100, bytes.size() - 100, partial) == stored);
+    ogg_stream_clear(&state);
+}
+
+}  // namespace
+
+int main() {
+    TestOpusLikeStream();
+    TestLacingEdges();
+    TestSegmentTableLimit();
+    TestShortStreams();
+    TestCrc();
+    return TestSupport::Result("OggPageWriterTest");
+}
@@ -0,0 +1,290 @@
+// Feeds one capture through RecordingFanout to a WAV, two FLAC and an Opus output, for
+// every capture sample type, and checks what each output was given. The encoded outputs
+// are deferred, so their journals hold exactly the PCM they received; a file already
+// holding each target's name keeps the transcoder from consuming the journals.
+//
+// The samples are 24-bit values in every container, so each conversion is exact and the
+// expected output is computed here with integer arithmetic.
+
+#include "RecordingFanout.h"
+#include "Transcoder.h"
+#include "WavReader.h"
+#include "TestSupport.h"
+
+#include <ks.h>
+#include <ksmedia.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr UINT32 kSampleRate = 8000;
+constexpr WORD kChannels = 2;
+constexpr UINT32 kFrames = kSampleRate * 5 / 2;
+
+enum class Capture {
+    Int16,
+    Int24,
+    Int32,
+    Float32
+};
+
+struct Pcm {
+    std::vector<BYTE> bytes;
+    std::vector<BYTE> format;       // WAVEFORMATEX (+ extension) as the journal stores it
+};
+
+WAVEFORMATEXTENSIBLE MakeFormat(WORD bitsPerSample, bool isFloat) {
+    WAVEFORMATEXTENSIBLE format = {};
+    format.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+    format.Format.nChannels = kChannels;
+    format.Format.nSamplesPerSec = kSampleRate;
+    format.Format.wBitsPerSample = bitsPerSample;
+    format.Format.nBlockAlign = static_cast<WORD>(kChannels * bitsPerSample / 8);
+    format.Format.nAvgBytesPerSec = kSampleRate * format.Format.nBlockAlign;
+    format.Format.cbSize = 22;
+    format.Samples.wValidBitsPerSample = bitsPerSample;
+    format.dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
+    format.SubFormat = isFloat ? KSDATAFORMAT_SUBTYPE_IEEE_FLOAT : KSDATAFORMAT_SUBTYPE_PCM;
+    return format;
+}
+
+WAVEFORMATEXTENSIBLE CaptureFormat(Capture capture) {
+    switch (capture) {
+    case Capture::Int16:
+        return MakeFormat(16, false);
+    case Capture::Int24:
+        return MakeFormat(24, false);
+    case Capture::Int32:
+        return MakeFormat(32, false);
+    case Capture::Float32:
+    default:
+        return MakeFormat(32, true);
+    }
+}
+
+// 24-bit sample values (16-bit ones for a 16-bit capture), both extremes included
+std::vector<int32_t> MakeValues(Capture capture) {
+    std::vector<int32_t> values(static_cast<size_t>(kFrames) * kChannels);
+    UINT32 seed = 1;
+    for (size_t i = 0; i < values.size(); i++) {
+        seed = seed * 1103515245u + 12345u;
+        values[i] = static_cast<int32_t>(seed >> 8) - 8388608;
+    }
+    values[0] = -8388608;
+    values[1] = 8388607;
+    if (capture == Capture::Int16) {
+        for (int32_t& value : values) {
+            value >>= 8;
+        }
+    }
+    return values;
+}
+
+size_t SampleBytes(Capture container) {
+    switch (container) {
+    case Capture::Int16:
+        return 2;
+    case Capture::Int24:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+// The values in one container: 16-bit, packed 24-bit, 24-in-32 or float
+std::vector<BYTE> Encode(const std::vector<int32_t>& values, Capture container) {
+    std::vector<BYTE> bytes;
+    for (int32_t value : values) {
+        BYTE sample[4];
+        size_t size = 4;
+        switch (container) {
+        case Capture::Int16: {
+            int16_t v = static_cast<int16_t>(value);
+            std::memcpy(sample, &v, 2);
+            size = 2;
+            break;
+        }
+        case Capture::Int24:
+            std::memcpy(sample, &value, 3);
+            size = 3;
+            break;
+        case Capture::Int32: {
+            int32_t v = static_cast<int32_t>(static_cast<uint32_t>(value) << 8);
+            std::memcpy(sample, &v, 4);
+            break;
+        }
+        case Capture::Float32: {
+            float v = static_cast<float>(value) / 8388608.0f;
+            std::memcpy(sample, &v, 4);
+            break;
+        }
+        }
+        bytes.insert(bytes.end(), sample, sample + size);
+    }
+    return bytes;
+}
+
+std::wstring TempPath(const wchar_t* name) {
+    wchar_t tempDir[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempDir);
+    return std::wstring(tempDir) + L"RecordingFanoutTest_" + std::to_wstring(GetCurrentProcessId()) + L"_" + name;
+}
+
+bool CreateEmptyFile(const std::wstring& path) {
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    CloseHandle(file);
+    return true;
+}
+
+Pcm ReadWav(const std::wstring& path) {
+    Pcm pcm;
+    WavReader reader;
+    if (!reader.Open(path)) {
+        return pcm;
+    }
+    const WAVEFORMATEX* format = reader.GetFormat();
+    pcm.format.assign(reinterpret_cast<const BYTE*>(format),
+                      reinterpret_cast<const BYTE*>(format) + sizeof(WAVEFORMATEX) + format->cbSize);
+    std::vector<BYTE> block(64 * 1024);
+    UINT32 bytesRead = 0;
+    while (reader.Read(block.data(), static_cast<UINT32>(block.size()), bytesRead) && bytesRead > 0) {
+        pcm.bytes.insert(pcm.bytes.end(), block.begin(), block.begin() + bytesRead);
+    }
+    return pcm;
+}
+
+Pcm ReadJournal(const std::wstring& path) {
+    Pcm pcm;
+    CaptureJournalReader reader;
+    if (!reader.Open(path)) {
+        return pcm;
+    }
+    JournalChunkHeader chunk;
+    std::vector<BYTE> format;
+    std::vector<BYTE> payload;
+    while (reader.ReadChunk(chunk, format, payload) == JournalChunkStatus::Chunk) {
+        pcm.format = format;
+        pcm.bytes.insert(pcm.bytes.end(), payload.begin(), payload.end());
+    }
+    return pcm;
+}
+
+// The output was given expected, in a format describing it as container
+void CheckOutput(const Pcm& pcm, const std::vector<BYTE>& expected, Capture container) {
+    CHECK(pcm.format.size() >= sizeof(WAVEFORMATEXTENSIBLE));
+    if (pcm.format.size() < sizeof(WAVEFORMATEXTENSIBLE)) {
+        return;
+    }
+    WAVEFORMATEXTENSIBLE want = CaptureFormat(container);
+    WAVEFORMATEXTENSIBLE got;
+    std::memcpy(&got, pcm.format.data(), sizeof(got));
+    CHECK(got.Format.wFormatTag == WAVE_FORMAT_EXTENSIBLE);
+    CHECK(got.Format.nChannels == kChannels);
+    CHECK(got.Format.wBitsPerSample == want.Format.wBitsPerSample);
+    CHECK(got.Format.nBlockAlign == want.Format.nBlockAlign);
+    CHECK(got.Samples.wValidBitsPerSample == want.Samples.wValidBitsPerSample);
+    CHECK(got.dwChannelMask == want.dwChannelMask);
+    CHECK(got.SubFormat == want.SubFormat);
+    CHECK(pcm.bytes == expected);
+}
+
+// Every output of a session, fed the same blocks (and a stretch of silence)
+void TestCapture(Capture capture) {
+    const WAVEFORMATEXTENSIBLE captureFormat = CaptureFormat(capture);
+    const std::vector<int32_t> values = MakeValues(capture);
+
+    // FLAC takes 16- and 24-bit PCM as captured and 24-bit otherwise; Opus takes float
+    // and 16-bit PCM as captured and float otherwise
+    const Capture flacInput = (capture == Capture::Int16 || capture == Capture::Int24) ? capture : Capture::Int24;
+    const Capture opusInput = (capture == Capture::Int16 || capture == Capture::Float32) ? capture : Capture::Float32;
+    CHECK(RecordingFanout::PreferredRepresentation(AudioFormat::FLAC, &captureFormat.Format) ==
+          (flacInput == capture ? SampleRepresentation::Native : SampleRepresentation::Int24));
+    CHECK(RecordingFanout::PreferredRepresentation(AudioFormat::OPUS, &captureFormat.Format) ==
+          (opusInput == capture ? SampleRepresentation::Native : SampleRepresentation::Float32));
+    CHECK(RecordingFanout::PreferredRepresentation(AudioFormat::WAV, &captureFormat.Format) ==
+          SampleRepresentation::Native);
+
+    const std::wstring wavPath = TempPath(L"out.wav");
+    const std::wstring targets[] = { TempPath(L"out.flac"), TempPath(L"out_2.flac"), TempPath(L"out.opus") };
+    for (const std::wstring& target : targets) {
+        CHECK(CreateEmptyFile(target));
+    }
+
+    RecordingFanout fanout;
+    RecordingOptions wav;
+    RecordingOptions flac;
+    flac.format = AudioFormat::FLAC;
+    flac.deferEncoding = true;
+    RecordingOptions opus;
+    opus.format = AudioFormat::OPUS;
+    opus.deferEncoding = true;
+    CHECK(fanout.Add(wavPath, &captureFormat.Format, wav));
+    CHECK(fanout.Add(targets[0], &captureFormat.Format, flac));
+    CHECK(fanout.Add(targets[1], &captureFormat.Format, flac));
+    CHECK(fanout.Add(targets[2], &captureFormat.Format, opus));
+    CHECK(fanout.GetOutputCount() == 4);
+
+    // All outputs share one capture format
+    WAVEFORMATEXTENSIBLE other = CaptureFormat(capture == Capture::Int16 ? Capture::Int24 : Capture::Int16);
+    CHECK(!fanout.Add(TempPath(L"other.wav"), &other.Format, wav));
+
+    // Uneven blocks, a stretch of silence halfway, then the rest
+    const std::vector<BYTE> input = Encode(values, capture);
+    const UINT32 blockAlign = captureFormat.Format.nBlockAlign;
+    const size_t halfFrames = kFrames / 2;
+    const UINT32 silentFrames = 1000;
+    size_t offset = 0;
+    auto writeUpTo = [&](size_t end) {
+        while (offset < end) {
+            size_t size = std::min<size_t>(end - offset, static_cast<size_t>(997) * blockAlign);
+            CHECK(fanout.WriteData(input.data() + offset, static_cast<UINT32>(size)));
+            offset += size;
+        }
+    };
+    writeUpTo(halfFrames * blockAlign);
+    CHECK(fanout.WriteSilence(silentFrames));
+    writeUpTo(input.size());
+    fanout.Close();
+
+    // The transcoder refuses every job (the targets exist); wait until it has
+    for (int wait = 0; wait < 1000 && Transcoder::Instance().GetPendingCount() > 0; wait++) {
+        Sleep(10);
+    }
+    CHECK(Transcoder::Instance().GetPendingCount() == 0);
+
+    // Each output's samples with the silence where it was written
+    auto expect = [&](Capture container) {
+        std::vector<BYTE> bytes = Encode(values, container);
+        size_t frameBytes = kChannels * SampleBytes(container);
+        bytes.insert(bytes.begin() + halfFrames * frameBytes, silentFrames * frameBytes, 0);
+        return bytes;
+    };
+
+    CheckOutput(ReadWav(wavPath), expect(capture), capture);
+    CheckOutput(ReadJournal(targets[0] + L".acj"), expect(flacInput), flacInput);
+    CheckOutput(ReadJournal(targets[1] + L".acj"), expect(flacInput), flacInput);
+    CheckOutput(ReadJournal(targets[2] + L".acj"), expect(opusInput), opusInput);
+
+    DeleteFileW(wavPath.c_str());
+    for (const std::wstring& target : targets) {
+        DeleteFileW(target.c_str());
+        DeleteFileW((target + L".acj").c_str());
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestCapture(Capture::Int16);
+    TestCapture(Capture::Int24);
+    TestCapture(Capture::Int32);
+    TestCapture(Capture::Float32);
+    return TestSupport::Result("RecordingFanoutTest");
+}
@@ -0,0 +1,183 @@
+// Records WAV through RecordingOutput with segment rotation and reads the segments back:
+// every timed segment holds exactly its length, cuts fall on the frame they were asked
+// for, and the segments concatenate back to exactly the audio (and silence) written.
+
+#include "RecordingOutput.h"
+#include "WavReader.h"
+#include "TestSupport.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr UINT32 kSampleRate = 8000;
+constexpr UINT32 kBlockAlign = 4;         // 16-bit stereo
+
+WAVEFORMATEX MakeFormat() {
+    WAVEFORMATEX format = {};
+    format.wFormatTag = WAVE_FORMAT_PCM;
+    format.nChannels = 2;
+    format.nSamplesPerSec = kSampleRate;
+    format.wBitsPerSample = 16;
+    format.nBlockAlign = kBlockAlign;
+    format.nAvgBytesPerSec = kSampleRate * kBlockAlign;
+    return format;
+}
+
+std::wstring TempPath(const wchar_t* name) {
+    wchar_t tempDir[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempDir);
+    return std::wstring(tempDir) + L"RecordingOutputTest_" + std::to_wstring(GetCurrentProcessId()) + L"_" + name;
+}
+
+// Name of segment number (1-based) of a recording started as base + L".wav"
+std::wstring SegmentPath(const std::wstring& base, UINT32 number) {
+    return number == 1 ? base + L".wav" : base + L"_seg" + std::to_wstring(number) + L".wav";
+}
+
+bool FileExists(const std::wstring& path) {
+    return GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+// The data chunk of one segment, or an empty vector if it can't be read
+std::vector<BYTE> ReadSegment(const std::wstring& path) {
+    std::vector<BYTE> data;
+    WavReader reader;
+    if (!reader.Open(path)) {
+        return data;
+    }
+    data.resize(static_cast<size_t>(reader.GetFrameCount()) * kBlockAlign);
+    size_t filled = 0;
+    UINT32 bytesRead = 0;
+    while (filled < data.size() &&
+           reader.Read(data.data() + filled, static_cast<UINT32>(data.size() - filled), bytesRead) && bytesRead > 0) {
+        filled += bytesRead;
+    }
+    data.resize(filled);
+    return data;
+}
+
+// Writes the frames that follow in the expected stream: noise, or zeros for silence
+class Writer {
+public:
+    explicit Writer(RecordingOutput& output) : m_output(output), m_seed(1) {}
+
+    bool Audio(UINT32 frames) {
+        std::vector<BYTE> block(static_cast<size_t>(frames) * kBlockAlign);
+        for (BYTE& byte : block) {
+            m_seed = m_seed * 1103515245u + 12345u;
+            byte = static_cast<BYTE>(m_seed >> 16);
+        }
+        expected.insert(expected.end(), block.begin(), block.end());
+        return m_output.WriteData(block.data(), static_cast<UINT32>(block.size()));
+    }
+
+    bool Silence(UINT32 frames) {
+        expected.insert(expected.end(), static_cast<size_t>(frames) * kBlockAlign, 0);
+        return m_output.WriteSilence(frames);
+    }
+
+    UINT64 Frames() const { return expected.size() / kBlockAlign; }
+
+    std::vector<BYTE> expected;
+
+private:
+    RecordingOutput& m_output;
+    UINT32 m_seed;
+};
+
+// Reads segments 1..count back, checks their lengths and that they join to the input.
+// The segment opened ahead of time for count + 1 must be gone.
+void CheckSegments(const std::wstring& base, const std::vector<UINT64>& lengths, const std::vector<BYTE>& expected) {
+    std::vector<BYTE> joined;
+    for (size_t i = 0; i < lengths.size(); i++) {
+        std::wstring path = SegmentPath(base, static_cast<UINT32>(i + 1));
+        std::vector<BYTE> data = ReadSegment(path);
+        CHECK(data.size() == lengths[i] * kBlockAlign);
+        joined.insert(joined.end(), data.begin(), data.end());
+        DeleteFileW(path.c_str());
+    }
+    CHECK(joined == expected);
+
+    std::wstring next = SegmentPath(base, static_cast<UINT32>(lengths.size() + 1));
+    CHECK(!FileExists(next));
+    DeleteFileW(next.c_str());
+}
+
+// One-second segments written in blocks that straddle the boundaries, land exactly on
+// them, and span several segments at once, with silence mixed in
+void TestTimedSegments() {
+    std::wstring base = TempPath(L"timed");
+    WAVEFORMATEX format = MakeFormat();
+    RecordingOptions options;
+    options.segments.segmentSeconds = 1;
+
+    RecordingOutput output;
+    CHECK(output.Open(base + L".wav", &format, options));
+    Writer writer(output);
+    for (UINT32 i = 0; i < 40; i++) {
+        CHECK(writer.Audio(37 + (i * 131) % 480));
+    }
+    CHECK(writer.Silence(kSampleRate - writer.Frames() % kSampleRate));   // Ends on a boundary
+    CHECK(writer.Audio(kSampleRate * 2 + 1));                             // Spans two cuts
+    CHECK(writer.Silence(kSampleRate + 500));
+    CHECK(writer.Audio(123));
+    output.Close();
+
+    std::vector<UINT64> lengths;
+    for (UINT64 remaining = writer.Frames(); remaining > 0; remaining -= lengths.back()) {
+        lengths.push_back(remaining < kSampleRate ? remaining : kSampleRate);
+    }
+    CheckSegments(base, lengths, writer.expected);
+}
+
+// On-demand cuts happen at the exact frame CutSegment is called at; a timed segment cut
+// early starts a full-length one
+void TestCutOnDemand() {
+    std::wstring base = TempPath(L"cuts");
+    WAVEFORMATEX format = MakeFormat();
+    RecordingOptions options;
+    options.segments.segmentSeconds = 1;
+    options.segments.onDemand = true;
+
+    RecordingOutput output;
+    CHECK(output.Open(base + L".wav", &format, options));
+    Writer writer(output);
+    CHECK(writer.Audio(1000));
+    CHECK(writer.Silence(234));
+    CHECK(output.CutSegment());                  // Segment 1: 1234 frames
+    CHECK(writer.Audio(kSampleRate + 10));       // Segment 2: a full second, then segment 3
+    CHECK(writer.Audio(5));
+    CHECK(output.CutSegment());                  // Segment 3: 15 frames
+    CHECK(writer.Audio(77));                     // Segment 4
+    output.Close();
+
+    CheckSegments(base, { 1234, kSampleRate, 15, 77 }, writer.expected);
+}
+
+// Without rotation everything goes to one file, and CutSegment is refused
+void TestSingleFile() {
+    std::wstring base = TempPath(L"single");
+    WAVEFORMATEX format = MakeFormat();
+
+    RecordingOutput output;
+    CHECK(output.Open(base + L".wav", &format, RecordingOptions()));
+    Writer writer(output);
+    CHECK(writer.Audio(kSampleRate * 3 + 7));
+    CHECK(!output.CutSegment());
+    CHECK(writer.Silence(99));
+    output.Close();
+
+    CheckSegments(base, { writer.Frames() }, writer.expected);
+}
+
+}  // namespace
+
+int main() {
+    TestTimedSegments();
+    TestCutOnDemand();
+    TestSingleFile();
+    return TestSupport::Result("RecordingOutputTest");
+}
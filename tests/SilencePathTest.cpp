@@ -0,0 +1,224 @@
+// Drives SyntheticSource scripts through the stages with a silence path (SilenceDetector,
+// ActivationGate, AudioMixer). A gap played as flagged silent blocks must give exactly
+// the same result as the same gap played as real zero samples, and flagged blocks must
+// stay flagged where a stage passes them on. Runs anywhere: the stages take a SampleFormat
+// and the gate hands its labels to a callback instead of a file.
+
+#include "ActivationGate.h"
+#include "AudioMixer.h"
+#include "LevelMeter.h"
+#include "SyntheticSource.h"
+#include "TestSupport.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t kSampleRate = 48000;
+constexpr uint32_t kBlockFrames = 480;          // 10 ms, as WASAPI delivers it
+
+SampleFormat MakeFormat(uint16_t bitsPerSample) {
+    return SampleFormat::Packed(kSampleRate, 2, bitsPerSample, bitsPerSample == 32);
+}
+
+uint32_t Ms(uint32_t ms) {
+    return kSampleRate / 1000 * ms;
+}
+
+// A gap of flagged silence, or of real zeros. The zero tone has no frequency, so like
+// flagged silence it leaves the phase of the tone that follows unchanged.
+void AddGap(SyntheticSource& source, uint32_t frames, bool flagged) {
+    if (flagged) {
+        source.AddSilence(frames);
+    } else {
+        source.AddTone(frames, 0.0f, 0.0f);
+    }
+}
+
+// Speech-like script: bursts of tone separated by gaps
+void Script(SyntheticSource& source, bool flaggedGaps) {
+    auto gap = [&source, flaggedGaps](uint32_t frames) {
+        AddGap(source, frames, flaggedGaps);
+    };
+
+    source.AddTone(Ms(1000), 440.0f, 0.5f);
+    gap(Ms(2000));
+    source.AddTone(Ms(500), 1000.0f, 0.25f);
+    gap(Ms(1500));
+    source.AddTone(Ms(250), 220.0f, 0.5f);
+    gap(Ms(300));
+    source.AddTone(Ms(250), 220.0f, 0.5f);
+}
+
+void Append(std::vector<uint8_t>& bytes, const AudioBlock& block) {
+    if (block.data) {
+        bytes.insert(bytes.end(), block.data, block.data + block.size);
+    } else {
+        bytes.resize(bytes.size() + block.size, 0);
+    }
+}
+
+struct SilenceRun {
+    std::vector<uint8_t> kept;         // Blocks skip-silence keeps, silent ones as zeros
+    uint64_t skippedFrames = 0;
+};
+
+SilenceRun RunSilenceDetector(const SampleFormat& format, bool flaggedGaps) {
+    SilenceRun run;
+    SilenceDetector detector;
+    SyntheticSource source;
+    CHECK(detector.Initialize(format, SilenceOptions()));
+    CHECK(source.Initialize(kSampleRate, format.channels, format.bitsPerSample, kBlockFrames));
+
+    source.SetDataCallback([&](const AudioBlock& block) {
+        if (detector.IsSilent(block)) {
+            run.skippedFrames += block.frames;
+        } else {
+            Append(run.kept, block);
+        }
+    });
+    Script(source, flaggedGaps);
+    source.Run();
+    return run;
+}
+
+void TestSilenceDetector(uint16_t bitsPerSample) {
+    SampleFormat format = MakeFormat(bitsPerSample);
+    SilenceRun flagged = RunSilenceDetector(format, true);
+    SilenceRun zeros = RunSilenceDetector(format, false);
+
+    CHECK(flagged.kept == zeros.kept);
+    CHECK(flagged.skippedFrames == zeros.skippedFrames);
+
+    // Each gap loses all but its first minSilenceMs; the 300 ms gap is kept whole
+    uint32_t minSilence = Ms(SilenceOptions().minSilenceMs);
+    CHECK(flagged.skippedFrames == (Ms(2000) - minSilence) + (Ms(1500) - minSilence));
+}
+
+struct GateRun {
+    std::vector<uint8_t> recorded;     // Everything the gate passed on, silent blocks as zeros
+    std::vector<bool> activations;  // Activation callbacks in order: true = start
+    std::vector<std::string> labels;   // Label lines, without the wall-clock column
+    uint64_t flaggedFrames = 0;
+    bool flaggedWithData = false;
+};
+
+GateRun RunGate(const SampleFormat& format, bool flaggedGaps) {
+    GateRun run;
+    ActivationGate gate;
+    SyntheticSource source;
+    CHECK(gate.Initialize(format, ActivationOptions()));
+    CHECK(source.Initialize(kSampleRate, format.channels, format.bitsPerSample, kBlockFrames));
+
+    gate.SetDataCallback([&run](const AudioBlock& block) {
+        if (block.silent) {
+            run.flaggedFrames += block.frames;
+            run.flaggedWithData = run.flaggedWithData || block.data != nullptr;
+        }
+        Append(run.recorded, block);
+    });
+    gate.SetActivationCallback([&run](bool active, uint32_t) {
+        run.activations.push_back(active);
+    });
+    gate.SetLabelCallback([&run](const char* line, size_t length) {
+        std::string label(line, length);
+        run.labels.push_back(label.substr(0, label.rfind('\t')));
+    });
+    source.SetDataCallback([&gate](const AudioBlock& block) {
+        gate.Process(block);
+    });
+
+    Script(source, flaggedGaps);
+    source.Run();
+    gate.Close();
+    return run;
+}
+
+void TestActivationGate(uint16_t bitsPerSample) {
+    SampleFormat format = MakeFormat(bitsPerSample);
+    GateRun flagged = RunGate(format, true);
+    GateRun zeros = RunGate(format, false);
+
+    CHECK(flagged.recorded == zeros.recorded);
+    CHECK(flagged.activations == zeros.activations);
+
+    // Gaps longer than hold + release end an activation; the 300 ms one doesn't
+    std::vector<bool> expected = { true, false, true, false, true, false };
+    CHECK(flagged.activations == expected);
+
+    // One label per activation, at the same recorded positions either way
+    CHECK(flagged.labels.size() == 3);
+    CHECK(flagged.labels == zeros.labels);
+
+    // Hold and release over a flagged gap pass it on still flagged, without data
+    CHECK(flagged.flaggedFrames > 0);
+    CHECK(!flagged.flaggedWithData);
+    CHECK(zeros.flaggedFrames == 0);
+}
+
+// One source plays the script, the other plays only a gap of the same length
+std::vector<uint8_t> RunMixer(const SampleFormat& format, bool flaggedGaps) {
+    AudioMixer mixer;
+    CHECK(mixer.Initialize(format));
+
+    SyntheticSource voice;
+    SyntheticSource quiet;
+    CHECK(voice.Initialize(kSampleRate, format.channels, format.bitsPerSample, kBlockFrames));
+    CHECK(quiet.Initialize(kSampleRate, format.channels, format.bitsPerSample, kBlockFrames));
+
+    std::vector<std::vector<uint8_t>> voiceData;
+    voice.SetDataCallback([&](const AudioBlock& block) {
+        voiceData.emplace_back(block.data, block.data + block.size);
+    });
+    Script(voice, false);
+    voice.Run();
+
+    std::vector<uint8_t> mixed;
+    std::vector<uint8_t> output;
+    size_t next = 0;
+    quiet.SetDataCallback([&](const AudioBlock& block) {
+        const std::vector<uint8_t>& data = voiceData[next++];
+        mixer.AddAudioData(1, AudioBlock::Samples(data.data(), static_cast<uint32_t>(data.size()), format.blockAlign), format);
+        mixer.AddAudioData(2, block, format);
+        while (mixer.GetMixedAudio(output)) {
+            mixed.insert(mixed.end(), output.begin(), output.end());
+        }
+    });
+
+    uint32_t frames = 0;
+    for (const std::vector<uint8_t>& data : voiceData) {
+        frames += static_cast<uint32_t>(data.size()) / format.blockAlign;
+    }
+    for (uint32_t done = 0; done < frames; done += kBlockFrames) {
+        AddGap(quiet, kBlockFrames, flaggedGaps);
+    }
+    quiet.Run();
+
+    // The quiet source adds nothing: the mix is the voice alone
+    std::vector<uint8_t> voiceBytes;
+    for (const std::vector<uint8_t>& data : voiceData) {
+        voiceBytes.insert(voiceBytes.end(), data.begin(), data.end());
+    }
+    CHECK(mixed == voiceBytes);
+    return mixed;
+}
+
+void TestMixer(uint16_t bitsPerSample) {
+    SampleFormat format = MakeFormat(bitsPerSample);
+    CHECK(RunMixer(format, true) == RunMixer(format, false));
+}
+
+}  // namespace
+
+int main() {
+    const uint16_t bitDepths[] = { 16, 32 };       // 16-bit PCM and float
+    for (uint16_t bitsPerSample : bitDepths) {
+        TestSilenceDetector(bitsPerSample);
+        TestActivationGate(bitsPerSample);
+        TestMixer(bitsPerSample);
+    }
+    return TestSupport::Result("SilencePathTest");
+}
@@ -0,0 +1,152 @@
+// Plays scripts through SyntheticSource and checks the blocks it delivers: sizes and
+// boundaries, silent blocks carrying no data, the tone itself, and a tone that does
+// not depend on how it is cut into blocks.
+
+#include "SyntheticSource.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t kSampleRate = 48000;
+
+struct DeliveredBlock {
+    uint32_t frames;
+    uint32_t size;
+    bool silent;
+    bool hasData;
+};
+
+struct Delivery {
+    std::vector<DeliveredBlock> blocks;
+    std::vector<uint8_t> bytes;     // Every block's samples, silent ones as zeros
+};
+
+Delivery Play(SyntheticSource& source) {
+    Delivery delivery;
+    source.SetDataCallback([&delivery](const AudioBlock& block) {
+        delivery.blocks.push_back({ block.frames, block.size, block.silent, block.data != nullptr });
+        if (block.data) {
+            delivery.bytes.insert(delivery.bytes.end(), block.data, block.data + block.size);
+        } else {
+            delivery.bytes.resize(delivery.bytes.size() + block.size, 0);
+        }
+    });
+    source.Run();
+    return delivery;
+}
+
+void TestInitialize() {
+    SyntheticSource source;
+    CHECK(!source.Initialize(0, 2, 16, 480));
+    CHECK(!source.Initialize(kSampleRate, 0, 16, 480));
+    CHECK(!source.Initialize(kSampleRate, 2, 24, 480));
+    CHECK(!source.Initialize(kSampleRate, 2, 16, 0));
+    CHECK(source.Initialize(kSampleRate, 2, 16, 480));
+    CHECK(source.GetBlockAlign() == 4);
+    CHECK(source.Initialize(kSampleRate, 6, 32, 480));
+    CHECK(source.GetBlockAlign() == 24);
+}
+
+// Blocks hold at most blockFrames and never span two parts of the script
+void TestBlockBoundaries() {
+    SyntheticSource source;
+    CHECK(source.Initialize(kSampleRate, 2, 16, 256));
+    source.AddTone(1000, 440.0f, 0.5f);
+    source.AddSilence(700);
+    source.AddTone(300, 440.0f, 0.0f);
+    Delivery delivery = Play(source);
+
+    const DeliveredBlock expected[] = {
+        { 256, 1024, false, true }, { 256, 1024, false, true }, { 256, 1024, false, true },
+        { 232, 928, false, true },
+        { 256, 1024, true, false }, { 256, 1024, true, false }, { 188, 752, true, false },
+        { 256, 1024, false, true }, { 44, 176, false, true },
+    };
+    size_t count = sizeof(expected) / sizeof(expected[0]);
+    CHECK(delivery.blocks.size() == count);
+    for (size_t i = 0; i < count && i < delivery.blocks.size(); i++) {
+        CHECK(delivery.blocks[i].frames == expected[i].frames);
+        CHECK(delivery.blocks[i].size == expected[i].size);
+        CHECK(delivery.blocks[i].silent == expected[i].silent);
+        CHECK(delivery.blocks[i].hasData == expected[i].hasData);
+    }
+
+    // The zero-amplitude tone is real zero samples
+    std::vector<uint8_t> zeros(300 * 4, 0);
+    CHECK(delivery.bytes.size() == 2000 * 4);
+    CHECK(delivery.bytes.size() == 2000 * 4 &&
+          std::memcmp(delivery.bytes.data() + 1700 * 4, zeros.data(), zeros.size()) == 0);
+
+    // The script is used up by Run
+    CHECK(Play(source).blocks.empty());
+}
+
+// A float tone has the requested level and frequency on every channel
+void TestFloatTone() {
+    SyntheticSource source;
+    CHECK(source.Initialize(kSampleRate, 2, 32, 480));
+    source.AddTone(kSampleRate, 1000.0f, 0.25f);
+    Delivery delivery = Play(source);
+    CHECK(delivery.bytes.size() == static_cast<size_t>(kSampleRate) * 8);
+
+    std::vector<float> samples(delivery.bytes.size() / sizeof(float));
+    std::memcpy(samples.data(), delivery.bytes.data(), delivery.bytes.size());
+
+    float peak = 0.0f;
+    int crossings = 0;
+    bool channelsMatch = true;
+    for (size_t frame = 0; frame < kSampleRate; frame++) {
+        float left = samples[frame * 2];
+        channelsMatch = channelsMatch && left == samples[frame * 2 + 1];
+        peak = std::max(peak, std::fabs(left));
+        if (frame > 0 && (samples[(frame - 1) * 2] < 0.0f) != (left < 0.0f)) {
+            crossings++;
+        }
+    }
+    CHECK(channelsMatch);
+    CHECK(std::fabs(peak - 0.25f) < 1e-3f);
+    CHECK(crossings >= 1999 && crossings <= 2001);
+}
+
+// The tone's phase carries across blocks, so the block size changes nothing
+void TestBlockSizeInvariance() {
+    std::vector<uint8_t> reference;
+    for (uint32_t blockFrames : { 100u, 441u, 4096u }) {
+        SyntheticSource source;
+        CHECK(source.Initialize(44100, 1, 16, blockFrames));
+        source.AddTone(10000, 997.0f, 0.9f);
+        source.AddSilence(1234);
+        source.AddTone(5000, 3000.0f, 1.0f);
+        Delivery delivery = Play(source);
+        if (reference.empty()) {
+            reference = delivery.bytes;
+        } else {
+            CHECK(delivery.bytes == reference);
+        }
+    }
+
+    // Full scale stays within the 16-bit range
+    std::vector<int16_t> samples(reference.size() / sizeof(int16_t));
+    std::memcpy(samples.data(), reference.data(), reference.size());
+    int peak = 0;
+    for (int16_t sample : samples) {
+        peak = std::max(peak, std::abs(static_cast<int>(sample)));
+    }
+    CHECK(peak >= 32000);
+}
+
+}  // namespace
+
+int main() {
+    TestInitialize();
+    TestBlockBoundaries();
+    TestFloatTone();
+    TestBlockSizeInvariance();
+    return TestSupport::Result("SyntheticSourceTest");
+}
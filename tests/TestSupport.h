@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal test helpers: each test is a plain executable that reports failed checks
+// on stderr and exits non-zero if any failed, which is all CTest needs.
+namespace TestSupport {
+
+inline int& FailureCount() {
+    static int failures = 0;
+    return failures;
+}
+
+inline int Result(const char* name) {
+    if (FailureCount() == 0) {
+        std::printf("%s: all checks passed\n", name);
+        return 0;
+    }
+    std::printf("%s: %d check(s) failed\n", name, FailureCount());
+    return 1;
+}
+
+}  // namespace TestSupport
+
+#define CHECK(condition)                                                              \
+    do {                                                                              \
+        if (!(condition)) {                                                           \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__,    \
+                         #condition);                                                 \
+            ++TestSupport::FailureCount();                                            \
+        }                                                                             \
+    } while (0)
@@ -0,0 +1,200 @@
+// Builds the files a crash leaves behind from a file WavWriter finalized - header sizes
+// rolled back to an earlier commit, the last frame cut short, a mapped writer's zero
+// reserve - and checks the sizes WavWriter::RecoverFile repairs them to.
+
+#include "WavWriter.h"
+#include "TestSupport.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr UINT32 kFrames = 1000;
+constexpr UINT32 kSilentFrames = 100;     // Digital silence at the end of the recording
+constexpr UINT32 kBlockAlign = 4;         // 16-bit stereo
+
+struct WavLayout {
+    UINT64 dataStart = 0;                 // Offset of the first audio byte
+};
+
+std::wstring TempPath(const wchar_t* name) {
+    wchar_t tempDir[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempDir);
+    return std::wstring(tempDir) + L"WavRecoveryTest_" + std::to_wstring(GetCurrentProcessId()) + L"_" + name;
+}
+
+std::vector<BYTE> ReadAll(const std::wstring& path) {
+    std::vector<BYTE> bytes;
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return bytes;
+    }
+    LARGE_INTEGER size = {};
+    GetFileSizeEx(file, &size);
+    bytes.resize(static_cast<size_t>(size.QuadPart));
+    OVERLAPPED overlapped = {};
+    DWORD read = 0;
+    if (!bytes.empty() && (!ReadFile(file, bytes.data(), static_cast<DWORD>(bytes.size()), &read, &overlapped) ||
+                           read != bytes.size())) {
+        bytes.clear();
+    }
+    CloseHandle(file);
+    return bytes;
+}
+
+bool WriteAll(const std::wstring& path, const std::vector<BYTE>& bytes) {
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    OVERLAPPED overlapped = {};
+    DWORD written = 0;
+    bool ok = WriteFile(file, bytes.data(), static_cast<DWORD>(bytes.size()), &written, &overlapped) &&
+              written == bytes.size();
+    CloseHandle(file);
+    return ok;
+}
+
+UINT32 ReadUInt32(const std::vector<BYTE>& bytes, UINT64 offset) {
+    UINT32 value = 0;
+    std::memcpy(&value, bytes.data() + offset, 4);
+    return value;
+}
+
+void WriteUInt32(std::vector<BYTE>& bytes, UINT64 offset, UINT32 value) {
+    std::memcpy(bytes.data() + offset, &value, 4);
+}
+
+// A finalized recording: a constant non-zero signal followed by silence
+std::vector<BYTE> MakeFinalizedFile(const std::wstring& path, WavLayout& layout) {
+    WAVEFORMATEX format = {};
+    format.wFormatTag = WAVE_FORMAT_PCM;
+    format.nChannels = 2;
+    format.nSamplesPerSec = 48000;
+    format.wBitsPerSample = 16;
+    format.nBlockAlign = kBlockAlign;
+    format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+
+    std::vector<int16_t> pcm(static_cast<size_t>(kFrames) * 2, 0x1111);
+    std::fill(pcm.end() - kSilentFrames * 2, pcm.end(), 0);
+
+    WavWriter writer;
+    if (!writer.Open(path, &format)) {
+        return std::vector<BYTE>();
+    }
+    writer.WriteData(reinterpret_cast<const BYTE*>(pcm.data()), static_cast<UINT32>(pcm.size() * sizeof(int16_t)));
+    writer.Close();
+
+    std::vector<BYTE> bytes = ReadAll(path);
+    layout.dataStart = bytes.size() - static_cast<UINT64>(kFrames) * kBlockAlign;
+    return bytes;
+}
+
+// Roll the header back to a commit describing committedFrames
+void RollBackHeader(std::vector<BYTE>& bytes, const WavLayout& layout, UINT32 committedFrames) {
+    UINT32 dataSize = committedFrames * kBlockAlign;
+    WriteUInt32(bytes, 4, static_cast<UINT32>(layout.dataStart + dataSize - 8));
+    WriteUInt32(bytes, layout.dataStart - 4, dataSize);
+}
+
+// Checks the file holds exactly frames of audio and a header that says so
+void CheckRepaired(const std::wstring& path, const WavLayout& layout, UINT32 frames) {
+    std::vector<BYTE> bytes = ReadAll(path);
+    UINT64 expectedSize = layout.dataStart + static_cast<UINT64>(frames) * kBlockAlign;
+    CHECK(bytes.size() == expectedSize);
+    if (bytes.size() != expectedSize) {
+        return;
+    }
+    CHECK(std::memcmp(bytes.data(), "RIFF", 4) == 0);
+    CHECK(ReadUInt32(bytes, 4) == expectedSize - 8);
+    CHECK(ReadUInt32(bytes, layout.dataStart - 4) == frames * kBlockAlign);
+}
+
+// A file WavWriter finalized is left exactly as it is
+void TestFinalizedFileUntouched() {
+    std::wstring path = TempPath(L"final.wav");
+    WavLayout layout;
+    std::vector<BYTE> original = MakeFinalizedFile(path, layout);
+    CHECK(!original.empty());
+
+    CHECK(WavWriter::RecoverFile(path));
+    CHECK(ReadAll(path) == original);
+    DeleteFileW(path.c_str());
+}
+
+// Cut mid-frame after the last header commit: the partial frame goes, and the silence
+// at the end is audio, not a reserve, so it stays
+void TestTruncatedMidFrame() {
+    std::wstring path = TempPath(L"truncated.wav");
+    WavLayout layout;
+    std::vector<BYTE> bytes = MakeFinalizedFile(path, layout);
+    CHECK(!bytes.empty());
+
+    RollBackHeader(bytes, layout, 0);
+    bytes.resize(bytes.size() - 1);
+    CHECK(WriteAll(path, bytes));
+
+    CHECK(WavWriter::RecoverFile(path));
+    CheckRepaired(path, layout, kFrames - 1);
+    DeleteFileW(path.c_str());
+}
+
+// Mapped output: the file runs to the end of its extent in zeros. They are trimmed back
+// to the last non-zero byte, but never past the last commit.
+void TestMappedReserveTrimmed() {
+    FileSinkOptions options;
+    options.mode = FileSinkMode::Mapped;
+    options.extentBytes = 1024 * 1024;
+    options.windowBytes = 64 * 1024;
+
+    const UINT32 kAudibleFrames = kFrames - kSilentFrames;
+    for (UINT32 committedFrames : { 0u, kAudibleFrames - 10, kFrames - 1 }) {
+        std::wstring path = TempPath(L"mapped.wav");
+        WavLayout layout;
+        std::vector<BYTE> bytes = MakeFinalizedFile(path, layout);
+        CHECK(!bytes.empty());
+
+        RollBackHeader(bytes, layout, committedFrames);
+        bytes.resize(static_cast<size_t>(options.extentBytes), 0);
+        CHECK(WriteAll(path, bytes));
+
+        CHECK(WavWriter::RecoverFile(path, options));
+        CheckRepaired(path, layout, committedFrames > kAudibleFrames ? committedFrames : kAudibleFrames);
+        DeleteFileW(path.c_str());
+    }
+}
+
+// Zeros are only a reserve in a file that still ends on an extent boundary; anything else
+// keeps its trailing zeros even when mapped output is configured
+void TestZerosKeptOffExtentBoundary() {
+    FileSinkOptions options;
+    options.mode = FileSinkMode::Mapped;
+    options.extentBytes = 1024 * 1024;
+
+    std::wstring path = TempPath(L"unaligned.wav");
+    WavLayout layout;
+    std::vector<BYTE> bytes = MakeFinalizedFile(path, layout);
+    CHECK(!bytes.empty());
+
+    RollBackHeader(bytes, layout, 0);
+    CHECK(WriteAll(path, bytes));
+
+    CHECK(WavWriter::RecoverFile(path, options));
+    CheckRepaired(path, layout, kFrames);
+    DeleteFileW(path.c_str());
+}
+
+}  // namespace
+
+int main() {
+    TestFinalizedFileUntouched();
+    TestTruncatedMidFrame();
+    TestMappedReserveTrimmed();
+    TestZerosKeptOffExtentBoundary();
+    return TestSupport::Result("WavRecoveryTest");
+}